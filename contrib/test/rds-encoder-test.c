@@ -0,0 +1,172 @@
+/*
+# libv4l2rds encoder round trip test
+
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU Lesser General Public License as published by
+# the Free Software Foundation; either version 2.1 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU Lesser General Public License for more details.
+#
+# You should have received a copy of the GNU Lesser General Public License
+# along with this program; if not, write to the Free Software
+# Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA  02110-1335  USA
+ */
+
+/*
+ * Encodes a number of RDS sources with v4l2_rds_encode_group(), feeds the
+ * resulting blocks to the decoder with v4l2_rds_add() and checks that the
+ * decoder ends up with the PI code, PTY, TP, PS name, radio text and clock
+ * time of the source. Also checks the checkwords of v4l2_rds_get_raw_block()
+ * by dividing the blocks by the generator polynomial. Exits with a non zero
+ * status when anything does not match.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../../lib/include/libv4l2rds.h"
+
+#define ARRAY_SIZE(x) ((int)sizeof(x) / (int)sizeof((x)[0]))
+
+/* Enough for a full radio text and the clock time at least twice */
+#define GROUPS		400
+
+static const struct {
+	uint16_t pi;
+	uint8_t pty;
+	bool tp;
+	const char *ps;
+	const char *rt;		/* NULL for no radio text */
+	time_t time;		/* 0 for no clock time */
+} sources[] = {
+	{ 0xd318, 10, true,  "TESTFM  ", "Now playing: a song of exactly 64 characters, padded to fit ....", 1351425720 },
+	{ 0x1234,  1, false, "RADIO 1 ", "Short text", 946684800 },
+	{ 0xfedc, 31, true,  "12345678", NULL, 1700000040 },
+	{ 0x0001,  2, false, "A       ", "x", 0 },
+};
+
+/* Returns the remainder of a 26 bit block divided by the generator
+   polynomial, which is the offset word of its block id when the checkword
+   is right (IEC 62106 Annex B) */
+static uint16_t rds_remainder(uint32_t raw)
+{
+	int i;
+
+	for (i = 25; i >= 10; i--)
+		if (raw & (1 << i))
+			raw ^= 0x5b9 << (i - 10);
+	return raw & 0x3ff;
+}
+
+static int check_raw_block(const struct v4l2_rds_data *rds_data)
+{
+	static const uint16_t offset_word[] = {
+		0x0fc, 0x198, 0x168, 0x1b4
+	};
+	uint16_t remainder = rds_remainder(v4l2_rds_get_raw_block(rds_data));
+	int block = rds_data->block & V4L2_RDS_BLOCK_MSK;
+
+	if (remainder == offset_word[block])
+		return 0;
+	printf("block %d %02x%02x: remainder %03x instead of %03x\n", block,
+			rds_data->msb, rds_data->lsb, remainder,
+			offset_word[block]);
+	return 1;
+}
+
+static int test_source(int idx)
+{
+	struct v4l2_rds src, *dec;
+	struct v4l2_rds_encoder enc;
+	struct v4l2_rds_data grp[4];
+	int i, j, errors = 0;
+
+	memset(&src, 0, sizeof(src));
+	src.pi = sources[idx].pi;
+	src.pty = sources[idx].pty;
+	src.tp = sources[idx].tp;
+	memcpy(src.ps, sources[idx].ps, 8);
+	src.valid_fields = V4L2_RDS_PI | V4L2_RDS_PTY | V4L2_RDS_TP |
+		V4L2_RDS_PS;
+	if (sources[idx].rt) {
+		src.rt_length = strlen(sources[idx].rt);
+		memcpy(src.rt, sources[idx].rt, src.rt_length);
+		src.valid_fields |= V4L2_RDS_RT;
+	}
+	if (sources[idx].time) {
+		src.time = sources[idx].time;
+		src.valid_fields |= V4L2_RDS_TIME;
+	}
+
+	dec = v4l2_rds_create(false);
+	if (!dec) {
+		printf("source %d: cannot create decoder\n", idx);
+		return 1;
+	}
+	v4l2_rds_encoder_init(&enc, &src);
+	for (i = 0; i < GROUPS; i++) {
+		v4l2_rds_encode_group(&enc, grp);
+		for (j = 0; j < 4; j++) {
+			if (i < 16)
+				errors += check_raw_block(&grp[j]);
+			v4l2_rds_add(dec, &grp[j]);
+		}
+	}
+
+	if (!(dec->valid_fields & V4L2_RDS_PI) || dec->pi != src.pi) {
+		printf("source %d: PI %04x instead of %04x\n", idx, dec->pi,
+				src.pi);
+		errors++;
+	}
+	if (!(dec->valid_fields & V4L2_RDS_PTY) || dec->pty != src.pty ||
+	    dec->tp != src.tp) {
+		printf("source %d: PTY %d TP %d instead of %d %d\n", idx,
+				dec->pty, dec->tp, src.pty, src.tp);
+		errors++;
+	}
+	if (!(dec->valid_fields & V4L2_RDS_PS) || memcmp(dec->ps, src.ps, 8)) {
+		printf("source %d: PS \"%.8s\" instead of \"%.8s\"\n", idx,
+				dec->ps, src.ps);
+		errors++;
+	}
+	if ((src.valid_fields & V4L2_RDS_RT) &&
+	    (!(dec->valid_fields & V4L2_RDS_RT) ||
+	     dec->rt_length != src.rt_length ||
+	     memcmp(dec->rt, src.rt, src.rt_length))) {
+		printf("source %d: RT \"%.*s\" instead of \"%s\"\n", idx,
+				dec->rt_length, dec->rt, src.rt);
+		errors++;
+	}
+	/* Clock time is transmitted with a resolution of a minute */
+	if ((src.valid_fields & V4L2_RDS_TIME) &&
+	    (!(dec->valid_fields & V4L2_RDS_TIME) ||
+	     dec->time != src.time - src.time % 60)) {
+		printf("source %d: CT %ld instead of %ld\n", idx,
+				(long)dec->time, (long)(src.time - src.time % 60));
+		errors++;
+	}
+
+	v4l2_rds_destroy(dec);
+	return errors;
+}
+
+int main(int argc, char *argv[])
+{
+	int i, errors = 0;
+
+	/* The decoder returns the clock time as local time */
+	setenv("TZ", "UTC", 1);
+	tzset();
+
+	for (i = 0; i < ARRAY_SIZE(sources); i++)
+		errors += test_source(i);
+
+	printf("%s: %d errors\n", errors ? "FAIL" : "PASS", errors);
+	return errors != 0;
+}
@@ -0,0 +1,245 @@
+/*
+# tinyjpeg IDCT accuracy test
+
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU Lesser General Public License as published by
+# the Free Software Foundation; either version 2.1 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU Lesser General Public License for more details.
+#
+# You should have received a copy of the GNU Lesser General Public License
+# along with this program; if not, write to the Free Software
+# Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA  02110-1335  USA
+ */
+
+/*
+ * Checks the error bound of the IDCTs of tinyjpeg at the IDCT output. 8x8
+ * blocks of 8 bit samples (noise, black and white noise, gradients and
+ * edges) go through an exact forward DCT and get quantized with the
+ * example luminance table of the JPEG standard scaled to a random
+ * quality, like an encoder would do. The coefficients are then
+ * transformed back by the float IDCT, by the SIMD integer IDCT of this
+ * cpu, and by an exact double precision IDCT.
+ *
+ * Both tinyjpeg IDCTs must be within 1 of the exact result and within 1
+ * of each other, the program exits with a non zero status otherwise.
+ * This bound only holds for coefficients that can come from 8 bit
+ * samples; corrupt streams can have coefficients that overflow the 16
+ * bit intermediates of the SIMD version.
+ *
+ * Usage: tinyjpeg-idct-test [number of blocks]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "../../lib/libv4lconvert/libv4lconvert-priv.h"
+#include "../../lib/libv4lconvert/tinyjpeg-internal.h"
+
+#define MAX_ERROR	1
+
+typedef void (*idct_fct)(struct component *compptr, uint8_t *output_buf,
+		int stride);
+
+/* Table K.1 of the JPEG standard, in natural order */
+static const int std_luminance_quant[64] = {
+	16,  11,  10,  16,  24,  40,  51,  61,
+	12,  12,  14,  19,  26,  58,  60,  55,
+	14,  13,  16,  24,  40,  57,  69,  56,
+	14,  17,  22,  29,  51,  87,  80,  62,
+	18,  22,  37,  56,  68, 109, 103,  77,
+	24,  35,  55,  64,  81, 104, 113,  92,
+	49,  64,  78,  87, 103, 121, 120, 101,
+	72,  92,  95,  98, 112, 100, 103,  99
+};
+
+/* Same as the scale factors of build_quantization_table() in tinyjpeg.c */
+static const double aanscalefactor[8] = {
+	1.0, 1.387039845, 1.306562965, 1.175875602,
+	1.0, 0.785694958, 0.541196100, 0.275899379
+};
+
+static double cos_table[8][8];	/* [x][u] = C(u) * cos((2x + 1)uPI / 16) */
+
+static void init_cos_table(void)
+{
+	int x, u;
+
+	for (x = 0; x < 8; x++)
+		for (u = 0; u < 8; u++)
+			cos_table[x][u] = (u ? 1.0 : M_SQRT1_2) *
+				cos((2 * x + 1) * u * M_PI / 16);
+}
+
+/* Fills in both quantization tables like libjpeg's jpeg_quality_scaling */
+static void make_quant_tables(int quality, float *qtable, int16_t *qtable_int)
+{
+	int i, q, scale;
+
+	scale = quality < 50 ? 5000 / quality : 200 - quality * 2;
+	for (i = 0; i < 64; i++) {
+		q = (std_luminance_quant[i] * scale + 50) / 100;
+		if (q < 1)
+			q = 1;
+		if (q > 255)
+			q = 255;
+		qtable_int[i] = q;
+		qtable[i] = q * aanscalefactor[i / 8] * aanscalefactor[i % 8];
+	}
+}
+
+/* Fills in 8x8 samples, minus 128 like the level shift of an encoder */
+static void make_block(double *samples)
+{
+	int x, y, edge = rand() % 8, kind = rand() % 4;
+
+	for (y = 0; y < 8; y++)
+		for (x = 0; x < 8; x++) {
+			int v;
+
+			switch (kind) {
+			case 0:
+				v = rand() % 256;
+				break;
+			case 1:
+				v = (rand() & 1) ? 255 : 0;
+				break;
+			case 2:
+				v = (x + 3 * y) * 10 % 256;
+				break;
+			default:
+				v = ((x > edge) ^ (y > 3)) ? 255 : 0;
+				break;
+			}
+			samples[y * 8 + x] = v - 128;
+		}
+}
+
+static void fdct_quantize(const double *samples, const int16_t *qtable_int,
+		short *coef)
+{
+	int x, y, u, v;
+
+	for (v = 0; v < 8; v++)
+		for (u = 0; u < 8; u++) {
+			double sum = 0;
+
+			for (y = 0; y < 8; y++)
+				for (x = 0; x < 8; x++)
+					sum += samples[y * 8 + x] *
+						cos_table[x][u] * cos_table[y][v];
+			coef[v * 8 + u] =
+				lround(sum / 4 / qtable_int[v * 8 + u]);
+		}
+}
+
+static void idct_exact(const short *coef, const int16_t *qtable_int,
+		uint8_t *out)
+{
+	int x, y, u, v, i;
+
+	for (y = 0; y < 8; y++)
+		for (x = 0; x < 8; x++) {
+			double sum = 0;
+
+			for (v = 0; v < 8; v++)
+				for (u = 0; u < 8; u++)
+					sum += coef[v * 8 + u] *
+						qtable_int[v * 8 + u] *
+						cos_table[x][u] * cos_table[y][v];
+			i = floor(sum / 4 + 128 + 0.5);
+			out[y * 8 + x] = i < 0 ? 0 : i > 255 ? 255 : i;
+		}
+}
+
+static idct_fct get_simd_idct(void)
+{
+#ifdef V4LCONVERT_HAVE_X86_SIMD
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("sse2"))
+		return tinyjpeg_idct_islow_sse2;
+#endif
+#ifdef V4LCONVERT_HAVE_NEON
+	return tinyjpeg_idct_islow_neon;
+#endif
+	return NULL;
+}
+
+static void run_idct(idct_fct idct, const short *coef, float *qtable,
+		int16_t *qtable_int, uint8_t *out)
+{
+	struct component comp;
+
+	memset(&comp, 0, sizeof(comp));
+	comp.Q_table = qtable;
+	comp.Q_table_int = qtable_int;
+	memcpy(comp.DCT, coef, sizeof(comp.DCT));
+	idct(&comp, out, 8);
+}
+
+int main(int argc, char *argv[])
+{
+	idct_fct simd_idct = get_simd_idct();
+	long blocks = argc > 1 ? atol(argv[1]) : 100000;
+	int max_float = 0, max_simd = 0, max_diff = 0;
+	long i, hist[MAX_ERROR + 2] = { 0 };
+	float qtable[64];
+	int16_t qtable_int[64];
+	double samples[64];
+	short coef[64];
+	uint8_t exact[64], out_float[64], out_simd[64];
+	int j;
+
+	if (!simd_idct) {
+		printf("No SIMD IDCT for this cpu, nothing to test\n");
+		return 0;
+	}
+
+	init_cos_table();
+	srand(1);
+	for (i = 0; i < blocks; i++) {
+		make_quant_tables(1 + rand() % 100, qtable, qtable_int);
+		make_block(samples);
+		fdct_quantize(samples, qtable_int, coef);
+
+		idct_exact(coef, qtable_int, exact);
+		run_idct(tinyjpeg_idct_float, coef, qtable, qtable_int,
+				out_float);
+		run_idct(simd_idct, coef, qtable, qtable_int, out_simd);
+
+		for (j = 0; j < 64; j++) {
+			int e_float = abs(out_float[j] - exact[j]);
+			int e_simd = abs(out_simd[j] - exact[j]);
+			int diff = abs(out_simd[j] - out_float[j]);
+
+			if (e_float > max_float)
+				max_float = e_float;
+			if (e_simd > max_simd)
+				max_simd = e_simd;
+			if (diff > max_diff)
+				max_diff = diff;
+			hist[diff > MAX_ERROR ? MAX_ERROR + 1 : diff]++;
+		}
+	}
+
+	printf("%ld blocks, max error float %d simd %d, max difference %d\n",
+			blocks, max_float, max_simd, max_diff);
+	for (j = 0; j <= MAX_ERROR + 1; j++)
+		printf("  difference %s%d: %ld samples\n",
+				j > MAX_ERROR ? "> " : "",
+				j > MAX_ERROR ? MAX_ERROR : j, hist[j]);
+
+	if (max_float > MAX_ERROR || max_simd > MAX_ERROR ||
+	    max_diff > MAX_ERROR) {
+		printf("FAIL: error bound of %d exceeded\n", MAX_ERROR);
+		return 1;
+	}
+	printf("PASS\n");
+	return 0;
+}
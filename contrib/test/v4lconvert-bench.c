@@ -0,0 +1,395 @@
+/*
+# libv4lconvert conversion benchmark
+
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU Lesser General Public License as published by
+# the Free Software Foundation; either version 2.1 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU Lesser General Public License for more details.
+#
+# You should have received a copy of the GNU Lesser General Public License
+# along with this program; if not, write to the Free Software
+# Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA  02110-1335  USA
+ */
+
+/*
+ * Times v4lconvert_convert() for every source format we can synthesize
+ * frames for, to every destination format, at several resolutions, and
+ * optionally with flipping, cropping, scaling or software processing.
+ *
+ * No device is needed: libv4lconvert talks to a fake device through its
+ * dev_ops, which offers a single format at a single resolution. The
+ * frames are generated with a fixed seed, so that the numbers can be
+ * compared across commits. Per case the median of the per frame times is
+ * reported as MPix/s (source pixels) and cycles per source pixel, next to
+ * the size of the source plus the destination frame. The latter leaves out
+ * the intermediate buffers of conversions done in several steps (f.e. with
+ * flipping, cropping, scaling or processing), so the GB/s derived from it
+ * is a lower bound of the memory traffic.
+ *
+ * Cycles are the cpu cycles of the calling thread when perf events are
+ * available. Otherwise the time stamp counter gets used on x86, which
+ * counts at a fixed rate regardless of the cpu's clock, so those are
+ * reported as ticks instead. With worker threads (LIBV4LCONVERT_THREADS)
+ * only MPix/s is meaningful.
+ */
+
+#define _GNU_SOURCE 1
+
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#if defined(__i386__) || defined(__x86_64__)
+#include <x86intrin.h>
+#endif
+
+#include "v4lconvert-testdev.h"
+
+#define MAX_SIZES	16
+#define MAX_FORMATS	64
+#define MAX_SAMPLES	100000
+#define MIN_SAMPLES	5
+
+enum {
+	VARIANT_PLAIN,
+	VARIANT_FLIP,
+	VARIANT_CROP,
+	VARIANT_SCALE,
+	VARIANT_PROCESS,
+	VARIANT_COUNT
+};
+
+static const char *variant_names[VARIANT_COUNT] = {
+	"plain", "flip", "crop", "scale", "process"
+};
+
+/* Cycle counter */
+static int cycles_fd = -1;
+static const char *cycles_name = "none";
+static const char *cycles_unit = "cycles";
+
+static void cycles_init(void)
+{
+	struct perf_event_attr attr;
+
+	memset(&attr, 0, sizeof(attr));
+	attr.type = PERF_TYPE_HARDWARE;
+	attr.size = sizeof(attr);
+	attr.config = PERF_COUNT_HW_CPU_CYCLES;
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+	cycles_fd = syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+	if (cycles_fd != -1) {
+		cycles_name = "cpu cycles (perf)";
+		return;
+	}
+#if defined(__i386__) || defined(__x86_64__)
+	cycles_name = "time stamp counter (not cpu cycles)";
+	cycles_unit = "ticks";
+#endif
+}
+
+static uint64_t cycles_read(void)
+{
+	uint64_t cycles;
+
+	if (cycles_fd != -1 &&
+			read(cycles_fd, &cycles, sizeof(cycles)) == sizeof(cycles))
+		return cycles;
+#if defined(__i386__) || defined(__x86_64__)
+	return __rdtsc();
+#else
+	return 0;
+#endif
+}
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int cmp_double(const void *a, const void *b)
+{
+	double x = *(const double *)a, y = *(const double *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+static double *times, *cycles;
+static double min_time = 0.25;
+
+static void bench_case(struct v4lconvert_data *data, struct frame *dev,
+		unsigned int dest_pixfmt, int variant)
+{
+	struct v4l2_format src_fmt, dest_fmt;
+	unsigned char *dest;
+	double start, t, bytes;
+	uint64_t c;
+	int n, res;
+	char buf[2][5];
+
+	set_ctrl(data, V4L2_CID_HFLIP, variant == VARIANT_FLIP);
+	set_ctrl(data, V4L2_CID_VFLIP, variant == VARIANT_FLIP);
+	set_ctrl(data, V4L2_CID_AUTO_WHITE_BALANCE, variant == VARIANT_PROCESS);
+	set_ctrl(data, V4L2_CID_GAMMA, variant == VARIANT_PROCESS ? 1500 : 1000);
+	v4lconvert_set_scaling(data, variant == VARIANT_SCALE ?
+			V4LCONVERT_SCALE_BILINEAR : V4LCONVERT_SCALE_NONE);
+
+	memset(&dest_fmt, 0, sizeof(dest_fmt));
+	dest_fmt.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+	dest_fmt.fmt.pix.pixelformat = dest_pixfmt;
+	dest_fmt.fmt.pix.field = V4L2_FIELD_NONE;
+	switch (variant) {
+	case VARIANT_CROP:
+		/* Small enough to be cropped off the device's resolution */
+		dest_fmt.fmt.pix.width = dev->width - 4;
+		dest_fmt.fmt.pix.height = dev->height - 1;
+		break;
+	case VARIANT_SCALE:
+		dest_fmt.fmt.pix.width = (dev->width * 3 / 4) & ~7;
+		dest_fmt.fmt.pix.height = (dev->height * 3 / 4) & ~1;
+		break;
+	default:
+		dest_fmt.fmt.pix.width = dev->width;
+		dest_fmt.fmt.pix.height = dev->height;
+	}
+
+	printf("%-4s  %-4s  %4dx%-4d  %4dx%-4d  %-7s", fourcc(dev->fmt, buf[0]),
+			fourcc(dest_pixfmt, buf[1]), dev->width, dev->height,
+			dest_fmt.fmt.pix.width, dest_fmt.fmt.pix.height,
+			variant_names[variant]);
+	fflush(stdout);
+
+	if (v4lconvert_try_format(data, &dest_fmt, &src_fmt)) {
+		printf("  error: try_format: %s\n", strerror(errno));
+		return;
+	}
+	if ((variant == VARIANT_PLAIN || variant == VARIANT_FLIP ||
+			variant == VARIANT_PROCESS) &&
+			(dest_fmt.fmt.pix.width != dev->width ||
+			 dest_fmt.fmt.pix.height != dev->height)) {
+		printf("  error: got %dx%d\n", dest_fmt.fmt.pix.width,
+				dest_fmt.fmt.pix.height);
+		return;
+	}
+
+	dest = malloc(dest_fmt.fmt.pix.sizeimage);
+	if (!dest) {
+		printf("  error: out of memory\n");
+		return;
+	}
+
+	/* Warm up, this also allocates all buffers */
+	res = v4lconvert_convert(data, &src_fmt, &dest_fmt, dev->data,
+			dev->size, dest, dest_fmt.fmt.pix.sizeimage);
+	if (res < 0) {
+		printf("  error: %s\n", v4lconvert_get_error_message(data));
+		free(dest);
+		return;
+	}
+
+	start = now();
+	for (n = 0; n < MAX_SAMPLES; n++) {
+		t = now();
+		c = cycles_read();
+		v4lconvert_convert(data, &src_fmt, &dest_fmt, dev->data,
+				dev->size, dest, dest_fmt.fmt.pix.sizeimage);
+		cycles[n] = cycles_read() - c;
+		times[n] = now() - t;
+		if (n + 1 >= MIN_SAMPLES && now() - start >= min_time) {
+			n++;
+			break;
+		}
+	}
+	free(dest);
+
+	qsort(times, n, sizeof(double), cmp_double);
+	qsort(cycles, n, sizeof(double), cmp_double);
+	t = times[n / 2];
+	bytes = dev->size + res;
+	printf("  %9.1f", dev->width * dev->height / t / 1e6);
+	if (strcmp(cycles_name, "none"))
+		printf("  %8.2f", cycles[n / 2] / (dev->width * dev->height));
+	else
+		printf("  %8s", "-");
+	printf("  %9.2f  %6.2f  %6d\n", bytes / 1e6, bytes / t / 1e9, n);
+	fflush(stdout);
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr,
+		"Usage: %s [options]\n"
+		"  -s, --size=WxH        source resolution, may be repeated\n"
+		"                        (default 640x480, 1280x720, 1920x1080)\n"
+		"  -f, --src=FOURCC      source format, may be repeated (default all)\n"
+		"  -d, --dest=FOURCC     destination format, may be repeated\n"
+		"                        (default all)\n"
+		"  -v, --variant=NAME    plain, flip, crop, scale or process, may be\n"
+		"                        repeated (default all)\n"
+		"  -t, --time=SECONDS    minimum time per case (default 0.25)\n"
+		"  -h, --help            show this help\n", name);
+}
+
+int main(int argc, char *argv[])
+{
+	static const struct option long_options[] = {
+		{ "size",	required_argument,	NULL,	's' },
+		{ "src",	required_argument,	NULL,	'f' },
+		{ "dest",	required_argument,	NULL,	'd' },
+		{ "variant",	required_argument,	NULL,	'v' },
+		{ "time",	required_argument,	NULL,	't' },
+		{ "help",	no_argument,		NULL,	'h' },
+		{ NULL, 0, NULL, 0 }
+	};
+	int sizes[MAX_SIZES][2], no_sizes = 0;
+	unsigned int srcs[MAX_FORMATS], dests[MAX_FORMATS];
+	int no_srcs = 0, no_dests = 0, variants = 0;
+	int c, i, j, k, v;
+	struct v4lconvert_data *data;
+	struct frame dev;
+	char buf[5];
+
+	while ((c = getopt_long(argc, argv, "s:f:d:v:t:h", long_options,
+					NULL)) != -1) {
+		switch (c) {
+		case 's':
+			if (no_sizes == MAX_SIZES ||
+					sscanf(optarg, "%dx%d", &sizes[no_sizes][0],
+						&sizes[no_sizes][1]) != 2 ||
+					sizes[no_sizes][0] < 16 ||
+					sizes[no_sizes][1] < 16) {
+				fprintf(stderr, "invalid size: %s\n", optarg);
+				return 1;
+			}
+			no_sizes++;
+			break;
+		case 'f':
+			if (no_srcs < MAX_FORMATS)
+				srcs[no_srcs++] = parse_fourcc(optarg);
+			break;
+		case 'd':
+			if (no_dests < MAX_FORMATS)
+				dests[no_dests++] = parse_fourcc(optarg);
+			break;
+		case 'v':
+			for (v = 0; v < VARIANT_COUNT; v++)
+				if (!strcmp(optarg, variant_names[v]))
+					break;
+			if (v == VARIANT_COUNT) {
+				fprintf(stderr, "invalid variant: %s\n", optarg);
+				return 1;
+			}
+			variants |= 1 << v;
+			break;
+		case 't':
+			min_time = strtod(optarg, NULL);
+			break;
+		default:
+			usage(argv[0]);
+			return c != 'h';
+		}
+	}
+
+	if (no_sizes == 0) {
+		static const int default_sizes[][2] = {
+			{ 640, 480 }, { 1280, 720 }, { 1920, 1080 }
+		};
+
+		for (no_sizes = 0; no_sizes < ARRAY_SIZE(default_sizes);
+				no_sizes++) {
+			sizes[no_sizes][0] = default_sizes[no_sizes][0];
+			sizes[no_sizes][1] = default_sizes[no_sizes][1];
+		}
+	}
+	if (no_srcs == 0)
+		for (; no_srcs < testdev_no_src_formats; no_srcs++)
+			srcs[no_srcs] = testdev_src_formats[no_srcs].fmt;
+	if (no_dests == 0)
+		for (; no_dests < testdev_no_dest_formats; no_dests++)
+			dests[no_dests] = testdev_dest_formats[no_dests];
+	if (variants == 0)
+		variants = (1 << VARIANT_COUNT) - 1;
+
+	times = malloc(MAX_SAMPLES * sizeof(double));
+	cycles = malloc(MAX_SAMPLES * sizeof(double));
+	if (!times || !cycles) {
+		fprintf(stderr, "out of memory\n");
+		return 1;
+	}
+
+	testdev_name = "v4lconvert-bench";
+	testdev_bus_info = "bench";
+
+	/* Make sure the fake device has the flip and processing controls */
+	setenv("LIBV4LCONTROL_CONTROLS", "15", 1);
+
+	cycles_init();
+	printf("# cycles: %s, threads: %s, simd: %s\n", cycles_name,
+			getenv("LIBV4LCONVERT_THREADS") ?: "1",
+			getenv("LIBV4LCONVERT_NO_SIMD") ? "off" : "on");
+	printf("# src   dest  src size   dest size  variant     MPix/s  "
+			"%6s/px  MB in+out    GB/s  frames\n", cycles_unit);
+
+	for (i = 0; i < no_srcs; i++) {
+		j = testdev_find_src_format(srcs[i]);
+		if (j == -1) {
+			fprintf(stderr, "unknown source format: %s\n",
+					fourcc(srcs[i], buf));
+			continue;
+		}
+
+		for (k = 0; k < no_sizes; k++) {
+			memset(&dev, 0, sizeof(dev));
+			dev.fmt = srcs[i];
+			dev.bpp = testdev_src_formats[j].bpp;
+			dev.width = sizes[k][0];
+			dev.height = sizes[k][1];
+			dev.type = FRAME_GRADIENT;
+
+			if (testdev_make_frame(&dev)) {
+				printf("%-4s  %4dx%-4d  skipped, can't synthesize "
+						"frames\n", fourcc(dev.fmt, buf),
+						dev.width, dev.height);
+				continue;
+			}
+			testdev_frame = &dev;
+
+			data = v4lconvert_create_with_dev_ops(-1, NULL,
+					&testdev_dev_ops);
+			if (!data) {
+				fprintf(stderr, "error creating v4lconvert\n");
+				return 1;
+			}
+
+			for (c = 0; c < no_dests; c++)
+				for (v = 0; v < VARIANT_COUNT; v++)
+					if (variants & (1 << v))
+						bench_case(data, &dev, dests[c],
+								v);
+
+			v4lconvert_destroy(data);
+			free(dev.data);
+		}
+	}
+
+	free(times);
+	free(cycles);
+	return 0;
+}
@@ -0,0 +1,910 @@
+/*
+# libv4lconvert differential tester
+
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU Lesser General Public License as published by
+# the Free Software Foundation; either version 2.1 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU Lesser General Public License for more details.
+#
+# You should have received a copy of the GNU Lesser General Public License
+# along with this program; if not, write to the Free Software
+# Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA  02110-1335  USA
+ */
+
+/*
+ * Runs v4lconvert_convert() for every source format we can synthesize
+ * frames for, to every destination format, with flipping, cropping,
+ * scaling, rotating and software processing, once with the plain C kernels in a
+ * single thread (the reference) and once in each of a number of optimized
+ * configurations: SIMD kernels, worker threads and both. The outputs must
+ * be identical, for every mismatching case the max error, the number of
+ * differing samples and the first one of them are reported. The one
+ * exception is decoding with tinyjpeg, whose SIMD IDCT may be off by a bit
+ * (see IDCT_TOLERANCE).
+ *
+ * (M)JPEG gets decoded by libjpeg when we have it, the tinyjpeg variant
+ * forces tinyjpeg instead. Synthesized gradients are yuv 4:2:2 jpegs
+ * without restart markers, noise is yuv 4:2:0 with restart markers, which
+ * the threaded configurations decode in parallel.
+ *
+ * The rotate90 variant rotates the frame by 90 degrees, as libv4lcontrol
+ * asks for with cameras which have their sensor mounted sideways. The
+ * rotation goes in tiles, the default sizes include ones which are no
+ * multiple of the tile size, with odd widths and heights of the
+ * (subsampled) planes, to cover the edges.
+ *
+ * With --baseline the output also gets compared with the libv4lconvert.so
+ * of another build, f.e. of the commit before a change. Cases it doesn't
+ * support get skipped, so that the summary shows how many cases really
+ * got compared. The baseline is loaded with RTLD_DEEPBIND, which
+ * AddressSanitizer does not support.
+ *
+ * The kernels get picked once per process, so every configuration runs in
+ * a forked child which sends its results back through a pipe. A child
+ * getting killed, f.e. by a sanitizer finding something, is reported
+ * together with the case it was working on. To run this under
+ * AddressSanitizer and UndefinedBehaviorSanitizer build libv4lconvert and
+ * this program with:
+ *
+ *   CFLAGS="-g -O1 -fsanitize=address,undefined -fno-omit-frame-pointer"
+ *   LDFLAGS="-fsanitize=address,undefined"
+ *
+ * Next to synthesized frames (smooth gradients and full range noise) real
+ * captured frames can be given on the command line, these must be named
+ * FOURCC-WIDTHxHEIGHT[-anything].raw, f.e. "MJPG-640x480-logitech.raw",
+ * and contain exactly one frame as the device gave it.
+ *
+ * No device is needed: libv4lconvert talks to a fake device through its
+ * dev_ops, which offers a single format at a single resolution.
+ */
+
+#define _GNU_SOURCE 1
+
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <signal.h>
+#include <getopt.h>
+#include <libgen.h>
+#include <dlfcn.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#include "v4lconvert-testdev.h"
+
+#define MAX_SIZES	16
+#define MAX_FORMATS	64
+
+/* The SIMD IDCT of tinyjpeg is an integer one, which is within 1 of its
+   float IDCT (see tinyjpeg-idct-test), upsampling and the colorspace
+   conversion can add up such differences of neighbouring samples */
+#define IDCT_TOLERANCE	3
+
+enum {
+	VARIANT_PLAIN,
+	VARIANT_FLIP,
+	VARIANT_CROP,
+	VARIANT_BILINEAR,
+	VARIANT_AREA,
+	VARIANT_PROCESS,
+	VARIANT_TINYJPEG,	/* (M)JPEG only */
+	VARIANT_ROTATE90,
+	VARIANT_COUNT
+};
+
+static const char *variant_names[VARIANT_COUNT] = {
+	"plain", "flip", "crop", "bilinear", "area", "process", "tinyjpeg",
+	"rotate90"
+};
+
+/* The functions of libv4lconvert we use, of the library we are linked
+   with, or of a baseline build */
+struct lib {
+	struct v4lconvert_data *(*create_with_dev_ops)(int fd,
+			void *dev_ops_priv, const struct libv4l_dev_ops *dev_ops);
+	void (*destroy)(struct v4lconvert_data *data);
+	int (*try_format)(struct v4lconvert_data *data,
+			struct v4l2_format *dest_fmt, struct v4l2_format *src_fmt);
+	int (*convert)(struct v4lconvert_data *data,
+			const struct v4l2_format *src_fmt,
+			const struct v4l2_format *dest_fmt,
+			unsigned char *src, int src_size,
+			unsigned char *dest, int dest_size);
+	int (*vidioc_s_ctrl)(struct v4lconvert_data *data, void *arg);
+	/* NULL for a baseline from before scaling got added */
+	void (*set_scaling)(struct v4lconvert_data *data, int filter);
+};
+
+static struct lib linked_lib = {
+	v4lconvert_create_with_dev_ops,
+	v4lconvert_destroy,
+	v4lconvert_try_format,
+	v4lconvert_convert,
+	v4lconvert_vidioc_s_ctrl,
+	v4lconvert_set_scaling,
+};
+
+static struct lib baseline_lib;
+
+/* The configurations, the first one is the reference, every other one gets
+   compared against the one given by ref. With SIMD tinyjpeg decodes
+   differently, so simd+threads gets compared against simd, to still hold
+   the threaded decoding to the exact same output. A baseline build only
+   runs when one is given, whatever it can't do (f.e. formats it doesn't
+   know yet) gets skipped. */
+static struct config {
+	const char *name;
+	int simd;
+	int threads;
+	int ref;
+	struct lib *lib;
+	pid_t pid;
+	FILE *f;
+	int dead;
+	int done;
+	/* Totals */
+	int mismatches;
+	int skipped;
+	int max_error;
+} configs[] = {
+	{ "reference",		0, 1, 0, &linked_lib },
+	{ "simd",		1, 1, 0, &linked_lib },
+	{ "simd+threads",	1, 0, 1, &linked_lib },
+	{ "threads",		0, 0, 0, &linked_lib },
+	{ "baseline",		0, 1, 0, &baseline_lib },
+};
+
+static int no_configs = ARRAY_SIZE(configs) - 1;
+
+struct test_case {
+	struct frame *frame;
+	unsigned int dest_fmt;
+	int variant;
+};
+
+/* What a configuration sends back per case, followed by size bytes of
+   converted frame data */
+struct result {
+	int index;
+	int res;
+	int error;
+	unsigned int pixelformat;
+	int width;
+	int height;
+	int bytesperline;
+	int size;
+};
+
+/* Loads a captured frame named FOURCC-WIDTHxHEIGHT[-anything].raw */
+static int load_frame(struct frame *frame, const char *filename)
+{
+	char *copy, *name, fmt[5];
+	struct stat st;
+	int i, fd, n;
+
+	copy = strdup(filename);
+	name = basename(copy);
+	i = sscanf(name, "%4[^-]-%dx%d", fmt, &frame->width, &frame->height);
+	free(copy);
+	if (i != 3 || frame->width <= 0 || frame->height <= 0) {
+		fprintf(stderr, "%s: not named FOURCC-WIDTHxHEIGHT.raw\n",
+				filename);
+		return -1;
+	}
+	frame->fmt = parse_fourcc(fmt);
+	i = testdev_find_src_format(frame->fmt);
+	if (i == -1) {
+		fprintf(stderr, "%s: unknown source format: %s\n", filename,
+				fmt);
+		return -1;
+	}
+	frame->bpp = testdev_src_formats[i].bpp;
+	frame->type = FRAME_FILE;
+	frame->name = filename;
+
+	fd = open(filename, O_RDONLY);
+	if (fd == -1 || fstat(fd, &st)) {
+		fprintf(stderr, "%s: %s\n", filename, strerror(errno));
+		if (fd != -1)
+			close(fd);
+		return -1;
+	}
+	frame->size = st.st_size;
+	frame->data = malloc(frame->size ? frame->size : 1);
+	n = frame->data ? read(fd, frame->data, frame->size) : -1;
+	close(fd);
+	if (n != frame->size) {
+		fprintf(stderr, "%s: error reading\n", filename);
+		free(frame->data);
+		return -1;
+	}
+	if (frame->bpp &&
+	    frame->size < frame->width * frame->height * frame->bpp / 8) {
+		fprintf(stderr, "%s: too short for a %dx%d %s frame\n",
+				filename, frame->width, frame->height, fmt);
+		free(frame->data);
+		return -1;
+	}
+	return 0;
+}
+
+/* Loads the libv4lconvert build to compare against, RTLD_DEEPBIND keeps
+   its calls of its own exported functions from ending up in the library
+   we are linked with */
+static int load_baseline(const char *filename)
+{
+	void *handle;
+
+	handle = dlopen(filename, RTLD_NOW | RTLD_LOCAL | RTLD_DEEPBIND);
+	if (!handle) {
+		fprintf(stderr, "%s\n", dlerror());
+		return -1;
+	}
+	baseline_lib.create_with_dev_ops =
+		dlsym(handle, "v4lconvert_create_with_dev_ops");
+	baseline_lib.destroy = dlsym(handle, "v4lconvert_destroy");
+	baseline_lib.try_format = dlsym(handle, "v4lconvert_try_format");
+	baseline_lib.convert = dlsym(handle, "v4lconvert_convert");
+	baseline_lib.vidioc_s_ctrl = dlsym(handle, "v4lconvert_vidioc_s_ctrl");
+	baseline_lib.set_scaling = dlsym(handle, "v4lconvert_set_scaling");
+	if (!baseline_lib.create_with_dev_ops || !baseline_lib.destroy ||
+	    !baseline_lib.try_format || !baseline_lib.convert ||
+	    !baseline_lib.vidioc_s_ctrl) {
+		fprintf(stderr, "%s: not a libv4lconvert with dev_ops\n",
+				filename);
+		dlclose(handle);
+		return -1;
+	}
+	return 0;
+}
+
+static void lib_set_ctrl(const struct lib *lib, struct v4lconvert_data *data,
+		int id, int value)
+{
+	struct v4l2_control ctrl = { .id = id, .value = value };
+
+	lib->vidioc_s_ctrl(data, &ctrl);
+}
+
+/* try_format does not know about rotating, the rotated frame has the width
+   and height of the device swapped */
+static void rotate_dest_fmt(struct v4l2_format *fmt)
+{
+	int width = fmt->fmt.pix.height, height = fmt->fmt.pix.width;
+
+	fmt->fmt.pix.width = width;
+	fmt->fmt.pix.height = height;
+	switch (fmt->fmt.pix.pixelformat) {
+	case V4L2_PIX_FMT_RGB24:
+	case V4L2_PIX_FMT_BGR24:
+		fmt->fmt.pix.bytesperline = width * 3;
+		fmt->fmt.pix.sizeimage = width * height * 3;
+		break;
+	case V4L2_PIX_FMT_YUYV:
+		fmt->fmt.pix.bytesperline = width * 2;
+		fmt->fmt.pix.sizeimage = width * height * 2;
+		break;
+	default:
+		fmt->fmt.pix.bytesperline = width;
+		fmt->fmt.pix.sizeimage = width * height * 3 / 2;
+	}
+}
+
+/* Converts a frame the way a test case says, with a fresh v4lconvert
+   instance, so that all lookup tables get computed from this frame */
+static unsigned char *run_case(const struct lib *lib,
+		const struct test_case *tc, struct result *result)
+{
+	struct v4l2_format src_fmt, dest_fmt;
+	struct v4lconvert_data *data;
+	unsigned char *src, *dest = NULL;
+	struct frame *dev;
+
+	dev = testdev_frame = tc->frame;
+	memset(result, 0, sizeof(*result));
+	result->res = -1;
+
+	if ((tc->variant == VARIANT_BILINEAR || tc->variant == VARIANT_AREA) &&
+	    !lib->set_scaling) {
+		result->error = EOPNOTSUPP;
+		return NULL;
+	}
+
+	/* The decoder gets picked when creating, libv4lcontrol reads its
+	   flags, which can force tinyjpeg or rotating, from the environment */
+	if (tc->variant == VARIANT_TINYJPEG)
+		setenv("LIBV4LCONTROL_FLAGS", "0x20", 1);
+	else if (tc->variant == VARIANT_ROTATE90)
+		setenv("LIBV4LCONTROL_FLAGS", "0x04", 1);
+	data = lib->create_with_dev_ops(-1, NULL, &testdev_dev_ops);
+	unsetenv("LIBV4LCONTROL_FLAGS");
+	if (!data) {
+		result->error = ENOMEM;
+		return NULL;
+	}
+
+	lib_set_ctrl(lib, data, V4L2_CID_HFLIP, tc->variant == VARIANT_FLIP);
+	lib_set_ctrl(lib, data, V4L2_CID_VFLIP, tc->variant == VARIANT_FLIP);
+	lib_set_ctrl(lib, data, V4L2_CID_AUTO_WHITE_BALANCE,
+			tc->variant == VARIANT_PROCESS);
+	lib_set_ctrl(lib, data, V4L2_CID_GAMMA,
+			tc->variant == VARIANT_PROCESS ? 1500 : 1000);
+	if (lib->set_scaling)
+		lib->set_scaling(data,
+				tc->variant == VARIANT_BILINEAR ?
+					V4LCONVERT_SCALE_BILINEAR :
+				tc->variant == VARIANT_AREA ?
+					V4LCONVERT_SCALE_AREA :
+					V4LCONVERT_SCALE_NONE);
+
+	memset(&dest_fmt, 0, sizeof(dest_fmt));
+	dest_fmt.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+	dest_fmt.fmt.pix.pixelformat = tc->dest_fmt;
+	dest_fmt.fmt.pix.field = V4L2_FIELD_NONE;
+	switch (tc->variant) {
+	case VARIANT_CROP:
+		/* Small enough to be cropped off the device's resolution */
+		dest_fmt.fmt.pix.width = dev->width - 4;
+		dest_fmt.fmt.pix.height = dev->height - 1;
+		break;
+	case VARIANT_BILINEAR:
+	case VARIANT_AREA:
+		dest_fmt.fmt.pix.width = dev->width * 3 / 4;
+		dest_fmt.fmt.pix.height = dev->height * 3 / 4;
+		break;
+	default:
+		dest_fmt.fmt.pix.width = dev->width;
+		dest_fmt.fmt.pix.height = dev->height;
+	}
+
+	if (lib->try_format(data, &dest_fmt, &src_fmt)) {
+		result->error = errno;
+		goto leave;
+	}
+	if (tc->variant == VARIANT_ROTATE90)
+		rotate_dest_fmt(&dest_fmt);
+	result->pixelformat = dest_fmt.fmt.pix.pixelformat;
+	result->width = dest_fmt.fmt.pix.width;
+	result->height = dest_fmt.fmt.pix.height;
+	result->bytesperline = dest_fmt.fmt.pix.bytesperline;
+
+	/* Give the conversion its own copy, some converters modify their
+	   source, and make sure a read past its end gets caught */
+	src = malloc(dev->size);
+	dest = malloc(dest_fmt.fmt.pix.sizeimage);
+	if (!src || !dest) {
+		free(src);
+		free(dest);
+		dest = NULL;
+		result->error = ENOMEM;
+		goto leave;
+	}
+	memcpy(src, dev->data, dev->size);
+	memset(dest, 0xa5, dest_fmt.fmt.pix.sizeimage);
+
+	result->res = lib->convert(data, &src_fmt, &dest_fmt, src,
+			dev->size, dest, dest_fmt.fmt.pix.sizeimage);
+	if (result->res < 0) {
+		result->error = errno;
+		free(dest);
+		dest = NULL;
+	} else {
+		result->size = result->res;
+	}
+	free(src);
+leave:
+	lib->destroy(data);
+	return dest;
+}
+
+static int write_all(int fd, const void *buf, int size)
+{
+	const char *p = buf;
+	int n;
+
+	while (size > 0) {
+		n = write(fd, p, size);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return -1;
+		p += n;
+		size -= n;
+	}
+	return 0;
+}
+
+/* The child side of a configuration, never returns */
+static void run_config(const struct config *config, int fd,
+		const struct test_case *cases, int no_cases)
+{
+	struct result result;
+	unsigned char *dest;
+	char buf[16], bus_info[32];
+	int i;
+
+	snprintf(bus_info, sizeof(bus_info), "difftest-%s", config->name);
+	testdev_bus_info = bus_info;
+
+	/* The kernels get picked by the first v4lconvert_create */
+	if (config->simd)
+		unsetenv("LIBV4LCONVERT_NO_SIMD");
+	else
+		setenv("LIBV4LCONVERT_NO_SIMD", "1", 1);
+	snprintf(buf, sizeof(buf), "%d", config->threads);
+	setenv("LIBV4LCONVERT_THREADS", buf, 1);
+	unsetenv("LIBV4LCONVERT_SCALE");
+	unsetenv("LIBV4LCONVERT_JPEG_FAST_DCT");
+	unsetenv("LIBV4LCONVERT_PROCESSING_UPDATE_MS");
+	unsetenv("LIBV4LCONVERT_PROCESSING_STATS_LINES");
+	unsetenv("LIBV4LCONTROL_FLAGS");
+
+	for (i = 0; i < no_cases; i++) {
+		dest = run_case(config->lib, &cases[i], &result);
+		result.index = i;
+		if (write_all(fd, &result, sizeof(result)) ||
+		    write_all(fd, dest, result.size))
+			_exit(1);
+		free(dest);
+	}
+	_exit(0);
+}
+
+static int start_config(struct config *config, const struct test_case *cases,
+		int no_cases)
+{
+	int fds[2];
+
+	if (pipe(fds)) {
+		perror("pipe");
+		return -1;
+	}
+	fflush(stdout);
+	config->pid = fork();
+	if (config->pid == -1) {
+		perror("fork");
+		close(fds[0]);
+		close(fds[1]);
+		return -1;
+	}
+	if (config->pid == 0) {
+		close(fds[0]);
+		run_config(config, fds[1], cases, no_cases);
+	}
+	close(fds[1]);
+	config->f = fdopen(fds[0], "r");
+	return 0;
+}
+
+/* Reads the result of the next case from a configuration, returns the
+   converted data (NULL if there is none) and sets dead when the child
+   is gone */
+static unsigned char *read_result(struct config *config,
+		struct result *result)
+{
+	unsigned char *dest;
+
+	if (config->dead)
+		return NULL;
+	if (fread(result, sizeof(*result), 1, config->f) != 1 ||
+	    result->index != config->done)
+		goto dead;
+	if (!result->size) {
+		config->done++;
+		return NULL;
+	}
+	dest = malloc(result->size);
+	if (dest && fread(dest, result->size, 1, config->f) == 1) {
+		config->done++;
+		return dest;
+	}
+	free(dest);
+dead:
+	config->dead = 1;
+	return NULL;
+}
+
+static void describe_case(const struct test_case *tc)
+{
+	char buf[2][5];
+
+	printf("%-4s %-8s %4dx%-4d -> %-4s %-8s",
+			fourcc(tc->frame->fmt, buf[0]),
+			testdev_frame_names[tc->frame->type],
+			tc->frame->width, tc->frame->height,
+			fourcc(tc->dest_fmt, buf[1]), variant_names[tc->variant]);
+	if (tc->frame->type == FRAME_FILE)
+		printf(" (%s)", tc->frame->name);
+}
+
+/* Translates an offset in a converted frame into a plane and pixel */
+static void describe_offset(unsigned int fmt, const struct result *r,
+		int offset)
+{
+	int bpl = r->bytesperline, y_size = r->bytesperline * r->height;
+	const char *plane;
+	int x, y;
+
+	switch (fmt) {
+	case V4L2_PIX_FMT_RGB24:
+	case V4L2_PIX_FMT_BGR24:
+		plane = (fmt == V4L2_PIX_FMT_RGB24 ? "RGB" : "BGR") +
+			offset % bpl % 3;
+		printf("%c at %d,%d", *plane, offset % bpl / 3, offset / bpl);
+		return;
+	case V4L2_PIX_FMT_YUYV:
+		printf("%c at %d,%d", "YUYV"[offset % bpl % 4],
+				offset % bpl / 2, offset / bpl);
+		return;
+	}
+
+	if (offset < y_size) {
+		printf("Y at %d,%d", offset % bpl, offset / bpl);
+		return;
+	}
+	offset -= y_size;
+	switch (fmt) {
+	case V4L2_PIX_FMT_NV12:
+	case V4L2_PIX_FMT_NV21:
+		x = offset % bpl / 2;
+		y = offset / bpl;
+		plane = ((fmt == V4L2_PIX_FMT_NV12) ^ (offset % bpl % 2)) ?
+			"U" : "V";
+		break;
+	default:
+		bpl /= 2;
+		plane = ((fmt == V4L2_PIX_FMT_YUV420) ^
+			 (offset >= bpl * r->height / 2)) ? "U" : "V";
+		offset %= bpl * r->height / 2;
+		x = offset % bpl;
+		y = offset / bpl;
+	}
+	printf("%s at %d,%d (subsampled)", plane, x, y);
+}
+
+/* Compares the result of a configuration with the one it gets compared
+   against, returns the max error, or 256 if they don't agree on the format
+   or on failing */
+static int compare(struct config *config, const struct test_case *tc,
+		const struct result *ref, const unsigned char *ref_dest,
+		const struct result *r, const unsigned char *dest,
+		int tolerance, int verbose)
+{
+	int i, diff, max_error = 0, mismatches = 0, first = -1;
+	int other_fmt = r->pixelformat && ref->pixelformat &&
+		(r->pixelformat != ref->pixelformat ||
+		 r->width != ref->width || r->height != ref->height ||
+		 r->bytesperline != ref->bytesperline);
+
+	/* A baseline failing or picking another format is from before the
+	   conversion got supported, the other way round is a regression */
+	if (config->lib == &baseline_lib &&
+	    ((r->res < 0 && ref->res >= 0) || other_fmt)) {
+		config->skipped++;
+		return 0;
+	}
+
+	/* Only the decoding of the SIMD IDCT differs from the C one */
+	if (tc->variant == VARIANT_TINYJPEG &&
+	    config->simd != configs[config->ref].simd &&
+	    tolerance < IDCT_TOLERANCE)
+		tolerance = IDCT_TOLERANCE;
+
+	if (r->res != ref->res || other_fmt ||
+	    (ref->res < 0 && r->error != ref->error)) {
+		max_error = 256;
+	} else {
+		for (i = 0; i < r->size; i++) {
+			diff = abs(dest[i] - ref_dest[i]);
+			if (!diff)
+				continue;
+			if (first == -1)
+				first = i;
+			if (diff > max_error)
+				max_error = diff;
+			mismatches++;
+		}
+	}
+
+	if (max_error > config->max_error)
+		config->max_error = max_error;
+	if (max_error > tolerance)
+		config->mismatches++;
+	if (max_error <= tolerance && !(verbose && max_error))
+		return max_error;
+
+	printf("%-12s ", config->name);
+	describe_case(tc);
+	if (max_error == 256) {
+		printf(": returned %d (%s) %dx%d, %s %d (%s) %dx%d\n",
+				r->res, r->res < 0 ? strerror(r->error) : "ok",
+				r->width, r->height,
+				configs[config->ref].name, ref->res,
+				ref->res < 0 ? strerror(ref->error) : "ok",
+				ref->width, ref->height);
+		return max_error;
+	}
+	printf(": max error %d, %d of %d samples differ, first %d vs %d, ",
+			max_error, mismatches, r->size, dest[first],
+			ref_dest[first]);
+	describe_offset(tc->dest_fmt, r, first);
+	printf("\n");
+	return max_error;
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr,
+		"Usage: %s [options] [FOURCC-WIDTHxHEIGHT[-anything].raw...]\n"
+		"  -s, --size=WxH        source resolution of synthesized frames,\n"
+		"                        may be repeated (default 64x48, 97x61,\n"
+		"                        322x242, 640x480)\n"
+		"  -f, --src=FOURCC      source format, may be repeated (default all)\n"
+		"  -d, --dest=FOURCC     destination format, may be repeated\n"
+		"                        (default all)\n"
+		"  -v, --variant=NAME    plain, flip, crop, bilinear, area, process,\n"
+		"                        tinyjpeg or rotate90, may be repeated\n"
+		"                        (default all)\n"
+		"  -j, --threads=N       worker threads of the threaded\n"
+		"                        configurations (default 4)\n"
+		"  -e, --tolerance=N     max error which does not count as a\n"
+		"                        mismatch (default 0)\n"
+		"  -b, --baseline=LIB    also compare with the libv4lconvert.so of\n"
+		"                        another build\n"
+		"  -n, --no-synth        only use the given captured frames\n"
+		"  -V, --verbose         also report differences within tolerance\n"
+		"  -h, --help            show this help\n", name);
+}
+
+int main(int argc, char *argv[])
+{
+	static const struct option long_options[] = {
+		{ "size",	required_argument,	NULL,	's' },
+		{ "src",	required_argument,	NULL,	'f' },
+		{ "dest",	required_argument,	NULL,	'd' },
+		{ "variant",	required_argument,	NULL,	'v' },
+		{ "threads",	required_argument,	NULL,	'j' },
+		{ "tolerance",	required_argument,	NULL,	'e' },
+		{ "baseline",	required_argument,	NULL,	'b' },
+		{ "no-synth",	no_argument,		NULL,	'n' },
+		{ "verbose",	no_argument,		NULL,	'V' },
+		{ "help",	no_argument,		NULL,	'h' },
+		{ NULL, 0, NULL, 0 }
+	};
+	int sizes[MAX_SIZES][2], no_sizes = 0;
+	unsigned int srcs[MAX_FORMATS], dests[MAX_FORMATS];
+	int no_srcs = 0, no_dests = 0, variants = 0, threads = 4;
+	int tolerance = 0, synth = 1, verbose = 0, failed = 0;
+	int c, i, j, k, t, v, no_frames = 0, no_cases = 0;
+	struct frame *frames;
+	struct test_case *cases;
+	struct result results[ARRAY_SIZE(configs)];
+	unsigned char *outputs[ARRAY_SIZE(configs)];
+	char buf[5];
+
+	while ((c = getopt_long(argc, argv, "s:f:d:v:j:e:b:nVh", long_options,
+					NULL)) != -1) {
+		switch (c) {
+		case 's':
+			if (no_sizes == MAX_SIZES ||
+					sscanf(optarg, "%dx%d", &sizes[no_sizes][0],
+						&sizes[no_sizes][1]) != 2 ||
+					sizes[no_sizes][0] < 16 ||
+					sizes[no_sizes][1] < 16) {
+				fprintf(stderr, "invalid size: %s\n", optarg);
+				return 1;
+			}
+			no_sizes++;
+			break;
+		case 'f':
+			if (no_srcs < MAX_FORMATS)
+				srcs[no_srcs++] = parse_fourcc(optarg);
+			break;
+		case 'd':
+			if (no_dests < MAX_FORMATS)
+				dests[no_dests++] = parse_fourcc(optarg);
+			break;
+		case 'v':
+			for (v = 0; v < VARIANT_COUNT; v++)
+				if (!strcmp(optarg, variant_names[v]))
+					break;
+			if (v == VARIANT_COUNT) {
+				fprintf(stderr, "invalid variant: %s\n", optarg);
+				return 1;
+			}
+			variants |= 1 << v;
+			break;
+		case 'j':
+			threads = atoi(optarg);
+			if (threads < 2) {
+				fprintf(stderr, "invalid thread count: %s\n",
+						optarg);
+				return 1;
+			}
+			break;
+		case 'e':
+			tolerance = atoi(optarg);
+			break;
+		case 'b':
+			if (load_baseline(optarg))
+				return 1;
+			no_configs = ARRAY_SIZE(configs);
+			break;
+		case 'n':
+			synth = 0;
+			break;
+		case 'V':
+			verbose = 1;
+			break;
+		default:
+			usage(argv[0]);
+			return c != 'h';
+		}
+	}
+
+	if (no_sizes == 0) {
+		static const int default_sizes[][2] = {
+			{ 64, 48 }, { 97, 61 }, { 322, 242 }, { 640, 480 }
+		};
+
+		for (no_sizes = 0; no_sizes < ARRAY_SIZE(default_sizes);
+				no_sizes++) {
+			sizes[no_sizes][0] = default_sizes[no_sizes][0];
+			sizes[no_sizes][1] = default_sizes[no_sizes][1];
+		}
+	}
+	if (no_srcs == 0)
+		for (; no_srcs < testdev_no_src_formats; no_srcs++)
+			srcs[no_srcs] = testdev_src_formats[no_srcs].fmt;
+	if (no_dests == 0)
+		for (; no_dests < testdev_no_dest_formats; no_dests++)
+			dests[no_dests] = testdev_dest_formats[no_dests];
+	if (variants == 0)
+		variants = (1 << VARIANT_COUNT) - 1;
+	for (i = 0; i < ARRAY_SIZE(configs); i++)
+		if (!configs[i].threads)
+			configs[i].threads = threads;
+
+	/* All frames get made up front, so that every configuration
+	   converts the very same data */
+	frames = calloc(no_srcs * no_sizes * 2 + argc - optind,
+			sizeof(*frames));
+	if (!frames) {
+		fprintf(stderr, "out of memory\n");
+		return 1;
+	}
+	for (i = optind; i < argc; i++) {
+		if (load_frame(&frames[no_frames], argv[i]))
+			return 1;
+		no_frames++;
+	}
+	for (i = 0; synth && i < no_srcs; i++) {
+		j = testdev_find_src_format(srcs[i]);
+		if (j == -1) {
+			fprintf(stderr, "unknown source format: %s\n",
+					fourcc(srcs[i], buf));
+			continue;
+		}
+		for (k = 0; k < no_sizes; k++) {
+			for (t = FRAME_GRADIENT; t <= FRAME_NOISE; t++) {
+				struct frame *frame = &frames[no_frames];
+
+				frame->fmt = srcs[i];
+				frame->bpp = testdev_src_formats[j].bpp;
+				frame->width = sizes[k][0] &
+					~(testdev_src_formats[j].align - 1);
+				frame->height = sizes[k][1] &
+					~(testdev_src_formats[j].align - 1);
+				frame->type = t;
+				if (testdev_make_frame(frame))
+					break;
+				no_frames++;
+			}
+			if (t == FRAME_GRADIENT) {
+				printf("%-4s skipped, can't synthesize frames\n",
+						fourcc(srcs[i], buf));
+				break;
+			}
+		}
+	}
+
+	cases = calloc(no_frames * no_dests * VARIANT_COUNT, sizeof(*cases));
+	if (!cases) {
+		fprintf(stderr, "out of memory\n");
+		return 1;
+	}
+	for (i = 0; i < no_frames; i++)
+		for (j = 0; j < no_dests; j++)
+			for (v = 0; v < VARIANT_COUNT; v++) {
+				if (!(variants & (1 << v)))
+					continue;
+				if (v == VARIANT_TINYJPEG &&
+				    frames[i].fmt != V4L2_PIX_FMT_MJPEG &&
+				    frames[i].fmt != V4L2_PIX_FMT_JPEG)
+					continue;
+				cases[no_cases].frame = &frames[i];
+				cases[no_cases].dest_fmt = dests[j];
+				cases[no_cases].variant = v;
+				no_cases++;
+			}
+
+	testdev_name = "v4lconvert-difftest";
+
+	/* Make sure the fake device has the flip and processing controls */
+	setenv("LIBV4LCONTROL_CONTROLS", "15", 1);
+	signal(SIGPIPE, SIG_IGN);
+
+	for (i = 0; i < no_configs; i++)
+		if (start_config(&configs[i], cases, no_cases))
+			return 1;
+
+	printf("# %d cases from %d frames, tolerance %d\n", no_cases, no_frames,
+			tolerance);
+	for (i = 0; i < no_cases; i++) {
+		for (j = 0; j < no_configs; j++)
+			outputs[j] = read_result(&configs[j], &results[j]);
+		for (j = 1; j < no_configs; j++) {
+			k = configs[j].ref;
+			if (configs[j].dead || configs[k].dead)
+				continue;
+			compare(&configs[j], &cases[i], &results[k], outputs[k],
+					&results[j], outputs[j], tolerance,
+					verbose);
+		}
+		for (j = 0; j < no_configs; j++)
+			free(outputs[j]);
+		if (configs[0].dead)
+			break;
+	}
+
+	/* A dead child died on the case after the last one it sent back,
+	   without the reference the others are of no use */
+	for (j = 0; j < no_configs; j++) {
+		int status;
+
+		if (configs[0].dead && j)
+			kill(configs[j].pid, SIGKILL);
+		fclose(configs[j].f);
+		waitpid(configs[j].pid, &status, 0);
+		if (!configs[j].dead || (configs[0].dead && j))
+			continue;
+		failed = 1;
+		printf("%-12s died", configs[j].name);
+		if (WIFSIGNALED(status))
+			printf(" (%s)", strsignal(WTERMSIG(status)));
+		else if (WIFEXITED(status))
+			printf(" (exit status %d)", WEXITSTATUS(status));
+		if (configs[j].done < no_cases) {
+			printf(" converting ");
+			describe_case(&cases[configs[j].done]);
+		}
+		printf("\n");
+	}
+
+	printf("# %-12s  %-12s  %7s  %10s  %7s  %9s\n", "config", "against",
+			"threads", "mismatches", "skipped", "max error");
+	for (j = 1; j < no_configs; j++) {
+		printf("  %-12s  %-12s  %7d  %10d  %7d  %9d\n", configs[j].name,
+				configs[configs[j].ref].name, configs[j].threads,
+				configs[j].mismatches, configs[j].skipped,
+				configs[j].max_error);
+		if (configs[j].mismatches)
+			failed = 1;
+	}
+
+	for (i = 0; i < no_frames; i++)
+		free(frames[i].data);
+	free(frames);
+	free(cases);
+	return failed;
+}
@@ -0,0 +1,337 @@
+/*
+# Fake device and frame synthesis shared by the libv4lconvert test tools
+
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU Lesser General Public License as published by
+# the Free Software Foundation; either version 2.1 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU Lesser General Public License for more details.
+#
+# You should have received a copy of the GNU Lesser General Public License
+# along with this program; if not, write to the Free Software
+# Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA  02110-1335  USA
+ */
+
+#define _GNU_SOURCE 1
+
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#ifdef HAVE_JPEG
+#include <jpeglib.h>
+#endif
+
+#include "v4lconvert-testdev.h"
+
+const struct testdev_src_format testdev_src_formats[] = {
+	{ V4L2_PIX_FMT_RGB24,		24,  1 },
+	{ V4L2_PIX_FMT_BGR24,		24,  1 },
+	{ V4L2_PIX_FMT_YUV420,		12,  2 },
+	{ V4L2_PIX_FMT_YVU420,		12,  2 },
+	{ V4L2_PIX_FMT_NV12,		12,  2 },
+	{ V4L2_PIX_FMT_NV21,		12,  2 },
+	{ V4L2_PIX_FMT_YUYV,		16,  2 },
+	{ V4L2_PIX_FMT_RGB565,		16,  1 },
+	{ V4L2_PIX_FMT_YVYU,		16,  2 },
+	{ V4L2_PIX_FMT_UYVY,		16,  2 },
+	{ V4L2_PIX_FMT_SPCA501,		12, 16 },
+	{ V4L2_PIX_FMT_SPCA505,		12, 16 },
+	{ V4L2_PIX_FMT_SPCA508,		12, 16 },
+	{ V4L2_PIX_FMT_CIT_YYVYUY,	12, 16 },
+	{ V4L2_PIX_FMT_KONICA420,	12, 16 },
+	{ V4L2_PIX_FMT_SN9C20X_I420,	12, 16 },
+	{ V4L2_PIX_FMT_M420,		12, 16 },
+	{ V4L2_PIX_FMT_HM12,		12, 32 },
+	{ V4L2_PIX_FMT_CPIA1,		 0,  1 },
+	{ V4L2_PIX_FMT_MJPEG,		 0, 16 },
+	{ V4L2_PIX_FMT_JPEG,		 0, 16 },
+	{ V4L2_PIX_FMT_PJPG,		 0,  1 },
+	{ V4L2_PIX_FMT_JPGL,		 0,  1 },
+	{ V4L2_PIX_FMT_OV511,		 0,  1 },
+	{ V4L2_PIX_FMT_OV518,		 0,  1 },
+	{ V4L2_PIX_FMT_SBGGR8,		 8,  2 },
+	{ V4L2_PIX_FMT_SGBRG8,		 8,  2 },
+	{ V4L2_PIX_FMT_SGRBG8,		 8,  2 },
+	{ V4L2_PIX_FMT_SRGGB8,		 8,  2 },
+	{ V4L2_PIX_FMT_STV0680,		 8,  2 },
+	{ V4L2_PIX_FMT_SPCA561,		 0,  1 },
+	{ V4L2_PIX_FMT_SN9C10X,		 0,  1 },
+	{ V4L2_PIX_FMT_SN9C2028,	 0,  1 },
+	{ V4L2_PIX_FMT_PAC207,		 0,  1 },
+	{ V4L2_PIX_FMT_MR97310A,	 0,  1 },
+	{ V4L2_PIX_FMT_JL2005BCD,	 0,  1 },
+	{ V4L2_PIX_FMT_SQ905C,		 0,  1 },
+	{ V4L2_PIX_FMT_SE401,		 0,  1 },
+	{ V4L2_PIX_FMT_GREY,		 8,  1 },
+	{ V4L2_PIX_FMT_Y4,		 8,  1 },
+	{ V4L2_PIX_FMT_Y6,		 8,  1 },
+	{ V4L2_PIX_FMT_Y10BPACK,	10,  4 },
+};
+
+const int testdev_no_src_formats = ARRAY_SIZE(testdev_src_formats);
+
+const unsigned int testdev_dest_formats[] = {
+	V4L2_PIX_FMT_RGB24,
+	V4L2_PIX_FMT_BGR24,
+	V4L2_PIX_FMT_YUV420,
+	V4L2_PIX_FMT_YVU420,
+	V4L2_PIX_FMT_NV12,
+	V4L2_PIX_FMT_NV21,
+	V4L2_PIX_FMT_YUYV,
+};
+
+const int testdev_no_dest_formats = ARRAY_SIZE(testdev_dest_formats);
+
+const char *testdev_frame_names[] = { "gradient", "noise", "file" };
+
+struct frame *testdev_frame;
+const char *testdev_name = "v4lconvert-testdev";
+const char *testdev_bus_info = "testdev";
+
+int testdev_bytesperline(const struct frame *frame)
+{
+	/* HM12 lines always are 720 bytes, other planar formats have a
+	   bytesperline of the y plane */
+	if (frame->fmt == V4L2_PIX_FMT_HM12)
+		return 720;
+	if (frame->bpp == 12)
+		return frame->width;
+	return frame->width * frame->bpp / 8;
+}
+
+int testdev_sizeimage(const struct frame *frame)
+{
+	int size;
+
+	if (frame->bpp == 12)
+		return testdev_bytesperline(frame) * frame->height * 3 / 2;
+	if (frame->bpp)
+		return testdev_bytesperline(frame) * frame->height;
+	/* Compressed, what a driver would reserve, but big enough for the
+	   frame we have */
+	size = frame->width * frame->height * 2;
+	return size < frame->size ? frame->size : size;
+}
+
+static int dev_ioctl(void *dev_ops_priv, int fd, unsigned long int request,
+		void *arg)
+{
+	struct frame *dev = testdev_frame;
+
+	switch (request) {
+	case VIDIOC_QUERYCAP: {
+		struct v4l2_capability *cap = arg;
+
+		memset(cap, 0, sizeof(*cap));
+		snprintf((char *)cap->driver, sizeof(cap->driver), "%s",
+				testdev_name);
+		snprintf((char *)cap->card, sizeof(cap->card), "%s",
+				testdev_name);
+		snprintf((char *)cap->bus_info, sizeof(cap->bus_info), "%s",
+				testdev_bus_info);
+		cap->capabilities = V4L2_CAP_VIDEO_CAPTURE | V4L2_CAP_STREAMING;
+		return 0;
+	}
+	case VIDIOC_ENUM_FMT: {
+		struct v4l2_fmtdesc *fmtdesc = arg;
+
+		if (fmtdesc->index != 0 ||
+				fmtdesc->type != V4L2_BUF_TYPE_VIDEO_CAPTURE)
+			break;
+		fmtdesc->pixelformat = dev->fmt;
+		fmtdesc->flags = dev->bpp ? 0 : V4L2_FMT_FLAG_COMPRESSED;
+		return 0;
+	}
+	case VIDIOC_ENUM_FRAMESIZES: {
+		struct v4l2_frmsizeenum *frmsize = arg;
+
+		if (frmsize->index != 0 || frmsize->pixel_format != dev->fmt)
+			break;
+		frmsize->type = V4L2_FRMSIZE_TYPE_DISCRETE;
+		frmsize->discrete.width = dev->width;
+		frmsize->discrete.height = dev->height;
+		return 0;
+	}
+	case VIDIOC_TRY_FMT:
+	case VIDIOC_S_FMT:
+	case VIDIOC_G_FMT: {
+		struct v4l2_format *fmt = arg;
+
+		if (fmt->type != V4L2_BUF_TYPE_VIDEO_CAPTURE)
+			break;
+		/* Like a real device, ignore what we can't do */
+		fmt->fmt.pix.pixelformat = dev->fmt;
+		fmt->fmt.pix.width = dev->width;
+		fmt->fmt.pix.height = dev->height;
+		fmt->fmt.pix.field = V4L2_FIELD_NONE;
+		fmt->fmt.pix.bytesperline = testdev_bytesperline(dev);
+		fmt->fmt.pix.sizeimage = testdev_sizeimage(dev);
+		fmt->fmt.pix.colorspace = V4L2_COLORSPACE_SRGB;
+		fmt->fmt.pix.priv = 0;
+		return 0;
+	}
+	}
+
+	errno = EINVAL;
+	return -1;
+}
+
+const struct libv4l_dev_ops testdev_dev_ops = {
+	.ioctl = dev_ioctl,
+};
+
+/* Deterministic frame contents, smooth gradients with a bit of noise,
+   roughly like a camera picture, or noise over the full range to hit all
+   the clamping. The seed is fixed, so that benchmark numbers can be
+   compared across commits. */
+static unsigned int rand_state;
+
+static unsigned int testdev_rand(void)
+{
+	rand_state = rand_state * 1103515245 + 12345;
+	return rand_state >> 16;
+}
+
+static void fill_frame(unsigned char *buf, int size, int width, int type)
+{
+	int i;
+
+	rand_state = 1;
+	for (i = 0; i < size; i++) {
+		int x = i % width, y = i / width;
+
+		if (type == FRAME_NOISE)
+			buf[i] = testdev_rand() >> 4;
+		else
+			buf[i] = ((x + y) / 4 + (x * y) / 512 +
+				  (testdev_rand() & 15)) & 0xff;
+	}
+}
+
+#ifdef HAVE_JPEG
+/* Encodes a frame as jpeg. Gradients become yuv 4:2:2 without restart
+   markers, as most (M)JPEG cameras send. Noise becomes yuv 4:2:0 with a
+   restart marker every 7 MCUs, so that the intervals don't line up with
+   the MCU rows. */
+static unsigned char *make_jpeg(int width, int height, int type, int *size)
+{
+	struct jpeg_compress_struct cinfo;
+	struct jpeg_error_mgr jerr;
+	unsigned char *rgb, *buf = NULL;
+	size_t buf_size = 0;
+	JSAMPROW row;
+	FILE *f;
+
+	rgb = malloc(width * height * 3);
+	f = open_memstream((char **)&buf, &buf_size);
+	if (!rgb || !f) {
+		free(rgb);
+		if (f)
+			fclose(f);
+		free(buf);
+		return NULL;
+	}
+	fill_frame(rgb, width * height * 3, width * 3, type);
+
+	cinfo.err = jpeg_std_error(&jerr);
+	jpeg_create_compress(&cinfo);
+	jpeg_stdio_dest(&cinfo, f);
+	cinfo.image_width = width;
+	cinfo.image_height = height;
+	cinfo.input_components = 3;
+	cinfo.in_color_space = JCS_RGB;
+	jpeg_set_defaults(&cinfo);
+	jpeg_set_quality(&cinfo, 85, TRUE);
+	cinfo.comp_info[0].h_samp_factor = 2;
+	if (type == FRAME_NOISE) {
+		cinfo.comp_info[0].v_samp_factor = 2;
+		cinfo.restart_interval = 7;
+	} else {
+		cinfo.comp_info[0].v_samp_factor = 1;
+	}
+	jpeg_start_compress(&cinfo, TRUE);
+	while (cinfo.next_scanline < cinfo.image_height) {
+		row = rgb + cinfo.next_scanline * width * 3;
+		jpeg_write_scanlines(&cinfo, &row, 1);
+	}
+	jpeg_finish_compress(&cinfo);
+	jpeg_destroy_compress(&cinfo);
+	fclose(f);
+	free(rgb);
+
+	*size = buf_size;
+	return buf;
+}
+#endif
+
+int testdev_make_frame(struct frame *frame)
+{
+	/* HM12 is made of 16x16 luma / 16x32 chroma macroblocks within its
+	   720 byte lines */
+	if (frame->fmt == V4L2_PIX_FMT_HM12 &&
+			(frame->width > 720 || frame->height % 32))
+		return -1;
+
+	if (frame->bpp) {
+		frame->size = testdev_sizeimage(frame);
+		frame->data = malloc(frame->size);
+		if (!frame->data)
+			return -1;
+		fill_frame(frame->data, frame->size,
+				testdev_bytesperline(frame), frame->type);
+		return 0;
+	}
+
+#ifdef HAVE_JPEG
+	if (frame->fmt == V4L2_PIX_FMT_MJPEG ||
+			frame->fmt == V4L2_PIX_FMT_JPEG) {
+		frame->data = make_jpeg(frame->width, frame->height,
+				frame->type, &frame->size);
+		return frame->data ? 0 : -1;
+	}
+#endif
+
+	return -1;
+}
+
+int testdev_find_src_format(unsigned int fmt)
+{
+	int i;
+
+	for (i = 0; i < testdev_no_src_formats; i++)
+		if (testdev_src_formats[i].fmt == fmt)
+			return i;
+	return -1;
+}
+
+const char *fourcc(unsigned int fmt, char *buf)
+{
+	buf[0] = fmt & 0xff;
+	buf[1] = (fmt >> 8) & 0xff;
+	buf[2] = (fmt >> 16) & 0xff;
+	buf[3] = fmt >> 24;
+	buf[4] = 0;
+	return buf;
+}
+
+unsigned int parse_fourcc(const char *s)
+{
+	char buf[4] = { ' ', ' ', ' ', ' ' };
+
+	memcpy(buf, s, strnlen(s, 4));
+	return v4l2_fourcc(buf[0], buf[1], buf[2], buf[3]);
+}
+
+void set_ctrl(struct v4lconvert_data *data, int id, int value)
+{
+	struct v4l2_control ctrl = { .id = id, .value = value };
+
+	v4lconvert_vidioc_s_ctrl(data, &ctrl);
+}
@@ -0,0 +1,85 @@
+/*
+# Fake device and frame synthesis shared by the libv4lconvert test tools
+
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU Lesser General Public License as published by
+# the Free Software Foundation; either version 2.1 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU Lesser General Public License for more details.
+#
+# You should have received a copy of the GNU Lesser General Public License
+# along with this program; if not, write to the Free Software
+# Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA  02110-1335  USA
+ */
+
+#ifndef __V4LCONVERT_TESTDEV_H
+#define __V4LCONVERT_TESTDEV_H
+
+#include "../../lib/include/libv4lconvert.h"
+#include "../../lib/include/libv4l-plugin.h"
+
+#define ARRAY_SIZE(x) ((int)sizeof(x) / (int)sizeof((x)[0]))
+
+/* The source formats of libv4lconvert (see supported_src_pixfmts), bpp is
+   0 for compressed formats, of these only (M)JPEG can be synthesized.
+   align is what the width and height of synthesized frames should get
+   rounded down to, the vendor formats only come in the few resolutions of
+   their cameras, which are all multiples of 16. */
+struct testdev_src_format {
+	unsigned int fmt;
+	int bpp;
+	int align;
+};
+
+extern const struct testdev_src_format testdev_src_formats[];
+extern const int testdev_no_src_formats;
+
+/* The destination formats of libv4lconvert */
+extern const unsigned int testdev_dest_formats[];
+extern const int testdev_no_dest_formats;
+
+enum {
+	FRAME_GRADIENT,
+	FRAME_NOISE,
+	FRAME_FILE,
+};
+
+extern const char *testdev_frame_names[];
+
+struct frame {
+	unsigned int fmt;
+	int bpp;
+	int width;
+	int height;
+	int type;
+	const char *name;	/* Of the file for FRAME_FILE */
+	unsigned char *data;
+	int size;
+};
+
+/* The fake device, it offers the single format and resolution of frame.
+   libv4lcontrol keeps the control values of a device in shared memory
+   named after its bus_info, so tools running several instances of
+   libv4lconvert at once must give each of them its own bus_info. */
+extern struct frame *testdev_frame;
+extern const char *testdev_name;
+extern const char *testdev_bus_info;
+extern const struct libv4l_dev_ops testdev_dev_ops;
+
+int testdev_bytesperline(const struct frame *frame);
+int testdev_sizeimage(const struct frame *frame);
+
+/* Fills in the data and size of a frame with deterministic contents of its
+   type, returns -1 if we can't make one */
+int testdev_make_frame(struct frame *frame);
+
+int testdev_find_src_format(unsigned int fmt);
+const char *fourcc(unsigned int fmt, char *buf);
+unsigned int parse_fourcc(const char *s);
+void set_ctrl(struct v4lconvert_data *data, int id, int value);
+
+#endif
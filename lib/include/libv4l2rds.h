@@ -174,6 +174,44 @@ struct v4l2_rds {
 	struct v4l2_rds_af_set rds_af; 		/* Alternative Frequencies */
 };
 
+/* identifies a shared memory segment containing a struct v4l2_rds_shm */
+#define V4L2_RDS_SHM_MAGIC (0x52445348)	/* "RDSH" */
+
+/* struct to publish the state of a decoding process in shared memory */
+/* One process (e.g. rds-ctl --publish) decodes the RDS stream of a device
+ * and copies its handle into this structure after every received block.
+ * Any number of other processes can map the segment read-only and access
+ * the fields of rds directly, without syscalls. The sequence counter is odd
+ * while the writer is updating rds; readers have to enclose their accesses
+ * in v4l2_rds_shm_read_begin() and v4l2_rds_shm_read_retry(), a counter
+ * that stays odd means the writer died during an update */
+struct v4l2_rds_shm {
+	uint32_t magic;			/* V4L2_RDS_SHM_MAGIC */
+	uint32_t version;		/* V4L2_RDS_VERSION of the writer */
+	volatile uint32_t sequence;	/* incremented before and after
+					 * every update of rds */
+	uint32_t reserved;
+	struct v4l2_rds rds;		/* published RDS state */
+};
+
+/* struct to encapsulate the state of an RDS encoding process */
+/* The encoder turns the RDS info fields of a struct v4l2_rds (the same
+ * structure that is filled by the decoder) into a cyclic sequence of
+ * RDS groups. Only the fields marked in valid_fields of the source are
+ * transmitted, except for PI, PTY, TP and PS, which are always sent.
+ * The structure is owned by the caller, the encoder never allocates memory */
+struct v4l2_rds_encoder {
+	const struct v4l2_rds *source;	/* RDS information to be encoded,
+					 * may be changed between groups */
+	uint8_t slot;			/* position in the group schedule */
+	uint8_t ps_segment;		/* next PS segment (0..3) */
+	uint8_t rt_segment;		/* next RT segment (0..15) */
+	uint8_t ptyn_segment;		/* next PTYN segment (0..1) */
+	uint8_t af_index;		/* next AF code to be transmitted */
+	bool lc_next;			/* send LC instead of ECC in the
+					 * next type 1A group */
+};
+
 /* v4l2_rds_init() - initializes a new decoding process
  * @is_rbds:	defines which standard is used: true=RBDS, false=RDS
  *
@@ -211,6 +249,51 @@ LIBV4L_PUBLIC const char *v4l2_rds_get_coverage_str(const struct v4l2_rds *handl
 LIBV4L_PUBLIC const struct v4l2_rds_group *v4l2_rds_get_group
 	(const struct v4l2_rds *handle);
 
+/* initializes an encoding process for the RDS information in @source */
+LIBV4L_PUBLIC void v4l2_rds_encoder_init(struct v4l2_rds_encoder *enc,
+		const struct v4l2_rds *source);
+
+/* generates the next RDS group of the sequence
+ * @rds_group:	array of 4 blocks (A, B, C, D) that receives the group, in the
+ *		format used by write() on RDS capable V4L2 modulators
+ * @return:	the group type code (0..15) of the generated group */
+LIBV4L_PUBLIC uint8_t v4l2_rds_encode_group(struct v4l2_rds_encoder *enc,
+		struct v4l2_rds_data *rds_group);
+
+/* returns the 26 bit representation of an RDS block as it is transmitted:
+ * 16 information bits followed by the 10 bit checkword, which includes
+ * the offset word for the block id in @rds_data */
+LIBV4L_PUBLIC uint32_t v4l2_rds_get_raw_block(const struct v4l2_rds_data *rds_data);
+
+/* initializes a shared memory segment before it is published */
+LIBV4L_PUBLIC void v4l2_rds_shm_init(struct v4l2_rds_shm *shm);
+
+/* copies the current state of the decoding process into the segment
+ * there must be only one writer per segment */
+LIBV4L_PUBLIC void v4l2_rds_shm_publish(struct v4l2_rds_shm *shm,
+		const struct v4l2_rds *handle);
+
+/* starts a read access to the published state, waits if an update is in
+ * progress
+ * If the writer dies in the middle of an update, the sequence number stays
+ * odd and the state stays half updated for good. So the wait is bounded:
+ * after spinning and then yielding the cpu for a bounded number of times
+ * (a fraction of a second on an idle system, longer under load), this fails
+ * with ETIMEDOUT. The segment then is of no use until a new writer
+ * initializes it again.
+ * @sequence:	receives the sequence number that has to be passed to
+ *		v4l2_rds_shm_read_retry()
+ * @return:	0 on success, -1 with errno set to ETIMEDOUT if the update
+ *		in progress does not finish */
+LIBV4L_PUBLIC int v4l2_rds_shm_read_begin(const struct v4l2_rds_shm *shm,
+		uint32_t *sequence);
+
+/* ends a read access to the published state
+ * @return:	true, if the state was updated during the read access and
+ *		the values read have to be discarded */
+LIBV4L_PUBLIC bool v4l2_rds_shm_read_retry(const struct v4l2_rds_shm *shm,
+		uint32_t sequence);
+
 
 #ifdef __cplusplus
 }
@@ -96,6 +96,32 @@ LIBV4L_PUBLIC int v4lconvert_convert(struct v4lconvert_data *data,
 		const struct v4l2_format *dest_fmt, /* in */
 		unsigned char *src, int src_size, unsigned char *dest, int dest_size);
 
+/* Like v4lconvert_convert, but when the frame would be passed on unmodified
+   no copy is made, *frame then points to src instead of to dest.
+   return value of -1 on error, otherwise the amount of bytes at *frame */
+LIBV4L_PUBLIC int v4lconvert_convert_nocopy(struct v4lconvert_data *data,
+		const struct v4l2_format *src_fmt,  /* in */
+		const struct v4l2_format *dest_fmt, /* in */
+		unsigned char *src, int src_size, unsigned char *dest, int dest_size,
+		unsigned char **frame); /* out */
+
+/* Can the conversion be done in the source buffer itself? This is the case
+   when only flipping and / or video-processing of a native destination
+   format is needed. */
+LIBV4L_PUBLIC int v4lconvert_can_convert_inplace(struct v4lconvert_data *data,
+		const struct v4l2_format *src_fmt,   /* in */
+		const struct v4l2_format *dest_fmt); /* in */
+
+/* Convert the src_size bytes frame in buf in place, buf is buf_size bytes
+   large. Only valid if v4lconvert_can_convert_inplace() returns true.
+   Fails with EINVAL if buf_size is smaller than a frame of src_fmt, and with
+   EPIPE if src_size is (a short frame).
+   return value of -1 on error, otherwise the amount of bytes in buf */
+LIBV4L_PUBLIC int v4lconvert_convert_inplace(struct v4lconvert_data *data,
+		const struct v4l2_format *src_fmt,  /* in */
+		const struct v4l2_format *dest_fmt, /* in */
+		unsigned char *buf, int src_size, int buf_size);
+
 /* get a string describing the last error */
 LIBV4L_PUBLIC const char *v4lconvert_get_error_message(struct v4lconvert_data *data);
 
@@ -125,6 +151,66 @@ LIBV4L_PUBLIC int v4lconvert_supported_dst_format(unsigned int pixelformat);
 LIBV4L_PUBLIC int v4lconvert_get_fps(struct v4lconvert_data *data);
 LIBV4L_PUBLIC void v4lconvert_set_fps(struct v4lconvert_data *data, int fps);
 
+/* Set the number of threads conversions get split over, including the
+   calling thread. 1 disables threading, <= 0 means one thread per online
+   cpu. The default is 1, unless overridden by the LIBV4LCONVERT_THREADS
+   environment variable. Returns the number of threads actually used. */
+LIBV4L_PUBLIC int v4lconvert_set_threads(struct v4lconvert_data *data,
+		int threads);
+
+/* Make the libjpeg based JPEG decoder use the fast, but less accurate,
+   integer IDCT, useful for preview streams. The default is the accurate
+   one, unless overridden by the LIBV4LCONVERT_JPEG_FAST_DCT environment
+   variable. This has no effect on the tinyjpeg decoder. */
+LIBV4L_PUBLIC void v4lconvert_set_jpeg_fast_dct(struct v4lconvert_data *data,
+		int fast);
+
+/* Set the time in ms between updates of the software whitebalance, autogain
+   and gamma correction from the frame contents, 0 updates them every frame.
+   The default is 333, unless overridden by the
+   LIBV4LCONVERT_PROCESSING_UPDATE_MS environment variable. With threads
+   enabled the updates are done in the background. */
+LIBV4L_PUBLIC void v4lconvert_set_processing_update_period(
+		struct v4lconvert_data *data, int ms);
+
+/* Set about how many lines, spread evenly over the frame, the software
+   whitebalance and autogain gather their statistics from. Fewer lines make
+   the updates cheaper, more lines make them follow small details in the
+   picture, 0 uses every line. The default is 64, unless overridden by the
+   LIBV4LCONVERT_PROCESSING_STATS_LINES environment variable. */
+LIBV4L_PUBLIC void v4lconvert_set_processing_stats_lines(
+		struct v4lconvert_data *data, int lines);
+
+/* Filters for v4lconvert_set_scaling() */
+#define V4LCONVERT_SCALE_NONE		0
+#define V4LCONVERT_SCALE_BILINEAR	1
+#define V4LCONVERT_SCALE_AREA		2
+
+/* Make v4lconvert_try_format() accept resolutions the device does not
+   support (up to 4 times the closest one it does support), which then get
+   scaled from the closest resolution with the given filter. The source is
+   cropped to the aspect ratio of the destination first. The area filter
+   averages all source pixels covered by a destination pixel when
+   downscaling and is bilinear when upscaling. The default is
+   V4LCONVERT_SCALE_NONE: only a few well known resolutions get made by
+   cropping or adding a border, unless overridden by the LIBV4LCONVERT_SCALE
+   environment variable. */
+LIBV4L_PUBLIC void v4lconvert_set_scaling(struct v4lconvert_data *data,
+		int filter);
+
+/* Make v4lconvert_try_format() cache the results of the device's
+   VIDIOC_TRY_FMT. Only enable this when all ioctls on the device go through
+   code which calls v4lconvert_invalidate_format_cache() after anything
+   which may change what formats / resolutions the device offers, such as
+   VIDIOC_S_FMT, VIDIOC_S_PARM, VIDIOC_S_STD or VIDIOC_S_INPUT, as libv4l2
+   does. The default is off. */
+LIBV4L_PUBLIC void v4lconvert_set_format_cache(struct v4lconvert_data *data,
+		int enable);
+
+/* Drop all cached VIDIOC_TRY_FMT results, see above */
+LIBV4L_PUBLIC void v4lconvert_invalidate_format_cache(
+		struct v4lconvert_data *data);
+
 #ifdef __cplusplus
 }
 #endif /* __cplusplus */
@@ -508,9 +508,55 @@ static int v4l2_needs_conversion(int index)
 			&devices[index].src_fmt, &devices[index].dest_fmt);
 }
 
+/* When only flipping / processing of a native format is needed, we do this
+   in the drivers buffers, so that the app can use these directly and we do
+   not need to copy each frame to our conversion buffers */
+static int v4l2_converts_inplace(int index)
+{
+	return v4l2_needs_conversion(index) &&
+		v4lconvert_can_convert_inplace(devices[index].convert,
+				&devices[index].src_fmt, &devices[index].dest_fmt);
+}
+
+/* Does the app get our conversion buffers instead of the drivers buffers? */
+static int v4l2_needs_conversion_bufs(int index)
+{
+	return v4l2_needs_conversion(index) && !v4l2_converts_inplace(index);
+}
+
+static void v4l2_convert_inplace(int index, struct v4l2_buffer *buf)
+{
+	unsigned char *frame;
+	int result;
+
+	if (buf->memory == V4L2_MEMORY_USERPTR)
+		frame = (unsigned char *)buf->m.userptr;
+	else if (buf->index < devices[index].no_frames)
+		frame = devices[index].frame_pointers[buf->index];
+	else
+		frame = MAP_FAILED;
+
+	if (frame == MAP_FAILED) {
+		V4L2_LOG_ERR("no mapping of buf %u to convert in place\n", buf->index);
+		return;
+	}
+
+	result = v4lconvert_convert_inplace(devices[index].convert,
+			&devices[index].src_fmt, &devices[index].dest_fmt,
+			frame, buf->bytesused, buf->length);
+	if (result < 0) {
+		/* Leave the frame as is, it still is in the right format */
+		V4L2_LOG("warning error while converting frame data: %s",
+				v4lconvert_get_error_message(devices[index].convert));
+		return;
+	}
+
+	buf->bytesused = result;
+}
+
 static void v4l2_set_conversion_buf_params(int index, struct v4l2_buffer *buf)
 {
-	if (!v4l2_needs_conversion(index))
+	if (!v4l2_needs_conversion_bufs(index))
 		return;
 
 	/* This may happen if the ioctl failed */
@@ -529,8 +575,8 @@ static int v4l2_buffers_mapped(int index)
 {
 	unsigned int i;
 
-	if (!v4l2_needs_conversion(index)) {
-		/* Normal (no conversion) mode */
+	if (!v4l2_needs_conversion_bufs(index)) {
+		/* Normal (no conversion or in place conversion) mode */
 		struct v4l2_buffer buf;
 
 		for (i = 0; i < devices[index].no_frames; i++) {
@@ -743,6 +789,11 @@ no_capture:
 	   a fram erate using the S_PARM ioctl after a S_FMT */
 	if (devices[index].convert)
 		v4lconvert_set_fps(devices[index].convert, V4L2_DEFAULT_FPS);
+
+	/* We invalidate the TRY_FMT cache on everything which may change
+	   the device's formats, so it is safe to use */
+	if (devices[index].convert)
+		v4lconvert_set_format_cache(devices[index].convert, 1);
 	v4l2_update_fps(index, &parm);
 
 	V4L2_LOG("open: %d\n", fd);
@@ -947,6 +998,7 @@ static int v4l2_s_fmt(int index, struct v4l2_format *dest_fmt)
 	result = devices[index].dev_ops->ioctl(devices[index].dev_ops_priv,
 					       devices[index].fd,
 					       VIDIOC_S_FMT, &src_fmt);
+	v4lconvert_invalidate_format_cache(devices[index].convert);
 	if (result) {
 		int saved_err = errno;
 		V4L2_LOG_ERR("setting pixformat: %s\n", strerror(errno));
@@ -1177,6 +1229,8 @@ no_capture_request:
 		if (result)
 			break;
 
+		v4lconvert_invalidate_format_cache(devices[index].convert);
+
 		/* These ioctls may have changed the device's fmt */
 		src_fmt.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
 		result = devices[index].dev_ops->ioctl(
@@ -1270,8 +1324,11 @@ no_capture_request:
 				break;
 		}
 
-		/* With some drivers the buffers must be mapped before queuing */
-		if (v4l2_needs_conversion(index)) {
+		/* With some drivers the buffers must be mapped before queuing,
+		   when converting in place we need them mapped ourselves too */
+		if (v4l2_needs_conversion_bufs(index) ||
+				(v4l2_converts_inplace(index) &&
+				 buf->memory == V4L2_MEMORY_MMAP)) {
 			result = v4l2_map_buffers(index);
 			if (result)
 				break;
@@ -1294,7 +1351,7 @@ no_capture_request:
 				break;
 		}
 
-		if (!v4l2_needs_conversion(index)) {
+		if (!v4l2_needs_conversion_bufs(index)) {
 			result = devices[index].dev_ops->ioctl(
 					devices[index].dev_ops_priv,
 					fd, VIDIOC_DQBUF, buf);
@@ -1302,7 +1359,8 @@ no_capture_request:
 				saved_err = errno;
 				V4L2_LOG_ERR("dequeuing buf: %s\n", strerror(errno));
 				errno = saved_err;
-			}
+			} else if (v4l2_needs_conversion(index))
+				v4l2_convert_inplace(index, buf);
 			break;
 		}
 
@@ -1365,6 +1423,9 @@ no_capture_request:
 		result = devices[index].dev_ops->ioctl(
 						devices[index].dev_ops_priv,
 						fd, VIDIOC_S_PARM, parm);
+		/* Both the S_PARM and adjusting the src fmt for it may change
+		   what the device offers */
+		v4lconvert_invalidate_format_cache(devices[index].convert);
 		if (result)
 			break;
 
@@ -1569,7 +1630,7 @@ void *v4l2_mmap(void *start, size_t length, int prot, int flags, int fd,
 	buffer_index = offset & 0xff;
 	if (buffer_index >= devices[index].no_frames ||
 			/* Got magic offset and not converting ?? */
-			!v4l2_needs_conversion(index)) {
+			!v4l2_needs_conversion_bufs(index)) {
 		errno = EINVAL;
 		result = MAP_FAILED;
 		goto leave;
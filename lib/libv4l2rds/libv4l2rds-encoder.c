@@ -0,0 +1,284 @@
+/*
+ * RDS group encoder, the transmit side counterpart of the libv4l2rds decoder
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA  02110-1335  USA
+ */
+
+#include <string.h>
+#include <time.h>
+#include <config.h>
+
+#include <linux/videodev2.h>
+
+#include "../include/libv4l2rds.h"
+
+/* group types that are scheduled by the encoder, in order of transmission
+ * groups whose information is not valid in the source handle are replaced
+ * by a type 0A group, which carries the basic tuning information */
+static const uint8_t rds_group_schedule[] = {
+	0, 2, 0, 2, 0, 1, 0, 2, 0, 2, 0, 10, 0, 2, 0, 4
+};
+
+/* offset words added to the checkword of the blocks A, B, C, D and C'
+ * (IEC 62106 Annex A), indexed by V4L2_RDS_BLOCK_* */
+static const uint16_t rds_offset_word[5] = {
+	0x0fc, 0x198, 0x168, 0x1b4, 0x350
+};
+
+/* checkword contribution of each information bit, starting with bit 15
+ * these are the rows of the generator matrix for the polynomial
+ * x^10 + x^8 + x^7 + x^5 + x^4 + x^3 + 1 (IEC 62106 Annex B) */
+static const uint16_t rds_generator_matrix[16] = {
+	0x077, 0x2e7, 0x3af, 0x30b, 0x359, 0x370, 0x1b8, 0x0dc,
+	0x06e, 0x037, 0x2c7, 0x3bf, 0x303, 0x35d, 0x372, 0x1b9
+};
+
+/* DI bit transmitted with each of the 4 segments of a type 0A group,
+ * using the same bit order as the decoder */
+static const uint8_t rds_di_flag[4] = {
+	V4L2_RDS_FLAG_STEREO, V4L2_RDS_FLAG_ARTIFICIAL_HEAD,
+	V4L2_RDS_FLAG_COMPRESSED, V4L2_RDS_FLAG_STATIC_PTY
+};
+
+/* special AF codes (IEC 62106 section 6.2.1.6) */
+#define RDS_AF_FILLER		205
+#define RDS_AF_COUNT_BASE	224
+#define RDS_AF_LF_MF		250
+
+static inline void rds_set_block(struct v4l2_rds_data *rds_data, uint8_t block,
+		uint16_t value)
+{
+	rds_data->msb = value >> 8;
+	rds_data->lsb = value & 0xff;
+	rds_data->block = block;
+}
+
+/* returns the AF code at position @idx of the AF sequence of a type 0A
+ * group: the number of AFs, followed by the AFs in the order of the set.
+ * LF/MF frequencies are preceded by the LF/MF code, which always has to be
+ * transmitted in the first byte of block C */
+static uint8_t rds_get_af_code(const struct v4l2_rds_af_set *af_set, uint8_t idx)
+{
+	uint8_t size = af_set->size < MAX_AF_CNT ? af_set->size : MAX_AF_CNT;
+	uint8_t pos = 1;
+
+	if (idx == 0)
+		return RDS_AF_COUNT_BASE + size;
+
+	for (int i = 0; i < size; i++) {
+		uint32_t freq = af_set->af[i];
+
+		if (freq >= 87600000) {
+			if (pos++ == idx)
+				return (freq - 87500000) / 100000;
+			continue;
+		}
+		/* LF/MF code + frequency have to start on an even position */
+		if (pos & 1) {
+			if (pos++ == idx)
+				return RDS_AF_FILLER;
+		}
+		if (pos++ == idx)
+			return RDS_AF_LF_MF;
+		if (pos++ == idx) {
+			if (freq < 531000)
+				return (freq - 153000) / 9000 + 1;
+			return (freq - 531000) / 9000 + 16;
+		}
+	}
+	return RDS_AF_FILLER;
+}
+
+/* group 0: basic tuning and switching */
+static void rds_encode_group0(struct v4l2_rds_encoder *enc, struct v4l2_rds_data *grp)
+{
+	const struct v4l2_rds *src = enc->source;
+	uint8_t segment = enc->ps_segment;
+	uint16_t block_b = segment;
+	uint16_t block_c;
+	uint8_t af_hi, af_lo;
+
+	if (src->ta)
+		block_b |= 0x10;
+	if (src->ms)
+		block_b |= 0x08;
+	if (src->di & rds_di_flag[segment])
+		block_b |= 0x04;
+	grp[1].lsb |= block_b;
+
+	/* block C carries two AF codes, or filler codes if no AFs are defined */
+	if (src->valid_fields & V4L2_RDS_AF && src->rds_af.size) {
+		af_hi = rds_get_af_code(&src->rds_af, enc->af_index);
+		af_lo = rds_get_af_code(&src->rds_af, enc->af_index + 1);
+		/* restart the AF sequence once all AFs were transmitted */
+		enc->af_index += 2;
+		if (rds_get_af_code(&src->rds_af, enc->af_index) == RDS_AF_FILLER)
+			enc->af_index = 0;
+	} else {
+		af_hi = af_lo = RDS_AF_FILLER;
+	}
+	block_c = (af_hi << 8) | af_lo;
+	rds_set_block(&grp[2], V4L2_RDS_BLOCK_C, block_c);
+
+	/* block D carries two chars of the PS name */
+	rds_set_block(&grp[3], V4L2_RDS_BLOCK_D,
+		(src->ps[segment * 2] << 8) | src->ps[segment * 2 + 1]);
+	enc->ps_segment = (segment + 1) & 0x03;
+}
+
+/* group 1: slow labeling codes, alternating between ECC and language code */
+static void rds_encode_group1(struct v4l2_rds_encoder *enc, struct v4l2_rds_data *grp)
+{
+	const struct v4l2_rds *src = enc->source;
+	bool send_lc = enc->lc_next || !(src->valid_fields & V4L2_RDS_ECC);
+
+	if (!(src->valid_fields & V4L2_RDS_LC))
+		send_lc = false;
+	/* bits 12-14 of block C contain the variant code */
+	if (send_lc)
+		rds_set_block(&grp[2], V4L2_RDS_BLOCK_C, (0x03 << 12) | src->lc);
+	else
+		rds_set_block(&grp[2], V4L2_RDS_BLOCK_C, src->ecc);
+	/* block D contains the program item number, which is not supported */
+	rds_set_block(&grp[3], V4L2_RDS_BLOCK_D, 0);
+	enc->lc_next = !send_lc;
+}
+
+/* group 2: radio text, terminated by a carriage return if shorter than
+ * 64 chars */
+static void rds_encode_group2(struct v4l2_rds_encoder *enc, struct v4l2_rds_data *grp)
+{
+	const struct v4l2_rds *src = enc->source;
+	uint8_t length = src->rt_length < 64 ? src->rt_length : 64;
+	uint8_t segments = length < 64 ? length / 4 + 1 : 16;
+	uint8_t segment = enc->rt_segment;
+	uint8_t chars[4];
+
+	for (int i = 0; i < 4; i++) {
+		uint8_t pos = segment * 4 + i;
+
+		if (pos < length)
+			chars[i] = src->rt[pos];
+		else if (pos == length)
+			chars[i] = 0x0d;
+		else
+			chars[i] = ' ';
+	}
+	grp[1].lsb |= (src->rt_ab_flag ? 0x10 : 0x00) | segment;
+	rds_set_block(&grp[2], V4L2_RDS_BLOCK_C, (chars[0] << 8) | chars[1]);
+	rds_set_block(&grp[3], V4L2_RDS_BLOCK_D, (chars[2] << 8) | chars[3]);
+	enc->rt_segment = (segment + 1 < segments) ? segment + 1 : 0;
+}
+
+/* group 4: clock time and date, transmitted as UTC */
+static void rds_encode_group4(struct v4l2_rds_encoder *enc, struct v4l2_rds_data *grp)
+{
+	time_t t = enc->source->time;
+	/* the unix epoch is MJD 40587 */
+	uint32_t mjd = t / 86400 + 40587;
+	uint8_t hour = (t / 3600) % 24;
+	uint8_t minute = (t / 60) % 60;
+
+	grp[1].lsb |= (mjd >> 15) & 0x03;
+	rds_set_block(&grp[2], V4L2_RDS_BLOCK_C,
+		((mjd & 0x7fff) << 1) | (hour >> 4));
+	/* the local time offset is always 0 */
+	rds_set_block(&grp[3], V4L2_RDS_BLOCK_D,
+		((hour & 0x0f) << 12) | (minute << 6));
+}
+
+/* group 10: program type name */
+static void rds_encode_group10(struct v4l2_rds_encoder *enc, struct v4l2_rds_data *grp)
+{
+	const struct v4l2_rds *src = enc->source;
+	uint8_t segment = enc->ptyn_segment;
+	const uint8_t *chars = &src->ptyn[segment * 4];
+
+	grp[1].lsb |= (src->ptyn_ab_flag ? 0x10 : 0x00) | segment;
+	rds_set_block(&grp[2], V4L2_RDS_BLOCK_C, (chars[0] << 8) | chars[1]);
+	rds_set_block(&grp[3], V4L2_RDS_BLOCK_D, (chars[2] << 8) | chars[3]);
+	enc->ptyn_segment = !segment;
+}
+
+/* returns the group type that will be transmitted for a slot of the schedule */
+static uint8_t rds_select_group(const struct v4l2_rds *src, uint8_t group_id)
+{
+	switch (group_id) {
+	case 1:
+		return (src->valid_fields & (V4L2_RDS_ECC | V4L2_RDS_LC)) ? 1 : 0;
+	case 2:
+		return (src->valid_fields & V4L2_RDS_RT) ? 2 : 0;
+	case 4:
+		return (src->valid_fields & V4L2_RDS_TIME) ? 4 : 0;
+	case 10:
+		return (src->valid_fields & V4L2_RDS_PTYN) ? 10 : 0;
+	}
+	return 0;
+}
+
+void v4l2_rds_encoder_init(struct v4l2_rds_encoder *enc, const struct v4l2_rds *source)
+{
+	memset(enc, 0, sizeof(*enc));
+	enc->source = source;
+}
+
+uint8_t v4l2_rds_encode_group(struct v4l2_rds_encoder *enc, struct v4l2_rds_data *rds_group)
+{
+	const struct v4l2_rds *src = enc->source;
+	uint8_t group_id = rds_select_group(src,
+		rds_group_schedule[enc->slot]);
+
+	if (++enc->slot == sizeof(rds_group_schedule))
+		enc->slot = 0;
+
+	/* block A always contains the PI code, block B the group type, TP flag
+	 * and PTY code; all types are transmitted as version A groups */
+	rds_set_block(&rds_group[0], V4L2_RDS_BLOCK_A, src->pi);
+	rds_set_block(&rds_group[1], V4L2_RDS_BLOCK_B, (group_id << 12) |
+		(src->tp ? 0x0400 : 0) | ((src->pty & 0x1f) << 5));
+
+	switch (group_id) {
+	case 0:
+		rds_encode_group0(enc, rds_group);
+		break;
+	case 1:
+		rds_encode_group1(enc, rds_group);
+		break;
+	case 2:
+		rds_encode_group2(enc, rds_group);
+		break;
+	case 4:
+		rds_encode_group4(enc, rds_group);
+		break;
+	case 10:
+		rds_encode_group10(enc, rds_group);
+		break;
+	}
+	return group_id;
+}
+
+uint32_t v4l2_rds_get_raw_block(const struct v4l2_rds_data *rds_data)
+{
+	uint16_t info = (rds_data->msb << 8) | rds_data->lsb;
+	uint8_t block_id = rds_data->block & V4L2_RDS_BLOCK_MSK;
+	uint16_t checkword = 0;
+
+	for (int i = 0; i < 16; i++)
+		if (info & (0x8000 >> i))
+			checkword ^= rds_generator_matrix[i];
+	if (block_id <= V4L2_RDS_BLOCK_C_ALT)
+		checkword ^= rds_offset_word[block_id];
+	return ((uint32_t)info << 10) | checkword;
+}
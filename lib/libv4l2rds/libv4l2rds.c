@@ -18,6 +18,7 @@
  */
 
 #include <errno.h>
+#include <sched.h>
 #include <unistd.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -125,7 +126,7 @@ static uint32_t rds_decode_b(struct rds_private_state *priv_state, struct v4l2_r
 	grp->group_version = (rds_data->msb & 0x08) ? 'B' : 'A';
 
 	/* bit 10 (2 of msb) defines Traffic program Code */
-	traffic_prog = (bool)rds_data->msb & 0x04;
+	traffic_prog = rds_data->msb & 0x04;
 	if (handle->tp != traffic_prog) {
 		handle->tp = traffic_prog;
 		updated_fields |= V4L2_RDS_TP;
@@ -562,11 +563,12 @@ static time_t rds_decode_mjd(const struct rds_private_state *priv_state)
 	m = m - 1 - k*12;
 
 	/* put the values into a tm struct for conversion into time_t value */
+	memset(&new_time, 0, sizeof(new_time));
 	new_time.tm_sec = 0;
 	new_time.tm_min = local_minute;
 	new_time.tm_hour = local_hour;
 	new_time.tm_mday = d;
-	new_time.tm_mon = m;
+	new_time.tm_mon = m - 1;	/* tm_mon counts from 0 */
 	new_time.tm_year = y;
 	/* offset (submitted by RDS) that was used to compute the local time,
 	 * expressed in multiples of half hours, bit 5 indicates -/+ */
@@ -619,7 +621,6 @@ static uint32_t rds_decode_group4(struct rds_private_state *priv_state)
 	handle->time = rds_decode_mjd(priv_state);
 	updated_fields |= V4L2_RDS_TIME;
 	handle->valid_fields |= V4L2_RDS_TIME;
-	printf("\nLIB: time_t: %ld", handle->time);
 	return updated_fields;
 }
 
@@ -962,3 +963,49 @@ const struct v4l2_rds_group *v4l2_rds_get_group
 	struct rds_private_state *priv_state = (struct rds_private_state *) handle;
 	return &priv_state->rds_group;
 }
+
+void v4l2_rds_shm_init(struct v4l2_rds_shm *shm)
+{
+	memset(shm, 0, sizeof(*shm));
+	shm->magic = V4L2_RDS_SHM_MAGIC;
+	shm->version = V4L2_RDS_VERSION;
+}
+
+void v4l2_rds_shm_publish(struct v4l2_rds_shm *shm, const struct v4l2_rds *handle)
+{
+	/* an odd sequence number tells readers that an update is in progress */
+	shm->sequence++;
+	__sync_synchronize();
+	memcpy(&shm->rds, handle, sizeof(shm->rds));
+	__sync_synchronize();
+	shm->sequence++;
+}
+
+/* an update only takes a copy of struct v4l2_rds, so spin a bit first,
+ * then give the writer the cpu, and give up when it doesn't finish at all */
+#define V4L2_RDS_SHM_SPINS	1000
+#define V4L2_RDS_SHM_YIELDS	1000000
+
+int v4l2_rds_shm_read_begin(const struct v4l2_rds_shm *shm, uint32_t *sequence)
+{
+	int i;
+
+	for (i = 0; (*sequence = shm->sequence) & 1; i++) {
+		if (i < V4L2_RDS_SHM_SPINS)
+			continue;
+		if (i == V4L2_RDS_SHM_SPINS + V4L2_RDS_SHM_YIELDS) {
+			/* the writer died in the middle of an update */
+			errno = ETIMEDOUT;
+			return -1;
+		}
+		sched_yield();
+	}
+	__sync_synchronize();
+	return 0;
+}
+
+bool v4l2_rds_shm_read_retry(const struct v4l2_rds_shm *shm, uint32_t sequence)
+{
+	__sync_synchronize();
+	return shm->sequence != sequence;
+}
@@ -0,0 +1,447 @@
+/*
+# SIMD versions of the inner loops of the bayer demosaic routines
+
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU Lesser General Public License as published by
+# the Free Software Foundation; either version 2.1 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU Lesser General Public License for more details.
+#
+# You should have received a copy of the GNU Lesser General Public License
+# along with this program; if not, write to the Free Software
+# Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA  02110-1335  USA
+ */
+
+/*
+ * These do exactly the same as the inner loops in bayer.c. Each step
+ * converts a pair of pixels: pixel A in the middle of a 3x3 block, which
+ * has a known value for its own color, the cross average for the second and
+ * the diagonal average for the third color; and pixel B, which has a known
+ * value for its own color and the horizontal resp. vertical average for the
+ * others. Even and odd bytes of the 3 source lines give all values needed,
+ * so a block of 8 (16) pairs needs 2 overlapping loads per line.
+ *
+ * For the luma version the weights of bayer.c are applied with 32 bit
+ * multiply-adds, the rounding constant 524288 is added as 32 * 16384.
+ */
+
+#include "simd-funcs.h"
+
+#ifdef V4LCONVERT_HAVE_X86_SIMD
+
+/* Calculates the sums needed for 8 pixel pairs */
+static ALWAYS_INLINE __attribute__((target("sse2")))
+void bayer_sums_sse2(const unsigned char *bayer, int stride,
+		__m128i *diag, __m128i *cross, __m128i *vert, __m128i *horiz,
+		__m128i *ca, __m128i *cb)
+{
+	const __m128i lo8 = _mm_set1_epi16(0x00ff);
+	__m128i r0 = _mm_loadu_si128((const __m128i *)bayer);
+	__m128i r0b = _mm_loadu_si128((const __m128i *)(bayer + 2));
+	__m128i r1 = _mm_loadu_si128((const __m128i *)(bayer + stride));
+	__m128i r1b = _mm_loadu_si128((const __m128i *)(bayer + stride + 2));
+	__m128i r2 = _mm_loadu_si128((const __m128i *)(bayer + stride * 2));
+	__m128i r2b = _mm_loadu_si128((const __m128i *)(bayer + stride * 2 + 2));
+	__m128i e0 = _mm_and_si128(r0, lo8), o0 = _mm_srli_epi16(r0, 8);
+	__m128i e0b = _mm_and_si128(r0b, lo8);
+	__m128i e1 = _mm_and_si128(r1, lo8), o1 = _mm_srli_epi16(r1, 8);
+	__m128i e1b = _mm_and_si128(r1b, lo8), o1b = _mm_srli_epi16(r1b, 8);
+	__m128i e2 = _mm_and_si128(r2, lo8), o2 = _mm_srli_epi16(r2, 8);
+	__m128i e2b = _mm_and_si128(r2b, lo8);
+
+	*diag = _mm_add_epi16(_mm_add_epi16(e0, e0b), _mm_add_epi16(e2, e2b));
+	*cross = _mm_add_epi16(_mm_add_epi16(o0, e1), _mm_add_epi16(e1b, o2));
+	*vert = _mm_add_epi16(e0b, e2b);
+	*horiz = _mm_add_epi16(o1, o1b);
+	*ca = o1;
+	*cb = e1b;
+}
+
+/* Converts 8 pixel pairs */
+static ALWAYS_INLINE __attribute__((target("sse2")))
+void bayer_to_bgr24_16_sse2(const unsigned char *bayer, unsigned char *bgr,
+		int stride, int blue_line)
+{
+	const __m128i one = _mm_set1_epi16(1), two = _mm_set1_epi16(2);
+	__m128i diag, cross, vert, horiz, ca, cb, c0, c1, c2;
+
+	bayer_sums_sse2(bayer, stride, &diag, &cross, &vert, &horiz, &ca, &cb);
+	diag = _mm_srli_epi16(_mm_add_epi16(diag, two), 2);
+	cross = _mm_srli_epi16(_mm_add_epi16(cross, two), 2);
+	vert = _mm_srli_epi16(_mm_add_epi16(vert, one), 1);
+	horiz = _mm_srli_epi16(_mm_add_epi16(horiz, one), 1);
+
+	/* pixel A goes in the low, pixel B in the high byte */
+	c0 = _mm_or_si128(diag, _mm_slli_epi16(vert, 8));
+	c1 = _mm_or_si128(cross, _mm_slli_epi16(cb, 8));
+	c2 = _mm_or_si128(ca, _mm_slli_epi16(horiz, 8));
+	if (blue_line)
+		store_rgb24_sse2(bgr, c0, c1, c2);
+	else
+		store_rgb24_sse2(bgr, c2, c1, c0);
+}
+
+/* Returns (wx * x + wy * y + wz * z + 524288) >> 15 */
+static ALWAYS_INLINE __attribute__((target("sse2")))
+__m128i bayer_weigh_sse2(__m128i x, int wx, __m128i y, int wy, __m128i z, int wz)
+{
+	const __m128i rnd = _mm_set1_epi16(32);
+	const __m128i wxy = _mm_set1_epi32((wy << 16) | wx);
+	const __m128i wzr = _mm_set1_epi32((16384 << 16) | wz);
+	__m128i lo = _mm_add_epi32(_mm_madd_epi16(_mm_unpacklo_epi16(x, y), wxy),
+				   _mm_madd_epi16(_mm_unpacklo_epi16(z, rnd), wzr));
+	__m128i hi = _mm_add_epi32(_mm_madd_epi16(_mm_unpackhi_epi16(x, y), wxy),
+				   _mm_madd_epi16(_mm_unpackhi_epi16(z, rnd), wzr));
+
+	return _mm_packs_epi32(_mm_srai_epi32(lo, 15), _mm_srai_epi32(hi, 15));
+}
+
+/* Converts 8 pixel pairs */
+static ALWAYS_INLINE __attribute__((target("sse2")))
+void bayer_to_y_16_sse2(const unsigned char *bayer, unsigned char *y,
+		int stride, int blue_line)
+{
+	__m128i diag, cross, vert, horiz, ca, cb, a, b;
+
+	bayer_sums_sse2(bayer, stride, &diag, &cross, &vert, &horiz, &ca, &cb);
+	if (blue_line) {
+		a = bayer_weigh_sse2(ca, 8453, cross, 4148, diag, 806);
+		b = bayer_weigh_sse2(horiz, 4226, cb, 16594, vert, 1611);
+	} else {
+		a = bayer_weigh_sse2(diag, 2113, cross, 4148, ca, 3223);
+		b = bayer_weigh_sse2(vert, 4226, cb, 16594, horiz, 1611);
+	}
+	_mm_storeu_si128((__m128i *)y, _mm_or_si128(a, _mm_slli_epi16(b, 8)));
+}
+
+static ALWAYS_INLINE __attribute__((target("sse2")))
+int bayer_line_to_bgr24_sse2(const unsigned char *bayer, unsigned char *bgr,
+		int count, int stride, int blue_line)
+{
+	int i;
+
+	for (i = 0; i + 8 <= count; i += 8) {
+		bayer_to_bgr24_16_sse2(bayer, bgr, stride, blue_line);
+		bayer += 16;
+		bgr += 48;
+	}
+	return i;
+}
+
+static ALWAYS_INLINE __attribute__((target("sse2")))
+int bayer_line_to_y_sse2(const unsigned char *bayer, unsigned char *y,
+		int count, int stride, int blue_line)
+{
+	int i;
+
+	for (i = 0; i + 8 <= count; i += 8) {
+		bayer_to_y_16_sse2(bayer, y, stride, blue_line);
+		bayer += 16;
+		y += 16;
+	}
+	return i;
+}
+
+__attribute__((target("sse2")))
+int v4lconvert_bayer_line_to_bgr24_sse2(const unsigned char *bayer,
+		unsigned char *dest, int count, int stride, int blue_line)
+{
+	if (blue_line)
+		return bayer_line_to_bgr24_sse2(bayer, dest, count, stride, 1);
+	return bayer_line_to_bgr24_sse2(bayer, dest, count, stride, 0);
+}
+
+__attribute__((target("sse2")))
+int v4lconvert_bayer_line_to_y_sse2(const unsigned char *bayer,
+		unsigned char *dest, int count, int stride, int blue_line)
+{
+	if (blue_line)
+		return bayer_line_to_y_sse2(bayer, dest, count, stride, 1);
+	return bayer_line_to_y_sse2(bayer, dest, count, stride, 0);
+}
+
+/* Calculates the sums needed for 16 pixel pairs */
+static ALWAYS_INLINE __attribute__((target("avx2")))
+void bayer_sums_avx2(const unsigned char *bayer, int stride,
+		__m256i *diag, __m256i *cross, __m256i *vert, __m256i *horiz,
+		__m256i *ca, __m256i *cb)
+{
+	const __m256i lo8 = _mm256_set1_epi16(0x00ff);
+	__m256i r0 = _mm256_loadu_si256((const __m256i *)bayer);
+	__m256i r0b = _mm256_loadu_si256((const __m256i *)(bayer + 2));
+	__m256i r1 = _mm256_loadu_si256((const __m256i *)(bayer + stride));
+	__m256i r1b = _mm256_loadu_si256((const __m256i *)(bayer + stride + 2));
+	__m256i r2 = _mm256_loadu_si256((const __m256i *)(bayer + stride * 2));
+	__m256i r2b = _mm256_loadu_si256((const __m256i *)(bayer + stride * 2 + 2));
+	__m256i e0 = _mm256_and_si256(r0, lo8), o0 = _mm256_srli_epi16(r0, 8);
+	__m256i e0b = _mm256_and_si256(r0b, lo8);
+	__m256i e1 = _mm256_and_si256(r1, lo8), o1 = _mm256_srli_epi16(r1, 8);
+	__m256i e1b = _mm256_and_si256(r1b, lo8), o1b = _mm256_srli_epi16(r1b, 8);
+	__m256i e2 = _mm256_and_si256(r2, lo8), o2 = _mm256_srli_epi16(r2, 8);
+	__m256i e2b = _mm256_and_si256(r2b, lo8);
+
+	*diag = _mm256_add_epi16(_mm256_add_epi16(e0, e0b), _mm256_add_epi16(e2, e2b));
+	*cross = _mm256_add_epi16(_mm256_add_epi16(o0, e1), _mm256_add_epi16(e1b, o2));
+	*vert = _mm256_add_epi16(e0b, e2b);
+	*horiz = _mm256_add_epi16(o1, o1b);
+	*ca = o1;
+	*cb = e1b;
+}
+
+/* Converts 16 pixel pairs */
+static ALWAYS_INLINE __attribute__((target("avx2")))
+void bayer_to_bgr24_32_avx2(const unsigned char *bayer, unsigned char *bgr,
+		int stride, int blue_line)
+{
+	const __m256i one = _mm256_set1_epi16(1), two = _mm256_set1_epi16(2);
+	__m256i diag, cross, vert, horiz, ca, cb, c0, c1, c2;
+
+	bayer_sums_avx2(bayer, stride, &diag, &cross, &vert, &horiz, &ca, &cb);
+	diag = _mm256_srli_epi16(_mm256_add_epi16(diag, two), 2);
+	cross = _mm256_srli_epi16(_mm256_add_epi16(cross, two), 2);
+	vert = _mm256_srli_epi16(_mm256_add_epi16(vert, one), 1);
+	horiz = _mm256_srli_epi16(_mm256_add_epi16(horiz, one), 1);
+
+	c0 = _mm256_or_si256(diag, _mm256_slli_epi16(vert, 8));
+	c1 = _mm256_or_si256(cross, _mm256_slli_epi16(cb, 8));
+	c2 = _mm256_or_si256(ca, _mm256_slli_epi16(horiz, 8));
+	if (blue_line)
+		store_rgb24_avx2(bgr, c0, c1, c2);
+	else
+		store_rgb24_avx2(bgr, c2, c1, c0);
+}
+
+static ALWAYS_INLINE __attribute__((target("avx2")))
+__m256i bayer_weigh_avx2(__m256i x, int wx, __m256i y, int wy, __m256i z, int wz)
+{
+	const __m256i rnd = _mm256_set1_epi16(32);
+	const __m256i wxy = _mm256_set1_epi32((wy << 16) | wx);
+	const __m256i wzr = _mm256_set1_epi32((16384 << 16) | wz);
+	__m256i lo = _mm256_add_epi32(_mm256_madd_epi16(_mm256_unpacklo_epi16(x, y), wxy),
+				      _mm256_madd_epi16(_mm256_unpacklo_epi16(z, rnd), wzr));
+	__m256i hi = _mm256_add_epi32(_mm256_madd_epi16(_mm256_unpackhi_epi16(x, y), wxy),
+				      _mm256_madd_epi16(_mm256_unpackhi_epi16(z, rnd), wzr));
+
+	/* unpack and pack both work per 128 bit lane, so the order is kept */
+	return _mm256_packs_epi32(_mm256_srai_epi32(lo, 15), _mm256_srai_epi32(hi, 15));
+}
+
+/* Converts 16 pixel pairs */
+static ALWAYS_INLINE __attribute__((target("avx2")))
+void bayer_to_y_32_avx2(const unsigned char *bayer, unsigned char *y,
+		int stride, int blue_line)
+{
+	__m256i diag, cross, vert, horiz, ca, cb, a, b;
+
+	bayer_sums_avx2(bayer, stride, &diag, &cross, &vert, &horiz, &ca, &cb);
+	if (blue_line) {
+		a = bayer_weigh_avx2(ca, 8453, cross, 4148, diag, 806);
+		b = bayer_weigh_avx2(horiz, 4226, cb, 16594, vert, 1611);
+	} else {
+		a = bayer_weigh_avx2(diag, 2113, cross, 4148, ca, 3223);
+		b = bayer_weigh_avx2(vert, 4226, cb, 16594, horiz, 1611);
+	}
+	_mm256_storeu_si256((__m256i *)y, _mm256_or_si256(a, _mm256_slli_epi16(b, 8)));
+}
+
+static ALWAYS_INLINE __attribute__((target("avx2")))
+int bayer_line_to_bgr24_avx2(const unsigned char *bayer, unsigned char *bgr,
+		int count, int stride, int blue_line)
+{
+	int i;
+
+	for (i = 0; i + 16 <= count; i += 16) {
+		bayer_to_bgr24_32_avx2(bayer, bgr, stride, blue_line);
+		bayer += 32;
+		bgr += 96;
+	}
+	if (i + 8 <= count) {
+		bayer_to_bgr24_16_sse2(bayer, bgr, stride, blue_line);
+		i += 8;
+	}
+	return i;
+}
+
+static ALWAYS_INLINE __attribute__((target("avx2")))
+int bayer_line_to_y_avx2(const unsigned char *bayer, unsigned char *y,
+		int count, int stride, int blue_line)
+{
+	int i;
+
+	for (i = 0; i + 16 <= count; i += 16) {
+		bayer_to_y_32_avx2(bayer, y, stride, blue_line);
+		bayer += 32;
+		y += 32;
+	}
+	if (i + 8 <= count) {
+		bayer_to_y_16_sse2(bayer, y, stride, blue_line);
+		i += 8;
+	}
+	return i;
+}
+
+__attribute__((target("avx2")))
+int v4lconvert_bayer_line_to_bgr24_avx2(const unsigned char *bayer,
+		unsigned char *dest, int count, int stride, int blue_line)
+{
+	if (blue_line)
+		return bayer_line_to_bgr24_avx2(bayer, dest, count, stride, 1);
+	return bayer_line_to_bgr24_avx2(bayer, dest, count, stride, 0);
+}
+
+__attribute__((target("avx2")))
+int v4lconvert_bayer_line_to_y_avx2(const unsigned char *bayer,
+		unsigned char *dest, int count, int stride, int blue_line)
+{
+	if (blue_line)
+		return bayer_line_to_y_avx2(bayer, dest, count, stride, 1);
+	return bayer_line_to_y_avx2(bayer, dest, count, stride, 0);
+}
+#endif /* V4LCONVERT_HAVE_X86_SIMD */
+
+#ifdef V4LCONVERT_HAVE_NEON
+#include <arm_neon.h>
+
+/* Loads the even and odd bytes needed for 8 pixel pairs */
+static ALWAYS_INLINE
+void bayer_load_neon(const unsigned char *bayer, int stride,
+		uint8x8x2_t *r0, uint8x8x2_t *r0b, uint8x8x2_t *r1,
+		uint8x8x2_t *r1b, uint8x8x2_t *r2, uint8x8x2_t *r2b)
+{
+	*r0 = vld2_u8(bayer);
+	*r0b = vld2_u8(bayer + 2);
+	*r1 = vld2_u8(bayer + stride);
+	*r1b = vld2_u8(bayer + stride + 2);
+	*r2 = vld2_u8(bayer + stride * 2);
+	*r2b = vld2_u8(bayer + stride * 2 + 2);
+}
+
+/* Converts 8 pixel pairs */
+static ALWAYS_INLINE
+void bayer_to_bgr24_16_neon(const unsigned char *bayer, unsigned char *bgr,
+		int stride, int blue_line)
+{
+	uint8x8x2_t r0, r0b, r1, r1b, r2, r2b, c0, c1, c2;
+	uint8x8_t diag, cross, vert, horiz;
+	uint8x16x3_t out;
+
+	bayer_load_neon(bayer, stride, &r0, &r0b, &r1, &r1b, &r2, &r2b);
+	/* the rounding shifts and halving adds match (sum + n / 2) / n */
+	diag = vrshrn_n_u16(vaddq_u16(vaddl_u8(r0.val[0], r0b.val[0]),
+				      vaddl_u8(r2.val[0], r2b.val[0])), 2);
+	cross = vrshrn_n_u16(vaddq_u16(vaddl_u8(r0.val[1], r1.val[0]),
+				       vaddl_u8(r1b.val[0], r2.val[1])), 2);
+	vert = vrhadd_u8(r0b.val[0], r2b.val[0]);
+	horiz = vrhadd_u8(r1.val[1], r1b.val[1]);
+
+	/* put pixel A and B values in pixel order */
+	c0 = vzip_u8(diag, vert);
+	c1 = vzip_u8(cross, r1b.val[0]);
+	c2 = vzip_u8(r1.val[1], horiz);
+	out.val[1] = vcombine_u8(c1.val[0], c1.val[1]);
+	if (blue_line) {
+		out.val[0] = vcombine_u8(c0.val[0], c0.val[1]);
+		out.val[2] = vcombine_u8(c2.val[0], c2.val[1]);
+	} else {
+		out.val[0] = vcombine_u8(c2.val[0], c2.val[1]);
+		out.val[2] = vcombine_u8(c0.val[0], c0.val[1]);
+	}
+	vst3q_u8(bgr, out);
+}
+
+/* Returns (wx * x + wy * y + wz * z + 524288) >> 15 */
+static ALWAYS_INLINE
+uint8x8_t bayer_weigh_neon(uint16x8_t x, uint16_t wx, uint16x8_t y, uint16_t wy,
+		uint16x8_t z, uint16_t wz)
+{
+	const uint32x4_t rnd = vdupq_n_u32(524288);
+	uint32x4_t lo, hi;
+
+	lo = vmlal_n_u16(rnd, vget_low_u16(x), wx);
+	lo = vmlal_n_u16(lo, vget_low_u16(y), wy);
+	lo = vmlal_n_u16(lo, vget_low_u16(z), wz);
+	hi = vmlal_n_u16(rnd, vget_high_u16(x), wx);
+	hi = vmlal_n_u16(hi, vget_high_u16(y), wy);
+	hi = vmlal_n_u16(hi, vget_high_u16(z), wz);
+
+	return vmovn_u16(vcombine_u16(vshrn_n_u32(lo, 15), vshrn_n_u32(hi, 15)));
+}
+
+/* Converts 8 pixel pairs */
+static ALWAYS_INLINE
+void bayer_to_y_16_neon(const unsigned char *bayer, unsigned char *y,
+		int stride, int blue_line)
+{
+	uint8x8x2_t r0, r0b, r1, r1b, r2, r2b, out;
+	uint16x8_t diag, cross, vert, horiz, ca, cb;
+	uint8x8_t a, b;
+
+	bayer_load_neon(bayer, stride, &r0, &r0b, &r1, &r1b, &r2, &r2b);
+	diag = vaddq_u16(vaddl_u8(r0.val[0], r0b.val[0]),
+			 vaddl_u8(r2.val[0], r2b.val[0]));
+	cross = vaddq_u16(vaddl_u8(r0.val[1], r1.val[0]),
+			  vaddl_u8(r1b.val[0], r2.val[1]));
+	vert = vaddl_u8(r0b.val[0], r2b.val[0]);
+	horiz = vaddl_u8(r1.val[1], r1b.val[1]);
+	ca = vmovl_u8(r1.val[1]);
+	cb = vmovl_u8(r1b.val[0]);
+
+	if (blue_line) {
+		a = bayer_weigh_neon(ca, 8453, cross, 4148, diag, 806);
+		b = bayer_weigh_neon(horiz, 4226, cb, 16594, vert, 1611);
+	} else {
+		a = bayer_weigh_neon(diag, 2113, cross, 4148, ca, 3223);
+		b = bayer_weigh_neon(vert, 4226, cb, 16594, horiz, 1611);
+	}
+	out = vzip_u8(a, b);
+	vst1q_u8(y, vcombine_u8(out.val[0], out.val[1]));
+}
+
+static ALWAYS_INLINE
+int bayer_line_to_bgr24_neon(const unsigned char *bayer, unsigned char *bgr,
+		int count, int stride, int blue_line)
+{
+	int i;
+
+	for (i = 0; i + 8 <= count; i += 8) {
+		bayer_to_bgr24_16_neon(bayer, bgr, stride, blue_line);
+		bayer += 16;
+		bgr += 48;
+	}
+	return i;
+}
+
+static ALWAYS_INLINE
+int bayer_line_to_y_neon(const unsigned char *bayer, unsigned char *y,
+		int count, int stride, int blue_line)
+{
+	int i;
+
+	for (i = 0; i + 8 <= count; i += 8) {
+		bayer_to_y_16_neon(bayer, y, stride, blue_line);
+		bayer += 16;
+		y += 16;
+	}
+	return i;
+}
+
+int v4lconvert_bayer_line_to_bgr24_neon(const unsigned char *bayer,
+		unsigned char *dest, int count, int stride, int blue_line)
+{
+	if (blue_line)
+		return bayer_line_to_bgr24_neon(bayer, dest, count, stride, 1);
+	return bayer_line_to_bgr24_neon(bayer, dest, count, stride, 0);
+}
+
+int v4lconvert_bayer_line_to_y_neon(const unsigned char *bayer,
+		unsigned char *dest, int count, int stride, int blue_line)
+{
+	if (blue_line)
+		return bayer_line_to_y_neon(bayer, dest, count, stride, 1);
+	return bayer_line_to_y_neon(bayer, dest, count, stride, 0);
+}
+#endif /* V4LCONVERT_HAVE_NEON */
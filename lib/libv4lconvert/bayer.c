@@ -162,168 +162,261 @@ static void v4lconvert_border_bayer_line_to_bgr24(
 	}
 }
 
-/* From libdc1394, which on turn was based on OpenCV's Bayer decoding */
-static void bayer_to_rgbbgr24(const unsigned char *bayer,
-		unsigned char *bgr, int width, int height, const unsigned int stride, unsigned int pixfmt,
-		int start_with_green, int blue_line)
+/* The lines between the first and the last line do not depend on each
+   other, so these get split in bands which are converted by the worker
+   threads. This is only worth it for frames of a reasonable size. */
+#define BAYER_MIN_BAND_LINES 32
+
+struct bayer_job {
+	const unsigned char *bayer;
+	unsigned char *dest;
+	unsigned char *udst;
+	unsigned char *vdst;
+	int uv_step;		/* 2 when u and v are interleaved */
+	int width;
+	int height;
+	unsigned int stride;
+	unsigned int pixfmt;
+	int start_with_green;
+	int blue_line;
+	int no_bands;
+	v4lconvert_bayer_line_func line_func;
+};
+
+static struct v4lconvert_workers *bayer_get_workers(struct v4lconvert_data *data,
+		struct bayer_job *job)
 {
-	/* render the first line */
-	v4lconvert_border_bayer_line_to_bgr24(bayer, bayer + stride, bgr, width,
-			start_with_green, blue_line);
-	bgr += width * 3;
-
-	/* reduce height by 2 because of the special case top/bottom line */
-	for (height -= 2; height; height--) {
-		int t0, t1;
-		/* (width - 2) because of the border */
-		const unsigned char *bayer_end = bayer + (width - 2);
-
-		if (start_with_green) {
-
-			t0 = (bayer[1] + bayer[stride * 2 + 1] + 1) >> 1;
-			/* Write first pixel */
-			t1 = (bayer[0] + bayer[stride * 2] + bayer[stride + 1] + 1) / 3;
-			if (blue_line) {
-				*bgr++ = t0;
-				*bgr++ = t1;
-				*bgr++ = bayer[stride];
-			} else {
-				*bgr++ = bayer[stride];
-				*bgr++ = t1;
-				*bgr++ = t0;
-			}
+	struct v4lconvert_workers *workers = NULL;
+	int max_bands = job->height / BAYER_MIN_BAND_LINES;
+
+	job->no_bands = 1;
+	if (max_bands >= 2)
+		workers = data->workers;
+	if (workers) {
+		/* Use some more bands than threads to even out the load */
+		job->no_bands = v4lconvert_workers_threads(workers) * 2;
+		if (job->no_bands > max_bands)
+			job->no_bands = max_bands;
+	}
+	return workers;
+}
 
-			/* Write second pixel */
-			t1 = (bayer[stride] + bayer[stride + 2] + 1) >> 1;
-			if (blue_line) {
-				*bgr++ = t0;
-				*bgr++ = bayer[stride + 1];
-				*bgr++ = t1;
-			} else {
-				*bgr++ = t1;
-				*bgr++ = bayer[stride + 1];
-				*bgr++ = t0;
-			}
-			bayer++;
+/* Returns the first line of a band, the lines of the frame without the top
+   and bottom line are divided over the bands */
+static int bayer_band_start(const struct bayer_job *job, int band)
+{
+	return 1 + band * (job->height - 2) / job->no_bands;
+}
+
+/* From libdc1394, which on turn was based on OpenCV's Bayer decoding
+   Converts one line which is not the first or last line, bayer points to
+   the line above it */
+static void bayer_line_to_bgr24(const unsigned char *bayer,
+		unsigned char *bgr, int width, const unsigned int stride,
+		int start_with_green, int blue_line,
+		v4lconvert_bayer_line_func line_func)
+{
+	int t0, t1;
+	/* (width - 2) because of the border */
+	const unsigned char *bayer_end = bayer + (width - 2);
+
+	if (start_with_green) {
+
+		t0 = (bayer[1] + bayer[stride * 2 + 1] + 1) >> 1;
+		/* Write first pixel */
+		t1 = (bayer[0] + bayer[stride * 2] + bayer[stride + 1] + 1) / 3;
+		if (blue_line) {
+			*bgr++ = t0;
+			*bgr++ = t1;
+			*bgr++ = bayer[stride];
 		} else {
-			/* Write first pixel */
-			t0 = (bayer[0] + bayer[stride * 2] + 1) >> 1;
-			if (blue_line) {
-				*bgr++ = t0;
-				*bgr++ = bayer[stride];
-				*bgr++ = bayer[stride + 1];
-			} else {
-				*bgr++ = bayer[stride + 1];
-				*bgr++ = bayer[stride];
-				*bgr++ = t0;
-			}
+			*bgr++ = bayer[stride];
+			*bgr++ = t1;
+			*bgr++ = t0;
 		}
 
+		/* Write second pixel */
+		t1 = (bayer[stride] + bayer[stride + 2] + 1) >> 1;
 		if (blue_line) {
-			for (; bayer <= bayer_end - 2; bayer += 2) {
-				t0 = (bayer[0] + bayer[2] + bayer[stride * 2] +
-					bayer[stride * 2 + 2] + 2) >> 2;
-				t1 = (bayer[1] + bayer[stride] + bayer[stride + 2] +
-					bayer[stride * 2 + 1] + 2) >> 2;
-				*bgr++ = t0;
-				*bgr++ = t1;
-				*bgr++ = bayer[stride + 1];
-
-				t0 = (bayer[2] + bayer[stride * 2 + 2] + 1) >> 1;
-				t1 = (bayer[stride + 1] + bayer[stride + 3] + 1) >> 1;
-				*bgr++ = t0;
-				*bgr++ = bayer[stride + 2];
-				*bgr++ = t1;
-			}
+			*bgr++ = t0;
+			*bgr++ = bayer[stride + 1];
+			*bgr++ = t1;
 		} else {
-			for (; bayer <= bayer_end - 2; bayer += 2) {
-				t0 = (bayer[0] + bayer[2] + bayer[stride * 2] +
-					bayer[stride * 2 + 2] + 2) >> 2;
-				t1 = (bayer[1] + bayer[stride] + bayer[stride + 2] +
-					bayer[stride * 2 + 1] + 2) >> 2;
-				*bgr++ = bayer[stride + 1];
-				*bgr++ = t1;
-				*bgr++ = t0;
-
-				t0 = (bayer[2] + bayer[stride * 2 + 2] + 1) >> 1;
-				t1 = (bayer[stride + 1] + bayer[stride + 3] + 1) >> 1;
-				*bgr++ = t1;
-				*bgr++ = bayer[stride + 2];
-				*bgr++ = t0;
-			}
+			*bgr++ = t1;
+			*bgr++ = bayer[stride + 1];
+			*bgr++ = t0;
 		}
+		bayer++;
+	} else {
+		/* Write first pixel */
+		t0 = (bayer[0] + bayer[stride * 2] + 1) >> 1;
+		if (blue_line) {
+			*bgr++ = t0;
+			*bgr++ = bayer[stride];
+			*bgr++ = bayer[stride + 1];
+		} else {
+			*bgr++ = bayer[stride + 1];
+			*bgr++ = bayer[stride];
+			*bgr++ = t0;
+		}
+	}
+
+	if (line_func && bayer_end - bayer > 0) {
+		int done = line_func(bayer, bgr, (bayer_end - bayer) / 2, stride,
+				blue_line);
+
+		bayer += done * 2;
+		bgr += done * 6;
+	}
 
-		if (bayer < bayer_end) {
-			/* write second to last pixel */
+	if (blue_line) {
+		for (; bayer <= bayer_end - 2; bayer += 2) {
 			t0 = (bayer[0] + bayer[2] + bayer[stride * 2] +
 				bayer[stride * 2 + 2] + 2) >> 2;
 			t1 = (bayer[1] + bayer[stride] + bayer[stride + 2] +
 				bayer[stride * 2 + 1] + 2) >> 2;
-			if (blue_line) {
-				*bgr++ = t0;
-				*bgr++ = t1;
-				*bgr++ = bayer[stride + 1];
-			} else {
-				*bgr++ = bayer[stride + 1];
-				*bgr++ = t1;
-				*bgr++ = t0;
-			}
-			/* write last pixel */
+			*bgr++ = t0;
+			*bgr++ = t1;
+			*bgr++ = bayer[stride + 1];
+
 			t0 = (bayer[2] + bayer[stride * 2 + 2] + 1) >> 1;
-			if (blue_line) {
-				*bgr++ = t0;
-				*bgr++ = bayer[stride + 2];
-				*bgr++ = bayer[stride + 1];
-			} else {
-				*bgr++ = bayer[stride + 1];
-				*bgr++ = bayer[stride + 2];
-				*bgr++ = t0;
-			}
+			t1 = (bayer[stride + 1] + bayer[stride + 3] + 1) >> 1;
+			*bgr++ = t0;
+			*bgr++ = bayer[stride + 2];
+			*bgr++ = t1;
+		}
+	} else {
+		for (; bayer <= bayer_end - 2; bayer += 2) {
+			t0 = (bayer[0] + bayer[2] + bayer[stride * 2] +
+				bayer[stride * 2 + 2] + 2) >> 2;
+			t1 = (bayer[1] + bayer[stride] + bayer[stride + 2] +
+				bayer[stride * 2 + 1] + 2) >> 2;
+			*bgr++ = bayer[stride + 1];
+			*bgr++ = t1;
+			*bgr++ = t0;
 
-			bayer++;
+			t0 = (bayer[2] + bayer[stride * 2 + 2] + 1) >> 1;
+			t1 = (bayer[stride + 1] + bayer[stride + 3] + 1) >> 1;
+			*bgr++ = t1;
+			*bgr++ = bayer[stride + 2];
+			*bgr++ = t0;
+		}
+	}
 
+	if (bayer < bayer_end) {
+		/* write second to last pixel */
+		t0 = (bayer[0] + bayer[2] + bayer[stride * 2] +
+			bayer[stride * 2 + 2] + 2) >> 2;
+		t1 = (bayer[1] + bayer[stride] + bayer[stride + 2] +
+			bayer[stride * 2 + 1] + 2) >> 2;
+		if (blue_line) {
+			*bgr++ = t0;
+			*bgr++ = t1;
+			*bgr++ = bayer[stride + 1];
 		} else {
-			/* write last pixel */
-			t0 = (bayer[0] + bayer[stride * 2] + 1) >> 1;
-			t1 = (bayer[1] + bayer[stride * 2 + 1] + bayer[stride] + 1) / 3;
-			if (blue_line) {
-				*bgr++ = t0;
-				*bgr++ = t1;
-				*bgr++ = bayer[stride + 1];
-			} else {
-				*bgr++ = bayer[stride + 1];
-				*bgr++ = t1;
-				*bgr++ = t0;
-			}
+			*bgr++ = bayer[stride + 1];
+			*bgr++ = t1;
+			*bgr++ = t0;
+		}
+		/* write last pixel */
+		t0 = (bayer[2] + bayer[stride * 2 + 2] + 1) >> 1;
+		if (blue_line) {
+			*bgr++ = t0;
+			*bgr++ = bayer[stride + 2];
+			*bgr++ = bayer[stride + 1];
+		} else {
+			*bgr++ = bayer[stride + 1];
+			*bgr++ = bayer[stride + 2];
+			*bgr++ = t0;
+		}
 
+		bayer++;
+
+	} else {
+		/* write last pixel */
+		t0 = (bayer[0] + bayer[stride * 2] + 1) >> 1;
+		t1 = (bayer[1] + bayer[stride * 2 + 1] + bayer[stride] + 1) / 3;
+		if (blue_line) {
+			*bgr++ = t0;
+			*bgr++ = t1;
+			*bgr++ = bayer[stride + 1];
+		} else {
+			*bgr++ = bayer[stride + 1];
+			*bgr++ = t1;
+			*bgr++ = t0;
 		}
 
-		/* skip 2 border pixels and padding */
-		bayer += (stride - width) + 2;
+	}
+}
 
-		blue_line = !blue_line;
-		start_with_green = !start_with_green;
+static void bayer_to_rgbbgr24_band(void *arg, int band)
+{
+	const struct bayer_job *job = arg;
+	int y, last = bayer_band_start(job, band + 1);
+
+	for (y = bayer_band_start(job, band); y < last; y++) {
+		/* the bayer phase changes every line */
+		int odd = (y - 1) & 1;
+
+		bayer_line_to_bgr24(job->bayer + (y - 1) * job->stride,
+				job->dest + y * job->width * 3, job->width, job->stride,
+				job->start_with_green ^ odd, job->blue_line ^ odd,
+				job->line_func);
 	}
+}
+
+static void bayer_to_rgbbgr24(struct v4lconvert_data *data,
+		const unsigned char *bayer, unsigned char *bgr,
+		int width, int height, const unsigned int stride, unsigned int pixfmt,
+		int start_with_green, int blue_line)
+{
+	struct bayer_job job = {
+		.bayer = bayer,
+		.dest = bgr,
+		.width = width,
+		.height = height,
+		.stride = stride,
+		.pixfmt = pixfmt,
+		.start_with_green = start_with_green,
+		.blue_line = blue_line,
+		.line_func = v4lconvert_kernels.bayer_to_bgr24_line,
+	};
+	struct v4lconvert_workers *workers = bayer_get_workers(data, &job);
+
+	/* render the first line */
+	v4lconvert_border_bayer_line_to_bgr24(bayer, bayer + stride, bgr, width,
+			start_with_green, blue_line);
+
+	v4lconvert_workers_run(workers, bayer_to_rgbbgr24_band, &job,
+			job.no_bands);
 
 	/* render the last line */
+	if ((height - 2) & 1) {
+		blue_line = !blue_line;
+		start_with_green = !start_with_green;
+	}
+	bayer += (height - 2) * stride;
+	bgr += (height - 1) * width * 3;
 	v4lconvert_border_bayer_line_to_bgr24(bayer + stride, bayer, bgr, width,
 			!start_with_green, !blue_line);
 }
 
-void v4lconvert_bayer_to_rgb24(const unsigned char *bayer,
-		unsigned char *bgr, int width, int height, const unsigned int stride, unsigned int pixfmt)
+void v4lconvert_bayer_to_rgb24(struct v4lconvert_data *data,
+		const unsigned char *bayer, unsigned char *bgr,
+		int width, int height, const unsigned int stride, unsigned int pixfmt)
 {
-	bayer_to_rgbbgr24(bayer, bgr, width, height, stride, pixfmt,
+	bayer_to_rgbbgr24(data, bayer, bgr, width, height, stride, pixfmt,
 			pixfmt == V4L2_PIX_FMT_SGBRG8		/* start with green */
 			|| pixfmt == V4L2_PIX_FMT_SGRBG8,
 			pixfmt != V4L2_PIX_FMT_SBGGR8		/* blue line */
 			&& pixfmt != V4L2_PIX_FMT_SGBRG8);
 }
 
-void v4lconvert_bayer_to_bgr24(const unsigned char *bayer,
-		unsigned char *bgr, int width, int height, const unsigned int stride, unsigned int pixfmt)
+void v4lconvert_bayer_to_bgr24(struct v4lconvert_data *data,
+		const unsigned char *bayer, unsigned char *bgr,
+		int width, int height, const unsigned int stride, unsigned int pixfmt)
 {
-	bayer_to_rgbbgr24(bayer, bgr, width, height, stride, pixfmt,
+	bayer_to_rgbbgr24(data, bayer, bgr, width, height, stride, pixfmt,
 			pixfmt == V4L2_PIX_FMT_SGBRG8		/* start with green */
 			|| pixfmt == V4L2_PIX_FMT_SGRBG8,
 			pixfmt == V4L2_PIX_FMT_SBGGR8		/* blue line */
@@ -429,25 +522,18 @@ static void v4lconvert_border_bayer_line_to_y(
 	}
 }
 
-void v4lconvert_bayer_to_yuv420(const unsigned char *bayer, unsigned char *yuv,
-		int width, int height, const unsigned int stride, unsigned int src_pixfmt, int yvu)
+/* Calculates the u and v values of the 2x2 pixel blocks first - last - 1 */
+static void bayer_to_uv_lines(const struct bayer_job *job, int first, int last)
 {
-	int blue_line = 0, start_with_green = 0, x, y;
-	unsigned char *ydst = yuv;
-	unsigned char *udst, *vdst;
-
-	if (yvu) {
-		vdst = yuv + width * height;
-		udst = vdst + width * height / 4;
-	} else {
-		udst = yuv + width * height;
-		vdst = udst + width * height / 4;
-	}
+	const unsigned char *bayer = job->bayer + first * 2 * job->stride;
+	const unsigned int stride = job->stride;
+	int width = job->width, step = job->uv_step, x, y;
+	unsigned char *udst = job->udst + first * ((width + 1) / 2) * step;
+	unsigned char *vdst = job->vdst + first * ((width + 1) / 2) * step;
 
-	/* First calculate the u and v planes 2x2 pixels at a time */
-	switch (src_pixfmt) {
+	switch (job->pixfmt) {
 	case V4L2_PIX_FMT_SBGGR8:
-		for (y = 0; y < height; y += 2) {
+		for (y = first; y < last; y++) {
 			for (x = 0; x < width; x += 2) {
 				int b, g, r;
 
@@ -455,16 +541,17 @@ void v4lconvert_bayer_to_yuv420(const unsigned char *bayer, unsigned char *yuv,
 				g  = bayer[x + 1];
 				g += bayer[x + stride];
 				r  = bayer[x + stride + 1];
-				*udst++ = (-4878 * r - 4789 * g + 14456 * b + 4210688) >> 15;
-				*vdst++ = (14456 * r - 6052 * g -  2351 * b + 4210688) >> 15;
+				*udst = (-4878 * r - 4789 * g + 14456 * b + 4210688) >> 15;
+				*vdst = (14456 * r - 6052 * g -  2351 * b + 4210688) >> 15;
+				udst += step;
+				vdst += step;
 			}
 			bayer += 2 * stride;
 		}
-		blue_line = 1;
 		break;
 
 	case V4L2_PIX_FMT_SRGGB8:
-		for (y = 0; y < height; y += 2) {
+		for (y = first; y < last; y++) {
 			for (x = 0; x < width; x += 2) {
 				int b, g, r;
 
@@ -472,15 +559,17 @@ void v4lconvert_bayer_to_yuv420(const unsigned char *bayer, unsigned char *yuv,
 				g  = bayer[x + 1];
 				g += bayer[x + stride];
 				b  = bayer[x + stride + 1];
-				*udst++ = (-4878 * r - 4789 * g + 14456 * b + 4210688) >> 15;
-				*vdst++ = (14456 * r - 6052 * g -  2351 * b + 4210688) >> 15;
+				*udst = (-4878 * r - 4789 * g + 14456 * b + 4210688) >> 15;
+				*vdst = (14456 * r - 6052 * g -  2351 * b + 4210688) >> 15;
+				udst += step;
+				vdst += step;
 			}
 			bayer += 2 * stride;
 		}
 		break;
 
 	case V4L2_PIX_FMT_SGBRG8:
-		for (y = 0; y < height; y += 2) {
+		for (y = first; y < last; y++) {
 			for (x = 0; x < width; x += 2) {
 				int b, g, r;
 
@@ -488,17 +577,17 @@ void v4lconvert_bayer_to_yuv420(const unsigned char *bayer, unsigned char *yuv,
 				b  = bayer[x + 1];
 				r  = bayer[x + stride];
 				g += bayer[x + stride + 1];
-				*udst++ = (-4878 * r - 4789 * g + 14456 * b + 4210688) >> 15;
-				*vdst++ = (14456 * r - 6052 * g -  2351 * b + 4210688) >> 15;
+				*udst = (-4878 * r - 4789 * g + 14456 * b + 4210688) >> 15;
+				*vdst = (14456 * r - 6052 * g -  2351 * b + 4210688) >> 15;
+				udst += step;
+				vdst += step;
 			}
 			bayer += 2 * stride;
 		}
-		blue_line = 1;
-		start_with_green = 1;
 		break;
 
 	case V4L2_PIX_FMT_SGRBG8:
-		for (y = 0; y < height; y += 2) {
+		for (y = first; y < last; y++) {
 			for (x = 0; x < width; x += 2) {
 				int b, g, r;
 
@@ -506,128 +595,228 @@ void v4lconvert_bayer_to_yuv420(const unsigned char *bayer, unsigned char *yuv,
 				r  = bayer[x + 1];
 				b  = bayer[x + stride];
 				g += bayer[x + stride + 1];
-				*udst++ = (-4878 * r - 4789 * g + 14456 * b + 4210688) >> 15;
-				*vdst++ = (14456 * r - 6052 * g -  2351 * b + 4210688) >> 15;
+				*udst = (-4878 * r - 4789 * g + 14456 * b + 4210688) >> 15;
+				*vdst = (14456 * r - 6052 * g -  2351 * b + 4210688) >> 15;
+				udst += step;
+				vdst += step;
 			}
 			bayer += 2 * stride;
 		}
-		start_with_green = 1;
 		break;
 	}
+}
 
-	/* Point bayer back to start of frame */
-	bayer -= stride * height;
+/* Converts one line which is not the first or last line, bayer points to
+   the line above it */
+static void bayer_line_to_y(const unsigned char *bayer, unsigned char *ydst,
+		int width, const unsigned int stride, int start_with_green,
+		int blue_line, v4lconvert_bayer_line_func line_func)
+{
+	int t0, t1;
+	/* (width - 2) because of the border */
+	const unsigned char *bayer_end = bayer + (width - 2);
 
-	/* render the first line */
-	v4lconvert_border_bayer_line_to_y(bayer, bayer + stride, ydst, width,
-			start_with_green, blue_line);
-	ydst += width;
-
-	/* reduce height by 2 because of the border */
-	for (height -= 2; height; height--) {
-		int t0, t1;
-		/* (width - 2) because of the border */
-		const unsigned char *bayer_end = bayer + (width - 2);
-
-		if (start_with_green) {
-			t0 = bayer[1] + bayer[stride * 2 + 1];
-			/* Write first pixel */
-			t1 = bayer[0] + bayer[stride * 2] + bayer[stride + 1];
-			if (blue_line)
-				*ydst++ = (8453 * bayer[stride] + 5516 * t1 +
-						1661 * t0 + 524288) >> 15;
-			else
-				*ydst++ = (4226 * t0 + 5516 * t1 +
-						3223 * bayer[stride] + 524288) >> 15;
-
-			/* Write second pixel */
-			t1 = bayer[stride] + bayer[stride + 2];
-			if (blue_line)
-				*ydst++ = (4226 * t1 + 16594 * bayer[stride + 1] +
-						1611 * t0 + 524288) >> 15;
-			else
-				*ydst++ = (4226 * t0 + 16594 * bayer[stride + 1] +
-						1611 * t1 + 524288) >> 15;
-			bayer++;
-		} else {
-			/* Write first pixel */
-			t0 = bayer[0] + bayer[stride * 2];
-			if (blue_line) {
-				*ydst++ = (8453 * bayer[stride + 1] + 16594 * bayer[stride] +
-						1661 * t0 + 524288) >> 15;
-			} else {
-				*ydst++ = (4226 * t0 + 16594 * bayer[stride] +
-						3223 * bayer[stride + 1] + 524288) >> 15;
-			}
-		}
+	if (start_with_green) {
+		t0 = bayer[1] + bayer[stride * 2 + 1];
+		/* Write first pixel */
+		t1 = bayer[0] + bayer[stride * 2] + bayer[stride + 1];
+		if (blue_line)
+			*ydst++ = (8453 * bayer[stride] + 5516 * t1 +
+					1661 * t0 + 524288) >> 15;
+		else
+			*ydst++ = (4226 * t0 + 5516 * t1 +
+					3223 * bayer[stride] + 524288) >> 15;
 
+		/* Write second pixel */
+		t1 = bayer[stride] + bayer[stride + 2];
+		if (blue_line)
+			*ydst++ = (4226 * t1 + 16594 * bayer[stride + 1] +
+					1611 * t0 + 524288) >> 15;
+		else
+			*ydst++ = (4226 * t0 + 16594 * bayer[stride + 1] +
+					1611 * t1 + 524288) >> 15;
+		bayer++;
+	} else {
+		/* Write first pixel */
+		t0 = bayer[0] + bayer[stride * 2];
 		if (blue_line) {
-			for (; bayer <= bayer_end - 2; bayer += 2) {
-				t0 = bayer[0] + bayer[2] + bayer[stride * 2] + bayer[stride * 2 + 2];
-				t1 = bayer[1] + bayer[stride] + bayer[stride + 2] + bayer[stride * 2 + 1];
-				*ydst++ = (8453 * bayer[stride + 1] + 4148 * t1 +
-						806 * t0 + 524288) >> 15;
-
-				t0 = bayer[2] + bayer[stride * 2 + 2];
-				t1 = bayer[stride + 1] + bayer[stride + 3];
-				*ydst++ = (4226 * t1 + 16594 * bayer[stride + 2] +
-						1611 * t0 + 524288) >> 15;
-			}
+			*ydst++ = (8453 * bayer[stride + 1] + 16594 * bayer[stride] +
+					1661 * t0 + 524288) >> 15;
 		} else {
-			for (; bayer <= bayer_end - 2; bayer += 2) {
-				t0 = bayer[0] + bayer[2] + bayer[stride * 2] + bayer[stride * 2 + 2];
-				t1 = bayer[1] + bayer[stride] + bayer[stride + 2] + bayer[stride * 2 + 1];
-				*ydst++ = (2113 * t0 + 4148 * t1 +
-						3223 * bayer[stride + 1] + 524288) >> 15;
-
-				t0 = bayer[2] + bayer[stride * 2 + 2];
-				t1 = bayer[stride + 1] + bayer[stride + 3];
-				*ydst++ = (4226 * t0 + 16594 * bayer[stride + 2] +
-						1611 * t1 + 524288) >> 15;
-			}
+			*ydst++ = (4226 * t0 + 16594 * bayer[stride] +
+					3223 * bayer[stride + 1] + 524288) >> 15;
 		}
+	}
+
+	if (line_func && bayer_end - bayer > 0) {
+		int done = line_func(bayer, ydst, (bayer_end - bayer) / 2, stride,
+				blue_line);
 
-		if (bayer < bayer_end) {
-			/* Write second to last pixel */
+		bayer += done * 2;
+		ydst += done * 2;
+	}
+
+	if (blue_line) {
+		for (; bayer <= bayer_end - 2; bayer += 2) {
 			t0 = bayer[0] + bayer[2] + bayer[stride * 2] + bayer[stride * 2 + 2];
 			t1 = bayer[1] + bayer[stride] + bayer[stride + 2] + bayer[stride * 2 + 1];
-			if (blue_line)
-				*ydst++ = (8453 * bayer[stride + 1] + 4148 * t1 +
-						806 * t0 + 524288) >> 15;
-			else
-				*ydst++ = (2113 * t0 + 4148 * t1 +
-						3223 * bayer[stride + 1] + 524288) >> 15;
-
-			/* write last pixel */
+			*ydst++ = (8453 * bayer[stride + 1] + 4148 * t1 +
+					806 * t0 + 524288) >> 15;
+
 			t0 = bayer[2] + bayer[stride * 2 + 2];
-			if (blue_line) {
-				*ydst++ = (8453 * bayer[stride + 1] + 16594 * bayer[stride + 2] +
-						1661 * t0 + 524288) >> 15;
-			} else {
-				*ydst++ = (4226 * t0 + 16594 * bayer[stride + 2] +
-						3223 * bayer[stride + 1] + 524288) >> 15;
-			}
-			bayer++;
+			t1 = bayer[stride + 1] + bayer[stride + 3];
+			*ydst++ = (4226 * t1 + 16594 * bayer[stride + 2] +
+					1611 * t0 + 524288) >> 15;
+		}
+	} else {
+		for (; bayer <= bayer_end - 2; bayer += 2) {
+			t0 = bayer[0] + bayer[2] + bayer[stride * 2] + bayer[stride * 2 + 2];
+			t1 = bayer[1] + bayer[stride] + bayer[stride + 2] + bayer[stride * 2 + 1];
+			*ydst++ = (2113 * t0 + 4148 * t1 +
+					3223 * bayer[stride + 1] + 524288) >> 15;
+
+			t0 = bayer[2] + bayer[stride * 2 + 2];
+			t1 = bayer[stride + 1] + bayer[stride + 3];
+			*ydst++ = (4226 * t0 + 16594 * bayer[stride + 2] +
+					1611 * t1 + 524288) >> 15;
+		}
+	}
+
+	if (bayer < bayer_end) {
+		/* Write second to last pixel */
+		t0 = bayer[0] + bayer[2] + bayer[stride * 2] + bayer[stride * 2 + 2];
+		t1 = bayer[1] + bayer[stride] + bayer[stride + 2] + bayer[stride * 2 + 1];
+		if (blue_line)
+			*ydst++ = (8453 * bayer[stride + 1] + 4148 * t1 +
+					806 * t0 + 524288) >> 15;
+		else
+			*ydst++ = (2113 * t0 + 4148 * t1 +
+					3223 * bayer[stride + 1] + 524288) >> 15;
+
+		/* write last pixel */
+		t0 = bayer[2] + bayer[stride * 2 + 2];
+		if (blue_line) {
+			*ydst++ = (8453 * bayer[stride + 1] + 16594 * bayer[stride + 2] +
+					1661 * t0 + 524288) >> 15;
 		} else {
-			/* write last pixel */
-			t0 = bayer[0] + bayer[stride * 2];
-			t1 = bayer[1] + bayer[stride * 2 + 1] + bayer[stride];
-			if (blue_line)
-				*ydst++ = (8453 * bayer[stride + 1] + 5516 * t1 +
-						1661 * t0 + 524288) >> 15;
-			else
-				*ydst++ = (4226 * t0 + 5516 * t1 +
-						3223 * bayer[stride + 1] + 524288) >> 15;
+			*ydst++ = (4226 * t0 + 16594 * bayer[stride + 2] +
+					3223 * bayer[stride + 1] + 524288) >> 15;
 		}
+		bayer++;
+	} else {
+		/* write last pixel */
+		t0 = bayer[0] + bayer[stride * 2];
+		t1 = bayer[1] + bayer[stride * 2 + 1] + bayer[stride];
+		if (blue_line)
+			*ydst++ = (8453 * bayer[stride + 1] + 5516 * t1 +
+					1661 * t0 + 524288) >> 15;
+		else
+			*ydst++ = (4226 * t0 + 5516 * t1 +
+					3223 * bayer[stride + 1] + 524288) >> 15;
+	}
+}
+
+static void bayer_to_yuv420_band(void *arg, int band)
+{
+	const struct bayer_job *job = arg;
+	int y, last, pairs = (job->height + 1) / 2;
 
-		/* skip 2 border pixels and padding */
-		bayer += (stride - width) + 2;
+	bayer_to_uv_lines(job, band * pairs / job->no_bands,
+			(band + 1) * pairs / job->no_bands);
 
-		blue_line = !blue_line;
-		start_with_green = !start_with_green;
+	last = bayer_band_start(job, band + 1);
+	for (y = bayer_band_start(job, band); y < last; y++) {
+		int odd = (y - 1) & 1;
+
+		bayer_line_to_y(job->bayer + (y - 1) * job->stride,
+				job->dest + y * job->width, job->width, job->stride,
+				job->start_with_green ^ odd, job->blue_line ^ odd,
+				job->line_func);
+	}
+}
+
+static void bayer_to_yuv(struct v4lconvert_data *data,
+		const unsigned char *bayer, unsigned char *ydst,
+		unsigned char *udst, unsigned char *vdst, int uv_step,
+		int width, int height, const unsigned int stride, unsigned int src_pixfmt)
+{
+	int blue_line = 0, start_with_green = 0;
+	struct v4lconvert_workers *workers;
+	struct bayer_job job;
+
+	switch (src_pixfmt) {
+	case V4L2_PIX_FMT_SBGGR8:
+		blue_line = 1;
+		break;
+	case V4L2_PIX_FMT_SGBRG8:
+		blue_line = 1;
+		start_with_green = 1;
+		break;
+	case V4L2_PIX_FMT_SGRBG8:
+		start_with_green = 1;
+		break;
 	}
 
+	job = (struct bayer_job) {
+		.bayer = bayer,
+		.dest = ydst,
+		.udst = udst,
+		.vdst = vdst,
+		.uv_step = uv_step,
+		.width = width,
+		.height = height,
+		.stride = stride,
+		.pixfmt = src_pixfmt,
+		.start_with_green = start_with_green,
+		.blue_line = blue_line,
+		.line_func = v4lconvert_kernels.bayer_to_y_line,
+	};
+	workers = bayer_get_workers(data, &job);
+
+	/* The u and v planes get calculated 2x2 pixels at a time, together
+	   with the inner lines of the y plane */
+	v4lconvert_workers_run(workers, bayer_to_yuv420_band, &job,
+			job.no_bands);
+
+	/* render the first line */
+	v4lconvert_border_bayer_line_to_y(bayer, bayer + stride, ydst, width,
+			start_with_green, blue_line);
+
 	/* render the last line */
+	if ((height - 2) & 1) {
+		blue_line = !blue_line;
+		start_with_green = !start_with_green;
+	}
+	bayer += (height - 2) * stride;
+	ydst += (height - 1) * width;
 	v4lconvert_border_bayer_line_to_y(bayer + stride, bayer, ydst, width,
 			!start_with_green, !blue_line);
 }
+
+void v4lconvert_bayer_to_yuv420(struct v4lconvert_data *data,
+		const unsigned char *bayer, unsigned char *yuv,
+		int width, int height, const unsigned int stride, unsigned int src_pixfmt, int yvu)
+{
+	unsigned char *udst, *vdst;
+
+	if (yvu) {
+		vdst = yuv + width * height;
+		udst = vdst + width * height / 4;
+	} else {
+		udst = yuv + width * height;
+		vdst = udst + width * height / 4;
+	}
+
+	bayer_to_yuv(data, bayer, yuv, udst, vdst, 1, width, height, stride,
+			src_pixfmt);
+}
+
+void v4lconvert_bayer_to_nv12(struct v4lconvert_data *data,
+		const unsigned char *bayer, unsigned char *nv12,
+		int width, int height, const unsigned int stride, unsigned int src_pixfmt, int nv21)
+{
+	unsigned char *uvdst = nv12 + width * height;
+
+	bayer_to_yuv(data, bayer, nv12, uvdst + nv21, uvdst + !nv21, 2,
+			width, height, stride, src_pixfmt);
+}
@@ -0,0 +1,153 @@
+/*
+# CPU feature detection and runtime selection of the SIMD kernels
+
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU Lesser General Public License as published by
+# the Free Software Foundation; either version 2.1 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU Lesser General Public License for more details.
+#
+# You should have received a copy of the GNU Lesser General Public License
+# along with this program; if not, write to the Free Software
+# Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA  02110-1335  USA
+ */
+
+#include <stdlib.h>
+#include <pthread.h>
+#include "libv4lconvert-priv.h"
+#include "tinyjpeg-internal.h"
+#if defined(__arm__) && defined(V4LCONVERT_HAVE_NEON)
+#include <sys/auxv.h>
+#endif
+
+/* Start with the C versions, so that all kernels can be used even before
+   v4lconvert_init_kernels() */
+struct v4lconvert_kernels v4lconvert_kernels = {
+	.hflip_line_rgb24 = v4lconvert_hflip_line_rgb24_c,
+	.hflip_line_8 = v4lconvert_hflip_line_8_c,
+	.rotate90_tile_rgb24 = v4lconvert_rotate90_tile_rgb24_c,
+	.rotate90_tile_8 = v4lconvert_rotate90_tile_8_c,
+	.lut_line_rgb24 = v4lconvert_lut_line_rgb24_c,
+	.lut_line_bayer = v4lconvert_lut_line_bayer_c,
+	.lut_line_yuv422 = v4lconvert_lut_line_yuv422_c,
+	.scale_line_v = v4lconvert_scale_line_v_c,
+	.sum_line = v4lconvert_sum_line_c,
+	.idct = tinyjpeg_idct_float,
+};
+
+static int v4lconvert_detect_cpu_flags(void)
+{
+	int flags = 0;
+
+	/* Allow forcing the C versions of all kernels for debugging */
+	if (getenv("LIBV4LCONVERT_NO_SIMD"))
+		return 0;
+
+#ifdef V4LCONVERT_HAVE_X86_SIMD
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("sse2"))
+		flags |= V4LCONVERT_CPU_SSE2;
+	if (__builtin_cpu_supports("ssse3"))
+		flags |= V4LCONVERT_CPU_SSSE3;
+	if (__builtin_cpu_supports("avx2"))
+		flags |= V4LCONVERT_CPU_AVX2;
+#endif
+#ifdef V4LCONVERT_HAVE_NEON
+#if defined(__arm__) && defined(HWCAP_ARM_NEON)
+	/* 32 bit arm builds may run on cpus without neon */
+	if (getauxval(AT_HWCAP) & HWCAP_ARM_NEON)
+		flags |= V4LCONVERT_CPU_NEON;
+#else
+	flags |= V4LCONVERT_CPU_NEON;
+#endif
+#endif
+	return flags;
+}
+
+static int v4lconvert_cpu_flags;
+static pthread_once_t v4lconvert_cpu_flags_once = PTHREAD_ONCE_INIT;
+static pthread_once_t v4lconvert_kernels_once = PTHREAD_ONCE_INIT;
+
+static void v4lconvert_init_cpu_flags(void)
+{
+	v4lconvert_cpu_flags = v4lconvert_detect_cpu_flags();
+}
+
+/* Returns a bitmask of the V4LCONVERT_CPU_* flags for the SIMD extensions
+   supported by both the build and the cpu we are running on */
+int v4lconvert_get_cpu_flags(void)
+{
+	pthread_once(&v4lconvert_cpu_flags_once, v4lconvert_init_cpu_flags);
+
+	return v4lconvert_cpu_flags;
+}
+
+static void v4lconvert_select_kernels(void)
+{
+	int cpu_flags = v4lconvert_get_cpu_flags();
+
+#ifdef V4LCONVERT_HAVE_X86_SIMD
+	if (cpu_flags & V4LCONVERT_CPU_SSE2) {
+		v4lconvert_kernels.yuv422_to_rgb24_line =
+			v4lconvert_yuv422_to_rgb24_line_sse2;
+		v4lconvert_kernels.bayer_to_bgr24_line =
+			v4lconvert_bayer_line_to_bgr24_sse2;
+		v4lconvert_kernels.bayer_to_y_line =
+			v4lconvert_bayer_line_to_y_sse2;
+		v4lconvert_kernels.ycbcr_to_rgb_line =
+			v4lconvert_ycbcr_to_rgb_line_sse2;
+		v4lconvert_kernels.rotate90_tile_8 =
+			v4lconvert_rotate90_tile_8_sse2;
+		v4lconvert_kernels.scale_line_v = v4lconvert_scale_line_v_sse2;
+		v4lconvert_kernels.sum_line = v4lconvert_sum_line_sse2;
+		v4lconvert_kernels.idct = tinyjpeg_idct_islow_sse2;
+	}
+	if (cpu_flags & V4LCONVERT_CPU_SSSE3) {
+		v4lconvert_kernels.hflip_line_rgb24 =
+			v4lconvert_hflip_line_rgb24_ssse3;
+		v4lconvert_kernels.hflip_line_8 =
+			v4lconvert_hflip_line_8_ssse3;
+		v4lconvert_kernels.rotate90_tile_rgb24 =
+			v4lconvert_rotate90_tile_rgb24_ssse3;
+	}
+	if (cpu_flags & V4LCONVERT_CPU_AVX2) {
+		v4lconvert_kernels.yuv422_to_rgb24_line =
+			v4lconvert_yuv422_to_rgb24_line_avx2;
+		v4lconvert_kernels.bayer_to_bgr24_line =
+			v4lconvert_bayer_line_to_bgr24_avx2;
+		v4lconvert_kernels.bayer_to_y_line =
+			v4lconvert_bayer_line_to_y_avx2;
+		v4lconvert_kernels.hflip_line_8 = v4lconvert_hflip_line_8_avx2;
+		v4lconvert_kernels.lut_line_rgb24 =
+			v4lconvert_lut_line_rgb24_avx2;
+		v4lconvert_kernels.lut_line_bayer =
+			v4lconvert_lut_line_bayer_avx2;
+		v4lconvert_kernels.lut_line_yuv422 =
+			v4lconvert_lut_line_yuv422_avx2;
+		v4lconvert_kernels.scale_line_v = v4lconvert_scale_line_v_avx2;
+	}
+#endif
+#ifdef V4LCONVERT_HAVE_NEON
+	if (cpu_flags & V4LCONVERT_CPU_NEON) {
+		v4lconvert_kernels.yuv422_to_rgb24_line =
+			v4lconvert_yuv422_to_rgb24_line_neon;
+		v4lconvert_kernels.bayer_to_bgr24_line =
+			v4lconvert_bayer_line_to_bgr24_neon;
+		v4lconvert_kernels.bayer_to_y_line =
+			v4lconvert_bayer_line_to_y_neon;
+		v4lconvert_kernels.idct = tinyjpeg_idct_islow_neon;
+	}
+#endif
+}
+
+/* Sets the entries of v4lconvert_kernels to the fastest versions for this
+   cpu, called from v4lconvert_create(), which may run in several threads
+   at once */
+void v4lconvert_init_kernels(void)
+{
+	pthread_once(&v4lconvert_kernels_once, v4lconvert_select_kernels);
+}
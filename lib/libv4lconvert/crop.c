@@ -286,3 +286,310 @@ void v4lconvert_crop(unsigned char *src, unsigned char *dest,
 		break;
 	}
 }
+
+/* Single pass flip and crop. The flip is done first, so the area which gets
+   cropped, reduced or bordered is that of the flipped source. This gives
+   the same result as v4lconvert_flip followed by v4lconvert_crop, without
+   the intermediate frame. Returns -1 for the cases it cannot handle. */
+int v4lconvert_flip_crop_init(struct v4lconvert_flip_crop *fc,
+		const struct v4l2_format *src_fmt, const struct v4l2_format *dest_fmt,
+		int hflip, int vflip)
+{
+	int sw = src_fmt->fmt.pix.width, sh = src_fmt->fmt.pix.height;
+	int dw = dest_fmt->fmt.pix.width, dh = dest_fmt->fmt.pix.height;
+	int xmask = ~0, ymask = ~0;
+
+	fc->yuv420 = 0;
+	fc->nv12 = 0;
+	fc->yuyv = 0;
+
+	switch (dest_fmt->fmt.pix.pixelformat) {
+	case V4L2_PIX_FMT_RGB24:
+	case V4L2_PIX_FMT_BGR24:
+		fc->bpp = 3;
+		break;
+	case V4L2_PIX_FMT_NV12:
+	case V4L2_PIX_FMT_NV21:
+		fc->nv12 = 1;
+		/* fall through */
+	case V4L2_PIX_FMT_YUV420:
+	case V4L2_PIX_FMT_YVU420:
+		if ((sw | sh | dw | dh) & 1)
+			return -1;
+		fc->bpp = 1;
+		fc->yuv420 = 1;
+		xmask = ymask = ~1;
+		break;
+	case V4L2_PIX_FMT_YUYV:
+		if ((sw | dw) & 1)
+			return -1;
+		fc->bpp = 2;
+		fc->yuyv = 1;
+		xmask = ~1;
+		break;
+	default:
+		return -1;
+	}
+
+	fc->src_width = sw;
+	fc->src_height = sh;
+	fc->dest_width = dw;
+	fc->dest_height = dh;
+	fc->hflip = hflip;
+	fc->vflip = vflip;
+	fc->step = 1;
+	fc->dest_stride = dw * fc->bpp;
+
+	if (sw == dw && sh == dh) {
+		/* Flip only */
+		fc->startx = 0;
+		fc->starty = 0;
+		return 0;
+	}
+
+	if (sw <= dw && sh <= dh) {
+		/* Add a border, only when it is the same on both sides */
+		int borderx = ((dw - sw) / 2) & xmask;
+		int bordery = ((dh - sh) / 2) & ymask;
+
+		if (2 * borderx != dw - sw || 2 * bordery != dh - sh)
+			return -1;
+		fc->startx = -borderx;
+		fc->starty = -bordery;
+		fc->dest_stride = dest_fmt->fmt.pix.bytesperline;
+	} else if (sw >= 2 * dw && sh >= 2 * dh) {
+		/* Skipping every other pixel would mix the y values of different
+		   yuyv pixel pairs */
+		if (fc->yuyv)
+			return -1;
+		/* Skip every other pixel and line */
+		fc->startx = (sw / 2 - dw) & xmask;
+		fc->starty = (sh / 2 - dh) & ymask;
+		fc->step = 2;
+	} else {
+		fc->startx = ((sw - dw) / 2) & xmask;
+		fc->starty = ((sh - dh) / 2) & ymask;
+		if (fc->startx < 0 || fc->starty < 0)
+			return -1;
+		fc->dest_stride = dest_fmt->fmt.pix.bytesperline;
+	}
+
+	if (fc->dest_stride < dw * fc->bpp)
+		return -1;
+
+	return 0;
+}
+
+/* Returns the (flipped) source line for line y of a plane which is
+   subsampled by shift, or -1 if it is a border line */
+static int v4lconvert_flip_crop_src_line(const struct v4lconvert_flip_crop *fc,
+		int y, int shift)
+{
+	int src_height = fc->src_height >> shift;
+	int line = (fc->starty >> shift) + y * fc->step;
+
+	if (line < 0 || line >= src_height)
+		return -1;
+
+	return fc->vflip ? src_height - 1 - line : line;
+}
+
+/* Returns the range of source lines src_first - src_last - 1 needed for the
+   destination lines first - last - 1. For yuv420 the range is rounded to
+   whole chroma lines. src_last == src_first if no source lines are needed. */
+void v4lconvert_flip_crop_src_lines(const struct v4lconvert_flip_crop *fc,
+		int first, int last, int *src_first, int *src_last)
+{
+	int y, min = fc->src_height, max = -1;
+
+	for (y = first; y < last; y++) {
+		int line = v4lconvert_flip_crop_src_line(fc, y, 0);
+
+		if (line == -1)
+			continue;
+		if (line < min)
+			min = line;
+		if (line > max)
+			max = line;
+	}
+
+	if (max == -1) {
+		*src_first = *src_last = 0;
+		return;
+	}
+
+	if (fc->yuv420) {
+		min &= ~1;
+		max |= 1;
+	}
+	*src_first = min;
+	*src_last = max + 1;
+}
+
+/* The layout of one plane, its pixels are subsampled by xshift and yshift,
+   take bpp bytes and are set to fill for border pixels. For yuyv we work on
+   pairs of pixels, as these share their u and v values. */
+struct v4lconvert_flip_crop_plane {
+	int xshift;
+	int yshift;
+	int bpp;
+	unsigned char fill[4];
+};
+
+static const struct v4lconvert_flip_crop_plane v4lconvert_rgb_plane =
+	{ 0, 0, 3, { 0, 0, 0 } };
+static const struct v4lconvert_flip_crop_plane v4lconvert_y_plane =
+	{ 0, 0, 1, { 16 } };
+static const struct v4lconvert_flip_crop_plane v4lconvert_uv_plane =
+	{ 1, 1, 1, { 128 } };
+static const struct v4lconvert_flip_crop_plane v4lconvert_nv12_uv_plane =
+	{ 1, 1, 2, { 128, 128 } };
+static const struct v4lconvert_flip_crop_plane v4lconvert_yuyv_plane =
+	{ 1, 0, 4, { 16, 128, 16, 128 } };
+
+static void v4lconvert_flip_crop_fill(unsigned char *dest, int count,
+		const struct v4lconvert_flip_crop_plane *plane)
+{
+	/* Only the yuyv fill is not a single repeated byte */
+	if (plane->bpp != 4) {
+		memset(dest, plane->fill[0], count * plane->bpp);
+		return;
+	}
+
+	while (count--) {
+		memcpy(dest, plane->fill, 4);
+		dest += 4;
+	}
+}
+
+static void v4lconvert_flip_crop_copy(unsigned char *dest,
+		const unsigned char *src, int count, int step, int bpp)
+{
+	int i;
+
+	if (step == 1) {
+		memcpy(dest, src, count * bpp);
+	} else if (step == -1 && (bpp == 3 || bpp == 1)) {
+		src -= (count - 1) * bpp;
+		if (bpp == 3)
+			v4lconvert_kernels.hflip_line_rgb24(dest, src, count);
+		else
+			v4lconvert_kernels.hflip_line_8(dest, src, count);
+	} else if (bpp == 3) {
+		while (count--) {
+			dest[0] = src[0];
+			dest[1] = src[1];
+			dest[2] = src[2];
+			dest += 3;
+			src += step * 3;
+		}
+	} else if (bpp == 1) {
+		while (count--) {
+			*dest++ = *src;
+			src += step;
+		}
+	} else {
+		while (count--) {
+			for (i = 0; i < bpp; i++)
+				dest[i] = src[i];
+			dest += bpp;
+			src += step * bpp;
+		}
+	}
+}
+
+static void v4lconvert_flip_crop_plane(const struct v4lconvert_flip_crop *fc,
+		const struct v4lconvert_flip_crop_plane *plane,
+		const unsigned char *src, int src_stride, int src_first,
+		unsigned char *dest, int dest_stride, int first, int last)
+{
+	int bpp = plane->bpp;
+	int src_width = fc->src_width >> plane->xshift;
+	int dest_width = fc->dest_width >> plane->xshift;
+	int startx = fc->startx >> plane->xshift;
+	/* The range of destination pixels which are not border pixels */
+	int x_first = startx < 0 ? -startx : 0;
+	int x_last = fc->step == 1 && src_width - startx < dest_width ?
+		src_width - startx : dest_width;
+	int y, x, step = fc->hflip ? -fc->step : fc->step;
+
+	dest += first * dest_stride;
+	for (y = first; y < last; y++, dest += dest_stride) {
+		int line = v4lconvert_flip_crop_src_line(fc, y, plane->yshift);
+		const unsigned char *s;
+		unsigned char *d;
+
+		if (line == -1) {
+			v4lconvert_flip_crop_fill(dest, dest_width, plane);
+			continue;
+		}
+
+		x = startx + x_first * fc->step;
+		if (fc->hflip)
+			x = src_width - 1 - x;
+		s = src + (line - src_first) * src_stride + x * bpp;
+
+		v4lconvert_flip_crop_fill(dest, x_first, plane);
+		v4lconvert_flip_crop_copy(dest + x_first * bpp, s,
+				x_last - x_first, step, bpp);
+		v4lconvert_flip_crop_fill(dest + x_last * bpp,
+				dest_width - x_last, plane);
+
+		/* The 2 y values of a flipped yuyv pixel pair swap places */
+		if (fc->yuyv && fc->hflip)
+			for (d = dest + x_first * 4; d < dest + x_last * 4; d += 4) {
+				unsigned char tmp = d[0];
+
+				d[0] = d[2];
+				d[2] = tmp;
+			}
+	}
+}
+
+/* Does the flip and crop for the destination lines first - last - 1 (which
+   must be even for yuv420), src holds the source lines src_first -
+   src_first + src_lines - 1, followed by the chroma plane(s) for yuv420 */
+void v4lconvert_flip_crop_lines(const struct v4lconvert_flip_crop *fc,
+		const unsigned char *src, int src_stride, int src_first,
+		int src_lines, unsigned char *dest, int first, int last)
+{
+	int dest_stride = fc->dest_stride;
+
+	if (fc->yuyv) {
+		v4lconvert_flip_crop_plane(fc, &v4lconvert_yuyv_plane, src,
+				src_stride, src_first, dest, dest_stride,
+				first, last);
+		return;
+	}
+
+	if (!fc->yuv420) {
+		v4lconvert_flip_crop_plane(fc, &v4lconvert_rgb_plane, src,
+				src_stride, src_first, dest, dest_stride,
+				first, last);
+		return;
+	}
+
+	v4lconvert_flip_crop_plane(fc, &v4lconvert_y_plane, src, src_stride,
+			src_first, dest, dest_stride, first, last);
+
+	src += src_lines * src_stride;
+	dest += fc->dest_height * dest_stride;
+	if (fc->nv12) {
+		/* U and V interleaved, with the same stride as Y */
+		v4lconvert_flip_crop_plane(fc, &v4lconvert_nv12_uv_plane, src,
+				src_stride, src_first / 2, dest, dest_stride,
+				first / 2, last / 2);
+		return;
+	}
+
+	/* U and V */
+	v4lconvert_flip_crop_plane(fc, &v4lconvert_uv_plane, src,
+			src_stride / 2, src_first / 2, dest, dest_stride / 2,
+			first / 2, last / 2);
+
+	src += src_lines / 2 * src_stride / 2;
+	dest += fc->dest_height / 2 * dest_stride / 2;
+	v4lconvert_flip_crop_plane(fc, &v4lconvert_uv_plane, src,
+			src_stride / 2, src_first / 2, dest, dest_stride / 2,
+			first / 2, last / 2);
+}
@@ -0,0 +1,205 @@
+/*
+# SIMD versions of the flip and rotate kernels
+
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU Lesser General Public License as published by
+# the Free Software Foundation; either version 2.1 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU Lesser General Public License for more details.
+#
+# You should have received a copy of the GNU Lesser General Public License
+# along with this program; if not, write to the Free Software
+# Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA  02110-1335  USA
+ */
+
+/*
+ * Horizontal flipping reverses blocks of pixels with byte shuffles, taking
+ * the blocks from the end of the source line. For rgb24 a block of 16
+ * pixels is 3 vectors, each destination vector gets picked together from
+ * the (at most 3) source vectors its bytes come from.
+ *
+ * Rotating a tile 90 degrees clockwise is transposing it after reversing
+ * the order of its lines, which is done by simply loading the lines bottom
+ * up. 8 bit tiles are transposed with 4 rounds of interleaving line k with
+ * line k + 8, rgb24 tiles are transposed in blocks of 4x4 pixels, which are
+ * padded to 32 bits per pixel for the transposition.
+ */
+
+#include <string.h>
+#include "simd-funcs.h"
+
+#ifdef V4LCONVERT_HAVE_X86_SIMD
+
+__attribute__((target("ssse3")))
+void v4lconvert_hflip_line_8_ssse3(unsigned char *dest,
+		const unsigned char *src, int count)
+{
+	const __m128i reverse = _mm_setr_epi8(15, 14, 13, 12, 11, 10, 9, 8,
+			7, 6, 5, 4, 3, 2, 1, 0);
+	__m128i v;
+
+	for (; count >= 16; count -= 16) {
+		v = _mm_loadu_si128((const __m128i *)(src + count - 16));
+		_mm_storeu_si128((__m128i *)dest, _mm_shuffle_epi8(v, reverse));
+		dest += 16;
+	}
+	v4lconvert_hflip_line_8_c(dest, src, count);
+}
+
+__attribute__((target("avx2")))
+void v4lconvert_hflip_line_8_avx2(unsigned char *dest,
+		const unsigned char *src, int count)
+{
+	const __m256i reverse = _mm256_setr_epi8(15, 14, 13, 12, 11, 10, 9, 8,
+			7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8,
+			7, 6, 5, 4, 3, 2, 1, 0);
+	__m256i v;
+
+	for (; count >= 32; count -= 32) {
+		v = _mm256_loadu_si256((const __m256i *)(src + count - 32));
+		/* Reverse both 128 bit lanes, then swap them */
+		v = _mm256_shuffle_epi8(v, reverse);
+		_mm256_storeu_si256((__m256i *)dest,
+				_mm256_permute4x64_epi64(v, 0x4e));
+		dest += 32;
+	}
+	v4lconvert_hflip_line_8_ssse3(dest, src, count);
+}
+
+__attribute__((target("ssse3")))
+void v4lconvert_hflip_line_rgb24_ssse3(unsigned char *dest,
+		const unsigned char *src, int count)
+{
+	/* Masks for destination vector i from source vector j, bytes which
+	   come from an other source vector are set to -1 (zero) */
+	const __m128i m0_1 = _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1,
+			-1, -1, -1, -1, -1, -1, -1, 14);
+	const __m128i m0_2 = _mm_setr_epi8(13, 14, 15, 10, 11, 12, 7, 8,
+			9, 4, 5, 6, 1, 2, 3, -1);
+	const __m128i m1_0 = _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1,
+			-1, -1, -1, -1, -1, -1, 15, -1);
+	const __m128i m1_1 = _mm_setr_epi8(15, -1, 11, 12, 13, 8, 9, 10,
+			5, 6, 7, 2, 3, 4, -1, 0);
+	const __m128i m1_2 = _mm_setr_epi8(-1, 0, -1, -1, -1, -1, -1, -1,
+			-1, -1, -1, -1, -1, -1, -1, -1);
+	const __m128i m2_0 = _mm_setr_epi8(-1, 12, 13, 14, 9, 10, 11, 6,
+			7, 8, 3, 4, 5, 0, 1, 2);
+	const __m128i m2_1 = _mm_setr_epi8(1, -1, -1, -1, -1, -1, -1, -1,
+			-1, -1, -1, -1, -1, -1, -1, -1);
+	const unsigned char *s;
+	__m128i s0, s1, s2;
+
+	for (; count >= 16; count -= 16) {
+		s = src + 3 * (count - 16);
+		s0 = _mm_loadu_si128((const __m128i *)s);
+		s1 = _mm_loadu_si128((const __m128i *)(s + 16));
+		s2 = _mm_loadu_si128((const __m128i *)(s + 32));
+		_mm_storeu_si128((__m128i *)dest,
+				_mm_or_si128(_mm_shuffle_epi8(s1, m0_1),
+					_mm_shuffle_epi8(s2, m0_2)));
+		_mm_storeu_si128((__m128i *)(dest + 16),
+				_mm_or_si128(_mm_shuffle_epi8(s0, m1_0),
+					_mm_or_si128(_mm_shuffle_epi8(s1, m1_1),
+						_mm_shuffle_epi8(s2, m1_2))));
+		_mm_storeu_si128((__m128i *)(dest + 32),
+				_mm_or_si128(_mm_shuffle_epi8(s0, m2_0),
+					_mm_shuffle_epi8(s1, m2_1)));
+		dest += 48;
+	}
+	v4lconvert_hflip_line_rgb24_c(dest, src, count);
+}
+
+__attribute__((target("sse2")))
+void v4lconvert_rotate90_tile_8_sse2(unsigned char *dest, int dest_stride,
+		const unsigned char *src, int src_stride)
+{
+	__m128i a[16], b[16];
+	int i, round;
+
+	for (i = 0; i < 16; i++)
+		a[i] = _mm_loadu_si128((const __m128i *)
+				(src + (15 - i) * src_stride));
+
+	for (round = 0; round < 4; round += 2) {
+		for (i = 0; i < 8; i++) {
+			b[2 * i] = _mm_unpacklo_epi8(a[i], a[i + 8]);
+			b[2 * i + 1] = _mm_unpackhi_epi8(a[i], a[i + 8]);
+		}
+		for (i = 0; i < 8; i++) {
+			a[2 * i] = _mm_unpacklo_epi8(b[i], b[i + 8]);
+			a[2 * i + 1] = _mm_unpackhi_epi8(b[i], b[i + 8]);
+		}
+	}
+
+	for (i = 0; i < 16; i++)
+		_mm_storeu_si128((__m128i *)(dest + i * dest_stride), a[i]);
+}
+
+/* Loads resp. stores 4 rgb24 pixels without touching the bytes after them */
+static ALWAYS_INLINE __attribute__((target("sse2")))
+__m128i load_rgb24_4_sse2(const unsigned char *src)
+{
+	int last;
+
+	memcpy(&last, src + 8, 4);
+	return _mm_unpacklo_epi64(_mm_loadl_epi64((const __m128i *)src),
+			_mm_cvtsi32_si128(last));
+}
+
+static ALWAYS_INLINE __attribute__((target("sse2")))
+void store_rgb24_4_sse2(unsigned char *dest, __m128i x)
+{
+	int last = _mm_cvtsi128_si32(_mm_srli_si128(x, 8));
+
+	_mm_storel_epi64((__m128i *)dest, x);
+	memcpy(dest + 8, &last, 4);
+}
+
+__attribute__((target("ssse3")))
+void v4lconvert_rotate90_tile_rgb24_ssse3(unsigned char *dest,
+		int dest_stride, const unsigned char *src, int src_stride)
+{
+	const __m128i pad = _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1,
+			6, 7, 8, -1, 9, 10, 11, -1);
+	const __m128i unpad = _mm_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9,
+			10, 12, 13, 14, -1, -1, -1, -1);
+	const unsigned char *s;
+	unsigned char *d;
+	__m128i r0, r1, r2, r3, t0, t1, t2, t3;
+	int x, y;
+
+	/* The 4x4 block at x, y of the destination is the rotated block at
+	   y, 12 - x of the source */
+	for (y = 0; y < 16; y += 4)
+		for (x = 0; x < 16; x += 4) {
+			s = src + (15 - x) * src_stride + 3 * y;
+			d = dest + y * dest_stride + 3 * x;
+
+			r0 = _mm_shuffle_epi8(load_rgb24_4_sse2(s), pad);
+			r1 = _mm_shuffle_epi8(load_rgb24_4_sse2(s - src_stride), pad);
+			r2 = _mm_shuffle_epi8(load_rgb24_4_sse2(s - 2 * src_stride),
+					pad);
+			r3 = _mm_shuffle_epi8(load_rgb24_4_sse2(s - 3 * src_stride),
+					pad);
+
+			t0 = _mm_unpacklo_epi32(r0, r1);
+			t1 = _mm_unpacklo_epi32(r2, r3);
+			t2 = _mm_unpackhi_epi32(r0, r1);
+			t3 = _mm_unpackhi_epi32(r2, r3);
+
+			store_rgb24_4_sse2(d, _mm_shuffle_epi8(
+					_mm_unpacklo_epi64(t0, t1), unpad));
+			store_rgb24_4_sse2(d + dest_stride, _mm_shuffle_epi8(
+					_mm_unpackhi_epi64(t0, t1), unpad));
+			store_rgb24_4_sse2(d + 2 * dest_stride, _mm_shuffle_epi8(
+					_mm_unpacklo_epi64(t2, t3), unpad));
+			store_rgb24_4_sse2(d + 3 * dest_stride, _mm_shuffle_epi8(
+					_mm_unpackhi_epi64(t2, t3), unpad));
+		}
+}
+
+#endif /* V4LCONVERT_HAVE_X86_SIMD */
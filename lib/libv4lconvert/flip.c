@@ -23,6 +23,8 @@
 #include <string.h>
 #include "libv4lconvert-priv.h"
 
+#define MIN(a, b) (((a) < (b)) ? (a) : (b))
+
 static void v4lconvert_vflip_rgbbgr24(unsigned char *src, unsigned char *dest,
 		struct v4l2_format *fmt)
 {
@@ -36,50 +38,63 @@ static void v4lconvert_vflip_rgbbgr24(unsigned char *src, unsigned char *dest,
 	}
 }
 
+/* The U and V planes of yuv420 are a quarter of the Y plane apart, with odd
+   widths / heights that is a bit more than their width / 2 x height / 2
+   pixels, so the planes get addressed from their start, as crop does */
+#define V4LCONVERT_UV_PLANE(buf, bpl, height, plane) \
+	((buf) + (bpl) * (height) + (plane) * (bpl) * (height) / 4)
+
 static void v4lconvert_vflip_yuv420(unsigned char *src, unsigned char *dest,
 		struct v4l2_format *fmt)
 {
-	int y;
+	int width = fmt->fmt.pix.width, height = fmt->fmt.pix.height;
+	int bpl = fmt->fmt.pix.bytesperline;
+	unsigned char *s, *d;
+	int y, plane;
 
 	/* First flip the Y plane */
-	src += fmt->fmt.pix.height * fmt->fmt.pix.bytesperline;
-	for (y = 0; y < fmt->fmt.pix.height; y++) {
-		src -= fmt->fmt.pix.bytesperline;
-		memcpy(dest, src, fmt->fmt.pix.width);
-		dest += fmt->fmt.pix.width;
+	for (y = 0; y < height; y++)
+		memcpy(dest + y * width, src + (height - 1 - y) * bpl, width);
+
+	/* Then the U and V planes */
+	for (plane = 0; plane < 2; plane++) {
+		s = V4LCONVERT_UV_PLANE(src, bpl, height, plane);
+		d = V4LCONVERT_UV_PLANE(dest, width, height, plane);
+		for (y = 0; y < height / 2; y++)
+			memcpy(d + y * (width / 2),
+			       s + (height / 2 - 1 - y) * (bpl / 2), width / 2);
 	}
+}
 
-	/* Now flip the U plane */
-	src += fmt->fmt.pix.height * fmt->fmt.pix.bytesperline * 5 / 4;
-	for (y = 0; y < fmt->fmt.pix.height / 2; y++) {
-		src -= fmt->fmt.pix.bytesperline / 2;
-		memcpy(dest, src, fmt->fmt.pix.width / 2);
-		dest += fmt->fmt.pix.width / 2;
+void v4lconvert_hflip_line_rgb24_c(unsigned char *dest,
+		const unsigned char *src, int count)
+{
+	src += 3 * count;
+	while (count--) {
+		src -= 3;
+		dest[0] = src[0];
+		dest[1] = src[1];
+		dest[2] = src[2];
+		dest += 3;
 	}
+}
 
-	/* Last flip the V plane */
-	src += fmt->fmt.pix.height * fmt->fmt.pix.bytesperline / 2;
-	for (y = 0; y < fmt->fmt.pix.height / 2; y++) {
-		src -= fmt->fmt.pix.bytesperline / 2;
-		memcpy(dest, src, fmt->fmt.pix.width / 2);
-		dest += fmt->fmt.pix.width / 2;
-	}
+void v4lconvert_hflip_line_8_c(unsigned char *dest,
+		const unsigned char *src, int count)
+{
+	src += count;
+	while (count--)
+		*dest++ = *--src;
 }
 
 static void v4lconvert_hflip_rgbbgr24(unsigned char *src, unsigned char *dest,
 		struct v4l2_format *fmt)
 {
-	int x, y;
+	int y;
 
 	for (y = 0; y < fmt->fmt.pix.height; y++) {
-		src += fmt->fmt.pix.width * 3;
-		for (x = 0; x < fmt->fmt.pix.width; x++) {
-			src -= 3;
-			dest[0] = src[0];
-			dest[1] = src[1];
-			dest[2] = src[2];
-			dest += 3;
-		}
+		v4lconvert_kernels.hflip_line_rgb24(dest, src, fmt->fmt.pix.width);
+		dest += fmt->fmt.pix.width * 3;
 		src += fmt->fmt.pix.bytesperline;
 	}
 }
@@ -87,115 +102,150 @@ static void v4lconvert_hflip_rgbbgr24(unsigned char *src, unsigned char *dest,
 static void v4lconvert_hflip_yuv420(unsigned char *src, unsigned char *dest,
 		struct v4l2_format *fmt)
 {
-	int x, y;
+	int width = fmt->fmt.pix.width, height = fmt->fmt.pix.height;
+	int bpl = fmt->fmt.pix.bytesperline;
+	unsigned char *s, *d;
+	int y, plane;
 
 	/* First flip the Y plane */
-	for (y = 0; y < fmt->fmt.pix.height; y++) {
-		src += fmt->fmt.pix.width;
-		for (x = 0; x < fmt->fmt.pix.width; x++)
-			*dest++ = *--src;
-		src += fmt->fmt.pix.bytesperline;
-	}
-
-	/* Now flip the U plane */
-	for (y = 0; y < fmt->fmt.pix.height / 2; y++) {
-		src += fmt->fmt.pix.width / 2;
-		for (x = 0; x < fmt->fmt.pix.width / 2; x++)
-			*dest++ = *--src;
-		src += fmt->fmt.pix.bytesperline / 2;
-	}
-
-	/* Last flip the V plane */
-	for (y = 0; y < fmt->fmt.pix.height / 2; y++) {
-		src += fmt->fmt.pix.width / 2;
-		for (x = 0; x < fmt->fmt.pix.width / 2; x++)
-			*dest++ = *--src;
-		src += fmt->fmt.pix.bytesperline / 2;
+	for (y = 0; y < height; y++)
+		v4lconvert_kernels.hflip_line_8(dest + y * width,
+				src + y * bpl, width);
+
+	/* Then the U and V planes */
+	for (plane = 0; plane < 2; plane++) {
+		s = V4LCONVERT_UV_PLANE(src, bpl, height, plane);
+		d = V4LCONVERT_UV_PLANE(dest, width, height, plane);
+		for (y = 0; y < height / 2; y++)
+			v4lconvert_kernels.hflip_line_8(d + y * (width / 2),
+					s + y * (bpl / 2), width / 2);
 	}
 }
 
+/* Rotating 180 degrees is flipping the whole frame as if it was one line */
 static void v4lconvert_rotate180_rgbbgr24(const unsigned char *src,
 		unsigned char *dst, int width, int height)
 {
-	int i;
-
-	src += 3 * width * height - 3;
-
-	for (i = 0; i < width * height; i++) {
-		dst[0] = src[0];
-		dst[1] = src[1];
-		dst[2] = src[2];
-		dst += 3;
-		src -= 3;
-	}
+	v4lconvert_kernels.hflip_line_rgb24(dst, src, width * height);
 }
 
 static void v4lconvert_rotate180_yuv420(const unsigned char *src,
 		unsigned char *dst, int width, int height)
 {
-	int i;
+	int plane;
 
 	/* First flip x and y of the Y plane */
-	src += width * height - 1;
-	for (i = 0; i < width * height; i++)
-		*dst++ = *src--;
-
-	/* Now flip the U plane */
-	src += width * height * 5 / 4;
-	for (i = 0; i < width * height / 4; i++)
-		*dst++ = *src--;
-
-	/* Last flip the V plane */
-	src += width * height / 2;
-	for (i = 0; i < width * height / 4; i++)
-		*dst++ = *src--;
+	v4lconvert_kernels.hflip_line_8(dst, src, width * height);
+
+	/* Then the U and V planes */
+	for (plane = 0; plane < 2; plane++)
+		v4lconvert_kernels.hflip_line_8(
+				V4LCONVERT_UV_PLANE(dst, width, height, plane),
+				V4LCONVERT_UV_PLANE(src, width, height, plane),
+				(width / 2) * (height / 2));
 }
 
-static void v4lconvert_rotate90_rgbbgr24(const unsigned char *src,
-		unsigned char *dst, int destwidth, int destheight)
+void v4lconvert_rotate90_tile_rgb24_c(unsigned char *dest, int dest_stride,
+		const unsigned char *src, int src_stride)
+{
+	const int n = V4LCONVERT_ROTATE_TILE;
+	const unsigned char *s;
+	int x, y;
+
+	for (y = 0; y < n; y++) {
+		/* Destination line y is source column y, bottom up */
+		s = src + (n - 1) * src_stride + 3 * y;
+		for (x = 0; x < n; x++) {
+			dest[3 * x] = s[0];
+			dest[3 * x + 1] = s[1];
+			dest[3 * x + 2] = s[2];
+			s -= src_stride;
+		}
+		dest += dest_stride;
+	}
+}
+
+void v4lconvert_rotate90_tile_8_c(unsigned char *dest, int dest_stride,
+		const unsigned char *src, int src_stride)
 {
+	const int n = V4LCONVERT_ROTATE_TILE;
 	int x, y;
-#define srcwidth destheight
-#define srcheight destwidth
-
-	for (y = 0; y < destheight; y++)
-		for (x = 0; x < destwidth; x++) {
-			int offset = ((srcheight - x - 1) * srcwidth + y) * 3;
-			*dst++ = src[offset++];
-			*dst++ = src[offset++];
-			*dst++ = src[offset];
+
+	for (y = 0; y < n; y++) {
+		for (x = 0; x < n; x++)
+			dest[x] = src[(n - 1 - x) * src_stride + y];
+		dest += dest_stride;
+	}
+}
+
+/* Rotate the pixels x0 - x1 of the destination lines y0 - y1 one by one */
+static void v4lconvert_rotate90_rect(const unsigned char *src,
+		unsigned char *dst, int destwidth, int destheight, int bpp,
+		int x0, int x1, int y0, int y1)
+{
+	int x, y, i, offset;
+
+	for (y = y0; y < y1; y++)
+		for (x = x0; x < x1; x++) {
+			offset = ((destwidth - x - 1) * destheight + y) * bpp;
+			for (i = 0; i < bpp; i++)
+				dst[(y * destwidth + x) * bpp + i] =
+					src[offset + i];
 		}
 }
 
+/* Reading the source column wise touches a new cache line (and often a new
+   page) for every pixel, so the plane gets rotated in square tiles, which
+   keeps both the source and the destination lines of a tile in the cache.
+   The source of destination line y is source column y, read bottom up. */
+static void v4lconvert_rotate90_plane(const unsigned char *src,
+		unsigned char *dst, int destwidth, int destheight, int bpp,
+		v4lconvert_rotate90_tile_func rotate90_tile)
+{
+	const int n = V4LCONVERT_ROTATE_TILE;
+	int srcheight = destwidth, src_stride = destheight * bpp;
+	int x, y;
+
+	for (y = 0; y + n <= destheight; y += n) {
+		for (x = 0; x + n <= destwidth; x += n)
+			rotate90_tile(dst + (y * destwidth + x) * bpp,
+				destwidth * bpp,
+				src + (srcheight - n - x) * src_stride + y * bpp,
+				src_stride);
+		v4lconvert_rotate90_rect(src, dst, destwidth, destheight, bpp,
+				x, destwidth, y, y + n);
+	}
+	v4lconvert_rotate90_rect(src, dst, destwidth, destheight, bpp,
+			0, destwidth, y, destheight);
+}
+
+static void v4lconvert_rotate90_rgbbgr24(const unsigned char *src,
+		unsigned char *dst, int destwidth, int destheight)
+{
+	v4lconvert_rotate90_plane(src, dst, destwidth, destheight, 3,
+			v4lconvert_kernels.rotate90_tile_rgb24);
+}
+
 static void v4lconvert_rotate90_yuv420(const unsigned char *src,
 		unsigned char *dst, int destwidth, int destheight)
 {
-	int x, y;
+	int size = destwidth * destheight;
 
 	/* Y-plane */
-	for (y = 0; y < destheight; y++)
-		for (x = 0; x < destwidth; x++) {
-			int offset = (srcheight - x - 1) * srcwidth + y;
-			*dst++ = src[offset];
-		}
+	v4lconvert_rotate90_plane(src, dst, destwidth, destheight, 1,
+			v4lconvert_kernels.rotate90_tile_8);
 
 	/* U-plane */
-	src += srcwidth * srcheight;
-	destwidth /= 2;
-	destheight /= 2;
-	for (y = 0; y < destheight; y++)
-		for (x = 0; x < destwidth; x++) {
-			int offset = (srcheight - x - 1) * srcwidth + y;
-			*dst++ = src[offset];
-		}
+	src += size;
+	dst += size;
+	v4lconvert_rotate90_plane(src, dst, destwidth / 2, destheight / 2, 1,
+			v4lconvert_kernels.rotate90_tile_8);
 
 	/* V-plane */
-	src += srcwidth * srcheight;
-	for (y = 0; y < destheight; y++)
-		for (x = 0; x < destwidth; x++) {
-			int offset = (srcheight - x - 1) * srcwidth + y;
-			*dst++ = src[offset];
-		}
+	src += size / 4;
+	dst += size / 4;
+	v4lconvert_rotate90_plane(src, dst, destwidth / 2, destheight / 2, 1,
+			v4lconvert_kernels.rotate90_tile_8);
 }
 
 void v4lconvert_rotate90(unsigned char *src, unsigned char *dest,
@@ -265,3 +315,147 @@ void v4lconvert_flip(unsigned char *src, unsigned char *dest,
 	/* Our newly written data has no padding */
 	v4lconvert_fixup_fmt(fmt);
 }
+
+/* Horizontally flip a line of count interleaved u and v pairs (nv12 / nv21
+   chroma) */
+static void v4lconvert_hflip_line_uv(unsigned char *dest,
+		const unsigned char *src, int count)
+{
+	src += 2 * count;
+	while (count--) {
+		src -= 2;
+		dest[0] = src[0];
+		dest[1] = src[1];
+		dest += 2;
+	}
+}
+
+/* Horizontally flip a yuyv line, count is in pairs of pixels */
+static void v4lconvert_hflip_line_yuyv(unsigned char *dest,
+		const unsigned char *src, int count)
+{
+	src += 4 * count;
+	while (count--) {
+		src -= 4;
+		dest[0] = src[2];
+		dest[1] = src[1];
+		dest[2] = src[0];
+		dest[3] = src[3];
+		dest += 4;
+	}
+}
+
+/* In place flipping goes through a small bounce buffer of this many pixels */
+#define V4LCONVERT_FLIP_CHUNK 256
+
+/* Swap 2 lines of len bytes */
+static void v4lconvert_swap_lines(unsigned char *a, unsigned char *b, int len)
+{
+	unsigned char tmp[V4LCONVERT_FLIP_CHUNK * 4];
+	int n;
+
+	while (len) {
+		n = MIN(len, (int)sizeof(tmp));
+		memcpy(tmp, a, n);
+		memcpy(a, b, n);
+		memcpy(b, tmp, n);
+		a += n;
+		b += n;
+		len -= n;
+	}
+}
+
+/* Make line a the mirror image of line b and the other way around, or if
+   a == b mirror the line in place. bpp is the size of the pixels hflip_line
+   works on, at most 4 */
+static void v4lconvert_hflip_swap_lines(unsigned char *a, unsigned char *b,
+		int width, int bpp, v4lconvert_hflip_line_func hflip_line)
+{
+	unsigned char tmp[2 * V4LCONVERT_FLIP_CHUNK * 4];
+	int n, x;
+
+	if (a != b) {
+		for (x = 0; x < width; x += n) {
+			n = MIN(width - x, V4LCONVERT_FLIP_CHUNK);
+			memcpy(tmp, a + x * bpp, n * bpp);
+			hflip_line(a + x * bpp, b + (width - x - n) * bpp, n);
+			hflip_line(b + (width - x - n) * bpp, tmp, n);
+		}
+		return;
+	}
+
+	/* Swap chunks from both ends working towards the middle, until what is
+	   left fits in the bounce buffer */
+	n = V4LCONVERT_FLIP_CHUNK;
+	for (x = 0; width - 2 * x > 2 * n; x += n) {
+		unsigned char *right = a + (width - x - n) * bpp;
+
+		memcpy(tmp, a + x * bpp, n * bpp);
+		hflip_line(a + x * bpp, right, n);
+		hflip_line(right, tmp, n);
+	}
+	n = width - 2 * x;
+	memcpy(tmp, a + x * bpp, n * bpp);
+	hflip_line(a + x * bpp, tmp, n);
+}
+
+static void v4lconvert_flip_plane_inplace(unsigned char *buf, int width,
+		int height, int stride, int bpp, v4lconvert_hflip_line_func hflip_line,
+		int hflip, int vflip)
+{
+	unsigned char *a, *b;
+	int y;
+
+	/* With vflip line y gets swapped with line height - 1 - y, so we only
+	   need to walk the top half */
+	for (y = 0; y < (vflip ? (height + 1) / 2 : height); y++) {
+		a = buf + y * stride;
+		b = vflip ? buf + (height - 1 - y) * stride : a;
+		if (hflip)
+			v4lconvert_hflip_swap_lines(a, b, width, bpp, hflip_line);
+		else if (a != b)
+			v4lconvert_swap_lines(a, b, width * bpp);
+	}
+}
+
+void v4lconvert_flip_inplace(unsigned char *buf,
+		const struct v4l2_format *fmt, int hflip, int vflip)
+{
+	int width = fmt->fmt.pix.width;
+	int height = fmt->fmt.pix.height;
+	int bpl = fmt->fmt.pix.bytesperline;
+
+	if (!hflip && !vflip)
+		return;
+
+	switch (fmt->fmt.pix.pixelformat) {
+	case V4L2_PIX_FMT_RGB24:
+	case V4L2_PIX_FMT_BGR24:
+		v4lconvert_flip_plane_inplace(buf, width, height, bpl, 3,
+				v4lconvert_kernels.hflip_line_rgb24, hflip, vflip);
+		break;
+	case V4L2_PIX_FMT_YUV420:
+	case V4L2_PIX_FMT_YVU420:
+		v4lconvert_flip_plane_inplace(buf, width, height, bpl, 1,
+				v4lconvert_kernels.hflip_line_8, hflip, vflip);
+		buf += height * bpl;
+		v4lconvert_flip_plane_inplace(buf, width / 2, height / 2, bpl / 2, 1,
+				v4lconvert_kernels.hflip_line_8, hflip, vflip);
+		buf += height * bpl / 4;
+		v4lconvert_flip_plane_inplace(buf, width / 2, height / 2, bpl / 2, 1,
+				v4lconvert_kernels.hflip_line_8, hflip, vflip);
+		break;
+	case V4L2_PIX_FMT_NV12:
+	case V4L2_PIX_FMT_NV21:
+		v4lconvert_flip_plane_inplace(buf, width, height, bpl, 1,
+				v4lconvert_kernels.hflip_line_8, hflip, vflip);
+		buf += height * bpl;
+		v4lconvert_flip_plane_inplace(buf, width / 2, height / 2, bpl, 2,
+				v4lconvert_hflip_line_uv, hflip, vflip);
+		break;
+	case V4L2_PIX_FMT_YUYV:
+		v4lconvert_flip_plane_inplace(buf, width / 2, height, bpl, 4,
+				v4lconvert_hflip_line_yuyv, hflip, vflip);
+		break;
+	}
+}
@@ -24,11 +24,22 @@
  * SUCH DAMAGE.
  */
 
+/* When libv4lconvert passes a file descriptor of a shared memory object as
+   argument, the frame data gets exchanged through that instead of through
+   stdin / stdout. The source data is at the start of the shared memory and
+   the decompressed data goes to V4LCONVERT_HELPER_SHM_DEST(src_size). */
+#define V4LCONVERT_HELPER_SHM_DEST(src_size) (((src_size) + 63) & ~63)
+
+/* libv4lconvert itself only needs the above */
+#ifndef V4LCONVERT_HELPER_PROTOCOL_ONLY
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
 #include <errno.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 static int v4lconvert_helper_write(int fd, const void *b, size_t count,
   char *progname)
@@ -77,3 +88,60 @@ static int v4lconvert_helper_read(int fd, void *b, size_t count,
 
   return 0;
 }
+
+struct v4lconvert_helper_shm {
+  int fd;
+  unsigned char *mem;
+  size_t size;
+};
+
+static void v4lconvert_helper_shm_init(struct v4lconvert_helper_shm *shm,
+  int argc, char *argv[])
+{
+  shm->fd = argc > 1 ? strtol(argv[1], NULL, 10) : -1;
+  shm->mem = NULL;
+  shm->size = 0;
+}
+
+/* Returns the shared memory, mapping (more of) it when it is too small for
+   src_size bytes of source data plus dest_size bytes of decompressed data */
+static unsigned char *v4lconvert_helper_shm_map(
+  struct v4lconvert_helper_shm *shm, int src_size, int dest_size,
+  char *progname)
+{
+  size_t size = V4LCONVERT_HELPER_SHM_DEST(src_size) + dest_size;
+  struct stat st;
+
+  if (size <= shm->size)
+    return shm->mem;
+
+  if (shm->mem)
+    munmap(shm->mem, shm->size);
+  shm->mem = NULL;
+  shm->size = 0;
+
+  if (fstat(shm->fd, &st)) {
+    fprintf(stderr, "%s: error with shm fstat: %s\n", progname,
+      strerror(errno));
+    return NULL;
+  }
+  if (st.st_size < size) {
+    fprintf(stderr, "%s: error: shm too small, need: %d\n", progname,
+      (int)size);
+    return NULL;
+  }
+
+  shm->mem = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED,
+    shm->fd, 0);
+  if (shm->mem == MAP_FAILED) {
+    fprintf(stderr, "%s: error with shm mmap: %s\n", progname,
+      strerror(errno));
+    shm->mem = NULL;
+    return NULL;
+  }
+  shm->size = st.st_size;
+
+  return shm->mem;
+}
+
+#endif /* V4LCONVERT_HELPER_PROTOCOL_ONLY */
@@ -22,8 +22,13 @@
 #include <errno.h>
 #include <string.h>
 #include <signal.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <sys/wait.h>
 #include "libv4lconvert-priv.h"
+#define V4LCONVERT_HELPER_PROTOCOL_ONLY
+#include "helper-funcs.h"
 
 #define READ_END  0
 #define WRITE_END 1
@@ -46,11 +51,76 @@
    From the helper to libv4l the following is send:
    int			data length (-1 in case of a decompression error)
    unsigned char[]	data (not present when a decompression error happened)
+
+   To avoid pushing every frame through the pipes twice, the helper gets
+   passed the fd of a shared memory object as argument when possible. Then
+   the data is not send, instead the source data is put at the start of the
+   shared memory and the helper puts the decompressed data at
+   V4LCONVERT_HELPER_SHM_DEST(data length). The pipes then only carry the
+   lengths, telling the other side the data is there.
  */
 
+/* The shared memory object gets unlinked right away, only the helper
+   inherits its fd. Without it we fall back to sending the data through the
+   pipes. */
+static void v4lconvert_helper_shm_create(struct v4lconvert_data *data)
+{
+	char shm_name[64];
+
+	snprintf(shm_name, sizeof(shm_name), "/libv4lconvert-helper-%d-%p",
+			(int)getpid(), (void *)data);
+	data->decompress_shm_fd = shm_open(shm_name, O_CREAT | O_EXCL | O_RDWR,
+			S_IRUSR | S_IWUSR);
+	if (data->decompress_shm_fd == -1) {
+		V4LCONVERT_ERR("creating helper shm: %s, using pipes\n",
+				strerror(errno));
+		data->decompress_no_shm = 1;
+		return;
+	}
+	shm_unlink(shm_name);
+}
+
+/* Makes sure the shared memory can hold size bytes */
+static int v4lconvert_helper_shm_resize(struct v4lconvert_data *data,
+		size_t size)
+{
+	unsigned char *mem;
+
+	if (size <= data->decompress_shm_size)
+		return 0;
+
+	/* Leave room for the compressed frames getting a bit bigger */
+	size = (size + size / 8 + 65535) & ~(size_t)65535;
+
+	if (ftruncate(data->decompress_shm_fd, size)) {
+		V4LCONVERT_ERR("resizing helper shm: %s\n", strerror(errno));
+		return -1;
+	}
+
+	mem = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED,
+			data->decompress_shm_fd, 0);
+	if (mem == MAP_FAILED) {
+		V4LCONVERT_ERR("mapping helper shm: %s\n", strerror(errno));
+		return -1;
+	}
+
+	if (data->decompress_shm)
+		munmap(data->decompress_shm, data->decompress_shm_size);
+	data->decompress_shm = mem;
+	data->decompress_shm_size = size;
+
+	return 0;
+}
+
 static int v4lconvert_helper_start(struct v4lconvert_data *data,
 		const char *helper)
 {
+	char shm_fd[16];
+
+	if (data->decompress_shm_fd == -1 && !data->decompress_no_shm)
+		v4lconvert_helper_shm_create(data);
+	snprintf(shm_fd, sizeof(shm_fd), "%d", data->decompress_shm_fd);
+
 	if (pipe(data->decompress_in_pipe)) {
 		V4LCONVERT_ERR("with helper pipe: %s\n", strerror(errno));
 		goto error;
@@ -84,8 +154,17 @@ static int v4lconvert_helper_start(struct v4lconvert_data *data,
 			exit(1);
 		}
 
-		/* And execute the helper */
-		execl(helper, helper, NULL);
+		/* And execute the helper, passing it the shm fd. The parent
+		   does not send the frame data when it has shm, so not being
+		   able to pass it on is fatal */
+		if (data->decompress_shm_fd != -1) {
+			if (fcntl(data->decompress_shm_fd, F_SETFD, 0)) {
+				perror("libv4lconvert: error with helper shm fd");
+				exit(1);
+			}
+			execl(helper, helper, shm_fd, NULL);
+		} else
+			execl(helper, helper, NULL);
 
 		/* We should never get here */
 		perror("libv4lconvert: error starting helper");
@@ -169,13 +248,25 @@ int v4lconvert_helper_decompress(struct v4lconvert_data *data,
 		const char *helper, const unsigned char *src, int src_size,
 		unsigned char *dest, int dest_size, int width, int height, int flags)
 {
-	int r;
+	int r, dest_offset = V4LCONVERT_HELPER_SHM_DEST(src_size);
 
 	if (data->decompress_pid == -1) {
 		if (v4lconvert_helper_start(data, helper))
 			return -1;
 	}
 
+	/* When the shm cannot grow, restart the helper to use the pipes */
+	if (data->decompress_shm_fd != -1 &&
+	    v4lconvert_helper_shm_resize(data, dest_offset + dest_size)) {
+		v4lconvert_helper_cleanup(data);
+		data->decompress_no_shm = 1;
+		if (v4lconvert_helper_start(data, helper))
+			return -1;
+	}
+
+	if (data->decompress_shm_fd != -1)
+		memcpy(data->decompress_shm, src, src_size);
+
 	if (v4lconvert_helper_write(data, &width, sizeof(int)))
 		return -1;
 
@@ -188,7 +279,8 @@ int v4lconvert_helper_decompress(struct v4lconvert_data *data,
 	if (v4lconvert_helper_write(data, &src_size, sizeof(int)))
 		return -1;
 
-	if (v4lconvert_helper_write(data, src, src_size))
+	if (data->decompress_shm_fd == -1 &&
+			v4lconvert_helper_write(data, src, src_size))
 		return -1;
 
 	if (v4lconvert_helper_read(data, &r, sizeof(int)))
@@ -204,6 +296,11 @@ int v4lconvert_helper_decompress(struct v4lconvert_data *data,
 		return -1;
 	}
 
+	if (data->decompress_shm_fd != -1) {
+		memcpy(dest, data->decompress_shm + dest_offset, r);
+		return 0;
+	}
+
 	return v4lconvert_helper_read(data, dest, r);
 }
 
@@ -220,4 +317,14 @@ void v4lconvert_helper_cleanup(struct v4lconvert_data *data)
 
 		data->decompress_pid = -1;
 	}
+
+	if (data->decompress_shm_fd != -1) {
+		if (data->decompress_shm)
+			munmap(data->decompress_shm, data->decompress_shm_size);
+		close(data->decompress_shm_fd);
+
+		data->decompress_shm_fd = -1;
+		data->decompress_shm = NULL;
+		data->decompress_shm_size = 0;
+	}
 }
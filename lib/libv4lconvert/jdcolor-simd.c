@@ -0,0 +1,180 @@
+/*
+# SIMD YCbCr to RGB conversion for tinyjpeg
+
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU Lesser General Public License as published by
+# the Free Software Foundation; either version 2.1 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU Lesser General Public License for more details.
+#
+# You should have received a copy of the GNU Lesser General Public License
+# along with this program; if not, write to the Free Software
+# Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA  02110-1335  USA
+ */
+
+/*
+ * These give exactly the same results as the C version in tinyjpeg.c:
+ *   add_r = (FIX(1.40200) * cr + ONE_HALF) >> SCALEBITS
+ *   add_g = (-FIX(0.34414) * cb - FIX(0.71414) * cr + ONE_HALF) >> SCALEBITS
+ *   add_b = (FIX(1.77200) * cb + ONE_HALF) >> SCALEBITS
+ *   r = clamp(y + add_r), g = clamp(y + add_g), b = clamp(y + add_b)
+ * As y << SCALEBITS has no fractional bits, adding it after the shift is
+ * the same as adding it before. The chroma products are summed in 32 bits
+ * with pmaddwd, the unsigned saturating pack does the clamping.
+ */
+
+#include "simd-funcs.h"
+#include "tinyjpeg-internal.h"
+
+#define SCALEBITS	10
+#define ONE_HALF	(1 << (SCALEBITS - 1))
+#define FIX_0_34414	352
+#define FIX_0_71414	731
+#define FIX_1_40200	1436
+#define FIX_1_77200	1815
+
+#ifdef V4LCONVERT_HAVE_X86_SIMD
+
+/* The r, g and b offsets of 8 chroma sample pairs as 16 bit values */
+static ALWAYS_INLINE __attribute__((target("sse2")))
+void ycbcr_chroma_sse2(const unsigned char *cb, const unsigned char *cr,
+		__m128i *add_r, __m128i *add_g, __m128i *add_b)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i c128 = _mm_set1_epi16(128);
+	const __m128i one = _mm_set1_epi16(1);
+	const __m128i half = _mm_set1_epi32(ONE_HALF);
+	/* pmaddwd pairs: (cr, 1), (cb, cr) and (cb, 1) */
+	const __m128i k_r = _mm_set_epi16(ONE_HALF, FIX_1_40200,
+			ONE_HALF, FIX_1_40200, ONE_HALF, FIX_1_40200,
+			ONE_HALF, FIX_1_40200);
+	const __m128i k_g = _mm_set_epi16(-FIX_0_71414, -FIX_0_34414,
+			-FIX_0_71414, -FIX_0_34414, -FIX_0_71414, -FIX_0_34414,
+			-FIX_0_71414, -FIX_0_34414);
+	const __m128i k_b = _mm_set_epi16(ONE_HALF, FIX_1_77200,
+			ONE_HALF, FIX_1_77200, ONE_HALF, FIX_1_77200,
+			ONE_HALF, FIX_1_77200);
+	__m128i u, v, lo, hi;
+
+	u = _mm_sub_epi16(_mm_unpacklo_epi8(
+			_mm_loadl_epi64((const __m128i *)cb), zero), c128);
+	v = _mm_sub_epi16(_mm_unpacklo_epi8(
+			_mm_loadl_epi64((const __m128i *)cr), zero), c128);
+
+	lo = _mm_madd_epi16(_mm_unpacklo_epi16(v, one), k_r);
+	hi = _mm_madd_epi16(_mm_unpackhi_epi16(v, one), k_r);
+	*add_r = _mm_packs_epi32(_mm_srai_epi32(lo, SCALEBITS),
+			_mm_srai_epi32(hi, SCALEBITS));
+
+	lo = _mm_add_epi32(_mm_madd_epi16(_mm_unpacklo_epi16(u, v), k_g), half);
+	hi = _mm_add_epi32(_mm_madd_epi16(_mm_unpackhi_epi16(u, v), k_g), half);
+	*add_g = _mm_packs_epi32(_mm_srai_epi32(lo, SCALEBITS),
+			_mm_srai_epi32(hi, SCALEBITS));
+
+	lo = _mm_madd_epi16(_mm_unpacklo_epi16(u, one), k_b);
+	hi = _mm_madd_epi16(_mm_unpackhi_epi16(u, one), k_b);
+	*add_b = _mm_packs_epi32(_mm_srai_epi32(lo, SCALEBITS),
+			_mm_srai_epi32(hi, SCALEBITS));
+}
+
+/* Converts and stores 8 pixels, bpp 3 is rgb24 / bgr24, bpp 4 the V4L2
+   RGB32 (x r g b) resp. BGR32 (b g r x) byte order */
+static ALWAYS_INLINE __attribute__((target("sse2")))
+void ycbcr_store_8_sse2(const unsigned char *y, unsigned char *dest,
+		__m128i add_r, __m128i add_g, __m128i add_b, int bpp, int bgr)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i ff = _mm_set1_epi8(-1);
+	__m128i l, r, g, b, c0, c2, lo, hi;
+
+	l = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)y), zero);
+	r = _mm_packus_epi16(_mm_add_epi16(l, add_r), zero);
+	g = _mm_packus_epi16(_mm_add_epi16(l, add_g), zero);
+	b = _mm_packus_epi16(_mm_add_epi16(l, add_b), zero);
+	c0 = bgr ? b : r;
+	c2 = bgr ? r : b;
+
+	if (bpp == 3) {
+		__m128i c01 = _mm_unpacklo_epi8(c0, g);
+		__m128i c2z = _mm_unpacklo_epi8(c2, zero);
+		__m128i p0 = pack_rgb32_to_rgb24_sse2(_mm_unpacklo_epi16(c01, c2z));
+		__m128i p1 = pack_rgb32_to_rgb24_sse2(_mm_unpackhi_epi16(c01, c2z));
+
+		_mm_storeu_si128((__m128i *)dest,
+				_mm_or_si128(p0, _mm_slli_si128(p1, 12)));
+		_mm_storel_epi64((__m128i *)(dest + 16), _mm_srli_si128(p1, 4));
+		return;
+	}
+
+	if (bgr) {
+		lo = _mm_unpacklo_epi8(b, g);
+		hi = _mm_unpacklo_epi8(r, ff);
+	} else {
+		lo = _mm_unpacklo_epi8(ff, r);
+		hi = _mm_unpacklo_epi8(g, b);
+	}
+	_mm_storeu_si128((__m128i *)dest, _mm_unpacklo_epi16(lo, hi));
+	_mm_storeu_si128((__m128i *)(dest + 16), _mm_unpackhi_epi16(lo, hi));
+}
+
+static ALWAYS_INLINE __attribute__((target("sse2")))
+int ycbcr_to_rgb_line_sse2(const unsigned char *y, const unsigned char *cb,
+		const unsigned char *cr, unsigned char *dest, int width,
+		int hshift, int bpp, int bgr)
+{
+	__m128i add_r, add_g, add_b;
+	int j;
+
+	for (j = 0; j + (8 << hshift) <= width; j += 8 << hshift) {
+		ycbcr_chroma_sse2(cb + (j >> hshift), cr + (j >> hshift),
+				&add_r, &add_g, &add_b);
+		if (hshift) {
+			/* Each chroma sample pair is used for 2 pixels */
+			ycbcr_store_8_sse2(y + j, dest + j * bpp,
+					_mm_unpacklo_epi16(add_r, add_r),
+					_mm_unpacklo_epi16(add_g, add_g),
+					_mm_unpacklo_epi16(add_b, add_b), bpp, bgr);
+			ycbcr_store_8_sse2(y + j + 8, dest + (j + 8) * bpp,
+					_mm_unpackhi_epi16(add_r, add_r),
+					_mm_unpackhi_epi16(add_g, add_g),
+					_mm_unpackhi_epi16(add_b, add_b), bpp, bgr);
+		} else {
+			ycbcr_store_8_sse2(y + j, dest + j * bpp,
+					add_r, add_g, add_b, bpp, bgr);
+		}
+	}
+	return j;
+}
+
+__attribute__((target("sse2")))
+int v4lconvert_ycbcr_to_rgb_line_sse2(const unsigned char *y,
+		const unsigned char *cb, const unsigned char *cr,
+		unsigned char *dest, int width, int hshift, int bpp, int bgr)
+{
+	/* Let the compiler generate a specialized loop for each format */
+	switch (((!!hshift * 2) + (bpp == 4)) * 2 + !!bgr) {
+	case 0:
+		return ycbcr_to_rgb_line_sse2(y, cb, cr, dest, width, 0, 3, 0);
+	case 1:
+		return ycbcr_to_rgb_line_sse2(y, cb, cr, dest, width, 0, 3, 1);
+	case 2:
+		return ycbcr_to_rgb_line_sse2(y, cb, cr, dest, width, 0, 4, 0);
+	case 3:
+		return ycbcr_to_rgb_line_sse2(y, cb, cr, dest, width, 0, 4, 1);
+	case 4:
+		return ycbcr_to_rgb_line_sse2(y, cb, cr, dest, width, 1, 3, 0);
+	case 5:
+		return ycbcr_to_rgb_line_sse2(y, cb, cr, dest, width, 1, 3, 1);
+	case 6:
+		return ycbcr_to_rgb_line_sse2(y, cb, cr, dest, width, 1, 4, 0);
+	case 7:
+		return ycbcr_to_rgb_line_sse2(y, cb, cr, dest, width, 1, 4, 1);
+	}
+	return 0;
+}
+
+#endif /* V4LCONVERT_HAVE_X86_SIMD */
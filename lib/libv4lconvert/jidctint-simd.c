@@ -0,0 +1,386 @@
+/*
+# SIMD integer dequantization and IDCT for tinyjpeg
+
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU Lesser General Public License as published by
+# the Free Software Foundation; either version 2.1 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU Lesser General Public License for more details.
+#
+# You should have received a copy of the GNU Lesser General Public License
+# along with this program; if not, write to the Free Software
+# Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA  02110-1335  USA
+ */
+
+/*
+ * This is the accurate integer (LLM) IDCT of libjpeg's jidctint.c, with
+ * CONST_BITS 13 and PASS1_BITS 2, done on all 8 columns resp. rows of a
+ * block at once. The coefficients get dequantized with a 16 bit multiply
+ * by the plain quantization table, so the float version's scaled tables
+ * are not needed. All products are summed in 32 bits, the results of the
+ * first pass are saturated to 16 bits, those of the second pass clamped
+ * to 0 - 255.
+ *
+ * The float IDCT in jidctflt.c stays in use on cpus without these
+ * extensions. For coefficients of 8 bit samples both are within 1 of an
+ * exact IDCT and of each other at the IDCT output; upsampling and
+ * color conversion can grow this to a few levels in the final pixels.
+ * Coefficients of corrupt streams may overflow the 16 bit intermediates,
+ * giving results unlike those of the float version.
+ * contrib/test/tinyjpeg-idct-test checks the bound.
+ */
+
+#include <string.h>
+#include "simd-funcs.h"
+#include "tinyjpeg-internal.h"
+
+#define CONST_BITS	13
+#define PASS1_BITS	2
+
+#define FIX_0_298631336	2446
+#define FIX_0_390180644	3196
+#define FIX_0_541196100	4433
+#define FIX_0_765366865	6270
+#define FIX_0_899976223	7373
+#define FIX_1_175875602	9633
+#define FIX_1_501321110	12299
+#define FIX_1_847759065	15137
+#define FIX_1_961570560	16069
+#define FIX_2_053119869	16819
+#define FIX_2_562915447	20995
+#define FIX_3_072711026	25172
+
+/* Blocks with only a DC coefficient are a single color, this gives the
+   same value as the full IDCT would */
+static void idct_dc_only(const struct component *compptr,
+		uint8_t *output_buf, int stride)
+{
+	int i, dc;
+
+	dc = (int16_t)(compptr->DCT[0] * compptr->Q_table_int[0]) << PASS1_BITS;
+	if (dc > 32767)
+		dc = 32767;
+	if (dc < -32768)
+		dc = -32768;
+	dc = ((dc + (1 << (PASS1_BITS + 2))) >> (PASS1_BITS + 3)) + 128;
+	if (dc < 0)
+		dc = 0;
+	if (dc > 255)
+		dc = 255;
+
+	for (i = 0; i < 8; i++) {
+		memset(output_buf, dc, 8);
+		output_buf += stride;
+	}
+}
+
+#ifdef V4LCONVERT_HAVE_X86_SIMD
+
+/* 2 16 bit constants for _mm_madd_epi16, a for the even lanes, b for the
+   odd ones */
+#define PAIR(a, b) _mm_set1_epi32((int)(((unsigned int)(b) << 16) | \
+			((a) & 0xffff)))
+
+static ALWAYS_INLINE __attribute__((target("sse2")))
+void transpose_8x8_epi16_sse2(__m128i *x)
+{
+	__m128i a0 = _mm_unpacklo_epi16(x[0], x[1]);
+	__m128i a1 = _mm_unpackhi_epi16(x[0], x[1]);
+	__m128i a2 = _mm_unpacklo_epi16(x[2], x[3]);
+	__m128i a3 = _mm_unpackhi_epi16(x[2], x[3]);
+	__m128i a4 = _mm_unpacklo_epi16(x[4], x[5]);
+	__m128i a5 = _mm_unpackhi_epi16(x[4], x[5]);
+	__m128i a6 = _mm_unpacklo_epi16(x[6], x[7]);
+	__m128i a7 = _mm_unpackhi_epi16(x[6], x[7]);
+	__m128i b0 = _mm_unpacklo_epi32(a0, a2);
+	__m128i b1 = _mm_unpackhi_epi32(a0, a2);
+	__m128i b2 = _mm_unpacklo_epi32(a1, a3);
+	__m128i b3 = _mm_unpackhi_epi32(a1, a3);
+	__m128i b4 = _mm_unpacklo_epi32(a4, a6);
+	__m128i b5 = _mm_unpackhi_epi32(a4, a6);
+	__m128i b6 = _mm_unpacklo_epi32(a5, a7);
+	__m128i b7 = _mm_unpackhi_epi32(a5, a7);
+
+	x[0] = _mm_unpacklo_epi64(b0, b4);
+	x[1] = _mm_unpackhi_epi64(b0, b4);
+	x[2] = _mm_unpacklo_epi64(b1, b5);
+	x[3] = _mm_unpackhi_epi64(b1, b5);
+	x[4] = _mm_unpacklo_epi64(b2, b6);
+	x[5] = _mm_unpackhi_epi64(b2, b6);
+	x[6] = _mm_unpacklo_epi64(b3, b7);
+	x[7] = _mm_unpackhi_epi64(b3, b7);
+}
+
+/* 1-D IDCT of 4 lanes, the arguments hold the interleaved pairs of inputs
+   their names refer to, out gets the 8 undescaled 32 bit outputs */
+static ALWAYS_INLINE __attribute__((target("sse2")))
+void idct_4_sse2(__m128i x04, __m128i x26, __m128i x75, __m128i x31,
+		__m128i x71, __m128i x53, __m128i *out)
+{
+	__m128i tmp0, tmp1, tmp2, tmp3, tmp10, tmp11, tmp12, tmp13, z3, z4;
+
+	/* Even part */
+	tmp3 = _mm_madd_epi16(x26,
+			PAIR(FIX_0_541196100 + FIX_0_765366865, FIX_0_541196100));
+	tmp2 = _mm_madd_epi16(x26,
+			PAIR(FIX_0_541196100, FIX_0_541196100 - FIX_1_847759065));
+	tmp0 = _mm_madd_epi16(x04, PAIR(1 << CONST_BITS, 1 << CONST_BITS));
+	tmp1 = _mm_madd_epi16(x04, PAIR(1 << CONST_BITS, -(1 << CONST_BITS)));
+
+	tmp10 = _mm_add_epi32(tmp0, tmp3);
+	tmp13 = _mm_sub_epi32(tmp0, tmp3);
+	tmp11 = _mm_add_epi32(tmp1, tmp2);
+	tmp12 = _mm_sub_epi32(tmp1, tmp2);
+
+	/* Odd part, z3 = in7 + in3 and z4 = in5 + in1 are not formed in 16 bits
+	   but distributed over the products */
+	z3 = _mm_add_epi32(
+		_mm_madd_epi16(x75, PAIR(FIX_1_175875602 - FIX_1_961570560,
+				FIX_1_175875602)),
+		_mm_madd_epi16(x31, PAIR(FIX_1_175875602 - FIX_1_961570560,
+				FIX_1_175875602)));
+	z4 = _mm_add_epi32(
+		_mm_madd_epi16(x75, PAIR(FIX_1_175875602,
+				FIX_1_175875602 - FIX_0_390180644)),
+		_mm_madd_epi16(x31, PAIR(FIX_1_175875602,
+				FIX_1_175875602 - FIX_0_390180644)));
+
+	tmp0 = _mm_add_epi32(z3, _mm_madd_epi16(x71,
+			PAIR(FIX_0_298631336 - FIX_0_899976223, -FIX_0_899976223)));
+	tmp3 = _mm_add_epi32(z4, _mm_madd_epi16(x71,
+			PAIR(-FIX_0_899976223, FIX_1_501321110 - FIX_0_899976223)));
+	tmp1 = _mm_add_epi32(z4, _mm_madd_epi16(x53,
+			PAIR(FIX_2_053119869 - FIX_2_562915447, -FIX_2_562915447)));
+	tmp2 = _mm_add_epi32(z3, _mm_madd_epi16(x53,
+			PAIR(-FIX_2_562915447, FIX_3_072711026 - FIX_2_562915447)));
+
+	out[0] = _mm_add_epi32(tmp10, tmp3);
+	out[7] = _mm_sub_epi32(tmp10, tmp3);
+	out[1] = _mm_add_epi32(tmp11, tmp2);
+	out[6] = _mm_sub_epi32(tmp11, tmp2);
+	out[2] = _mm_add_epi32(tmp12, tmp1);
+	out[5] = _mm_sub_epi32(tmp12, tmp1);
+	out[3] = _mm_add_epi32(tmp13, tmp0);
+	out[4] = _mm_sub_epi32(tmp13, tmp0);
+}
+
+/* 1-D IDCT of 8 lanes, x[k] holds input k of each lane. The results get
+   round and shift added / applied and are saturated to 16 bits */
+static ALWAYS_INLINE __attribute__((target("sse2")))
+void idct_8_sse2(__m128i *x, __m128i round, int shift)
+{
+	__m128i lo[8], hi[8];
+	int i;
+
+	idct_4_sse2(_mm_unpacklo_epi16(x[0], x[4]),
+			_mm_unpacklo_epi16(x[2], x[6]),
+			_mm_unpacklo_epi16(x[7], x[5]),
+			_mm_unpacklo_epi16(x[3], x[1]),
+			_mm_unpacklo_epi16(x[7], x[1]),
+			_mm_unpacklo_epi16(x[5], x[3]), lo);
+	idct_4_sse2(_mm_unpackhi_epi16(x[0], x[4]),
+			_mm_unpackhi_epi16(x[2], x[6]),
+			_mm_unpackhi_epi16(x[7], x[5]),
+			_mm_unpackhi_epi16(x[3], x[1]),
+			_mm_unpackhi_epi16(x[7], x[1]),
+			_mm_unpackhi_epi16(x[5], x[3]), hi);
+
+	for (i = 0; i < 8; i++)
+		x[i] = _mm_packs_epi32(
+			_mm_srai_epi32(_mm_add_epi32(lo[i], round), shift),
+			_mm_srai_epi32(_mm_add_epi32(hi[i], round), shift));
+}
+
+__attribute__((target("sse2")))
+void tinyjpeg_idct_islow_sse2(struct component *compptr, uint8_t *output_buf,
+		int stride)
+{
+	const __m128i *in = (const __m128i *)compptr->DCT;
+	const __m128i *q = (const __m128i *)compptr->Q_table_int;
+	__m128i x[8], ac;
+	int i;
+
+	/* Dequantize, x[k] is row k of coefficients, so pass 1 does the columns */
+	for (i = 0; i < 8; i++)
+		x[i] = _mm_mullo_epi16(_mm_loadu_si128(in + i),
+				_mm_loadu_si128(q + i));
+
+	ac = _mm_andnot_si128(_mm_cvtsi32_si128(0xffff), x[0]);
+	for (i = 1; i < 8; i++)
+		ac = _mm_or_si128(ac, x[i]);
+	if (_mm_movemask_epi8(_mm_cmpeq_epi16(ac, _mm_setzero_si128())) ==
+			0xffff) {
+		idct_dc_only(compptr, output_buf, stride);
+		return;
+	}
+
+	idct_8_sse2(x, _mm_set1_epi32(1 << (CONST_BITS - PASS1_BITS - 1)),
+			CONST_BITS - PASS1_BITS);
+	transpose_8x8_epi16_sse2(x);
+
+	/* Pass 2 does the rows, descaling by another factor of 8 and adding
+	   the 128 level shift */
+	idct_8_sse2(x, _mm_set1_epi32((1 << (CONST_BITS + PASS1_BITS + 2)) +
+				(128 << (CONST_BITS + PASS1_BITS + 3))),
+			CONST_BITS + PASS1_BITS + 3);
+	transpose_8x8_epi16_sse2(x);
+
+	for (i = 0; i < 8; i += 2) {
+		__m128i rows = _mm_packus_epi16(x[i], x[i + 1]);
+
+		_mm_storel_epi64((__m128i *)output_buf, rows);
+		_mm_storel_epi64((__m128i *)(output_buf + stride),
+				_mm_srli_si128(rows, 8));
+		output_buf += 2 * stride;
+	}
+}
+
+#endif /* V4LCONVERT_HAVE_X86_SIMD */
+
+#ifdef V4LCONVERT_HAVE_NEON
+#include <arm_neon.h>
+
+static ALWAYS_INLINE
+void transpose_8x8_s16_neon(int16x8_t *x)
+{
+	int16x8x2_t t01 = vtrnq_s16(x[0], x[1]);
+	int16x8x2_t t23 = vtrnq_s16(x[2], x[3]);
+	int16x8x2_t t45 = vtrnq_s16(x[4], x[5]);
+	int16x8x2_t t67 = vtrnq_s16(x[6], x[7]);
+	int32x4x2_t u02 = vtrnq_s32(vreinterpretq_s32_s16(t01.val[0]),
+			vreinterpretq_s32_s16(t23.val[0]));
+	int32x4x2_t u13 = vtrnq_s32(vreinterpretq_s32_s16(t01.val[1]),
+			vreinterpretq_s32_s16(t23.val[1]));
+	int32x4x2_t u46 = vtrnq_s32(vreinterpretq_s32_s16(t45.val[0]),
+			vreinterpretq_s32_s16(t67.val[0]));
+	int32x4x2_t u57 = vtrnq_s32(vreinterpretq_s32_s16(t45.val[1]),
+			vreinterpretq_s32_s16(t67.val[1]));
+
+	x[0] = vcombine_s16(vget_low_s16(vreinterpretq_s16_s32(u02.val[0])),
+			vget_low_s16(vreinterpretq_s16_s32(u46.val[0])));
+	x[4] = vcombine_s16(vget_high_s16(vreinterpretq_s16_s32(u02.val[0])),
+			vget_high_s16(vreinterpretq_s16_s32(u46.val[0])));
+	x[2] = vcombine_s16(vget_low_s16(vreinterpretq_s16_s32(u02.val[1])),
+			vget_low_s16(vreinterpretq_s16_s32(u46.val[1])));
+	x[6] = vcombine_s16(vget_high_s16(vreinterpretq_s16_s32(u02.val[1])),
+			vget_high_s16(vreinterpretq_s16_s32(u46.val[1])));
+	x[1] = vcombine_s16(vget_low_s16(vreinterpretq_s16_s32(u13.val[0])),
+			vget_low_s16(vreinterpretq_s16_s32(u57.val[0])));
+	x[5] = vcombine_s16(vget_high_s16(vreinterpretq_s16_s32(u13.val[0])),
+			vget_high_s16(vreinterpretq_s16_s32(u57.val[0])));
+	x[3] = vcombine_s16(vget_low_s16(vreinterpretq_s16_s32(u13.val[1])),
+			vget_low_s16(vreinterpretq_s16_s32(u57.val[1])));
+	x[7] = vcombine_s16(vget_high_s16(vreinterpretq_s16_s32(u13.val[1])),
+			vget_high_s16(vreinterpretq_s16_s32(u57.val[1])));
+}
+
+/* 1-D IDCT of 4 lanes, x[k] holds input k of each lane, out gets the 8
+   undescaled 32 bit outputs */
+static ALWAYS_INLINE
+void idct_4_neon(const int16x4_t *x, int32x4_t *out)
+{
+	int32x4_t tmp0, tmp1, tmp2, tmp3, tmp10, tmp11, tmp12, tmp13, z3, z4;
+
+	/* Even part */
+	tmp3 = vmlal_n_s16(vmull_n_s16(x[2],
+				FIX_0_541196100 + FIX_0_765366865),
+			x[6], FIX_0_541196100);
+	tmp2 = vmlal_n_s16(vmull_n_s16(x[2], FIX_0_541196100),
+			x[6], FIX_0_541196100 - FIX_1_847759065);
+	tmp0 = vshlq_n_s32(vaddl_s16(x[0], x[4]), CONST_BITS);
+	tmp1 = vshlq_n_s32(vsubl_s16(x[0], x[4]), CONST_BITS);
+
+	tmp10 = vaddq_s32(tmp0, tmp3);
+	tmp13 = vsubq_s32(tmp0, tmp3);
+	tmp11 = vaddq_s32(tmp1, tmp2);
+	tmp12 = vsubq_s32(tmp1, tmp2);
+
+	/* Odd part, z3 = in7 + in3 and z4 = in5 + in1 */
+	z3 = vmull_n_s16(x[7], FIX_1_175875602 - FIX_1_961570560);
+	z3 = vmlal_n_s16(z3, x[3], FIX_1_175875602 - FIX_1_961570560);
+	z3 = vmlal_n_s16(z3, x[5], FIX_1_175875602);
+	z3 = vmlal_n_s16(z3, x[1], FIX_1_175875602);
+	z4 = vmull_n_s16(x[7], FIX_1_175875602);
+	z4 = vmlal_n_s16(z4, x[3], FIX_1_175875602);
+	z4 = vmlal_n_s16(z4, x[5], FIX_1_175875602 - FIX_0_390180644);
+	z4 = vmlal_n_s16(z4, x[1], FIX_1_175875602 - FIX_0_390180644);
+
+	tmp0 = vmlal_n_s16(z3, x[7], FIX_0_298631336 - FIX_0_899976223);
+	tmp0 = vmlal_n_s16(tmp0, x[1], -FIX_0_899976223);
+	tmp3 = vmlal_n_s16(z4, x[7], -FIX_0_899976223);
+	tmp3 = vmlal_n_s16(tmp3, x[1], FIX_1_501321110 - FIX_0_899976223);
+	tmp1 = vmlal_n_s16(z4, x[5], FIX_2_053119869 - FIX_2_562915447);
+	tmp1 = vmlal_n_s16(tmp1, x[3], -FIX_2_562915447);
+	tmp2 = vmlal_n_s16(z3, x[5], -FIX_2_562915447);
+	tmp2 = vmlal_n_s16(tmp2, x[3], FIX_3_072711026 - FIX_2_562915447);
+
+	out[0] = vaddq_s32(tmp10, tmp3);
+	out[7] = vsubq_s32(tmp10, tmp3);
+	out[1] = vaddq_s32(tmp11, tmp2);
+	out[6] = vsubq_s32(tmp11, tmp2);
+	out[2] = vaddq_s32(tmp12, tmp1);
+	out[5] = vsubq_s32(tmp12, tmp1);
+	out[3] = vaddq_s32(tmp13, tmp0);
+	out[4] = vsubq_s32(tmp13, tmp0);
+}
+
+void tinyjpeg_idct_islow_neon(struct component *compptr, uint8_t *output_buf,
+		int stride)
+{
+	int16x8_t x[8], ac;
+	int16x4_t lo_in[8], hi_in[8];
+	int32x4_t lo[8], hi[8];
+	int i;
+
+	/* Dequantize, x[k] is row k of coefficients, so pass 1 does the columns */
+	for (i = 0; i < 8; i++)
+		x[i] = vmulq_s16(vld1q_s16(compptr->DCT + 8 * i),
+				vld1q_s16(compptr->Q_table_int + 8 * i));
+
+	ac = vsetq_lane_s16(0, x[0], 0);
+	for (i = 1; i < 8; i++)
+		ac = vorrq_s16(ac, x[i]);
+	if (vget_lane_u64(vreinterpret_u64_s16(vorr_s16(vget_low_s16(ac),
+				vget_high_s16(ac))), 0) == 0) {
+		idct_dc_only(compptr, output_buf, stride);
+		return;
+	}
+
+	for (i = 0; i < 8; i++) {
+		lo_in[i] = vget_low_s16(x[i]);
+		hi_in[i] = vget_high_s16(x[i]);
+	}
+	idct_4_neon(lo_in, lo);
+	idct_4_neon(hi_in, hi);
+	for (i = 0; i < 8; i++)
+		x[i] = vcombine_s16(
+			vqmovn_s32(vrshrq_n_s32(lo[i], CONST_BITS - PASS1_BITS)),
+			vqmovn_s32(vrshrq_n_s32(hi[i], CONST_BITS - PASS1_BITS)));
+	transpose_8x8_s16_neon(x);
+
+	/* Pass 2 does the rows, descaling by another factor of 8 and adding
+	   the 128 level shift */
+	for (i = 0; i < 8; i++) {
+		lo_in[i] = vget_low_s16(x[i]);
+		hi_in[i] = vget_high_s16(x[i]);
+	}
+	idct_4_neon(lo_in, lo);
+	idct_4_neon(hi_in, hi);
+	for (i = 0; i < 8; i++)
+		x[i] = vqaddq_s16(vcombine_s16(
+			vqmovn_s32(vrshrq_n_s32(lo[i], CONST_BITS + PASS1_BITS + 3)),
+			vqmovn_s32(vrshrq_n_s32(hi[i], CONST_BITS + PASS1_BITS + 3))),
+			vdupq_n_s16(128));
+	transpose_8x8_s16_neon(x);
+
+	for (i = 0; i < 8; i++) {
+		vst1_u8(output_buf, vqmovun_s16(x[i]));
+		output_buf += stride;
+	}
+}
+
+#endif /* V4LCONVERT_HAVE_NEON */
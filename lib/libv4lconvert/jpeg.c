@@ -41,6 +41,7 @@ int v4lconvert_decode_jpeg_tinyjpeg(struct v4lconvert_data *data,
 	}
 	flags |= TINYJPEG_FLAGS_MJPEG_TABLE;
 	tinyjpeg_set_flags(data->tinyjpeg, flags);
+	tinyjpeg_set_workers(data->tinyjpeg, data->workers);
 	if (tinyjpeg_parse_header(data->tinyjpeg, src, src_size)) {
 		V4LCONVERT_ERR("parsing JPEG header: %s",
 				tinyjpeg_get_errorstring(data->tinyjpeg));
@@ -88,6 +89,22 @@ int v4lconvert_decode_jpeg_tinyjpeg(struct v4lconvert_data *data,
 		tinyjpeg_set_components(data->tinyjpeg, components, 3);
 		result = tinyjpeg_decode(data->tinyjpeg, TINYJPEG_FMT_YUV420P);
 		break;
+	case V4L2_PIX_FMT_NV12:
+		components[1] = components[0] + width * height;
+		components[2] = components[1] + 1;
+		tinyjpeg_set_components(data->tinyjpeg, components, 3);
+		result = tinyjpeg_decode(data->tinyjpeg, TINYJPEG_FMT_NV12);
+		break;
+	case V4L2_PIX_FMT_NV21:
+		components[2] = components[0] + width * height;
+		components[1] = components[2] + 1;
+		tinyjpeg_set_components(data->tinyjpeg, components, 3);
+		result = tinyjpeg_decode(data->tinyjpeg, TINYJPEG_FMT_NV12);
+		break;
+	case V4L2_PIX_FMT_YUYV:
+		tinyjpeg_set_components(data->tinyjpeg, components, 1);
+		result = tinyjpeg_decode(data->tinyjpeg, TINYJPEG_FMT_YUYV);
+		break;
 	}
 
 	if (result) {
@@ -227,16 +244,75 @@ static int decode_libjpeg_h_samp1(struct v4lconvert_data *data,
 	return 0;
 }
 
+/* For the packed destination formats a 16 line strip is decoded into a
+   temporary buffer laid out as yuv420 (the y lines only for yuyv, for nv12
+   the y lines go straight to dest), and packed into dest after each strip */
+static void pack_libjpeg_strip(struct v4lconvert_data *data,
+	unsigned char *strip, unsigned char *dest, int line,
+	unsigned int dest_pix_fmt)
+{
+	unsigned int width = data->cinfo.image_width;
+	unsigned int height = data->cinfo.image_height;
+	const unsigned char *usrc = strip + width * 16;
+	const unsigned char *vsrc = usrc + width * 4;
+	unsigned char *uvdest;
+	unsigned int i;
+
+	switch (dest_pix_fmt) {
+	case V4L2_PIX_FMT_NV12:
+	case V4L2_PIX_FMT_NV21:
+		uvdest = dest + width * height + line / 2 * width;
+		if (dest_pix_fmt == V4L2_PIX_FMT_NV21) {
+			const unsigned char *tmp = usrc;
+
+			usrc = vsrc;
+			vsrc = tmp;
+		}
+		for (i = 0; i < width * 4; i++) {
+			*uvdest++ = *usrc++;
+			*uvdest++ = *vsrc++;
+		}
+		break;
+	case V4L2_PIX_FMT_YUYV:
+		v4lconvert_yuv420_to_yuyv(strip, dest + line * width * 2,
+					  width, 16, 0);
+		break;
+	}
+}
+
 static int decode_libjpeg_h_samp2(struct v4lconvert_data *data,
-	unsigned char *ydest, unsigned char *udest, unsigned char *vdest,
-	int v_samp)
+	unsigned char *dest, unsigned int dest_pix_fmt, int v_samp)
 {
 	struct jpeg_decompress_struct *cinfo = &data->cinfo;
 	int y;
 	unsigned int width = cinfo->image_width;
+	unsigned int height = cinfo->image_height;
+	unsigned char *ydest, *udest, *vdest, *strip = NULL;
 	JSAMPROW y_rows[16], u_rows[8], v_rows[8];
 	JSAMPARRAY rows[3] = { y_rows, u_rows, v_rows };
 
+	switch (dest_pix_fmt) {
+	case V4L2_PIX_FMT_YUV420:
+		ydest = dest;
+		udest = dest + width * height;
+		vdest = udest + width * height / 4;
+		break;
+	case V4L2_PIX_FMT_YVU420:
+		ydest = dest;
+		vdest = dest + width * height;
+		udest = vdest + width * height / 4;
+		break;
+	default:
+		strip = v4lconvert_alloc_buffer(width * 24,
+						&data->convert_pixfmt_buf,
+						&data->convert_pixfmt_buf_size);
+		if (!strip)
+			return v4lconvert_oom_error(data);
+		ydest = (dest_pix_fmt == V4L2_PIX_FMT_YUYV) ? strip : dest;
+		udest = strip + width * 16;
+		vdest = udest + width * 4;
+	}
+
 	while (cinfo->output_scanline < cinfo->image_height) {
 		for (y = 0; y < 8 * v_samp; y++) {
 			y_rows[y] = ydest;
@@ -258,6 +334,17 @@ static int decode_libjpeg_h_samp2(struct v4lconvert_data *data,
 		if (cinfo->output_scanline % 16) {
 			udest -= width * 8 / 2;
 			vdest -= width * 8 / 2;
+			continue;
+		}
+
+		if (strip) {
+			pack_libjpeg_strip(data, strip, dest,
+					   cinfo->output_scanline - 16,
+					   dest_pix_fmt);
+			if (dest_pix_fmt == V4L2_PIX_FMT_YUYV)
+				ydest = strip;
+			udest = strip + width * 16;
+			vdest = udest + width * 4;
 		}
 	}
 	return 0;
@@ -283,8 +370,12 @@ int v4lconvert_decode_jpeg_libjpeg(struct v4lconvert_data *data,
 
 	init_libjpeg_cinfo(data);
 
+	/* Tables from previous frames stay in cinfo, so frames which omit
+	   the DHT and / or DQT markers get decoded with the last seen ones */
 	jpeg_mem_src(&data->cinfo, src, src_size);
 	jpeg_read_header(&data->cinfo, TRUE);
+	/* jpeg_read_header() resets the decompression parameters */
+	data->cinfo.dct_method = data->jpeg_fast_dct ? JDCT_IFAST : JDCT_ISLOW;
 
 	if (data->cinfo.image_width  != width ||
 	    data->cinfo.image_height != height) {
@@ -326,7 +417,6 @@ int v4lconvert_decode_jpeg_libjpeg(struct v4lconvert_data *data,
 #endif
 	} else {
 		int h_samp, v_samp;
-		unsigned char *udest, *vdest;
 
 		if (data->cinfo.max_h_samp_factor == 2 &&
 		    data->cinfo.cur_comp_info[0]->h_samp_factor == 2 &&
@@ -382,25 +472,26 @@ int v4lconvert_decode_jpeg_libjpeg(struct v4lconvert_data *data,
 			return -1;
 		}
 
-		if (dest_pix_fmt == V4L2_PIX_FMT_YVU420) {
-			vdest = dest + width * height;
-			udest = vdest + (width * height) / 4;
-		} else {
-			udest = dest + width * height;
-			vdest = udest + (width * height) / 4;
-		}
-
 		data->cinfo.raw_data_out = TRUE;
 		data->cinfo.do_fancy_upsampling = FALSE;
 		jpeg_start_decompress(&data->cinfo);
 		/* Make libjpeg errors report that we've got some data */
 		data->jerr_errno = EPIPE;
 		if (h_samp == 1) {
+			unsigned char *udest, *vdest;
+
+			if (dest_pix_fmt == V4L2_PIX_FMT_YVU420) {
+				vdest = dest + width * height;
+				udest = vdest + (width * height) / 4;
+			} else {
+				udest = dest + width * height;
+				vdest = udest + (width * height) / 4;
+			}
 			result = decode_libjpeg_h_samp1(data, dest, udest,
 							vdest, v_samp);
 		} else {
-			result = decode_libjpeg_h_samp2(data, dest, udest,
-							vdest, v_samp);
+			result = decode_libjpeg_h_samp2(data, dest,
+							dest_pix_fmt, v_samp);
 		}
 		if (result)
 			jpeg_abort_decompress(&data->cinfo);
@@ -22,6 +22,7 @@
 #include <config.h>
 #include <stdio.h>
 #include <stdint.h>
+#include <pthread.h>
 #include <sys/types.h>
 #ifdef HAVE_JPEG
 #include <jpeglib.h>
@@ -37,6 +38,8 @@
 
 #define V4LCONVERT_ERROR_MSG_SIZE 256
 #define V4LCONVERT_MAX_FRAMESIZES 256
+#define V4LCONVERT_MAX_THREADS 8
+#define V4LCONVERT_TRY_FMT_CACHE_SIZE 256
 
 #define V4LCONVERT_ERR(...) \
 	snprintf(data->error_msg, V4LCONVERT_ERROR_MSG_SIZE, \
@@ -46,6 +49,60 @@
 #define V4LCONVERT_IS_UVC                0x01
 #define V4LCONVERT_USE_TINYJPEG          0x02
 
+/* SIMD extensions used by the optimized conversion routines */
+#define V4LCONVERT_CPU_SSE2              0x01
+#define V4LCONVERT_CPU_AVX2              0x02
+#define V4LCONVERT_CPU_NEON              0x04
+#define V4LCONVERT_CPU_SSSE3             0x08
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define V4LCONVERT_HAVE_X86_SIMD
+#endif
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define V4LCONVERT_HAVE_NEON
+#endif
+
+/* Byte order of the packed yuv 4:2:2 formats */
+#define V4LCONVERT_ORDER_YUYV            0
+#define V4LCONVERT_ORDER_YVYU            1
+#define V4LCONVERT_ORDER_UYVY            2
+
+/* The filter of one axis of a scaler, destination pixel i is the weighted
+   sum of the taps source pixels starting at start[i], with the weights
+   weights[i * taps] - weights[i * taps + taps - 1] adding up to
+   V4LCONVERT_SCALE_ONE */
+#define V4LCONVERT_SCALE_BITS 14
+#define V4LCONVERT_SCALE_ONE (1 << V4LCONVERT_SCALE_BITS)
+
+struct v4lconvert_scale_axis {
+	int taps;
+	int *start;
+	short *weights;
+};
+
+/* Precalculated filters for scaling frames of one size and format to an
+   other size, see scale.c */
+struct v4lconvert_scaler {
+	int filter;
+	int yuv420;
+	int src_width;
+	int src_height;
+	int dest_width;
+	int dest_height;
+	struct v4lconvert_scale_axis x, y;	/* rgb24 or y plane */
+	struct v4lconvert_scale_axis cx, cy;	/* u and v planes */
+	unsigned char *rows;	/* 16 bit vertically filtered lines, 1 per band */
+	int rows_size;
+};
+
+/* Result of a VIDIOC_TRY_FMT on the device for the format in */
+struct v4lconvert_try_fmt_cache_entry {
+	struct v4l2_pix_format in;
+	int result;
+	int error;	/* errno when result is -1 */
+	struct v4l2_pix_format pix;
+};
+
 struct v4lconvert_data {
 	int fd;
 	int flags; /* bitfield */
@@ -60,21 +117,24 @@ struct v4lconvert_data {
 	jmp_buf jerr_jmp_state;
 	struct jpeg_decompress_struct cinfo;
 	int cinfo_initialized;
+	int jpeg_fast_dct;
 #endif // HAVE_JPEG
 	struct v4l2_frmsizeenum framesizes[V4LCONVERT_MAX_FRAMESIZES];
+	/* bitfields of the supported_src_formats which can do each framesize */
+	int64_t framesize_src_formats[V4LCONVERT_MAX_FRAMESIZES];
 	unsigned int no_framesizes;
 	int bandwidth;
 	int fps;
-	int convert1_buf_size;
 	int convert2_buf_size;
 	int rotate90_buf_size;
 	int flip_buf_size;
 	int convert_pixfmt_buf_size;
-	unsigned char *convert1_buf;
+	int repack_buf_size;
 	unsigned char *convert2_buf;
 	unsigned char *rotate90_buf;
 	unsigned char *flip_buf;
 	unsigned char *convert_pixfmt_buf;
+	unsigned char *repack_buf;	/* yuv420 to be repacked to nv12 / yuyv */
 	struct v4lcontrol_data *control;
 	struct v4lprocessing_data *processing;
 	void *dev_ops_priv;
@@ -84,12 +144,32 @@ struct v4lconvert_data {
 	pid_t decompress_pid;
 	int decompress_in_pipe[2];  /* Data from helper to us */
 	int decompress_out_pipe[2]; /* Data from us to helper */
+	int decompress_shm_fd;      /* Frame data shared with the helper */
+	int decompress_no_shm;      /* Shm failed, use the pipes instead */
+	unsigned char *decompress_shm;
+	size_t decompress_shm_size;
 
 	/* For mr97310a decoder */
 	int frames_dropped;
 
 	/* For cpia1 decoder */
 	unsigned char *previous_frame;
+
+	/* Worker threads to split conversions over, NULL when disabled */
+	struct v4lconvert_workers *workers;
+
+	/* Scaling to resolutions the device does not support */
+	int scale_filter;
+	struct v4lconvert_scaler scaler;
+
+	/* VIDIOC_TRY_FMT results, used round robin when enabled */
+	int try_fmt_cache_enabled;
+	struct v4lconvert_try_fmt_cache_entry
+		try_fmt_cache[V4LCONVERT_TRY_FMT_CACHE_SIZE];
+	int try_fmt_cache_count;
+	int try_fmt_cache_next;
+	unsigned int try_fmt_cache_generation;
+	pthread_mutex_t try_fmt_cache_lock;
 };
 
 struct v4lconvert_pixfmt {
@@ -102,6 +182,206 @@ struct v4lconvert_pixfmt {
 
 void v4lconvert_fixup_fmt(struct v4l2_format *fmt);
 
+int v4lconvert_get_cpu_flags(void);
+
+typedef void (*v4lconvert_job_func)(void *arg, int job);
+
+int v4lconvert_workers_default_threads(void);
+
+struct v4lconvert_workers *v4lconvert_workers_create(int threads);
+
+void v4lconvert_workers_destroy(struct v4lconvert_workers *workers);
+
+int v4lconvert_workers_threads(struct v4lconvert_workers *workers);
+
+void v4lconvert_workers_run(struct v4lconvert_workers *workers,
+		v4lconvert_job_func func, void *arg, int no_jobs);
+
+/* Optimized line converters for packed yuv 4:2:2 to rgb24 / bgr24, these
+   return the (even) number of pixels converted, the caller must convert the
+   rest of the line */
+typedef int (*v4lconvert_yuv422_line_func)(const unsigned char *src,
+		unsigned char *dest, int width, int order, int bgr);
+
+#ifdef V4LCONVERT_HAVE_X86_SIMD
+int v4lconvert_yuv422_to_rgb24_line_sse2(const unsigned char *src,
+		unsigned char *dest, int width, int order, int bgr);
+int v4lconvert_yuv422_to_rgb24_line_avx2(const unsigned char *src,
+		unsigned char *dest, int width, int order, int bgr);
+#endif
+#ifdef V4LCONVERT_HAVE_NEON
+int v4lconvert_yuv422_to_rgb24_line_neon(const unsigned char *src,
+		unsigned char *dest, int width, int order, int bgr);
+#endif
+
+/* Optimized demosaic of the inner pixels of a bayer line, 2 pixels at a
+   time. bayer points to the line above the one being converted, count is
+   the number of pixel pairs to do. These return the number of pairs
+   converted, the caller must convert the rest. */
+typedef int (*v4lconvert_bayer_line_func)(const unsigned char *bayer,
+		unsigned char *dest, int count, int stride, int blue_line);
+
+#ifdef V4LCONVERT_HAVE_X86_SIMD
+int v4lconvert_bayer_line_to_bgr24_sse2(const unsigned char *bayer,
+		unsigned char *dest, int count, int stride, int blue_line);
+int v4lconvert_bayer_line_to_bgr24_avx2(const unsigned char *bayer,
+		unsigned char *dest, int count, int stride, int blue_line);
+int v4lconvert_bayer_line_to_y_sse2(const unsigned char *bayer,
+		unsigned char *dest, int count, int stride, int blue_line);
+int v4lconvert_bayer_line_to_y_avx2(const unsigned char *bayer,
+		unsigned char *dest, int count, int stride, int blue_line);
+#endif
+#ifdef V4LCONVERT_HAVE_NEON
+int v4lconvert_bayer_line_to_bgr24_neon(const unsigned char *bayer,
+		unsigned char *dest, int count, int stride, int blue_line);
+int v4lconvert_bayer_line_to_y_neon(const unsigned char *bayer,
+		unsigned char *dest, int count, int stride, int blue_line);
+#endif
+
+/* Convert a line of tinyjpeg Y, Cb and Cr samples to rgb24 / bgr24 (bpp 3)
+   or rgb32 / bgr32 (bpp 4). hshift is 1 when the chroma is horizontally
+   subsampled. These return the number of pixels converted, the caller must
+   convert the rest of the line. */
+typedef int (*v4lconvert_ycbcr_line_func)(const unsigned char *y,
+		const unsigned char *cb, const unsigned char *cr,
+		unsigned char *dest, int width, int hshift, int bpp, int bgr);
+
+#ifdef V4LCONVERT_HAVE_X86_SIMD
+int v4lconvert_ycbcr_to_rgb_line_sse2(const unsigned char *y,
+		const unsigned char *cb, const unsigned char *cr,
+		unsigned char *dest, int width, int hshift, int bpp, int bgr);
+#endif
+
+/* Horizontally flip a line, dest gets the count pixels starting at src in
+   reverse order */
+typedef void (*v4lconvert_hflip_line_func)(unsigned char *dest,
+		const unsigned char *src, int count);
+
+void v4lconvert_hflip_line_rgb24_c(unsigned char *dest,
+		const unsigned char *src, int count);
+void v4lconvert_hflip_line_8_c(unsigned char *dest,
+		const unsigned char *src, int count);
+#ifdef V4LCONVERT_HAVE_X86_SIMD
+void v4lconvert_hflip_line_rgb24_ssse3(unsigned char *dest,
+		const unsigned char *src, int count);
+void v4lconvert_hflip_line_8_ssse3(unsigned char *dest,
+		const unsigned char *src, int count);
+void v4lconvert_hflip_line_8_avx2(unsigned char *dest,
+		const unsigned char *src, int count);
+#endif
+
+/* Rotate a square tile of V4LCONVERT_ROTATE_TILE pixels 90 degrees clockwise,
+   src points to the top left pixel of the tile in the source */
+#define V4LCONVERT_ROTATE_TILE 16
+
+typedef void (*v4lconvert_rotate90_tile_func)(unsigned char *dest,
+		int dest_stride, const unsigned char *src, int src_stride);
+
+void v4lconvert_rotate90_tile_rgb24_c(unsigned char *dest, int dest_stride,
+		const unsigned char *src, int src_stride);
+void v4lconvert_rotate90_tile_8_c(unsigned char *dest, int dest_stride,
+		const unsigned char *src, int src_stride);
+#ifdef V4LCONVERT_HAVE_X86_SIMD
+void v4lconvert_rotate90_tile_rgb24_ssse3(unsigned char *dest,
+		int dest_stride, const unsigned char *src, int src_stride);
+void v4lconvert_rotate90_tile_8_sse2(unsigned char *dest, int dest_stride,
+		const unsigned char *src, int src_stride);
+#endif
+
+/* Apply the lookup tables of v4lprocessing to a line of count rgb24 / bgr24
+   pixels, respectively to count pairs of bayer pixels or of 8 bit samples,
+   respectively to count pixel pairs of packed yuv 4:2:2. The AVX2 versions
+   read up to 3 bytes past the end of the tables. */
+typedef void (*v4lconvert_lut_rgb24_func)(unsigned char *buf, int count,
+		const unsigned char *lut0, const unsigned char *lut1,
+		const unsigned char *lut2);
+typedef void (*v4lconvert_lut_bayer_func)(unsigned char *buf, int count,
+		const unsigned char *lut0, const unsigned char *lut1);
+typedef void (*v4lconvert_lut_yuv422_func)(unsigned char *buf, int count,
+		const unsigned char *lut0, const unsigned char *lut1,
+		const unsigned char *lut2, const unsigned char *lut3);
+
+void v4lconvert_lut_line_rgb24_c(unsigned char *buf, int count,
+		const unsigned char *lut0, const unsigned char *lut1,
+		const unsigned char *lut2);
+void v4lconvert_lut_line_bayer_c(unsigned char *buf, int count,
+		const unsigned char *lut0, const unsigned char *lut1);
+void v4lconvert_lut_line_yuv422_c(unsigned char *buf, int count,
+		const unsigned char *lut0, const unsigned char *lut1,
+		const unsigned char *lut2, const unsigned char *lut3);
+#ifdef V4LCONVERT_HAVE_X86_SIMD
+void v4lconvert_lut_line_rgb24_avx2(unsigned char *buf, int count,
+		const unsigned char *lut0, const unsigned char *lut1,
+		const unsigned char *lut2);
+void v4lconvert_lut_line_bayer_avx2(unsigned char *buf, int count,
+		const unsigned char *lut0, const unsigned char *lut1);
+void v4lconvert_lut_line_yuv422_avx2(unsigned char *buf, int count,
+		const unsigned char *lut0, const unsigned char *lut1,
+		const unsigned char *lut2, const unsigned char *lut3);
+#endif
+
+/* Add the per channel sums of a line of count groups of channels (1 - 4)
+   interleaved 8 bit samples to sums[0] - sums[channels - 1] */
+typedef void (*v4lconvert_sum_line_func)(const unsigned char *buf, int count,
+		int channels, unsigned int *sums);
+
+void v4lconvert_sum_line_c(const unsigned char *buf, int count,
+		int channels, unsigned int *sums);
+#ifdef V4LCONVERT_HAVE_X86_SIMD
+void v4lconvert_sum_line_sse2(const unsigned char *buf, int count,
+		int channels, unsigned int *sums);
+#endif
+
+/* The vertical pass of the scaler: dest gets count weighted sums of the
+   samples of taps source lines starting at src, with the fraction bits of
+   the weights reduced to 8 */
+typedef void (*v4lconvert_scale_line_func)(unsigned short *dest,
+		const unsigned char *src, int stride, const short *weights,
+		int taps, int count);
+
+void v4lconvert_scale_line_v_c(unsigned short *dest,
+		const unsigned char *src, int stride, const short *weights,
+		int taps, int count);
+#ifdef V4LCONVERT_HAVE_X86_SIMD
+void v4lconvert_scale_line_v_sse2(unsigned short *dest,
+		const unsigned char *src, int stride, const short *weights,
+		int taps, int count);
+void v4lconvert_scale_line_v_avx2(unsigned short *dest,
+		const unsigned char *src, int stride, const short *weights,
+		int taps, int count);
+#endif
+
+/* Dequantize and IDCT a tinyjpeg block, see jidctflt.c */
+struct component;
+typedef void (*v4lconvert_idct_func)(struct component *compptr,
+		uint8_t *output_buf, int stride);
+
+/* The hot kernels, set to the fastest version for the cpu we are running on
+   by v4lconvert_init_kernels(). The optional ones are NULL when there is no
+   optimized version, their callers then use their own C code. */
+struct v4lconvert_kernels {
+	/* Optional */
+	v4lconvert_yuv422_line_func yuv422_to_rgb24_line;
+	v4lconvert_bayer_line_func bayer_to_bgr24_line;
+	v4lconvert_bayer_line_func bayer_to_y_line;
+	v4lconvert_ycbcr_line_func ycbcr_to_rgb_line;
+	/* Always set */
+	v4lconvert_hflip_line_func hflip_line_rgb24;
+	v4lconvert_hflip_line_func hflip_line_8;
+	v4lconvert_rotate90_tile_func rotate90_tile_rgb24;
+	v4lconvert_rotate90_tile_func rotate90_tile_8;
+	v4lconvert_lut_rgb24_func lut_line_rgb24;
+	v4lconvert_lut_bayer_func lut_line_bayer;
+	v4lconvert_lut_yuv422_func lut_line_yuv422;
+	v4lconvert_scale_line_func scale_line_v;
+	v4lconvert_sum_line_func sum_line;
+	v4lconvert_idct_func idct;
+};
+
+extern struct v4lconvert_kernels v4lconvert_kernels;
+
+void v4lconvert_init_kernels(void);
+
 unsigned char *v4lconvert_alloc_buffer(int needed,
 		unsigned char **buf, int *buf_size);
 
@@ -140,6 +420,33 @@ void v4lconvert_uyvy_to_bgr24(const unsigned char *src, unsigned char *dst,
 void v4lconvert_uyvy_to_yuv420(const unsigned char *src, unsigned char *dst,
 		int width, int height, int stride, int yvu);
 
+void v4lconvert_yuyv_to_nv12(const unsigned char *src, unsigned char *dst,
+		int width, int height, int stride, int nv21);
+
+void v4lconvert_uyvy_to_nv12(const unsigned char *src, unsigned char *dst,
+		int width, int height, int stride, int nv21);
+
+void v4lconvert_yuv422_to_yuyv(const unsigned char *src, unsigned char *dst,
+		int width, int height, int stride, int order);
+
+void v4lconvert_yuv420_to_nv12(const unsigned char *src, unsigned char *dst,
+		int width, int height, int yvu);
+
+void v4lconvert_yuv420_to_yuyv(const unsigned char *src, unsigned char *dst,
+		int width, int height, int yvu);
+
+void v4lconvert_nv12_to_rgb24(const unsigned char *src, unsigned char *dst,
+		int width, int height, int bgr, int nv21);
+
+void v4lconvert_nv12_to_yuv420(const unsigned char *src, unsigned char *dst,
+		int width, int height, int yvu);
+
+void v4lconvert_nv12_to_nv21(const unsigned char *src, unsigned char *dst,
+		int width, int height);
+
+void v4lconvert_nv12_to_yuyv(const unsigned char *src, unsigned char *dst,
+		int width, int height, int nv21);
+
 void v4lconvert_swap_rgb(const unsigned char *src, unsigned char *dst,
 		int width, int height);
 
@@ -237,14 +544,17 @@ void v4lconvert_decode_sq905c(const unsigned char *src, unsigned char *dst,
 void v4lconvert_decode_stv0680(const unsigned char *src, unsigned char *dst,
 		int width, int height);
 
-void v4lconvert_bayer_to_rgb24(const unsigned char *bayer,
-		unsigned char *rgb, int width, int height, const unsigned int stride, unsigned int pixfmt);
+void v4lconvert_bayer_to_rgb24(struct v4lconvert_data *data,
+		const unsigned char *bayer, unsigned char *rgb, int width, int height, const unsigned int stride, unsigned int pixfmt);
+
+void v4lconvert_bayer_to_bgr24(struct v4lconvert_data *data,
+		const unsigned char *bayer, unsigned char *rgb, int width, int height, const unsigned int stride, unsigned int pixfmt);
 
-void v4lconvert_bayer_to_bgr24(const unsigned char *bayer,
-		unsigned char *rgb, int width, int height, const unsigned int stride, unsigned int pixfmt);
+void v4lconvert_bayer_to_yuv420(struct v4lconvert_data *data,
+		const unsigned char *bayer, unsigned char *yuv, int width, int height, const unsigned int stride, unsigned int src_pixfmt, int yvu);
 
-void v4lconvert_bayer_to_yuv420(const unsigned char *bayer, unsigned char *yuv,
-		int width, int height, const unsigned int stride, unsigned int src_pixfmt, int yvu);
+void v4lconvert_bayer_to_nv12(struct v4lconvert_data *data,
+		const unsigned char *bayer, unsigned char *nv12, int width, int height, const unsigned int stride, unsigned int src_pixfmt, int nv21);
 
 void v4lconvert_hm12_to_rgb24(const unsigned char *src,
 		unsigned char *dst, int width, int height);
@@ -261,9 +571,51 @@ void v4lconvert_rotate90(unsigned char *src, unsigned char *dest,
 void v4lconvert_flip(unsigned char *src, unsigned char *dest,
 		struct v4l2_format *fmt, int hflip, int vflip);
 
+/* Flipping both ways is rotating 180 degrees, fmt may include padding */
+void v4lconvert_flip_inplace(unsigned char *buf,
+		const struct v4l2_format *fmt, int hflip, int vflip);
+
 void v4lconvert_crop(unsigned char *src, unsigned char *dest,
 		const struct v4l2_format *src_fmt, const struct v4l2_format *dest_fmt);
 
+int v4lconvert_scale_needed(struct v4lconvert_data *data,
+		const struct v4l2_format *src_fmt, const struct v4l2_format *dest_fmt);
+
+int v4lconvert_scale(struct v4lconvert_data *data, unsigned char *src,
+		unsigned char *dest, const struct v4l2_format *src_fmt,
+		const struct v4l2_format *dest_fmt);
+
+void v4lconvert_scaler_free(struct v4lconvert_scaler *scaler);
+
+/* For flipping and cropping in a single pass, see crop.c */
+struct v4lconvert_flip_crop {
+	int bpp;		/* bytes per pixel of the (first) plane */
+	int yuv420;		/* chroma subsampled by 2 in both directions */
+	int nv12;		/* with u and v interleaved in a single plane */
+	int yuyv;		/* packed pairs of pixels sharing u and v */
+	int src_width;
+	int src_height;
+	int dest_width;
+	int dest_height;
+	int dest_stride;
+	int hflip;
+	int vflip;
+	int step;		/* 2 when reducing, 1 otherwise */
+	int startx;		/* top left of the used part of the flipped */
+	int starty;		/* source, negative when adding a border */
+};
+
+int v4lconvert_flip_crop_init(struct v4lconvert_flip_crop *fc,
+		const struct v4l2_format *src_fmt, const struct v4l2_format *dest_fmt,
+		int hflip, int vflip);
+
+void v4lconvert_flip_crop_src_lines(const struct v4lconvert_flip_crop *fc,
+		int first, int last, int *src_first, int *src_last);
+
+void v4lconvert_flip_crop_lines(const struct v4lconvert_flip_crop *fc,
+		const unsigned char *src, int src_stride, int src_first,
+		int src_lines, unsigned char *dest, int first, int last);
+
 int v4lconvert_helper_decompress(struct v4lconvert_data *data,
 		const char *helper, const unsigned char *src, int src_size,
 		unsigned char *dest, int dest_size, int width, int height, int command);
@@ -78,14 +78,16 @@ static void v4lconvert_get_framesizes(struct v4lconvert_data *data,
 	{ V4L2_PIX_FMT_RGB24,		24,	 1,	 5,	0 }, \
 	{ V4L2_PIX_FMT_BGR24,		24,	 1,	 5,	0 }, \
 	{ V4L2_PIX_FMT_YUV420,		12,	 6,	 1,	0 }, \
-	{ V4L2_PIX_FMT_YVU420,		12,	 6,	 1,	0 }
+	{ V4L2_PIX_FMT_YVU420,		12,	 6,	 1,	0 }, \
+	{ V4L2_PIX_FMT_NV12,		12,	 6,	 1,	0 }, \
+	{ V4L2_PIX_FMT_NV21,		12,	 6,	 1,	0 }, \
+	{ V4L2_PIX_FMT_YUYV,		16,	 5,	 4,	0 }
 
 static const struct v4lconvert_pixfmt supported_src_pixfmts[] = {
 	SUPPORTED_DST_PIXFMTS,
 	/* packed rgb formats */
 	{ V4L2_PIX_FMT_RGB565,		16,	 4,	 6,	0 },
-	/* yuv 4:2:2 formats */
-	{ V4L2_PIX_FMT_YUYV,		16,	 5,	 4,	0 },
+	/* yuv 4:2:2 formats, yuyv is one of the dst formats */
 	{ V4L2_PIX_FMT_YVYU,		16,	 5,	 4,	0 },
 	{ V4L2_PIX_FMT_UYVY,		16,	 5,	 4,	0 },
 	/* yuv 4:2:0 formats */
@@ -158,6 +160,7 @@ struct v4lconvert_data *v4lconvert_create_with_dev_ops(int fd, void *dev_ops_pri
 	int i, j;
 	struct v4lconvert_data *data = calloc(1, sizeof(struct v4lconvert_data));
 	struct v4l2_capability cap;
+	char *s;
 	/* This keeps tracks of devices which have only formats for which apps
 	   most likely will need conversion and we can thus safely add software
 	   processing controls without a performance impact. */
@@ -172,8 +175,12 @@ struct v4lconvert_data *v4lconvert_create_with_dev_ops(int fd, void *dev_ops_pri
 	data->dev_ops = dev_ops;
 	data->dev_ops_priv = dev_ops_priv;
 	data->decompress_pid = -1;
+	data->decompress_shm_fd = -1;
+	pthread_mutex_init(&data->try_fmt_cache_lock, NULL);
 	data->fps = 30;
 
+	v4lconvert_init_kernels();
+
 	/* Check supported formats */
 	for (i = 0; ; i++) {
 		struct v4l2_fmtdesc fmt = { .type = V4L2_BUF_TYPE_VIDEO_CAPTURE };
@@ -229,6 +236,29 @@ struct v4lconvert_data *v4lconvert_create_with_dev_ops(int fd, void *dev_ops_pri
 		return NULL;
 	}
 
+	/* Worker threads are opt-in, allow enabling them through environment */
+	s = getenv("LIBV4LCONVERT_THREADS");
+	if (s)
+		v4lconvert_set_threads(data, strtol(s, NULL, 0));
+
+	s = getenv("LIBV4LCONVERT_JPEG_FAST_DCT");
+	if (s)
+		v4lconvert_set_jpeg_fast_dct(data, strtol(s, NULL, 0));
+
+	s = getenv("LIBV4LCONVERT_PROCESSING_UPDATE_MS");
+	if (s)
+		v4lconvert_set_processing_update_period(data,
+				strtol(s, NULL, 0));
+
+	s = getenv("LIBV4LCONVERT_PROCESSING_STATS_LINES");
+	if (s)
+		v4lconvert_set_processing_stats_lines(data,
+				strtol(s, NULL, 0));
+
+	s = getenv("LIBV4LCONVERT_SCALE");
+	if (s)
+		v4lconvert_set_scaling(data, strtol(s, NULL, 0));
+
 	return data;
 }
 
@@ -250,12 +280,15 @@ void v4lconvert_destroy(struct v4lconvert_data *data)
 		jpeg_destroy_decompress(&data->cinfo);
 #endif // HAVE_JPEG
 	v4lconvert_helper_cleanup(data);
-	free(data->convert1_buf);
+	v4lconvert_workers_destroy(data->workers);
 	free(data->convert2_buf);
 	free(data->rotate90_buf);
 	free(data->flip_buf);
 	free(data->convert_pixfmt_buf);
+	free(data->repack_buf);
 	free(data->previous_frame);
+	v4lconvert_scaler_free(&data->scaler);
+	pthread_mutex_destroy(&data->try_fmt_cache_lock);
 	free(data);
 }
 
@@ -317,13 +350,68 @@ int v4lconvert_enum_fmt(struct v4lconvert_data *data, struct v4l2_fmtdesc *fmt)
 	return 0;
 }
 
+/* Returns 1 for the semi-planar and packed yuv dst formats, many source
+   formats get converted to these through yuv420 */
+static int v4lconvert_is_repacked_fmt(unsigned int pixelformat)
+{
+	switch (pixelformat) {
+	case V4L2_PIX_FMT_NV12:
+	case V4L2_PIX_FMT_NV21:
+	case V4L2_PIX_FMT_YUYV:
+		return 1;
+	}
+	return 0;
+}
+
+/* Returns 1 if there is no direct conversion from src_pix_fmt to
+   dest_pix_fmt, and we need to convert to yuv420 and repack that */
+static int v4lconvert_needs_repack(struct v4lconvert_data *data,
+		unsigned int src_pix_fmt, unsigned int dest_pix_fmt)
+{
+	if (!v4lconvert_is_repacked_fmt(dest_pix_fmt))
+		return 0;
+
+	switch (src_pix_fmt) {
+	case V4L2_PIX_FMT_YUV420:
+	case V4L2_PIX_FMT_YVU420:
+	case V4L2_PIX_FMT_NV12:
+	case V4L2_PIX_FMT_NV21:
+	case V4L2_PIX_FMT_YUYV:
+	case V4L2_PIX_FMT_YVYU:
+	case V4L2_PIX_FMT_UYVY:
+	case V4L2_PIX_FMT_PJPG:
+	case V4L2_PIX_FMT_MJPEG:
+	case V4L2_PIX_FMT_JPEG:
+		return 0;
+	/* The bayer formats calculate u and v per 2x2 pixels */
+	case V4L2_PIX_FMT_SPCA561:
+	case V4L2_PIX_FMT_SN9C10X:
+	case V4L2_PIX_FMT_PAC207:
+	case V4L2_PIX_FMT_MR97310A:
+#ifdef HAVE_JPEG
+	case V4L2_PIX_FMT_JL2005BCD:
+#endif
+	case V4L2_PIX_FMT_SN9C2028:
+	case V4L2_PIX_FMT_SQ905C:
+	case V4L2_PIX_FMT_STV0680:
+	case V4L2_PIX_FMT_SBGGR8:
+	case V4L2_PIX_FMT_SGBRG8:
+	case V4L2_PIX_FMT_SGRBG8:
+	case V4L2_PIX_FMT_SRGGB8:
+		return dest_pix_fmt == V4L2_PIX_FMT_YUYV;
+	}
+	return 1;
+}
+
 /* This function returns a value to rank (sort) source format by preference
    when multiple source formats are available for a certain resolution, the
    source format for which this function returns the lowest value wins.
    
    This function uses the rgb_rank resp. yuv_rank values as a base when
-   converting to rgb32 resp. yuv420. The initial ranks range from 1 - 10,
-   the initial rank purely expresses the CPU cost of doing the conversion, the
+   converting to rgb32 resp. yuv420, nv12 and yuyv. For the latter 2 going
+   through yuv420 costs an extra point, while reordering one packed yuv 4:2:2
+   format into yuyv is about as cheap as it gets. The initial ranks range
+   from 1 - 10 and purely express the CPU cost of doing the conversion, the
    ranking algorithm will give a penalty of 10 points if
    (width * height * fps * bpp / 8) > bandwidth
    thus disqualifying a src format which causes the bandwidth to be exceeded,
@@ -346,6 +434,23 @@ static int v4lconvert_get_rank(struct v4lconvert_data *data,
 	case V4L2_PIX_FMT_YVU420:
 		rank = supported_src_pixfmts[src_index].yuv_rank;
 		break;
+	case V4L2_PIX_FMT_NV12:
+	case V4L2_PIX_FMT_NV21:
+	case V4L2_PIX_FMT_YUYV:
+		rank = supported_src_pixfmts[src_index].yuv_rank;
+		if (v4lconvert_needs_repack(data,
+				supported_src_pixfmts[src_index].fmt,
+				dest_pixelformat))
+			rank++;
+		if (dest_pixelformat == V4L2_PIX_FMT_YUYV)
+			switch (supported_src_pixfmts[src_index].fmt) {
+			case V4L2_PIX_FMT_YUYV:
+			case V4L2_PIX_FMT_YVYU:
+			case V4L2_PIX_FMT_UYVY:
+				rank = 1;
+				break;
+			}
+		break;
 	}
 
 	/* So that if both rgb32 and bgr32 are supported, or both yuv420 and
@@ -401,7 +506,7 @@ static int v4lconvert_do_try_format_uvc(struct v4lconvert_data *data,
 
 	for (i = 0; i < ARRAY_SIZE(supported_src_pixfmts); i++) {
 		/* is this format supported? */
-		if (!(data->framesizes[best_framesize].pixel_format & (1 << i)))
+		if (!(data->framesize_src_formats[best_framesize] & (1ULL << i)))
 			continue;
 
 		/* Note the hardcoded use of discrete is based on this function
@@ -432,6 +537,63 @@ static int v4lconvert_do_try_format_uvc(struct v4lconvert_data *data,
 	return 0;
 }
 
+/* Does a VIDIOC_TRY_FMT on the device, remembering the results, as apps
+   tend to probe many resolutions and each of these tries all our supported
+   source formats, which can be slow (f.e. USB control transfers). The cache
+   is enabled with v4lconvert_set_format_cache() and gets invalidated with
+   v4lconvert_invalidate_format_cache(). */
+static int v4lconvert_cached_try_fmt(struct v4lconvert_data *data,
+		struct v4l2_format *fmt)
+{
+	struct v4lconvert_try_fmt_cache_entry *entry, new_entry;
+	struct v4l2_pix_format *pix = &fmt->fmt.pix;
+	unsigned int generation;
+	int i, result;
+
+	if (!data->try_fmt_cache_enabled ||
+			fmt->type != V4L2_BUF_TYPE_VIDEO_CAPTURE)
+		return data->dev_ops->ioctl(data->dev_ops_priv, data->fd,
+				VIDIOC_TRY_FMT, fmt);
+
+	/* Drivers may look at any field, so all of them are the key */
+	pthread_mutex_lock(&data->try_fmt_cache_lock);
+	for (i = 0; i < data->try_fmt_cache_count; i++) {
+		entry = &data->try_fmt_cache[i];
+		if (!memcmp(&entry->in, pix, sizeof(*pix))) {
+			result = entry->result;
+			if (result)
+				errno = entry->error;
+			else
+				*pix = entry->pix;
+			pthread_mutex_unlock(&data->try_fmt_cache_lock);
+			return result;
+		}
+	}
+	generation = data->try_fmt_cache_generation;
+	pthread_mutex_unlock(&data->try_fmt_cache_lock);
+
+	new_entry.in = *pix;
+	result = data->dev_ops->ioctl(data->dev_ops_priv, data->fd,
+			VIDIOC_TRY_FMT, fmt);
+	new_entry.result = result;
+	new_entry.error = errno;
+	new_entry.pix = *pix;
+
+	/* Don't store results from before an invalidation */
+	pthread_mutex_lock(&data->try_fmt_cache_lock);
+	if (generation == data->try_fmt_cache_generation) {
+		data->try_fmt_cache[data->try_fmt_cache_next] = new_entry;
+		data->try_fmt_cache_next = (data->try_fmt_cache_next + 1) %
+			V4LCONVERT_TRY_FMT_CACHE_SIZE;
+		if (data->try_fmt_cache_count < V4LCONVERT_TRY_FMT_CACHE_SIZE)
+			data->try_fmt_cache_count++;
+	}
+	pthread_mutex_unlock(&data->try_fmt_cache_lock);
+
+	errno = new_entry.error;
+	return result;
+}
+
 static int v4lconvert_do_try_format(struct v4lconvert_data *data,
 		struct v4l2_format *dest_fmt, struct v4l2_format *src_fmt)
 {
@@ -450,8 +612,7 @@ static int v4lconvert_do_try_format(struct v4lconvert_data *data,
 
 		try_fmt = *dest_fmt;
 		try_fmt.fmt.pix.pixelformat = supported_src_pixfmts[i].fmt;
-		if (data->dev_ops->ioctl(data->dev_ops_priv, data->fd,
-				VIDIOC_TRY_FMT, &try_fmt))
+		if (v4lconvert_cached_try_fmt(data, &try_fmt))
 			continue;
 
 		if (try_fmt.fmt.pix.pixelformat !=
@@ -499,9 +660,15 @@ void v4lconvert_fixup_fmt(struct v4l2_format *fmt)
 		break;
 	case V4L2_PIX_FMT_YUV420:
 	case V4L2_PIX_FMT_YVU420:
+	case V4L2_PIX_FMT_NV12:
+	case V4L2_PIX_FMT_NV21:
 		fmt->fmt.pix.bytesperline = fmt->fmt.pix.width;
 		fmt->fmt.pix.sizeimage = fmt->fmt.pix.width * fmt->fmt.pix.height * 3 / 2;
 		break;
+	case V4L2_PIX_FMT_YUYV:
+		fmt->fmt.pix.bytesperline = fmt->fmt.pix.width * 2;
+		fmt->fmt.pix.sizeimage = fmt->fmt.pix.width * fmt->fmt.pix.height * 2;
+		break;
 	}
 }
 
@@ -525,8 +692,7 @@ int v4lconvert_try_format(struct v4lconvert_data *data,
 	if (!v4lconvert_supported_dst_format(dest_fmt->fmt.pix.pixelformat) ||
 			dest_fmt->type != V4L2_BUF_TYPE_VIDEO_CAPTURE ||
 			v4lconvert_do_try_format(data, &try_dest, &try_src)) {
-		result = data->dev_ops->ioctl(data->dev_ops_priv, data->fd,
-				VIDIOC_TRY_FMT, dest_fmt);
+		result = v4lconvert_cached_try_fmt(data, dest_fmt);
 		if (src_fmt)
 			*src_fmt = *dest_fmt;
 		return result;
@@ -598,6 +764,18 @@ int v4lconvert_try_format(struct v4lconvert_data *data,
 		}
 	}
 
+	/* Otherwise give the app what it asked for by scaling the closest
+	   resolution, when enabled */
+	if (data->scale_filter != V4LCONVERT_SCALE_NONE &&
+			(try_dest.fmt.pix.width != desired_width ||
+			 try_dest.fmt.pix.height != desired_height) &&
+			desired_width >= 8 && desired_height >= 2 &&
+			desired_width <= try_src.fmt.pix.width * 4 &&
+			desired_height <= try_src.fmt.pix.height * 4) {
+		try_dest.fmt.pix.width = desired_width;
+		try_dest.fmt.pix.height = desired_height;
+	}
+
 	/* Some applications / libs (*cough* gstreamer *cough*) will not work
 	   correctly with planar YUV formats when the width is not a multiple of 8
 	   or the height is not a multiple of 2. With RGB formats these apps require
@@ -634,37 +812,6 @@ int v4lconvert_needs_conversion(struct v4lconvert_data *data,
 	return 0;
 }
 
-static int v4lconvert_processing_needs_double_conversion(
-		unsigned int src_pix_fmt, unsigned int dest_pix_fmt)
-{
-	switch (src_pix_fmt) {
-	case V4L2_PIX_FMT_RGB24:
-	case V4L2_PIX_FMT_BGR24:
-	case V4L2_PIX_FMT_SPCA561:
-	case V4L2_PIX_FMT_SN9C10X:
-	case V4L2_PIX_FMT_PAC207:
-	case V4L2_PIX_FMT_MR97310A:
-#ifdef HAVE_JPEG
-	case V4L2_PIX_FMT_JL2005BCD:
-#endif
-	case V4L2_PIX_FMT_SN9C2028:
-	case V4L2_PIX_FMT_SQ905C:
-	case V4L2_PIX_FMT_SBGGR8:
-	case V4L2_PIX_FMT_SGBRG8:
-	case V4L2_PIX_FMT_SGRBG8:
-	case V4L2_PIX_FMT_SRGGB8:
-	case V4L2_PIX_FMT_STV0680:
-		return 0;
-	}
-	switch (dest_pix_fmt) {
-	case V4L2_PIX_FMT_RGB24:
-	case V4L2_PIX_FMT_BGR24:
-		return 0;
-	}
-
-	return 1;
-}
-
 unsigned char *v4lconvert_alloc_buffer(int needed,
 		unsigned char **buf, int *buf_size)
 {
@@ -697,6 +844,36 @@ static int v4lconvert_convert_pixfmt(struct v4lconvert_data *data,
 	unsigned int height = fmt->fmt.pix.height;
 	unsigned int bytesperline = fmt->fmt.pix.bytesperline;
 
+	if (v4lconvert_needs_repack(data, src_pix_fmt, dest_pix_fmt)) {
+		unsigned char *d = v4lconvert_alloc_buffer(width * height * 3 / 2,
+				&data->repack_buf, &data->repack_buf_size);
+		if (!d)
+			return v4lconvert_oom_error(data);
+
+		result = v4lconvert_convert_pixfmt(data, src, src_size, d,
+				width * height * 3 / 2, fmt, V4L2_PIX_FMT_YUV420);
+		/* Errors before conversion leave fmt as is */
+		if (fmt->fmt.pix.pixelformat != V4L2_PIX_FMT_YUV420)
+			return result;
+
+		width = fmt->fmt.pix.width;
+		height = fmt->fmt.pix.height;
+		switch (dest_pix_fmt) {
+		case V4L2_PIX_FMT_NV12:
+			v4lconvert_yuv420_to_nv12(d, dest, width, height, 0);
+			break;
+		case V4L2_PIX_FMT_NV21:
+			v4lconvert_yuv420_to_nv12(d, dest, width, height, 1);
+			break;
+		case V4L2_PIX_FMT_YUYV:
+			v4lconvert_yuv420_to_yuyv(d, dest, width, height, 0);
+			break;
+		}
+		fmt->fmt.pix.pixelformat = dest_pix_fmt;
+		v4lconvert_fixup_fmt(fmt);
+		return result;
+	}
+
 	switch (src_pix_fmt) {
 	/* JPG and variants */
 	case V4L2_PIX_FMT_MJPEG:
@@ -933,16 +1110,22 @@ static int v4lconvert_convert_pixfmt(struct v4lconvert_data *data,
 	case V4L2_PIX_FMT_SRGGB8:
 		switch (dest_pix_fmt) {
 		case V4L2_PIX_FMT_RGB24:
-			v4lconvert_bayer_to_rgb24(src, dest, width, height, bytesperline, src_pix_fmt);
+			v4lconvert_bayer_to_rgb24(data, src, dest, width, height, bytesperline, src_pix_fmt);
 			break;
 		case V4L2_PIX_FMT_BGR24:
-			v4lconvert_bayer_to_bgr24(src, dest, width, height, bytesperline, src_pix_fmt);
+			v4lconvert_bayer_to_bgr24(data, src, dest, width, height, bytesperline, src_pix_fmt);
 			break;
 		case V4L2_PIX_FMT_YUV420:
-			v4lconvert_bayer_to_yuv420(src, dest, width, height, bytesperline, src_pix_fmt, 0);
+			v4lconvert_bayer_to_yuv420(data, src, dest, width, height, bytesperline, src_pix_fmt, 0);
 			break;
 		case V4L2_PIX_FMT_YVU420:
-			v4lconvert_bayer_to_yuv420(src, dest, width, height, bytesperline, src_pix_fmt, 1);
+			v4lconvert_bayer_to_yuv420(data, src, dest, width, height, bytesperline, src_pix_fmt, 1);
+			break;
+		case V4L2_PIX_FMT_NV12:
+			v4lconvert_bayer_to_nv12(data, src, dest, width, height, bytesperline, src_pix_fmt, 0);
+			break;
+		case V4L2_PIX_FMT_NV21:
+			v4lconvert_bayer_to_nv12(data, src, dest, width, height, bytesperline, src_pix_fmt, 1);
 			break;
 		}
 		if (src_size < (width * height)) {
@@ -1111,6 +1294,15 @@ static int v4lconvert_convert_pixfmt(struct v4lconvert_data *data,
 		case V4L2_PIX_FMT_YVU420:
 			v4lconvert_swap_uv(src, dest, fmt);
 			break;
+		case V4L2_PIX_FMT_NV12:
+			v4lconvert_yuv420_to_nv12(src, dest, width, height, 0);
+			break;
+		case V4L2_PIX_FMT_NV21:
+			v4lconvert_yuv420_to_nv12(src, dest, width, height, 1);
+			break;
+		case V4L2_PIX_FMT_YUYV:
+			v4lconvert_yuv420_to_yuyv(src, dest, width, height, 0);
+			break;
 		}
 		if (src_size < (width * height * 3 / 2)) {
 			V4LCONVERT_ERR("short yuv420 data frame\n");
@@ -1135,6 +1327,15 @@ static int v4lconvert_convert_pixfmt(struct v4lconvert_data *data,
 		case V4L2_PIX_FMT_YVU420:
 			memcpy(dest, src, width * height * 3 / 2);
 			break;
+		case V4L2_PIX_FMT_NV12:
+			v4lconvert_yuv420_to_nv12(src, dest, width, height, 1);
+			break;
+		case V4L2_PIX_FMT_NV21:
+			v4lconvert_yuv420_to_nv12(src, dest, width, height, 0);
+			break;
+		case V4L2_PIX_FMT_YUYV:
+			v4lconvert_yuv420_to_yuyv(src, dest, width, height, 1);
+			break;
 		}
 		if (src_size < (width * height * 3 / 2)) {
 			V4LCONVERT_ERR("short yvu420 data frame\n");
@@ -1143,6 +1344,42 @@ static int v4lconvert_convert_pixfmt(struct v4lconvert_data *data,
 		}
 		break;
 
+	case V4L2_PIX_FMT_NV12:
+	case V4L2_PIX_FMT_NV21: {
+		int nv21 = src_pix_fmt == V4L2_PIX_FMT_NV21;
+
+		switch (dest_pix_fmt) {
+		case V4L2_PIX_FMT_RGB24:
+			v4lconvert_nv12_to_rgb24(src, dest, width, height, 0, nv21);
+			break;
+		case V4L2_PIX_FMT_BGR24:
+			v4lconvert_nv12_to_rgb24(src, dest, width, height, 1, nv21);
+			break;
+		case V4L2_PIX_FMT_YUV420:
+			v4lconvert_nv12_to_yuv420(src, dest, width, height, nv21);
+			break;
+		case V4L2_PIX_FMT_YVU420:
+			v4lconvert_nv12_to_yuv420(src, dest, width, height, !nv21);
+			break;
+		case V4L2_PIX_FMT_NV12:
+		case V4L2_PIX_FMT_NV21:
+			if (dest_pix_fmt == src_pix_fmt)
+				memcpy(dest, src, width * height * 3 / 2);
+			else
+				v4lconvert_nv12_to_nv21(src, dest, width, height);
+			break;
+		case V4L2_PIX_FMT_YUYV:
+			v4lconvert_nv12_to_yuyv(src, dest, width, height, nv21);
+			break;
+		}
+		if (src_size < (width * height * 3 / 2)) {
+			V4LCONVERT_ERR("short nv12 data frame\n");
+			errno = EPIPE;
+			result = -1;
+		}
+		break;
+	}
+
 	case V4L2_PIX_FMT_YUYV:
 		switch (dest_pix_fmt) {
 		case V4L2_PIX_FMT_RGB24:
@@ -1157,6 +1394,16 @@ static int v4lconvert_convert_pixfmt(struct v4lconvert_data *data,
 		case V4L2_PIX_FMT_YVU420:
 			v4lconvert_yuyv_to_yuv420(src, dest, width, height, bytesperline, 1);
 			break;
+		case V4L2_PIX_FMT_NV12:
+			v4lconvert_yuyv_to_nv12(src, dest, width, height, bytesperline, 0);
+			break;
+		case V4L2_PIX_FMT_NV21:
+			v4lconvert_yuyv_to_nv12(src, dest, width, height, bytesperline, 1);
+			break;
+		case V4L2_PIX_FMT_YUYV:
+			v4lconvert_yuv422_to_yuyv(src, dest, width, height, bytesperline,
+					V4LCONVERT_ORDER_YUYV);
+			break;
 		}
 		if (src_size < (width * height * 2)) {
 			V4LCONVERT_ERR("short yuyv data frame\n");
@@ -1181,6 +1428,16 @@ static int v4lconvert_convert_pixfmt(struct v4lconvert_data *data,
 		case V4L2_PIX_FMT_YVU420:
 			v4lconvert_yuyv_to_yuv420(src, dest, width, height, bytesperline, 0);
 			break;
+		case V4L2_PIX_FMT_NV12:
+			v4lconvert_yuyv_to_nv12(src, dest, width, height, bytesperline, 1);
+			break;
+		case V4L2_PIX_FMT_NV21:
+			v4lconvert_yuyv_to_nv12(src, dest, width, height, bytesperline, 0);
+			break;
+		case V4L2_PIX_FMT_YUYV:
+			v4lconvert_yuv422_to_yuyv(src, dest, width, height, bytesperline,
+					V4LCONVERT_ORDER_YVYU);
+			break;
 		}
 		if (src_size < (width * height * 2)) {
 			V4LCONVERT_ERR("short yvyu data frame\n");
@@ -1203,6 +1460,16 @@ static int v4lconvert_convert_pixfmt(struct v4lconvert_data *data,
 		case V4L2_PIX_FMT_YVU420:
 			v4lconvert_uyvy_to_yuv420(src, dest, width, height, bytesperline, 1);
 			break;
+		case V4L2_PIX_FMT_NV12:
+			v4lconvert_uyvy_to_nv12(src, dest, width, height, bytesperline, 0);
+			break;
+		case V4L2_PIX_FMT_NV21:
+			v4lconvert_uyvy_to_nv12(src, dest, width, height, bytesperline, 1);
+			break;
+		case V4L2_PIX_FMT_YUYV:
+			v4lconvert_yuv422_to_yuyv(src, dest, width, height, bytesperline,
+					V4LCONVERT_ORDER_UYVY);
+			break;
 		}
 		if (src_size < (width * height * 2)) {
 			V4LCONVERT_ERR("short uyvy data frame\n");
@@ -1223,15 +1490,274 @@ static int v4lconvert_convert_pixfmt(struct v4lconvert_data *data,
 	return result;
 }
 
+/* Size of the strips in which line based formats get converted */
+#define V4LCONVERT_STRIP_SIZE 65536
+
+/* Returns 1 if the lines of src can be converted separately, when flipping
+   and / or cropping we then convert a strip of lines at a time and directly
+   flip / crop these while they are still in the cache */
+static int v4lconvert_can_convert_strips(struct v4lconvert_data *data,
+		const struct v4l2_format *fmt, unsigned int dest_pix_fmt,
+		int src_size)
+{
+	int width = fmt->fmt.pix.width;
+	int bytesperline = fmt->fmt.pix.bytesperline;
+
+	/* Leave short frames to the normal path, which reports them */
+	if (src_size < fmt->fmt.pix.height * bytesperline)
+		return 0;
+
+	/* Repacking uses a single buffer for the whole frame */
+	if (v4lconvert_needs_repack(data, fmt->fmt.pix.pixelformat,
+				dest_pix_fmt))
+		return 0;
+
+	switch (fmt->fmt.pix.pixelformat) {
+	case V4L2_PIX_FMT_YUYV:
+	case V4L2_PIX_FMT_YVYU:
+	case V4L2_PIX_FMT_UYVY:
+		return bytesperline >= width * 2;
+	/* These conversions assume there is no padding at the end of lines */
+	case V4L2_PIX_FMT_RGB24:
+	case V4L2_PIX_FMT_BGR24:
+		return bytesperline == width * 3;
+	case V4L2_PIX_FMT_RGB565:
+		return bytesperline == width * 2;
+	case V4L2_PIX_FMT_GREY:
+		return bytesperline == width;
+	}
+	return 0;
+}
+
+/* Returns 1 if processing should be done on the source frame rather than
+   on the converted one. Processing yuv (gamma on luma only, whitebalance
+   as chroma offsets) does not give the same picture as processing rgb, so
+   yuv sources only get processed as is for yuv destinations. For rgb
+   destinations the rgb frame gets processed, like it always did. */
+static int v4lconvert_process_src(unsigned int src_pix_fmt,
+		unsigned int dest_pix_fmt)
+{
+	if (!v4lprocessing_supported_fmt(src_pix_fmt))
+		return 0;
+
+	switch (src_pix_fmt) {
+	case V4L2_PIX_FMT_YUV420:
+	case V4L2_PIX_FMT_YVU420:
+	case V4L2_PIX_FMT_NV12:
+	case V4L2_PIX_FMT_NV21:
+	case V4L2_PIX_FMT_YUYV:
+	case V4L2_PIX_FMT_YVYU:
+	case V4L2_PIX_FMT_UYVY:
+		return dest_pix_fmt != V4L2_PIX_FMT_RGB24 &&
+			dest_pix_fmt != V4L2_PIX_FMT_BGR24;
+	}
+	return 1;
+}
+
+/* Processing of strips, the lookup tables get applied to the source lines
+   before converting them, or to the converted lines */
+#define V4LCONVERT_PROCESS_SRC 1
+#define V4LCONVERT_PROCESS_DEST 2
+
+/* Returns how to process the strips of this frame, or 0 if the frame must
+   be processed as a whole as the lookup tables need updating. Like for
+   whole frames see v4lconvert_process_src() for which one gets processed. */
+static int v4lconvert_strips_processing(struct v4lconvert_data *data,
+		const struct v4l2_format *src_fmt, unsigned int dest_pix_fmt)
+{
+	if (v4lconvert_process_src(src_fmt->fmt.pix.pixelformat, dest_pix_fmt))
+		return v4lprocessing_start_processing_lines(data->processing,
+				src_fmt->fmt.pix.pixelformat) ?
+			V4LCONVERT_PROCESS_SRC : 0;
+
+	return v4lprocessing_start_processing_lines(data->processing,
+			dest_pix_fmt) ? V4LCONVERT_PROCESS_DEST : 0;
+}
+
+struct v4lconvert_strips_job {
+	struct v4lconvert_data *data;
+	const struct v4l2_format *src_fmt;
+	unsigned int dest_pix_fmt;
+	const struct v4lconvert_flip_crop *fc;
+	unsigned char *src;
+	unsigned char *dest;
+	unsigned char *strips;	/* a strip buffer per band */
+	int strip_size;
+	int processing;		/* 0 or V4LCONVERT_PROCESS_* */
+	int src_strip_size;	/* for processed copies of the source lines */
+	int lines;		/* destination lines per strip */
+	int no_strips;
+	int no_bands;
+	int result;
+};
+
+static void v4lconvert_convert_strips_band(void *arg, int band)
+{
+	struct v4lconvert_strips_job *job = arg;
+	const struct v4lconvert_flip_crop *fc = job->fc;
+	int bytesperline = job->src_fmt->fmt.pix.bytesperline;
+	unsigned char *strip = job->strips +
+		band * (job->strip_size + job->src_strip_size);
+	unsigned char *src_strip = strip + job->strip_size;
+	int i, res, first, last, src_first, src_last;
+	struct v4l2_format strip_fmt;
+	unsigned char *src;
+
+	for (i = band * job->no_strips / job->no_bands;
+			i < (band + 1) * job->no_strips / job->no_bands; i++) {
+		first = i * job->lines;
+		last = MIN(first + job->lines, fc->dest_height);
+		v4lconvert_flip_crop_src_lines(fc, first, last,
+				&src_first, &src_last);
+
+		/* Nothing to convert for lines which are all border */
+		if (src_last > src_first) {
+			strip_fmt = *job->src_fmt;
+			strip_fmt.fmt.pix.height = src_last - src_first;
+			src = job->src + src_first * bytesperline;
+
+			/* Strips may share source lines, so process a copy of
+			   them instead of the source itself */
+			if (job->processing == V4LCONVERT_PROCESS_SRC) {
+				memcpy(src_strip, src,
+					(src_last - src_first) * bytesperline);
+				v4lprocessing_processing_lines(
+					job->data->processing, src_strip,
+					&strip_fmt, 0, strip_fmt.fmt.pix.height);
+				src = src_strip;
+			}
+
+			res = v4lconvert_convert_pixfmt(job->data, src,
+					(src_last - src_first) * bytesperline,
+					strip, job->strip_size, &strip_fmt,
+					job->dest_pix_fmt);
+			if (res)
+				job->result = res;
+
+			if (job->processing == V4LCONVERT_PROCESS_DEST)
+				v4lprocessing_processing_lines(
+					job->data->processing, strip,
+					&strip_fmt, 0, strip_fmt.fmt.pix.height);
+		}
+
+		v4lconvert_flip_crop_lines(fc, strip, fc->src_width * fc->bpp,
+				src_first, src_last - src_first, job->dest, first, last);
+	}
+}
+
+static int v4lconvert_convert_strips(struct v4lconvert_data *data,
+		const struct v4l2_format *src_fmt, unsigned int dest_pix_fmt,
+		const struct v4lconvert_flip_crop *fc, unsigned char *src,
+		unsigned char *dest, int processing)
+{
+	struct v4lconvert_strips_job job = {
+		.data = data,
+		.src_fmt = src_fmt,
+		.dest_pix_fmt = dest_pix_fmt,
+		.fc = fc,
+		.src = src,
+		.dest = dest,
+		.processing = processing,
+		.no_bands = 1,
+	};
+
+	job.lines = (V4LCONVERT_STRIP_SIZE / (fc->src_width * fc->bpp)) & ~1;
+	if (job.lines < 2)
+		job.lines = 2;
+	job.no_strips = (fc->dest_height + job.lines - 1) / job.lines;
+
+	if (data->workers) {
+		/* Use some more bands than threads to even out the load */
+		job.no_bands = v4lconvert_workers_threads(data->workers) * 2;
+		if (job.no_bands > job.no_strips)
+			job.no_bands = job.no_strips;
+	}
+
+	/* When reducing we need twice the lines, + 2 for rounding to whole
+	   chroma lines */
+	job.strip_size = (job.lines * fc->step + 2) * fc->src_width * 3;
+	if (processing == V4LCONVERT_PROCESS_SRC)
+		job.src_strip_size = (job.lines * fc->step + 2) *
+			src_fmt->fmt.pix.bytesperline;
+	job.strips = v4lconvert_alloc_buffer(job.no_bands *
+			(job.strip_size + job.src_strip_size),
+			&data->convert2_buf, &data->convert2_buf_size);
+	if (!job.strips)
+		return v4lconvert_oom_error(data);
+
+	v4lconvert_workers_run(data->workers, v4lconvert_convert_strips_band,
+			&job, job.no_bands);
+
+	return job.result;
+}
+
+/* Does a complete conversion to yuv420 and converts the result to
+   dest_fmt, which is one of the repacked formats */
+static int v4lconvert_convert_repacked(struct v4lconvert_data *data,
+		const struct v4l2_format *src_fmt, const struct v4l2_format *dest_fmt,
+		unsigned char *src, int src_size, unsigned char *dest,
+		const struct v4l2_format *repack_fmt)
+{
+	int res, width = repack_fmt->fmt.pix.width;
+	int height = repack_fmt->fmt.pix.height;
+	struct v4l2_format yuv_fmt = *dest_fmt;
+	unsigned char *d;
+
+	yuv_fmt.fmt.pix.pixelformat = V4L2_PIX_FMT_YUV420;
+	v4lconvert_fixup_fmt(&yuv_fmt);
+	d = v4lconvert_alloc_buffer(yuv_fmt.fmt.pix.sizeimage,
+			&data->repack_buf, &data->repack_buf_size);
+	if (!d)
+		return v4lconvert_oom_error(data);
+
+	res = v4lconvert_convert(data, src_fmt, &yuv_fmt, src, src_size, d,
+			yuv_fmt.fmt.pix.sizeimage);
+	if (res < 0)
+		return res;
+
+	switch (repack_fmt->fmt.pix.pixelformat) {
+	case V4L2_PIX_FMT_NV12:
+		v4lconvert_yuv420_to_nv12(d, dest, width, height, 0);
+		break;
+	case V4L2_PIX_FMT_NV21:
+		v4lconvert_yuv420_to_nv12(d, dest, width, height, 1);
+		break;
+	case V4L2_PIX_FMT_YUYV:
+		v4lconvert_yuv420_to_yuyv(d, dest, width, height, 0);
+		break;
+	}
+
+	return 0;
+}
+
+/* Returns 1 if the frame gets passed on unmodified */
+static int v4lconvert_passthrough(struct v4lconvert_data *data,
+		const struct v4l2_format *src_fmt, const struct v4l2_format *dest_fmt,
+		int processing)
+{
+	/* If no conversion/processing is needed */
+	if (src_fmt->fmt.pix.pixelformat == dest_fmt->fmt.pix.pixelformat &&
+			src_fmt->fmt.pix.width == dest_fmt->fmt.pix.width &&
+			src_fmt->fmt.pix.height == dest_fmt->fmt.pix.height &&
+			!processing &&
+			!(data->control_flags & V4LCONTROL_ROTATED_90_JPEG) &&
+			!v4lcontrol_get_ctrl(data->control, V4LCONTROL_HFLIP) &&
+			!v4lcontrol_get_ctrl(data->control, V4LCONTROL_VFLIP))
+		return 1;
+
+	/* or if we should do processing/rotating/flipping but the app tries to
+	   use the native cam format, we just return an unprocessed frame copy */
+	return !v4lconvert_supported_dst_format(dest_fmt->fmt.pix.pixelformat);
+}
+
 int v4lconvert_convert(struct v4lconvert_data *data,
 		const struct v4l2_format *src_fmt,  /* in */
 		const struct v4l2_format *dest_fmt, /* in */
 		unsigned char *src, int src_size, unsigned char *dest, int dest_size)
 {
 	int res, dest_needed, temp_needed, processing, convert = 0;
-	int rotate90, vflip, hflip, crop;
-	unsigned char *convert1_dest = dest;
-	int convert1_dest_size = dest_size;
+	int rotate90, vflip, hflip, crop, flip_crop = 0, flip_inplace = 0, threaded;
+	int strips_processing = 0;
 	unsigned char *convert2_src = src, *convert2_dest = dest;
 	int convert2_dest_size = dest_size;
 	unsigned char *rotate90_src = src, *rotate90_dest = dest;
@@ -1239,6 +1765,7 @@ int v4lconvert_convert(struct v4lconvert_data *data,
 	unsigned char *crop_src = src;
 	struct v4l2_format my_src_fmt = *src_fmt;
 	struct v4l2_format my_dest_fmt = *dest_fmt;
+	struct v4lconvert_flip_crop fc;
 
 	processing = v4lprocessing_pre_processing(data->processing);
 	rotate90 = data->control_flags & V4LCONTROL_ROTATED_90_JPEG;
@@ -1247,12 +1774,7 @@ int v4lconvert_convert(struct v4lconvert_data *data,
 	crop = my_dest_fmt.fmt.pix.width != my_src_fmt.fmt.pix.width ||
 		my_dest_fmt.fmt.pix.height != my_src_fmt.fmt.pix.height;
 
-	if (/* If no conversion/processing is needed */
-			(src_fmt->fmt.pix.pixelformat == dest_fmt->fmt.pix.pixelformat &&
-			 !processing && !rotate90 && !hflip && !vflip && !crop) ||
-			/* or if we should do processing/rotating/flipping but the app tries to
-			   use the native cam format, we just return an unprocessed frame copy */
-			!v4lconvert_supported_dst_format(dest_fmt->fmt.pix.pixelformat)) {
+	if (v4lconvert_passthrough(data, src_fmt, dest_fmt, processing)) {
 		int to_copy = MIN(dest_size, src_size);
 		memcpy(dest, src, to_copy);
 		return to_copy;
@@ -1274,11 +1796,17 @@ int v4lconvert_convert(struct v4lconvert_data *data,
 		break;
 	case V4L2_PIX_FMT_YUV420:
 	case V4L2_PIX_FMT_YVU420:
+	case V4L2_PIX_FMT_NV12:
+	case V4L2_PIX_FMT_NV21:
 		dest_needed =
 			my_dest_fmt.fmt.pix.width * my_dest_fmt.fmt.pix.height * 3 / 2;
 		temp_needed =
 			my_src_fmt.fmt.pix.width * my_src_fmt.fmt.pix.height * 3 / 2;
 		break;
+	case V4L2_PIX_FMT_YUYV:
+		dest_needed = my_dest_fmt.fmt.pix.width * my_dest_fmt.fmt.pix.height * 2;
+		temp_needed = my_src_fmt.fmt.pix.width * my_src_fmt.fmt.pix.height * 2;
+		break;
 	default:
 		V4LCONVERT_ERR("Unknown dest format in conversion\n");
 		errno = EINVAL;
@@ -1293,13 +1821,7 @@ int v4lconvert_convert(struct v4lconvert_data *data,
 	}
 
 
-	/* Sometimes we need foo -> rgb -> bar as video processing (whitebalance,
-	   etc.) can only be done on rgb data */
-	if (processing && v4lconvert_processing_needs_double_conversion(
-				my_src_fmt.fmt.pix.pixelformat,
-				my_dest_fmt.fmt.pix.pixelformat))
-		convert = 2;
-	else if (my_dest_fmt.fmt.pix.pixelformat !=
+	if (my_dest_fmt.fmt.pix.pixelformat !=
 			my_src_fmt.fmt.pix.pixelformat ||
 		 /* Special case if we do not need to do conversion, but we
 		    are not doing any other step involving copying either,
@@ -1308,21 +1830,58 @@ int v4lconvert_convert(struct v4lconvert_data *data,
 		 (!rotate90 && !hflip && !vflip && !crop))
 		convert = 1;
 
-	/* convert_pixfmt (only if convert == 2) -> processing -> convert_pixfmt ->
-	   rotate -> flip -> crop, all steps are optional */
-	if (convert == 2) {
-		convert1_dest = v4lconvert_alloc_buffer(
-				my_src_fmt.fmt.pix.width * my_src_fmt.fmt.pix.height * 3,
-				&data->convert1_buf, &data->convert1_buf_size);
-		if (!convert1_dest)
-			return v4lconvert_oom_error(data);
+	/* Flipping and cropping only move pixels around, so we do both in a
+	   single pass when possible */
+	threaded = data->workers && my_src_fmt.fmt.pix.pixelformat !=
+		my_dest_fmt.fmt.pix.pixelformat;
+	if (!rotate90 && (hflip || vflip || crop || threaded || processing) &&
+			!(crop && v4lconvert_scale_needed(data, &my_src_fmt,
+				&my_dest_fmt)))
+		flip_crop = !v4lconvert_flip_crop_init(&fc, &my_src_fmt,
+				&my_dest_fmt, hflip, vflip);
+
+	/* And if there is no processing to do on the whole frame, do so
+	   directly on strips of converted lines, which also is how we split
+	   the conversion of these formats over the worker threads. The
+	   lookup tables then get applied to the strips too, unless they need
+	   updating from the whole frame. */
+	if (flip_crop && convert == 1 &&
+			v4lconvert_can_convert_strips(data, &my_src_fmt,
+				my_dest_fmt.fmt.pix.pixelformat, src_size) &&
+			(!processing || (strips_processing =
+				v4lconvert_strips_processing(data, &my_src_fmt,
+					my_dest_fmt.fmt.pix.pixelformat)))) {
+		res = v4lconvert_convert_strips(data, &my_src_fmt,
+				my_dest_fmt.fmt.pix.pixelformat, &fc, src, dest,
+				strips_processing);
+		return res ? res : dest_needed;
+	}
+
+	/* Without flipping / cropping we only wanted the strips */
+	if (!hflip && !vflip && !crop)
+		flip_crop = 0;
+
+	/* Rotating and the separate flip and crop steps only know about rgb
+	   and planar yuv, for the other formats these get done on yuv420 */
+	if (v4lconvert_is_repacked_fmt(my_dest_fmt.fmt.pix.pixelformat) &&
+			(rotate90 || ((hflip || vflip || crop) && !flip_crop))) {
+		res = v4lconvert_convert_repacked(data, src_fmt, dest_fmt,
+				src, src_size, dest, &my_dest_fmt);
+		return res ? res : dest_needed;
+	}
 
-		convert1_dest_size =
-			my_src_fmt.fmt.pix.width * my_src_fmt.fmt.pix.height * 3;
-		convert2_src = convert1_dest;
+	/* Flipping without cropping is done in place on the converted frame,
+	   instead of converting to a temporary buffer first */
+	if (convert && flip_crop && !crop) {
+		flip_crop = 0;
+		flip_inplace = 1;
 	}
 
-	if (convert && (rotate90 || hflip || vflip || crop)) {
+	/* processing -> convert_pixfmt -> rotate -> flip -> crop, all steps are
+	   optional. Processing works on rgb, bayer and yuv data, so it gets done
+	   either on the src or on the converted frame, see
+	   v4lconvert_process_src(). */
+	if (convert && !flip_inplace && (rotate90 || hflip || vflip || crop)) {
 		convert2_dest = v4lconvert_alloc_buffer(temp_needed,
 				&data->convert2_buf, &data->convert2_buf_size);
 		if (!convert2_dest)
@@ -1341,7 +1900,7 @@ int v4lconvert_convert(struct v4lconvert_data *data,
 		flip_src = crop_src = rotate90_dest;
 	}
 
-	if ((vflip || hflip) && crop) {
+	if ((vflip || hflip) && crop && !flip_crop) {
 		flip_dest = v4lconvert_alloc_buffer(temp_needed, &data->flip_buf,
 				&data->flip_buf_size);
 		if (!flip_dest)
@@ -1352,18 +1911,8 @@ int v4lconvert_convert(struct v4lconvert_data *data,
 
 	/* Done setting sources / dest and allocating intermediate buffers,
 	   real conversion / processing / ... starts here. */
-	if (convert == 2) {
-		res = v4lconvert_convert_pixfmt(data, src, src_size,
-				convert1_dest, convert1_dest_size,
-				&my_src_fmt,
-				V4L2_PIX_FMT_RGB24);
-		if (res)
-			return res;
-
-		src_size = my_src_fmt.fmt.pix.sizeimage;
-	}
-
-	if (processing)
+	if (processing && v4lconvert_process_src(my_src_fmt.fmt.pix.pixelformat,
+				my_dest_fmt.fmt.pix.pixelformat))
 		v4lprocessing_processing(data->processing, convert2_src, &my_src_fmt);
 
 	if (convert) {
@@ -1376,25 +1925,142 @@ int v4lconvert_convert(struct v4lconvert_data *data,
 
 		src_size = my_src_fmt.fmt.pix.sizeimage;
 
-		/* We call processing here again in case the source format was not
-		   rgb, but the dest is. v4lprocessing checks it self it only actually
+		/* We call processing here again in case the source did not
+		   get processed. v4lprocessing checks it self it only actually
 		   does the processing once per frame. */
 		if (processing)
 			v4lprocessing_processing(data->processing, convert2_dest, &my_src_fmt);
 	}
 
+	if (flip_inplace) {
+		v4lconvert_flip_inplace(dest, &my_src_fmt, hflip, vflip);
+		return dest_needed;
+	}
+
 	if (rotate90)
 		v4lconvert_rotate90(rotate90_src, rotate90_dest, &my_src_fmt);
 
+	if (flip_crop) {
+		v4lconvert_flip_crop_lines(&fc, crop_src,
+				my_src_fmt.fmt.pix.bytesperline, 0,
+				my_src_fmt.fmt.pix.height, dest, 0, fc.dest_height);
+		return dest_needed;
+	}
+
 	if (hflip || vflip)
 		v4lconvert_flip(flip_src, flip_dest, &my_src_fmt, hflip, vflip);
 
-	if (crop)
+	if (crop && v4lconvert_scale_needed(data, &my_src_fmt, &my_dest_fmt)) {
+		res = v4lconvert_scale(data, crop_src, dest, &my_src_fmt,
+				&my_dest_fmt);
+		if (res)
+			return res;
+	} else if (crop) {
 		v4lconvert_crop(crop_src, dest, &my_src_fmt, &my_dest_fmt);
+	}
 
 	return dest_needed;
 }
 
+int v4lconvert_convert_nocopy(struct v4lconvert_data *data,
+		const struct v4l2_format *src_fmt,  /* in */
+		const struct v4l2_format *dest_fmt, /* in */
+		unsigned char *src, int src_size, unsigned char *dest, int dest_size,
+		unsigned char **frame)
+{
+	int processing = v4lprocessing_pre_processing(data->processing);
+
+	if (v4lconvert_passthrough(data, src_fmt, dest_fmt, processing)) {
+		*frame = src;
+		return src_size;
+	}
+
+	*frame = dest;
+	return v4lconvert_convert(data, src_fmt, dest_fmt, src, src_size,
+			dest, dest_size);
+}
+
+int v4lconvert_can_convert_inplace(struct v4lconvert_data *data,
+		const struct v4l2_format *src_fmt,  /* in */
+		const struct v4l2_format *dest_fmt) /* in */
+{
+	if (src_fmt->fmt.pix.pixelformat != dest_fmt->fmt.pix.pixelformat ||
+			src_fmt->fmt.pix.width != dest_fmt->fmt.pix.width ||
+			src_fmt->fmt.pix.height != dest_fmt->fmt.pix.height ||
+			src_fmt->fmt.pix.bytesperline != dest_fmt->fmt.pix.bytesperline ||
+			(data->control_flags & V4LCONTROL_ROTATED_90_JPEG))
+		return 0;
+
+	switch (dest_fmt->fmt.pix.pixelformat) {
+	case V4L2_PIX_FMT_RGB24:
+	case V4L2_PIX_FMT_BGR24:
+	case V4L2_PIX_FMT_YUV420:
+	case V4L2_PIX_FMT_YVU420:
+	case V4L2_PIX_FMT_NV12:
+	case V4L2_PIX_FMT_NV21:
+	case V4L2_PIX_FMT_YUYV:
+		return 1;
+	}
+	return 0;
+}
+
+int v4lconvert_convert_inplace(struct v4lconvert_data *data,
+		const struct v4l2_format *src_fmt,  /* in */
+		const struct v4l2_format *dest_fmt, /* in */
+		unsigned char *buf, int src_size, int buf_size)
+{
+	int processing, hflip, vflip, frame_size;
+	struct v4l2_format my_fmt = *src_fmt;
+
+	if (!v4lconvert_can_convert_inplace(data, src_fmt, dest_fmt)) {
+		V4LCONVERT_ERR("cannot convert %dx%d frame in place\n",
+				dest_fmt->fmt.pix.width, dest_fmt->fmt.pix.height);
+		errno = EINVAL;
+		return -1;
+	}
+
+	processing = v4lprocessing_pre_processing(data->processing);
+	hflip = v4lcontrol_get_ctrl(data->control, V4LCONTROL_HFLIP);
+	vflip = v4lcontrol_get_ctrl(data->control, V4LCONTROL_VFLIP);
+
+	/* When field is V4L2_FIELD_ALTERNATE, each buffer only contains half the
+	   lines */
+	if (my_fmt.fmt.pix.field == V4L2_FIELD_ALTERNATE)
+		my_fmt.fmt.pix.height /= 2;
+
+	/* Flipping and processing touch the chroma planes too */
+	frame_size = my_fmt.fmt.pix.bytesperline * my_fmt.fmt.pix.height;
+	switch (my_fmt.fmt.pix.pixelformat) {
+	case V4L2_PIX_FMT_YUV420:
+	case V4L2_PIX_FMT_YVU420:
+	case V4L2_PIX_FMT_NV12:
+	case V4L2_PIX_FMT_NV21:
+		frame_size = frame_size * 3 / 2;
+		break;
+	}
+
+	if (buf_size < frame_size) {
+		V4LCONVERT_ERR("buffer too small (%d < %d) for in place conversion\n",
+				buf_size, frame_size);
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (src_size < frame_size) {
+		V4LCONVERT_ERR("short frame (%d < %d) for in place conversion\n",
+				src_size, frame_size);
+		errno = EPIPE;
+		return -1;
+	}
+
+	if (processing)
+		v4lprocessing_processing(data->processing, buf, &my_fmt);
+
+	v4lconvert_flip_inplace(buf, &my_fmt, hflip, vflip);
+
+	return src_size;
+}
+
 const char *v4lconvert_get_error_message(struct v4lconvert_data *data)
 {
 	return data->error_msg;
@@ -1441,9 +2107,8 @@ static void v4lconvert_get_framesizes(struct v4lconvert_data *data,
 				return;
 			}
 			data->framesizes[data->no_framesizes].type = frmsize.type;
-			/* We use the pixel_format member to store a bitmask of all
-			   supported src_formats which can do this size */
-			data->framesizes[data->no_framesizes].pixel_format = 1 << index;
+			/* Remember which supported src_formats can do this size */
+			data->framesize_src_formats[data->no_framesizes] = 1ULL << index;
 
 			switch (frmsize.type) {
 			case V4L2_FRMSIZE_TYPE_DISCRETE:
@@ -1456,7 +2121,7 @@ static void v4lconvert_get_framesizes(struct v4lconvert_data *data,
 			}
 			data->no_framesizes++;
 		} else {
-			data->framesizes[j].pixel_format |= 1 << index;
+			data->framesize_src_formats[j] |= 1ULL << index;
 		}
 	}
 }
@@ -1605,3 +2270,61 @@ void v4lconvert_set_fps(struct v4lconvert_data *data, int fps)
 {
 	data->fps = fps;
 }
+
+int v4lconvert_set_threads(struct v4lconvert_data *data, int threads)
+{
+	if (threads <= 0)
+		threads = v4lconvert_workers_default_threads();
+	if (threads > V4LCONVERT_MAX_THREADS)
+		threads = V4LCONVERT_MAX_THREADS;
+
+	if (threads == v4lconvert_workers_threads(data->workers))
+		return threads;
+
+	v4lconvert_workers_destroy(data->workers);
+	data->workers = v4lconvert_workers_create(threads);
+	v4lprocessing_set_workers(data->processing, data->workers);
+
+	return v4lconvert_workers_threads(data->workers);
+}
+
+void v4lconvert_set_jpeg_fast_dct(struct v4lconvert_data *data, int fast)
+{
+#ifdef HAVE_JPEG
+	data->jpeg_fast_dct = fast;
+#endif
+}
+
+void v4lconvert_set_processing_update_period(struct v4lconvert_data *data,
+		int ms)
+{
+	v4lprocessing_set_update_period(data->processing, ms);
+}
+
+void v4lconvert_set_processing_stats_lines(struct v4lconvert_data *data,
+		int lines)
+{
+	v4lprocessing_set_stats_lines(data->processing, lines);
+}
+
+void v4lconvert_set_scaling(struct v4lconvert_data *data, int filter)
+{
+	if (filter < V4LCONVERT_SCALE_NONE || filter > V4LCONVERT_SCALE_AREA)
+		filter = V4LCONVERT_SCALE_NONE;
+	data->scale_filter = filter;
+}
+
+void v4lconvert_set_format_cache(struct v4lconvert_data *data, int enable)
+{
+	v4lconvert_invalidate_format_cache(data);
+	data->try_fmt_cache_enabled = enable;
+}
+
+void v4lconvert_invalidate_format_cache(struct v4lconvert_data *data)
+{
+	pthread_mutex_lock(&data->try_fmt_cache_lock);
+	data->try_fmt_cache_count = 0;
+	data->try_fmt_cache_next = 0;
+	data->try_fmt_cache_generation++;
+	pthread_mutex_unlock(&data->try_fmt_cache_lock);
+}
@@ -615,6 +615,10 @@ int main(int argc, char *argv[])
 	int width, height, yvu, src_size, dest_size;
 	unsigned char src_buf[500000];
 	unsigned char dest_buf[500000];
+	unsigned char *src = src_buf, *dest = dest_buf;
+	struct v4lconvert_helper_shm shm;
+
+	v4lconvert_helper_shm_init(&shm, argc, argv);
 
 	while (1) {
 		if (v4lconvert_helper_read(STDIN_FILENO, &width, sizeof(int), argv[0]))
@@ -629,30 +633,41 @@ int main(int argc, char *argv[])
 		if (v4lconvert_helper_read(STDIN_FILENO, &src_size, sizeof(int), argv[0]))
 			return 1; /* Erm, no way to recover without loosing sync with libv4l */
 
-		if (src_size > sizeof(src_buf)) {
-			fprintf(stderr, "%s: error: src_buf too small, need: %d\n",
-					argv[0], src_size);
-			return 2;
-		}
+		dest_size = width * height * 3 / 2;
+		if (shm.fd != -1) {
+			/* The frame data is in shared memory */
+			src = v4lconvert_helper_shm_map(&shm, src_size, dest_size,
+					argv[0]);
+			if (src)
+				dest = src + V4LCONVERT_HELPER_SHM_DEST(src_size);
+			else
+				dest_size = -1;
+		} else {
+			if (src_size > sizeof(src_buf)) {
+				fprintf(stderr, "%s: error: src_buf too small, need: %d\n",
+						argv[0], src_size);
+				return 2;
+			}
 
-		if (v4lconvert_helper_read(STDIN_FILENO, src_buf, src_size, argv[0]))
-			return 1; /* Erm, no way to recover without loosing sync with libv4l */
+			if (v4lconvert_helper_read(STDIN_FILENO, src_buf, src_size, argv[0]))
+				return 1; /* Erm, no way to recover without loosing sync with libv4l */
 
+			if (dest_size > sizeof(dest_buf)) {
+				fprintf(stderr, "%s: error: dest_buf too small, need: %d\n",
+						argv[0], dest_size);
+				dest_size = -1;
+			}
+		}
 
-		dest_size = width * height * 3 / 2;
-		if (dest_size > sizeof(dest_buf)) {
-			fprintf(stderr, "%s: error: dest_buf too small, need: %d\n",
-					argv[0], dest_size);
-			dest_size = -1;
-		} else if (v4lconvert_ov511_to_yuv420(src_buf, dest_buf, width, height,
-					yvu, src_size))
+		if (dest_size != -1 && v4lconvert_ov511_to_yuv420(src, dest,
+					width, height, yvu, src_size))
 			dest_size = -1;
 
 		if (v4lconvert_helper_write(STDOUT_FILENO, &dest_size, sizeof(int),
 					argv[0]))
 			return 1; /* Erm, no way to recover without loosing sync with libv4l */
 
-		if (dest_size == -1)
+		if (dest_size == -1 || shm.fd != -1)
 			continue;
 
 		if (v4lconvert_helper_write(STDOUT_FILENO, dest_buf, dest_size, argv[0]))
@@ -74,10 +74,12 @@ static int autogain_calculate_lookup_tables(
 		struct v4lprocessing_data *data,
 		unsigned char *buf, const struct v4l2_format *fmt)
 {
-	int x, y, target, steps, avg_lum = 0;
+	int target, steps, lines, step, avg_lum = 0;
+	unsigned int sum = 0;
 	int gain, exposure, orig_gain, orig_exposure, exposure_low;
 	struct v4l2_control ctrl;
 	struct v4l2_queryctrl gainctrl, expoctrl;
+	struct v4lprocessing_yuv_layout layout;
 	const int deadzone = 6;
 
 	ctrl.id = V4L2_CID_EXPOSURE;
@@ -105,6 +107,10 @@ static int autogain_calculate_lookup_tables(
 		return 0;
 	gain = orig_gain = ctrl.value;
 
+	/* Look at the center quarter of the image */
+	lines = fmt->fmt.pix.height / 2;
+	step = v4lprocessing_stats_step(data, lines);
+
 	switch (fmt->fmt.pix.pixelformat) {
 	case V4L2_PIX_FMT_SGBRG8:
 	case V4L2_PIX_FMT_SGRBG8:
@@ -112,31 +118,42 @@ static int autogain_calculate_lookup_tables(
 	case V4L2_PIX_FMT_SRGGB8:
 		buf += fmt->fmt.pix.height * fmt->fmt.pix.bytesperline / 4 +
 			fmt->fmt.pix.width / 4;
-
-		for (y = 0; y < fmt->fmt.pix.height / 2; y++) {
-			for (x = 0; x < fmt->fmt.pix.width / 2; x++)
-				avg_lum += *buf++;
-			buf += fmt->fmt.pix.bytesperline - fmt->fmt.pix.width / 2;
-		}
-		avg_lum /= fmt->fmt.pix.height * fmt->fmt.pix.width / 4;
+		/* Keep the step odd, so that both kinds of lines get sampled */
+		step |= 1;
+		lines = v4lprocessing_sum_region(buf, fmt->fmt.pix.bytesperline,
+				fmt->fmt.pix.width / 2, 1, lines, step, &sum);
+		avg_lum = sum / (lines * fmt->fmt.pix.width / 2);
 		break;
 
 	case V4L2_PIX_FMT_RGB24:
 	case V4L2_PIX_FMT_BGR24:
 		buf += fmt->fmt.pix.height * fmt->fmt.pix.bytesperline / 4 +
 			fmt->fmt.pix.width * 3 / 4;
+		lines = v4lprocessing_sum_region(buf, fmt->fmt.pix.bytesperline,
+				fmt->fmt.pix.width * 3 / 2, 1, lines, step, &sum);
+		avg_lum = sum / (lines * fmt->fmt.pix.width * 3 / 2);
+		break;
 
-		for (y = 0; y < fmt->fmt.pix.height / 2; y++) {
-			for (x = 0; x < fmt->fmt.pix.width / 2; x++) {
-				avg_lum += *buf++;
-				avg_lum += *buf++;
-				avg_lum += *buf++;
-			}
-			buf += fmt->fmt.pix.bytesperline - fmt->fmt.pix.width * 3 / 2;
-		}
-		avg_lum /= fmt->fmt.pix.height * fmt->fmt.pix.width * 3 / 4;
+	case V4L2_PIX_FMT_YUV420:
+	case V4L2_PIX_FMT_YVU420:
+	case V4L2_PIX_FMT_NV12:
+	case V4L2_PIX_FMT_NV21:
+	case V4L2_PIX_FMT_YUYV:
+	case V4L2_PIX_FMT_YVYU:
+	case V4L2_PIX_FMT_UYVY: {
+		/* For packed formats sum (y, chroma) pairs, keeping only y */
+		unsigned int sums[2] = { 0, 0 };
+
+		v4lprocessing_get_yuv_layout(buf, fmt, &layout);
+		buf = layout.y + fmt->fmt.pix.height / 4 * layout.y_stride +
+			fmt->fmt.pix.width / 4 * layout.y_step;
+		lines = v4lprocessing_sum_region(buf, layout.y_stride,
+				fmt->fmt.pix.width / 2, layout.y_step, lines, step,
+				sums);
+		avg_lum = sums[0] / (lines * fmt->fmt.pix.width / 2);
 		break;
 	}
+	}
 
 	/* If we are off a multiple of deadzone, do multiple steps to reach the
 	   desired lumination fast (with the risc of a slight overshoot) */
@@ -196,7 +213,7 @@ static int autogain_calculate_lookup_tables(
 		   skip the next frame as that is still captured with the old settings,
 		   and another one just to be sure (because if we re-adjust based
 		   on the old settings we might overshoot). */
-		data->lookup_table_update_counter = V4L2PROCESSING_UPDATE_RATE - 2;
+		data->update_frames = 3;
 	}
 
 	if (gain != orig_gain) {
@@ -34,6 +34,7 @@ static int gamma_calculate_lookup_tables(
 		unsigned char *buf, const struct v4l2_format *fmt)
 {
 	int i, x, gamma;
+	struct v4lprocessing_yuv_layout layout;
 
 	gamma = v4lcontrol_get_ctrl(data->control, V4LCONTROL_GAMMA);
 
@@ -45,6 +46,13 @@ static int gamma_calculate_lookup_tables(
 		data->last_gamma = gamma;
 	}
 
+	/* For yuv only the luma gets gamma corrected */
+	if (v4lprocessing_get_yuv_layout(buf, fmt, &layout)) {
+		for (i = 0; i < 256; i++)
+			data->comp1[i] = data->gamma_table[data->comp1[i]];
+		return 1;
+	}
+
 	for (i = 0; i < 256; i++) {
 		data->comp1[i] = data->gamma_table[data->comp1[i]];
 		data->green[i] = data->gamma_table[data->green[i]];
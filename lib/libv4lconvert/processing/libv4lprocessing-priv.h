@@ -21,23 +21,49 @@
 #ifndef __LIBV4LPROCESSING_PRIV_H
 #define __LIBV4LPROCESSING_PRIV_H
 
+#include <pthread.h>
 #include "../control/libv4lcontrol.h"
 #include "../libv4lsyscall-priv.h"
 
-#define V4L2PROCESSING_UPDATE_RATE 10
+/* Default time between lookup table updates, about every 10 frames at 30 fps */
+#define V4L2PROCESSING_UPDATE_PERIOD 333 /* ms */
+/* The filters gather the statistics for their lookup tables from about this
+   many lines by default, spread evenly over the region they look at */
+#define V4L2PROCESSING_STATS_LINES 64
+
+/* A set of lookup tables, these are RGB/BGR lookup tables, for yuv formats
+   comp1 is used for y, green for u and comp2 for v. The tables must be
+   followed by other members, as the AVX2 lookup kernels read a few bytes
+   past a table. */
+struct v4lprocessing_tables {
+	unsigned char comp1[256];
+	unsigned char green[256];
+	unsigned char comp2[256];
+	/* True if any of the lookup tables does not contain
+	   linear 0-255 */
+	int active;
+};
 
 struct v4lprocessing_data {
 	struct v4lcontrol_data *control;
 	int fd;
 	int do_process;
 	int controls_changed;
-	/* True if any of the lookup tables does not contain
-	   linear 0-255 */
-	int lookup_table_active;
-	/* Counts the number of processed frames until a
-	   V4L2PROCESSING_UPDATE_RATE overflow happens */
-	int lookup_table_update_counter;
-	/* RGB/BGR lookup tables */
+	/* Bitmask of the filters which are active for the current frame */
+	int filters_active;
+	/* CLOCK_MONOTONIC time in ms at which the lookup tables get updated
+	   next, and the time between updates */
+	long long next_update;
+	int update_period;
+	/* About how many lines of a region the statistics get gathered from,
+	   0 for all of them */
+	int stats_lines;
+	/* When not 0, filters which are still converging want the lookup
+	   tables updated after this many frames, instead of at next_update */
+	int update_frames;
+	/* The pixelformat the lookup tables were calculated for */
+	unsigned int lookup_table_pixfmt;
+	/* The lookup tables the filters calculate */
 	unsigned char comp1[256];
 	unsigned char green[256];
 	unsigned char comp2[256];
@@ -51,6 +77,27 @@ struct v4lprocessing_data {
 	unsigned char gamma_table[256];
 	/* autogain.c data */
 	int last_gain_correction;
+	/* Worker threads to split applying the lookup tables over */
+	struct v4lconvert_workers *workers;
+	/* Calculated tables get published in tables[current], while frames
+	   may still get processed with the other set. frame_tables are the
+	   tables for the frame being processed. */
+	struct v4lprocessing_tables tables[2];
+	int current;
+	const struct v4lprocessing_tables *frame_tables;
+	/* When there are worker threads, the lookup tables get updated by a
+	   background thread from a copy of the frame. While updating is set,
+	   the filter data, the calculated tables, update_frames and
+	   tables[!current] belong to the update thread. */
+	pthread_t update_thread;
+	int have_update_thread;
+	pthread_mutex_t update_lock;
+	pthread_cond_t update_cond;
+	int updating;
+	int update_quit;
+	unsigned char *update_buf;
+	int update_buf_size;
+	struct v4l2_format update_fmt;
 };
 
 struct v4lprocessing_filter {
@@ -61,6 +108,30 @@ struct v4lprocessing_filter {
 			unsigned char *buf, const struct v4l2_format *fmt);
 };
 
+/* Where to find the samples of a yuv frame. step is the distance between
+   2 samples of the same plane on a line, 1 for planar formats. The chroma
+   planes have width / 2 samples per line and uv_lines lines. */
+struct v4lprocessing_yuv_layout {
+	unsigned char *y, *u, *v;
+	int y_stride, y_step;
+	int uv_stride, uv_step, uv_lines;
+};
+
+/* Returns 1 and fills in layout if fmt is a yuv format, 0 otherwise */
+int v4lprocessing_get_yuv_layout(unsigned char *buf,
+		const struct v4l2_format *fmt,
+		struct v4lprocessing_yuv_layout *layout);
+
+/* Returns the line step to use for sampling about data->stats_lines out of
+   lines lines */
+int v4lprocessing_stats_step(struct v4lprocessing_data *data, int lines);
+
+/* Adds the per channel sums of every step-th line of a region of lines lines,
+   with count groups of channels interleaved samples each, to sums. Returns
+   the number of lines summed. */
+int v4lprocessing_sum_region(const unsigned char *buf, int stride, int count,
+		int channels, int lines, int step, unsigned int *sums);
+
 extern struct v4lprocessing_filter whitebalance_filter;
 extern struct v4lprocessing_filter autogain_filter;
 extern struct v4lprocessing_filter gamma_filter;
@@ -33,6 +33,14 @@ static struct v4lprocessing_filter *filters[] = {
 	&gamma_filter,
 };
 
+static long long v4lprocessing_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000LL + ts.tv_nsec / 1000000;
+}
+
 struct v4lprocessing_data *v4lprocessing_create(int fd, struct v4lcontrol_data *control)
 {
 	struct v4lprocessing_data *data =
@@ -45,34 +53,90 @@ struct v4lprocessing_data *v4lprocessing_create(int fd, struct v4lcontrol_data *
 
 	data->fd = fd;
 	data->control = control;
+	data->update_period = V4L2PROCESSING_UPDATE_PERIOD;
+	data->stats_lines = V4L2PROCESSING_STATS_LINES;
+	data->frame_tables = &data->tables[0];
+	pthread_mutex_init(&data->update_lock, NULL);
+	pthread_cond_init(&data->update_cond, NULL);
 
 	return data;
 }
 
+static void v4lprocessing_stop_update_thread(struct v4lprocessing_data *data)
+{
+	if (!data->have_update_thread)
+		return;
+
+	pthread_mutex_lock(&data->update_lock);
+	data->update_quit = 1;
+	pthread_cond_broadcast(&data->update_cond);
+	pthread_mutex_unlock(&data->update_lock);
+
+	pthread_join(data->update_thread, NULL);
+	data->have_update_thread = 0;
+	data->update_quit = 0;
+}
+
 void v4lprocessing_destroy(struct v4lprocessing_data *data)
 {
+	v4lprocessing_stop_update_thread(data);
+	pthread_cond_destroy(&data->update_cond);
+	pthread_mutex_destroy(&data->update_lock);
+	free(data->update_buf);
 	free(data);
 }
 
+void v4lprocessing_set_update_period(struct v4lprocessing_data *data, int ms)
+{
+	data->update_period = ms;
+}
+
+void v4lprocessing_set_stats_lines(struct v4lprocessing_data *data, int lines)
+{
+	data->stats_lines = lines > 0 ? lines : 0;
+}
+
+/* Returns 1 while a background update is running, when it is not the frame
+   path owns all of data again */
+static int v4lprocessing_updating(struct v4lprocessing_data *data)
+{
+	int updating;
+
+	pthread_mutex_lock(&data->update_lock);
+	updating = data->updating;
+	pthread_mutex_unlock(&data->update_lock);
+
+	return updating;
+}
+
 int v4lprocessing_pre_processing(struct v4lprocessing_data *data)
 {
 	int i;
 
-	data->do_process = 0;
-	for (i = 0; i < ARRAY_SIZE(filters); i++) {
-		if (filters[i]->active(data))
-			data->do_process = 1;
+	/* The filters reset their data when they are not active, so leave
+	   them alone while a background update uses that data, and stick to
+	   the filters of the last frame until it is done */
+	if (!v4lprocessing_updating(data)) {
+		data->filters_active = 0;
+		for (i = 0; i < ARRAY_SIZE(filters); i++) {
+			if (filters[i]->active(data))
+				data->filters_active |= 1 << i;
+		}
 	}
+	data->do_process = data->filters_active != 0;
 
 	data->controls_changed |= v4lcontrol_controls_changed(data->control);
 
 	return data->do_process;
 }
 
+/* Calculates new lookup tables and publishes them, this runs either in the
+   frame path or in the update thread */
 static void v4lprocessing_update_lookup_tables(struct v4lprocessing_data *data,
 		unsigned char *buf, const struct v4l2_format *fmt)
 {
-	int i;
+	struct v4lprocessing_tables *tables;
+	int i, active = 0;
 
 	for (i = 0; i < 256; i++) {
 		data->comp1[i] = i;
@@ -80,109 +144,485 @@ static void v4lprocessing_update_lookup_tables(struct v4lprocessing_data *data,
 		data->comp2[i] = i;
 	}
 
-	data->lookup_table_active = 0;
 	for (i = 0; i < ARRAY_SIZE(filters); i++) {
-		if (filters[i]->active(data)) {
+		if (data->filters_active & (1 << i)) {
 			if (filters[i]->calculate_lookup_tables(data, buf, fmt))
-				data->lookup_table_active = 1;
+				active = 1;
 		}
 	}
+
+	/* Frames only use tables[current], and no new update gets started
+	   before the frame which started this one is done with the other set */
+	tables = &data->tables[!data->current];
+	memcpy(tables->comp1, data->comp1, 256);
+	memcpy(tables->green, data->green, 256);
+	memcpy(tables->comp2, data->comp2, 256);
+	tables->active = active;
+
+	pthread_mutex_lock(&data->update_lock);
+	data->current = !data->current;
+	pthread_mutex_unlock(&data->update_lock);
 }
 
-static void v4lprocessing_do_processing(struct v4lprocessing_data *data,
+static void *v4lprocessing_update_thread(void *arg)
+{
+	struct v4lprocessing_data *data = arg;
+
+	pthread_mutex_lock(&data->update_lock);
+	for (;;) {
+		while (!data->update_quit && !data->updating)
+			pthread_cond_wait(&data->update_cond, &data->update_lock);
+		/* Finish an update started right before being told to quit,
+		   v4lprocessing_update() waits for it to clear updating */
+		if (!data->updating)
+			break;
+
+		pthread_mutex_unlock(&data->update_lock);
+		v4lprocessing_update_lookup_tables(data, data->update_buf,
+				&data->update_fmt);
+		pthread_mutex_lock(&data->update_lock);
+
+		data->updating = 0;
+		pthread_cond_broadcast(&data->update_cond);
+	}
+	pthread_mutex_unlock(&data->update_lock);
+
+	return NULL;
+}
+
+void v4lprocessing_set_workers(struct v4lprocessing_data *data,
+		struct v4lconvert_workers *workers)
+{
+	data->workers = workers;
+
+	/* With threads enabled, also update the lookup tables in the
+	   background. Without, do not start threads behind the apps back. */
+	if (!workers) {
+		v4lprocessing_stop_update_thread(data);
+	} else if (!data->have_update_thread) {
+		data->have_update_thread = !pthread_create(&data->update_thread,
+				NULL, v4lprocessing_update_thread, data);
+	}
+}
+
+/* Returns the size of a frame of a format processing supports */
+static int v4lprocessing_frame_size(const struct v4l2_format *fmt)
+{
+	int size = fmt->fmt.pix.bytesperline * fmt->fmt.pix.height;
+
+	switch (fmt->fmt.pix.pixelformat) {
+	case V4L2_PIX_FMT_YUV420:
+	case V4L2_PIX_FMT_YVU420:
+	case V4L2_PIX_FMT_NV12:
+	case V4L2_PIX_FMT_NV21:
+		return size * 3 / 2;
+	}
+	return size;
+}
+
+/* Called once per frame, returns 1 if the lookup tables must be updated
+   with this frame. If not, sets frame_tables to the tables to use. */
+static int v4lprocessing_next_frame(struct v4lprocessing_data *data,
+		unsigned int pixelformat)
+{
+	/* Changed settings apply right away, and tables for another format
+	   are of no use */
+	if (data->controls_changed || data->lookup_table_pixfmt != pixelformat)
+		return 1;
+
+	pthread_mutex_lock(&data->update_lock);
+	data->frame_tables = &data->tables[data->current];
+	if (data->updating) {
+		pthread_mutex_unlock(&data->update_lock);
+		return 0;
+	}
+	pthread_mutex_unlock(&data->update_lock);
+
+	if (data->update_frames == 1 ||
+			v4lprocessing_now() >= data->next_update)
+		return 1;
+
+	if (data->update_frames)
+		data->update_frames--;
+	return 0;
+}
+
+/* Updates the lookup tables for this frame, or starts updating them in the
+   background from a copy of the frame, and sets frame_tables */
+static void v4lprocessing_update(struct v4lprocessing_data *data,
 		unsigned char *buf, const struct v4l2_format *fmt)
 {
-	int x, y;
+	int background = data->have_update_thread && !data->controls_changed &&
+		data->lookup_table_pixfmt == fmt->fmt.pix.pixelformat;
+
+	/* Wait for a running update, to not have it publish old tables */
+	pthread_mutex_lock(&data->update_lock);
+	while (data->updating)
+		pthread_cond_wait(&data->update_cond, &data->update_lock);
+	pthread_mutex_unlock(&data->update_lock);
+
+	/* Do this before updating so that filters can force the next update
+	   to be sooner when they changed camera settings */
+	data->controls_changed = 0;
+	data->update_frames = 0;
+	data->next_update = v4lprocessing_now() + data->update_period;
+	data->lookup_table_pixfmt = fmt->fmt.pix.pixelformat;
+
+	if (background && v4lconvert_alloc_buffer(v4lprocessing_frame_size(fmt),
+				&data->update_buf, &data->update_buf_size)) {
+		memcpy(data->update_buf, buf, v4lprocessing_frame_size(fmt));
+		data->update_fmt = *fmt;
+
+		pthread_mutex_lock(&data->update_lock);
+		data->frame_tables = &data->tables[data->current];
+		data->updating = 1;
+		pthread_cond_broadcast(&data->update_cond);
+		pthread_mutex_unlock(&data->update_lock);
+		return;
+	}
+
+	v4lprocessing_update_lookup_tables(data, buf, fmt);
+	data->frame_tables = &data->tables[data->current];
+}
+
+void v4lconvert_lut_line_rgb24_c(unsigned char *buf, int count,
+		const unsigned char *lut0, const unsigned char *lut1,
+		const unsigned char *lut2)
+{
+	while (count--) {
+		buf[0] = lut0[buf[0]];
+		buf[1] = lut1[buf[1]];
+		buf[2] = lut2[buf[2]];
+		buf += 3;
+	}
+}
+
+void v4lconvert_lut_line_bayer_c(unsigned char *buf, int count,
+		const unsigned char *lut0, const unsigned char *lut1)
+{
+	while (count--) {
+		buf[0] = lut0[buf[0]];
+		buf[1] = lut1[buf[1]];
+		buf += 2;
+	}
+}
+
+void v4lconvert_lut_line_yuv422_c(unsigned char *buf, int count,
+		const unsigned char *lut0, const unsigned char *lut1,
+		const unsigned char *lut2, const unsigned char *lut3)
+{
+	while (count--) {
+		buf[0] = lut0[buf[0]];
+		buf[1] = lut1[buf[1]];
+		buf[2] = lut2[buf[2]];
+		buf[3] = lut3[buf[3]];
+		buf += 4;
+	}
+}
+
+void v4lconvert_sum_line_c(const unsigned char *buf, int count,
+		int channels, unsigned int *sums)
+{
+	int c;
+
+	while (count--)
+		for (c = 0; c < channels; c++)
+			sums[c] += *buf++;
+}
+
+int v4lprocessing_stats_step(struct v4lprocessing_data *data, int lines)
+{
+	int step = data->stats_lines ? lines / data->stats_lines : 1;
+
+	return step ? step : 1;
+}
+
+int v4lprocessing_sum_region(const unsigned char *buf, int stride, int count,
+		int channels, int lines, int step, unsigned int *sums)
+{
+	int y, summed = 0;
+
+	for (y = 0; y < lines; y += step, summed++)
+		v4lconvert_kernels.sum_line(buf + y * stride, count, channels,
+				sums);
+
+	return summed;
+}
+
+int v4lprocessing_get_yuv_layout(unsigned char *buf,
+		const struct v4l2_format *fmt,
+		struct v4lprocessing_yuv_layout *layout)
+{
+	int stride = fmt->fmt.pix.bytesperline;
+	int height = fmt->fmt.pix.height;
+	unsigned char *tmp;
+
+	switch (fmt->fmt.pix.pixelformat) {
+	case V4L2_PIX_FMT_YUV420:
+	case V4L2_PIX_FMT_YVU420:
+		layout->y = buf;
+		layout->u = buf + stride * height;
+		layout->v = layout->u + stride * height / 4;
+		layout->y_stride = stride;
+		layout->y_step = 1;
+		layout->uv_stride = stride / 2;
+		layout->uv_step = 1;
+		layout->uv_lines = height / 2;
+		break;
+	case V4L2_PIX_FMT_NV12:
+	case V4L2_PIX_FMT_NV21:
+		layout->y = buf;
+		layout->u = buf + stride * height;
+		layout->v = layout->u + 1;
+		layout->y_stride = stride;
+		layout->y_step = 1;
+		layout->uv_stride = stride;
+		layout->uv_step = 2;
+		layout->uv_lines = height / 2;
+		break;
+	case V4L2_PIX_FMT_YUYV:
+	case V4L2_PIX_FMT_YVYU:
+		layout->y = buf;
+		layout->u = buf + 1;
+		layout->v = buf + 3;
+		layout->y_stride = stride;
+		layout->y_step = 2;
+		layout->uv_stride = stride;
+		layout->uv_step = 4;
+		layout->uv_lines = height;
+		break;
+	case V4L2_PIX_FMT_UYVY:
+		layout->y = buf + 1;
+		layout->u = buf;
+		layout->v = buf + 2;
+		layout->y_stride = stride;
+		layout->y_step = 2;
+		layout->uv_stride = stride;
+		layout->uv_step = 4;
+		layout->uv_lines = height;
+		break;
+	default:
+		return 0;
+	}
+
+	switch (fmt->fmt.pix.pixelformat) {
+	case V4L2_PIX_FMT_YVU420:
+	case V4L2_PIX_FMT_NV21:
+	case V4L2_PIX_FMT_YVYU:
+		tmp = layout->u;
+		layout->u = layout->v;
+		layout->v = tmp;
+		break;
+	}
+	return 1;
+}
+
+/* Apply a single lookup table to count 8 bit samples */
+static void v4lprocessing_lut_line_8(unsigned char *buf, int count,
+		const unsigned char *lut)
+{
+	v4lconvert_kernels.lut_line_bayer(buf, count / 2, lut, lut);
+	if (count & 1)
+		buf[count - 1] = lut[buf[count - 1]];
+}
+
+/* Process lines first till last of the frame in buf, first must be even */
+static void v4lprocessing_do_processing(struct v4lprocessing_data *data,
+		unsigned char *buf, const struct v4l2_format *fmt,
+		int first, int last)
+{
+	const struct v4lprocessing_tables *t = data->frame_tables;
+	int y, stride = fmt->fmt.pix.bytesperline;
+	int width = fmt->fmt.pix.width;
+	struct v4lprocessing_yuv_layout l;
 
 	switch (fmt->fmt.pix.pixelformat) {
 	case V4L2_PIX_FMT_SGBRG8:
 	case V4L2_PIX_FMT_SGRBG8: /* Bayer patterns starting with green */
-		for (y = 0; y < fmt->fmt.pix.height / 2; y++) {
-			for (x = 0; x < fmt->fmt.pix.width / 2; x++) {
-				*buf = data->green[*buf];
-				buf++;
-				*buf = data->comp1[*buf];
-				buf++;
-			}
-			buf += fmt->fmt.pix.bytesperline - fmt->fmt.pix.width;
-			for (x = 0; x < fmt->fmt.pix.width / 2; x++) {
-				*buf = data->comp2[*buf];
-				buf++;
-				*buf = data->green[*buf];
-				buf++;
-			}
-			buf += fmt->fmt.pix.bytesperline - fmt->fmt.pix.width;
+		buf += first * stride;
+		for (y = 0; y < (last - first) / 2; y++) {
+			v4lconvert_kernels.lut_line_bayer(buf,
+					fmt->fmt.pix.width / 2, t->green, t->comp1);
+			buf += stride;
+			v4lconvert_kernels.lut_line_bayer(buf,
+					fmt->fmt.pix.width / 2, t->comp2, t->green);
+			buf += stride;
 		}
 		break;
 
 	case V4L2_PIX_FMT_SBGGR8:
 	case V4L2_PIX_FMT_SRGGB8: /* Bayer patterns *NOT* starting with green */
-		for (y = 0; y < fmt->fmt.pix.height / 2; y++) {
-			for (x = 0; x < fmt->fmt.pix.width / 2; x++) {
-				*buf = data->comp1[*buf];
-				buf++;
-				*buf = data->green[*buf];
-				buf++;
-			}
-			buf += fmt->fmt.pix.bytesperline - fmt->fmt.pix.width;
-			for (x = 0; x < fmt->fmt.pix.width / 2; x++) {
-				*buf = data->green[*buf];
-				buf++;
-				*buf = data->comp2[*buf];
-				buf++;
-			}
-			buf += fmt->fmt.pix.bytesperline - fmt->fmt.pix.width;
+		buf += first * stride;
+		for (y = 0; y < (last - first) / 2; y++) {
+			v4lconvert_kernels.lut_line_bayer(buf,
+					fmt->fmt.pix.width / 2, t->comp1, t->green);
+			buf += stride;
+			v4lconvert_kernels.lut_line_bayer(buf,
+					fmt->fmt.pix.width / 2, t->green, t->comp2);
+			buf += stride;
 		}
 		break;
 
 	case V4L2_PIX_FMT_RGB24:
 	case V4L2_PIX_FMT_BGR24:
-		for (y = 0; y < fmt->fmt.pix.height; y++) {
-			for (x = 0; x < fmt->fmt.pix.width; x++) {
-				*buf = data->comp1[*buf];
-				buf++;
-				*buf = data->green[*buf];
-				buf++;
-				*buf = data->comp2[*buf];
-				buf++;
+		buf += first * stride;
+		for (y = first; y < last; y++) {
+			v4lconvert_kernels.lut_line_rgb24(buf, fmt->fmt.pix.width,
+					t->comp1, t->green, t->comp2);
+			buf += stride;
+		}
+		break;
+
+	case V4L2_PIX_FMT_YUV420:
+	case V4L2_PIX_FMT_YVU420:
+	case V4L2_PIX_FMT_NV12:
+	case V4L2_PIX_FMT_NV21:
+		v4lprocessing_get_yuv_layout(buf, fmt, &l);
+		for (y = first; y < last; y++)
+			v4lprocessing_lut_line_8(l.y + y * l.y_stride, width,
+					t->comp1);
+		for (y = first / 2; y < last / 2; y++) {
+			if (l.uv_step == 1) {
+				v4lprocessing_lut_line_8(l.u + y * l.uv_stride,
+						width / 2, t->green);
+				v4lprocessing_lut_line_8(l.v + y * l.uv_stride,
+						width / 2, t->comp2);
+			} else if (l.u < l.v) {
+				v4lconvert_kernels.lut_line_bayer(
+						l.u + y * l.uv_stride, width / 2,
+						t->green, t->comp2);
+			} else {
+				v4lconvert_kernels.lut_line_bayer(
+						l.v + y * l.uv_stride, width / 2,
+						t->comp2, t->green);
 			}
-			buf += fmt->fmt.pix.bytesperline - 3 * fmt->fmt.pix.width;
+		}
+		break;
+
+	case V4L2_PIX_FMT_YUYV:
+		buf += first * stride;
+		for (y = first; y < last; y++) {
+			v4lconvert_kernels.lut_line_yuv422(buf, width / 2,
+					t->comp1, t->green, t->comp1,
+					t->comp2);
+			buf += stride;
+		}
+		break;
+
+	case V4L2_PIX_FMT_YVYU:
+		buf += first * stride;
+		for (y = first; y < last; y++) {
+			v4lconvert_kernels.lut_line_yuv422(buf, width / 2,
+					t->comp1, t->comp2, t->comp1,
+					t->green);
+			buf += stride;
+		}
+		break;
+
+	case V4L2_PIX_FMT_UYVY:
+		buf += first * stride;
+		for (y = first; y < last; y++) {
+			v4lconvert_kernels.lut_line_yuv422(buf, width / 2,
+					t->green, t->comp1, t->comp2,
+					t->comp1);
+			buf += stride;
 		}
 		break;
 	}
 }
 
-void v4lprocessing_processing(struct v4lprocessing_data *data,
-		unsigned char *buf, const struct v4l2_format *fmt)
+/* Bands must not be too small, so that the threads are not busy just
+   synchronizing */
+#define V4L2PROCESSING_MIN_BAND_LINES 32
+
+struct v4lprocessing_job {
+	struct v4lprocessing_data *data;
+	unsigned char *buf;
+	const struct v4l2_format *fmt;
+	int no_bands;
+};
+
+static void v4lprocessing_do_band(void *arg, int band)
 {
-	if (!data->do_process)
-		return;
+	struct v4lprocessing_job *job = arg;
+	int height = job->fmt->fmt.pix.height;
+	int first, last;
 
-	/* Do we support the current pixformat? */
-	switch (fmt->fmt.pix.pixelformat) {
+	/* Start bands on an even line, so that the bayer pattern stays the same
+	   and bands of 4:2:0 yuv have whole chroma lines */
+	first = (band * height / job->no_bands) & ~1;
+	if (band == job->no_bands - 1)
+		last = height;
+	else
+		last = ((band + 1) * height / job->no_bands) & ~1;
+
+	v4lprocessing_do_processing(job->data, job->buf, job->fmt, first, last);
+}
+
+int v4lprocessing_supported_fmt(unsigned int pixelformat)
+{
+	switch (pixelformat) {
 	case V4L2_PIX_FMT_SGBRG8:
 	case V4L2_PIX_FMT_SGRBG8:
 	case V4L2_PIX_FMT_SBGGR8:
 	case V4L2_PIX_FMT_SRGGB8:
 	case V4L2_PIX_FMT_RGB24:
 	case V4L2_PIX_FMT_BGR24:
-		break;
-	default:
-		return; /* Non supported pix format */
+	case V4L2_PIX_FMT_YUV420:
+	case V4L2_PIX_FMT_YVU420:
+	case V4L2_PIX_FMT_NV12:
+	case V4L2_PIX_FMT_NV21:
+	case V4L2_PIX_FMT_YUYV:
+	case V4L2_PIX_FMT_YVYU:
+	case V4L2_PIX_FMT_UYVY:
+		return 1;
 	}
+	return 0;
+}
 
-	if (data->controls_changed ||
-			data->lookup_table_update_counter == V4L2PROCESSING_UPDATE_RATE) {
-		data->controls_changed = 0;
-		data->lookup_table_update_counter = 0;
-		/* Do this after resetting lookup_table_update_counter so that filters can
-		   force the next update to be sooner when they changed camera settings */
-		v4lprocessing_update_lookup_tables(data, buf, fmt);
-	} else
-		data->lookup_table_update_counter++;
+void v4lprocessing_processing(struct v4lprocessing_data *data,
+		unsigned char *buf, const struct v4l2_format *fmt)
+{
+	if (!data->do_process)
+		return;
 
-	if (data->lookup_table_active)
-		v4lprocessing_do_processing(data, buf, fmt);
+	if (!v4lprocessing_supported_fmt(fmt->fmt.pix.pixelformat))
+		return;
+
+	if (v4lprocessing_next_frame(data, fmt->fmt.pix.pixelformat))
+		v4lprocessing_update(data, buf, fmt);
+
+	if (data->frame_tables->active) {
+		struct v4lprocessing_job job = { data, buf, fmt, 1 };
+		int max_bands = fmt->fmt.pix.height / V4L2PROCESSING_MIN_BAND_LINES;
+
+		if (data->workers && max_bands >= 2) {
+			/* Use some more bands than threads to even out the load */
+			job.no_bands = v4lconvert_workers_threads(data->workers) * 2;
+			if (job.no_bands > max_bands)
+				job.no_bands = max_bands;
+		}
+		v4lconvert_workers_run(data->workers, v4lprocessing_do_band, &job,
+				job.no_bands);
+	}
 
 	data->do_process = 0;
 }
+
+int v4lprocessing_start_processing_lines(struct v4lprocessing_data *data,
+		unsigned int pixelformat)
+{
+	if (!data->do_process || !v4lprocessing_supported_fmt(pixelformat) ||
+			v4lprocessing_next_frame(data, pixelformat))
+		return 0;
+
+	data->do_process = 0;
+	return 1;
+}
+
+void v4lprocessing_processing_lines(struct v4lprocessing_data *data,
+		unsigned char *buf, const struct v4l2_format *fmt, int first, int last)
+{
+	if (data->frame_tables->active)
+		v4lprocessing_do_processing(data, buf, fmt, first, last);
+}
@@ -26,10 +26,23 @@
 
 struct v4lprocessing_data;
 struct v4lcontrol_data;
+struct v4lconvert_workers;
 
 struct v4lprocessing_data *v4lprocessing_create(int fd, struct v4lcontrol_data *data);
 void v4lprocessing_destroy(struct v4lprocessing_data *data);
 
+/* Split applying the lookup tables over workers, NULL to not use threads */
+void v4lprocessing_set_workers(struct v4lprocessing_data *data,
+  struct v4lconvert_workers *workers);
+
+/* Set the time in ms between updates of the lookup tables from the frame
+   statistics, the default is V4L2PROCESSING_UPDATE_PERIOD */
+void v4lprocessing_set_update_period(struct v4lprocessing_data *data, int ms);
+
+/* Set about how many lines of the frame the filters gather their statistics
+   from, 0 uses all lines, the default is V4L2PROCESSING_STATS_LINES */
+void v4lprocessing_set_stats_lines(struct v4lprocessing_data *data, int lines);
+
 /* Prepare to process 1 frame, returns 1 if processing is necesary,
    return 0 if no processing will be done */
 int v4lprocessing_pre_processing(struct v4lprocessing_data *data);
@@ -40,4 +53,21 @@ int v4lprocessing_pre_processing(struct v4lprocessing_data *data);
 void v4lprocessing_processing(struct v4lprocessing_data *data,
   unsigned char *buf, const struct v4l2_format *fmt);
 
+/* Returns 1 if frames of pixelformat can be processed */
+int v4lprocessing_supported_fmt(unsigned int pixelformat);
+
+/* Alternative to v4lprocessing_processing() for frames which get processed
+   a few lines at a time, while these are in the cache anyway. Returns 1 if
+   the lookup tables for pixelformat are up to date, the caller then must
+   pass all lines of the frame to v4lprocessing_processing_lines(). Returns
+   0 if the lookup tables must be updated from a whole frame first, then
+   v4lprocessing_processing() must be used for this frame. */
+int v4lprocessing_start_processing_lines(struct v4lprocessing_data *data,
+  unsigned int pixelformat);
+
+/* Process lines first till last of the frame in buf, first must be even. Can
+   be called from multiple threads for different lines. */
+void v4lprocessing_processing_lines(struct v4lprocessing_data *data,
+  unsigned char *buf, const struct v4l2_format *fmt, int first, int last);
+
 #endif
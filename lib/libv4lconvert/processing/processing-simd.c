@@ -0,0 +1,243 @@
+/*
+# SIMD versions of the libv4lprocessing statistics and lookup table kernels
+
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU Lesser General Public License as published by
+# the Free Software Foundation; either version 2.1 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU Lesser General Public License for more details.
+#
+# You should have received a copy of the GNU Lesser General Public License
+# along with this program; if not, write to the Free Software
+# Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA  02110-1335  USA
+ */
+
+/*
+ * The sums are done with psadbw against zero, which adds 8 bytes into a 64
+ * bit lane. The bytes of all but the last channel are picked out with a
+ * mask, the last channel is what is left of the total.
+ *
+ * The lookup tables are applied with AVX2 gathers. All tables get addressed
+ * relative to the first one, so that a single gather can look up samples of
+ * different channels: the index of each sample is its value plus the offset
+ * of the table for its channel. Gathering 32 bit values and keeping the low
+ * byte reads up to 3 bytes past the end of a table.
+ */
+
+#include <limits.h>
+#include <stddef.h>
+#include "../simd-funcs.h"
+
+#ifdef V4LCONVERT_HAVE_X86_SIMD
+
+static ALWAYS_INLINE __attribute__((target("sse2")))
+unsigned int hsum_epi64_sse2(__m128i x)
+{
+	return _mm_cvtsi128_si32(x) + _mm_cvtsi128_si32(_mm_srli_si128(x, 8));
+}
+
+static ALWAYS_INLINE __attribute__((target("sse2")))
+void sum_line_sse2(const unsigned char *buf, int count, int channels,
+		unsigned int *sums)
+{
+	const __m128i zero = _mm_setzero_si128();
+	/* Bytes at offset 0, 1 and 2 modulo 3 of a 16 byte block, for 3
+	   channels the pattern repeats every 3 blocks */
+	const __m128i mod3_0 = _mm_setr_epi8(-1, 0, 0, -1, 0, 0, -1, 0,
+			0, -1, 0, 0, -1, 0, 0, -1);
+	const __m128i mod3_1 = _mm_setr_epi8(0, -1, 0, 0, -1, 0, 0, -1,
+			0, 0, -1, 0, 0, -1, 0, 0);
+	const __m128i mod3_2 = _mm_setr_epi8(0, 0, -1, 0, 0, -1, 0, 0,
+			-1, 0, 0, -1, 0, 0, -1, 0);
+	const __m128i m2 = _mm_set1_epi16(0x00ff);
+	const __m128i m4_0 = _mm_set1_epi32(0x000000ff);
+	const __m128i m4_1 = _mm_set1_epi32(0x0000ff00);
+	const __m128i m4_2 = _mm_set1_epi32(0x00ff0000);
+	__m128i total = zero, acc0 = zero, acc1 = zero, acc2 = zero;
+	int i, c, bytes = count * channels, block = channels == 3 ? 48 : 16;
+	unsigned int s0, s1, s2;
+
+	for (i = 0; i + block <= bytes; i += block) {
+		__m128i v = _mm_loadu_si128((const __m128i *)(buf + i));
+
+		total = _mm_add_epi64(total, _mm_sad_epu8(v, zero));
+		switch (channels) {
+		case 2:
+			acc0 = _mm_add_epi64(acc0,
+				_mm_sad_epu8(_mm_and_si128(v, m2), zero));
+			break;
+		case 3: {
+			__m128i v1 = _mm_loadu_si128((const __m128i *)(buf + i + 16));
+			__m128i v2 = _mm_loadu_si128((const __m128i *)(buf + i + 32));
+
+			total = _mm_add_epi64(total, _mm_add_epi64(
+					_mm_sad_epu8(v1, zero), _mm_sad_epu8(v2, zero)));
+			acc0 = _mm_add_epi64(acc0, _mm_add_epi64(
+				_mm_sad_epu8(_mm_and_si128(v, mod3_0), zero),
+				_mm_add_epi64(
+				_mm_sad_epu8(_mm_and_si128(v1, mod3_2), zero),
+				_mm_sad_epu8(_mm_and_si128(v2, mod3_1), zero))));
+			acc1 = _mm_add_epi64(acc1, _mm_add_epi64(
+				_mm_sad_epu8(_mm_and_si128(v, mod3_1), zero),
+				_mm_add_epi64(
+				_mm_sad_epu8(_mm_and_si128(v1, mod3_0), zero),
+				_mm_sad_epu8(_mm_and_si128(v2, mod3_2), zero))));
+			break;
+		}
+		case 4:
+			acc0 = _mm_add_epi64(acc0,
+				_mm_sad_epu8(_mm_and_si128(v, m4_0), zero));
+			acc1 = _mm_add_epi64(acc1,
+				_mm_sad_epu8(_mm_and_si128(v, m4_1), zero));
+			acc2 = _mm_add_epi64(acc2,
+				_mm_sad_epu8(_mm_and_si128(v, m4_2), zero));
+			break;
+		}
+	}
+
+	s0 = hsum_epi64_sse2(acc0);
+	s1 = hsum_epi64_sse2(acc1);
+	s2 = hsum_epi64_sse2(acc2);
+	switch (channels) {
+	case 1:
+		sums[0] += hsum_epi64_sse2(total);
+		break;
+	case 2:
+		sums[0] += s0;
+		sums[1] += hsum_epi64_sse2(total) - s0;
+		break;
+	case 3:
+		sums[0] += s0;
+		sums[1] += s1;
+		sums[2] += hsum_epi64_sse2(total) - s0 - s1;
+		break;
+	case 4:
+		sums[0] += s0;
+		sums[1] += s1;
+		sums[2] += s2;
+		sums[3] += hsum_epi64_sse2(total) - s0 - s1 - s2;
+		break;
+	}
+
+	/* The blocks are a multiple of channels, so i is at a channel 0 byte */
+	for (; i < bytes; i += channels)
+		for (c = 0; c < channels; c++)
+			sums[c] += buf[i + c];
+}
+
+__attribute__((target("sse2")))
+void v4lconvert_sum_line_sse2(const unsigned char *buf, int count,
+		int channels, unsigned int *sums)
+{
+	/* Let the compiler generate a specialized loop for each layout */
+	switch (channels) {
+	case 1:
+		sum_line_sse2(buf, count, 1, sums);
+		break;
+	case 2:
+		sum_line_sse2(buf, count, 2, sums);
+		break;
+	case 3:
+		sum_line_sse2(buf, count, 3, sums);
+		break;
+	case 4:
+		sum_line_sse2(buf, count, 4, sums);
+		break;
+	}
+}
+
+/* Returns 1 if all entries of lut can be addressed with a 32 bit offset
+   relative to base */
+static int lut_offset_ok(const unsigned char *base, const unsigned char *lut)
+{
+	ptrdiff_t offset = lut - base;
+
+	return offset >= INT_MIN && offset <= INT_MAX - 255;
+}
+
+/* Looks up 16 bytes in place, the tables of the first and the last 8 bytes
+   are at the 32 bit offsets from base in offs_lo resp. offs_hi */
+static ALWAYS_INLINE __attribute__((target("avx2")))
+void lut_16_avx2(unsigned char *buf, const unsigned char *base,
+		__m256i offs_lo, __m256i offs_hi)
+{
+	const __m256i ff = _mm256_set1_epi32(0xff);
+	const __m256i order = _mm256_setr_epi32(0, 4, 1, 5, 0, 4, 1, 5);
+	__m256i lo, hi;
+
+	lo = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)buf));
+	hi = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)(buf + 8)));
+	lo = _mm256_and_si256(_mm256_i32gather_epi32((const int *)base,
+			_mm256_add_epi32(lo, offs_lo), 1), ff);
+	hi = _mm256_and_si256(_mm256_i32gather_epi32((const int *)base,
+			_mm256_add_epi32(hi, offs_hi), 1), ff);
+
+	/* Per 128 bit lane the packs give lo 0-3, hi 0-3 resp. lo 4-7, hi 4-7 */
+	lo = _mm256_packus_epi16(_mm256_packus_epi32(lo, hi), lo);
+	lo = _mm256_permutevar8x32_epi32(lo, order);
+	_mm_storeu_si128((__m128i *)buf, _mm256_castsi256_si128(lo));
+}
+
+__attribute__((target("avx2")))
+void v4lconvert_lut_line_rgb24_avx2(unsigned char *buf, int count,
+		const unsigned char *lut0, const unsigned char *lut1,
+		const unsigned char *lut2)
+{
+	int i = 0, bytes = count * 3;
+
+	if (lut_offset_ok(lut0, lut1) && lut_offset_ok(lut0, lut2)) {
+		int d1 = lut1 - lut0, d2 = lut2 - lut0;
+		/* The offsets of 8 bytes starting with component 0, 1 and 2 */
+		const __m256i offs0 = _mm256_setr_epi32(0, d1, d2, 0, d1, d2, 0, d1);
+		const __m256i offs1 = _mm256_setr_epi32(d1, d2, 0, d1, d2, 0, d1, d2);
+		const __m256i offs2 = _mm256_setr_epi32(d2, 0, d1, d2, 0, d1, d2, 0);
+
+		for (; i + 48 <= bytes; i += 48) {
+			lut_16_avx2(buf + i, lut0, offs0, offs2);
+			lut_16_avx2(buf + i + 16, lut0, offs1, offs0);
+			lut_16_avx2(buf + i + 32, lut0, offs2, offs1);
+		}
+	}
+	v4lconvert_lut_line_rgb24_c(buf + i, (bytes - i) / 3, lut0, lut1, lut2);
+}
+
+__attribute__((target("avx2")))
+void v4lconvert_lut_line_bayer_avx2(unsigned char *buf, int count,
+		const unsigned char *lut0, const unsigned char *lut1)
+{
+	int i = 0, bytes = count * 2;
+
+	if (lut_offset_ok(lut0, lut1)) {
+		int d1 = lut1 - lut0;
+		const __m256i offs = _mm256_setr_epi32(0, d1, 0, d1, 0, d1, 0, d1);
+
+		for (; i + 16 <= bytes; i += 16)
+			lut_16_avx2(buf + i, lut0, offs, offs);
+	}
+	v4lconvert_lut_line_bayer_c(buf + i, (bytes - i) / 2, lut0, lut1);
+}
+
+__attribute__((target("avx2")))
+void v4lconvert_lut_line_yuv422_avx2(unsigned char *buf, int count,
+		const unsigned char *lut0, const unsigned char *lut1,
+		const unsigned char *lut2, const unsigned char *lut3)
+{
+	int i = 0, bytes = count * 4;
+
+	if (lut_offset_ok(lut0, lut1) && lut_offset_ok(lut0, lut2) &&
+			lut_offset_ok(lut0, lut3)) {
+		int d1 = lut1 - lut0, d2 = lut2 - lut0, d3 = lut3 - lut0;
+		const __m256i offs = _mm256_setr_epi32(0, d1, d2, d3, 0, d1, d2, d3);
+
+		for (; i + 16 <= bytes; i += 16)
+			lut_16_avx2(buf + i, lut0, offs, offs);
+	}
+	v4lconvert_lut_line_yuv422_c(buf + i, (bytes - i) / 4, lut0, lut1,
+			lut2, lut3);
+}
+
+#endif /* V4LCONVERT_HAVE_X86_SIMD */
@@ -43,10 +43,11 @@ static int whitebalance_active(struct v4lprocessing_data *data)
 	return wb;
 }
 
-static int whitebalance_calculate_lookup_tables_generic(
+/* Updates the averages used for the correction, returns 1 if the colors
+   are off enough to need correcting */
+static int whitebalance_update_averages(
 		struct v4lprocessing_data *data, int green_avg, int comp1_avg, int comp2_avg)
 {
-	int i, avg_avg;
 	const int threshold = 64;
 	const int max_step = 128;
 
@@ -99,9 +100,8 @@ static int whitebalance_calculate_lookup_tables_generic(
 		 * update cycle, as asking for an update each frame while
 		 * some other pluging is trying to adjust hw settings is bad.
 		 */
-		if (throttling && data->lookup_table_update_counter == 0)
-			data->lookup_table_update_counter =
-						V4L2PROCESSING_UPDATE_RATE;
+		if (throttling && data->update_frames == 0)
+			data->update_frames = 1;
 	}
 
 	if (abs(data->green_avg - data->comp1_avg) < threshold &&
@@ -109,6 +109,17 @@ static int whitebalance_calculate_lookup_tables_generic(
 			abs(data->comp1_avg - data->comp2_avg) < threshold)
 		return 0;
 
+	return 1;
+}
+
+static int whitebalance_calculate_lookup_tables_generic(
+		struct v4lprocessing_data *data, int green_avg, int comp1_avg, int comp2_avg)
+{
+	int i, avg_avg;
+
+	if (!whitebalance_update_averages(data, green_avg, comp1_avg, comp2_avg))
+		return 0;
+
 	avg_avg = (data->green_avg + data->comp1_avg + data->comp2_avg) / 3;
 
 	for (i = 0; i < 256; i++) {
@@ -124,36 +135,35 @@ static int whitebalance_calculate_lookup_tables_bayer(
 		struct v4lprocessing_data *data, unsigned char *buf,
 		const struct v4l2_format *fmt, int starts_with_green)
 {
-	int x, y, a1 = 0, a2 = 0, b1 = 0, b2 = 0;
-	int green_avg, comp1_avg, comp2_avg;
-
-	for (y = 0; y < fmt->fmt.pix.height; y += 2) {
-		for (x = 0; x < fmt->fmt.pix.width; x += 2) {
-			a1 += *buf++;
-			a2 += *buf++;
-		}
-		buf += fmt->fmt.pix.bytesperline - fmt->fmt.pix.width;
-		for (x = 0; x < fmt->fmt.pix.width; x += 2) {
-			b1 += *buf++;
-			b2 += *buf++;
-		}
-		buf += fmt->fmt.pix.bytesperline - fmt->fmt.pix.width;
-	}
+	unsigned int a[2] = { 0, 0 }, b[2] = { 0, 0 };
+	int lines, step, norm, green_avg, comp1_avg, comp2_avg;
+
+	/* Sample line pairs, so that we see all 4 colors */
+	lines = fmt->fmt.pix.height / 2;
+	step = v4lprocessing_stats_step(data, lines);
+	v4lprocessing_sum_region(buf, 2 * fmt->fmt.pix.bytesperline,
+			fmt->fmt.pix.width / 2, 2, lines, step, a);
+	lines = v4lprocessing_sum_region(buf + fmt->fmt.pix.bytesperline,
+			2 * fmt->fmt.pix.bytesperline,
+			fmt->fmt.pix.width / 2, 2, lines, step, b);
 
 	if (starts_with_green) {
-		green_avg = a1 / 2 + b2 / 2;
-		comp1_avg = a2;
-		comp2_avg = b1;
+		green_avg = a[0] / 2 + b[1] / 2;
+		comp1_avg = a[1];
+		comp2_avg = b[0];
 	} else {
-		green_avg = a2 / 2 + b1 / 2;
-		comp1_avg = a1;
-		comp2_avg = b2;
+		green_avg = a[1] / 2 + b[0] / 2;
+		comp1_avg = a[0];
+		comp2_avg = b[1];
 	}
 
-	/* Norm avg to ~ 0 - 4095 */
-	green_avg /= fmt->fmt.pix.width * fmt->fmt.pix.height / 64;
-	comp1_avg /= fmt->fmt.pix.width * fmt->fmt.pix.height / 64;
-	comp2_avg /= fmt->fmt.pix.width * fmt->fmt.pix.height / 64;
+	/* Norm avg to ~ 0 - 4095, tiny frames give too few samples */
+	norm = lines * fmt->fmt.pix.width / 32;
+	if (norm == 0)
+		return 0;
+	green_avg /= norm;
+	comp1_avg /= norm;
+	comp2_avg /= norm;
 
 	return whitebalance_calculate_lookup_tables_generic(data, green_avg,
 			comp1_avg, comp2_avg);
@@ -163,26 +173,107 @@ static int whitebalance_calculate_lookup_tables_rgb(
 		struct v4lprocessing_data *data, unsigned char *buf,
 		const struct v4l2_format *fmt)
 {
-	int x, y, green_avg = 0, comp1_avg = 0, comp2_avg = 0;
+	unsigned int sums[3] = { 0, 0, 0 };
+	int lines, norm, green_avg, comp1_avg, comp2_avg;
 
-	for (y = 0; y < fmt->fmt.pix.height; y++) {
-		for (x = 0; x < fmt->fmt.pix.width; x++) {
-			comp1_avg += *buf++;
-			green_avg += *buf++;
-			comp2_avg += *buf++;
-		}
-		buf += fmt->fmt.pix.bytesperline - fmt->fmt.pix.width * 3;
-	}
+	lines = v4lprocessing_sum_region(buf, fmt->fmt.pix.bytesperline,
+			fmt->fmt.pix.width, 3, fmt->fmt.pix.height,
+			v4lprocessing_stats_step(data, fmt->fmt.pix.height),
+			sums);
 
-	/* Norm avg to ~ 0 - 4095 */
-	green_avg /= fmt->fmt.pix.width * fmt->fmt.pix.height / 16;
-	comp1_avg /= fmt->fmt.pix.width * fmt->fmt.pix.height / 16;
-	comp2_avg /= fmt->fmt.pix.width * fmt->fmt.pix.height / 16;
+	/* Norm avg to ~ 0 - 4095, tiny frames give too few samples */
+	norm = lines * fmt->fmt.pix.width / 16;
+	if (norm == 0)
+		return 0;
+	comp1_avg = sums[0] / norm;
+	green_avg = sums[1] / norm;
+	comp2_avg = sums[2] / norm;
 
 	return whitebalance_calculate_lookup_tables_generic(data, green_avg,
 			comp1_avg, comp2_avg);
 }
 
+/*
+ * For yuv the averages get converted to rgb, so that the same averaging and
+ * thresholds get used as for rgb. Instead of scaling r, g and b, the
+ * correction then is an offset on the chroma, which moves the average color
+ * to grey.
+ */
+static int whitebalance_calculate_lookup_tables_yuv(
+		struct v4lprocessing_data *data, unsigned char *buf,
+		const struct v4l2_format *fmt)
+{
+	struct v4lprocessing_yuv_layout l;
+	unsigned int sums[4] = { 0, 0, 0, 0 };
+	int i, y_avg, u_avg, v_avg, u_off, v_off, y_lines, uv_lines, step;
+	int y_norm, uv_norm;
+	int green_avg, comp1_avg, comp2_avg;
+	int width = fmt->fmt.pix.width;
+
+	v4lprocessing_get_yuv_layout(buf, fmt, &l);
+	step = v4lprocessing_stats_step(data, fmt->fmt.pix.height);
+
+	if (l.y_step == 2) {
+		/* Packed, get all 3 planes from one pass over 4 byte groups */
+		y_lines = uv_lines = v4lprocessing_sum_region(buf, l.y_stride,
+				width / 2, 4, fmt->fmt.pix.height, step, sums);
+		y_avg = sums[l.y - buf] + sums[l.y - buf + 2];
+		u_avg = sums[l.u - buf];
+		v_avg = sums[l.v - buf];
+	} else {
+		y_lines = v4lprocessing_sum_region(l.y, l.y_stride, width, 1,
+				fmt->fmt.pix.height, step, &sums[2]);
+		y_avg = sums[2];
+		step = v4lprocessing_stats_step(data, l.uv_lines);
+		if (l.uv_step == 2) {
+			/* Interleaved chroma plane */
+			uv_lines = v4lprocessing_sum_region(
+					l.u < l.v ? l.u : l.v, l.uv_stride,
+					width / 2, 2, l.uv_lines, step, sums);
+			u_avg = sums[l.u > l.v];
+			v_avg = sums[l.v > l.u];
+		} else {
+			uv_lines = v4lprocessing_sum_region(l.u, l.uv_stride,
+					width / 2, 1, l.uv_lines, step, &sums[0]);
+			v4lprocessing_sum_region(l.v, l.uv_stride, width / 2, 1,
+					l.uv_lines, step, &sums[1]);
+			u_avg = sums[0];
+			v_avg = sums[1];
+		}
+	}
+
+	/* Norm avg to ~ 0 - 4095, and center u and v around 0 */
+	y_norm = y_lines * width / 16;
+	uv_norm = uv_lines * width / 2 / 16;
+	if (y_norm == 0 || uv_norm == 0)
+		return 0;
+	y_avg /= y_norm;
+	u_avg /= uv_norm;
+	v_avg /= uv_norm;
+	u_avg -= 2048;
+	v_avg -= 2048;
+
+	/* CCIR 601 yuv -> rgb, with 10 bits fixed point coefficients */
+	comp1_avg = y_avg + ((1436 * v_avg) >> 10);
+	green_avg = y_avg - ((352 * u_avg + 731 * v_avg) >> 10);
+	comp2_avg = y_avg + ((1815 * u_avg) >> 10);
+
+	if (!whitebalance_update_averages(data, green_avg, comp1_avg, comp2_avg))
+		return 0;
+
+	/* Chroma of the (throttled) average color, scaled back to 0 - 255 */
+	u_off = (-173 * data->comp1_avg - 339 * data->green_avg +
+		 512 * data->comp2_avg) / (1024 * 16);
+	v_off = (512 * data->comp1_avg - 429 * data->green_avg -
+		 83 * data->comp2_avg) / (1024 * 16);
+
+	for (i = 0; i < 256; i++) {
+		data->green[i] = CLIP256(data->green[i] - u_off);
+		data->comp2[i] = CLIP256(data->comp2[i] - v_off);
+	}
+
+	return 1;
+}
 
 static int whitebalance_calculate_lookup_tables(
 		struct v4lprocessing_data *data,
@@ -200,6 +291,15 @@ static int whitebalance_calculate_lookup_tables(
 	case V4L2_PIX_FMT_RGB24:
 	case V4L2_PIX_FMT_BGR24:
 		return whitebalance_calculate_lookup_tables_rgb(data, buf, fmt);
+
+	case V4L2_PIX_FMT_YUV420:
+	case V4L2_PIX_FMT_YVU420:
+	case V4L2_PIX_FMT_NV12:
+	case V4L2_PIX_FMT_NV21:
+	case V4L2_PIX_FMT_YUYV:
+	case V4L2_PIX_FMT_YVYU:
+	case V4L2_PIX_FMT_UYVY:
+		return whitebalance_calculate_lookup_tables_yuv(data, buf, fmt);
 	}
 
 	return 0; /* Should never happen */
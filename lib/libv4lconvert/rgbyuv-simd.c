@@ -0,0 +1,333 @@
+/*
+
+# SIMD versions of the packed yuv 4:2:2 to RGB conversion routines
+
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU Lesser General Public License as published by
+# the Free Software Foundation; either version 2.1 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU Lesser General Public License for more details.
+#
+# You should have received a copy of the GNU Lesser General Public License
+# along with this program; if not, write to the Free Software
+# Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA  02110-1335  USA
+
+ */
+
+/*
+ * These give exactly the same results as the plain C versions in rgbyuv.c:
+ *   u1 = (129 * (u - 128)) >> 6
+ *   rg = (3 * (u - 128) + 6 * (v - 128)) >> 3
+ *   v1 = (3 * (v - 128)) >> 1
+ *   r = CLIP(y + v1), g = CLIP(y - rg), b = CLIP(y + u1)
+ * All intermediate values fit in a signed 16 bit integer, and the unsigned
+ * saturating pack instructions do the clipping.
+ */
+
+#include "simd-funcs.h"
+
+#ifdef V4LCONVERT_HAVE_X86_SIMD
+
+/* Splits 8 pixels (16 bytes) of packed yuv 4:2:2 in 16 bit luma values, and
+   per pixel 16 bit u and v values */
+static ALWAYS_INLINE __attribute__((target("sse2")))
+void yuv422_unpack_sse2(__m128i pixels, int order,
+		__m128i *y, __m128i *u, __m128i *v)
+{
+	const __m128i lo8 = _mm_set1_epi16(0x00ff);
+	const __m128i lo16 = _mm_set1_epi32(0x0000ffff);
+	__m128i c, c0, c1;
+
+	if (order == V4LCONVERT_ORDER_UYVY) {
+		*y = _mm_srli_epi16(pixels, 8);
+		c = _mm_and_si128(pixels, lo8);
+	} else {
+		*y = _mm_and_si128(pixels, lo8);
+		c = _mm_srli_epi16(pixels, 8);
+	}
+	/* duplicate the first resp. second chroma value of each pixel pair */
+	c0 = _mm_or_si128(_mm_and_si128(c, lo16), _mm_slli_epi32(c, 16));
+	c1 = _mm_or_si128(_mm_srli_epi32(c, 16), _mm_andnot_si128(lo16, c));
+	if (order == V4LCONVERT_ORDER_YVYU) {
+		*u = c1;
+		*v = c0;
+	} else {
+		*u = c0;
+		*v = c1;
+	}
+}
+
+static ALWAYS_INLINE __attribute__((target("sse2")))
+void yuv_to_rgb_sse2(__m128i y, __m128i u, __m128i v,
+		__m128i *r, __m128i *g, __m128i *b)
+{
+	const __m128i c128 = _mm_set1_epi16(128);
+	__m128i du = _mm_sub_epi16(u, c128);
+	__m128i dv = _mm_sub_epi16(v, c128);
+	__m128i u1 = _mm_srai_epi16(_mm_add_epi16(_mm_slli_epi16(du, 7), du), 6);
+	__m128i rg = _mm_srai_epi16(_mm_add_epi16(
+				_mm_add_epi16(_mm_slli_epi16(du, 1), du),
+				_mm_add_epi16(_mm_slli_epi16(dv, 2), _mm_slli_epi16(dv, 1))), 3);
+	__m128i v1 = _mm_srai_epi16(_mm_add_epi16(_mm_slli_epi16(dv, 1), dv), 1);
+
+	*r = _mm_add_epi16(y, v1);
+	*g = _mm_sub_epi16(y, rg);
+	*b = _mm_add_epi16(y, u1);
+}
+
+/* Converts 16 pixels */
+static ALWAYS_INLINE __attribute__((target("sse2")))
+void yuv422_to_rgb24_16_sse2(const unsigned char *src, unsigned char *dest,
+		int order, int bgr)
+{
+	__m128i y, u, v, ra, ga, ba, rb, gb, bb, r, g, b;
+
+	yuv422_unpack_sse2(_mm_loadu_si128((const __m128i *)src), order,
+			&y, &u, &v);
+	yuv_to_rgb_sse2(y, u, v, &ra, &ga, &ba);
+	yuv422_unpack_sse2(_mm_loadu_si128((const __m128i *)(src + 16)), order,
+			&y, &u, &v);
+	yuv_to_rgb_sse2(y, u, v, &rb, &gb, &bb);
+
+	r = _mm_packus_epi16(ra, rb);
+	g = _mm_packus_epi16(ga, gb);
+	b = _mm_packus_epi16(ba, bb);
+	if (bgr)
+		store_rgb24_sse2(dest, b, g, r);
+	else
+		store_rgb24_sse2(dest, r, g, b);
+}
+
+static ALWAYS_INLINE __attribute__((target("sse2")))
+int yuv422_to_rgb24_line_sse2(const unsigned char *src, unsigned char *dest,
+		int width, int order, int bgr)
+{
+	int j;
+
+	for (j = 0; j + 16 <= width; j += 16) {
+		yuv422_to_rgb24_16_sse2(src, dest, order, bgr);
+		src += 32;
+		dest += 48;
+	}
+	return j;
+}
+
+__attribute__((target("sse2")))
+int v4lconvert_yuv422_to_rgb24_line_sse2(const unsigned char *src,
+		unsigned char *dest, int width, int order, int bgr)
+{
+	/* Let the compiler generate a specialized loop for each format */
+	switch (order * 2 + !!bgr) {
+	case V4LCONVERT_ORDER_YUYV * 2:
+		return yuv422_to_rgb24_line_sse2(src, dest, width, V4LCONVERT_ORDER_YUYV, 0);
+	case V4LCONVERT_ORDER_YUYV * 2 + 1:
+		return yuv422_to_rgb24_line_sse2(src, dest, width, V4LCONVERT_ORDER_YUYV, 1);
+	case V4LCONVERT_ORDER_YVYU * 2:
+		return yuv422_to_rgb24_line_sse2(src, dest, width, V4LCONVERT_ORDER_YVYU, 0);
+	case V4LCONVERT_ORDER_YVYU * 2 + 1:
+		return yuv422_to_rgb24_line_sse2(src, dest, width, V4LCONVERT_ORDER_YVYU, 1);
+	case V4LCONVERT_ORDER_UYVY * 2:
+		return yuv422_to_rgb24_line_sse2(src, dest, width, V4LCONVERT_ORDER_UYVY, 0);
+	case V4LCONVERT_ORDER_UYVY * 2 + 1:
+		return yuv422_to_rgb24_line_sse2(src, dest, width, V4LCONVERT_ORDER_UYVY, 1);
+	}
+	return 0;
+}
+
+static ALWAYS_INLINE __attribute__((target("avx2")))
+void yuv422_unpack_avx2(__m256i pixels, int order,
+		__m256i *y, __m256i *u, __m256i *v)
+{
+	const __m256i lo8 = _mm256_set1_epi16(0x00ff);
+	const __m256i lo16 = _mm256_set1_epi32(0x0000ffff);
+	__m256i c, c0, c1;
+
+	if (order == V4LCONVERT_ORDER_UYVY) {
+		*y = _mm256_srli_epi16(pixels, 8);
+		c = _mm256_and_si256(pixels, lo8);
+	} else {
+		*y = _mm256_and_si256(pixels, lo8);
+		c = _mm256_srli_epi16(pixels, 8);
+	}
+	c0 = _mm256_or_si256(_mm256_and_si256(c, lo16), _mm256_slli_epi32(c, 16));
+	c1 = _mm256_or_si256(_mm256_srli_epi32(c, 16), _mm256_andnot_si256(lo16, c));
+	if (order == V4LCONVERT_ORDER_YVYU) {
+		*u = c1;
+		*v = c0;
+	} else {
+		*u = c0;
+		*v = c1;
+	}
+}
+
+static ALWAYS_INLINE __attribute__((target("avx2")))
+void yuv_to_rgb_avx2(__m256i y, __m256i u, __m256i v,
+		__m256i *r, __m256i *g, __m256i *b)
+{
+	const __m256i c128 = _mm256_set1_epi16(128);
+	__m256i du = _mm256_sub_epi16(u, c128);
+	__m256i dv = _mm256_sub_epi16(v, c128);
+	__m256i u1 = _mm256_srai_epi16(_mm256_add_epi16(_mm256_slli_epi16(du, 7), du), 6);
+	__m256i rg = _mm256_srai_epi16(_mm256_add_epi16(
+				_mm256_add_epi16(_mm256_slli_epi16(du, 1), du),
+				_mm256_add_epi16(_mm256_slli_epi16(dv, 2), _mm256_slli_epi16(dv, 1))), 3);
+	__m256i v1 = _mm256_srai_epi16(_mm256_add_epi16(_mm256_slli_epi16(dv, 1), dv), 1);
+
+	*r = _mm256_add_epi16(y, v1);
+	*g = _mm256_sub_epi16(y, rg);
+	*b = _mm256_add_epi16(y, u1);
+}
+
+/* Converts 32 pixels */
+static ALWAYS_INLINE __attribute__((target("avx2")))
+void yuv422_to_rgb24_32_avx2(const unsigned char *src, unsigned char *dest,
+		int order, int bgr)
+{
+	__m256i y, u, v, ra, ga, ba, rb, gb, bb, r, g, b;
+
+	yuv422_unpack_avx2(_mm256_loadu_si256((const __m256i *)src), order,
+			&y, &u, &v);
+	yuv_to_rgb_avx2(y, u, v, &ra, &ga, &ba);
+	yuv422_unpack_avx2(_mm256_loadu_si256((const __m256i *)(src + 32)), order,
+			&y, &u, &v);
+	yuv_to_rgb_avx2(y, u, v, &rb, &gb, &bb);
+
+	/* packus works per 128 bit lane, restore the pixel order */
+	r = _mm256_permute4x64_epi64(_mm256_packus_epi16(ra, rb), 0xd8);
+	g = _mm256_permute4x64_epi64(_mm256_packus_epi16(ga, gb), 0xd8);
+	b = _mm256_permute4x64_epi64(_mm256_packus_epi16(ba, bb), 0xd8);
+	if (bgr)
+		store_rgb24_avx2(dest, b, g, r);
+	else
+		store_rgb24_avx2(dest, r, g, b);
+}
+
+static ALWAYS_INLINE __attribute__((target("avx2")))
+int yuv422_to_rgb24_line_avx2(const unsigned char *src, unsigned char *dest,
+		int width, int order, int bgr)
+{
+	int j;
+
+	for (j = 0; j + 32 <= width; j += 32) {
+		yuv422_to_rgb24_32_avx2(src, dest, order, bgr);
+		src += 64;
+		dest += 96;
+	}
+	if (j + 16 <= width) {
+		yuv422_to_rgb24_16_sse2(src, dest, order, bgr);
+		j += 16;
+	}
+	return j;
+}
+
+__attribute__((target("avx2")))
+int v4lconvert_yuv422_to_rgb24_line_avx2(const unsigned char *src,
+		unsigned char *dest, int width, int order, int bgr)
+{
+	switch (order * 2 + !!bgr) {
+	case V4LCONVERT_ORDER_YUYV * 2:
+		return yuv422_to_rgb24_line_avx2(src, dest, width, V4LCONVERT_ORDER_YUYV, 0);
+	case V4LCONVERT_ORDER_YUYV * 2 + 1:
+		return yuv422_to_rgb24_line_avx2(src, dest, width, V4LCONVERT_ORDER_YUYV, 1);
+	case V4LCONVERT_ORDER_YVYU * 2:
+		return yuv422_to_rgb24_line_avx2(src, dest, width, V4LCONVERT_ORDER_YVYU, 0);
+	case V4LCONVERT_ORDER_YVYU * 2 + 1:
+		return yuv422_to_rgb24_line_avx2(src, dest, width, V4LCONVERT_ORDER_YVYU, 1);
+	case V4LCONVERT_ORDER_UYVY * 2:
+		return yuv422_to_rgb24_line_avx2(src, dest, width, V4LCONVERT_ORDER_UYVY, 0);
+	case V4LCONVERT_ORDER_UYVY * 2 + 1:
+		return yuv422_to_rgb24_line_avx2(src, dest, width, V4LCONVERT_ORDER_UYVY, 1);
+	}
+	return 0;
+}
+#endif /* V4LCONVERT_HAVE_X86_SIMD */
+
+#ifdef V4LCONVERT_HAVE_NEON
+#include <arm_neon.h>
+
+/* Converts 16 pixels */
+static ALWAYS_INLINE
+void yuv422_to_rgb24_16_neon(const unsigned char *src, unsigned char *dest,
+		int order, int bgr)
+{
+	/* vld4 splits the 8 pixel pairs in their 4 components */
+	uint8x8x4_t in = vld4_u8(src);
+	uint8x8_t y0, y1, u, v;
+	int16x8_t du, dv, u1, rg, v1, ye, yo;
+	uint8x8x2_t r, g, b;
+	uint8x16x3_t out;
+
+	switch (order) {
+	case V4LCONVERT_ORDER_YVYU:
+		y0 = in.val[0]; v = in.val[1]; y1 = in.val[2]; u = in.val[3];
+		break;
+	case V4LCONVERT_ORDER_UYVY:
+		u = in.val[0]; y0 = in.val[1]; v = in.val[2]; y1 = in.val[3];
+		break;
+	default:
+		y0 = in.val[0]; u = in.val[1]; y1 = in.val[2]; v = in.val[3];
+	}
+
+	du = vreinterpretq_s16_u16(vsubl_u8(u, vdup_n_u8(128)));
+	dv = vreinterpretq_s16_u16(vsubl_u8(v, vdup_n_u8(128)));
+	u1 = vshrq_n_s16(vaddq_s16(vshlq_n_s16(du, 7), du), 6);
+	rg = vshrq_n_s16(vaddq_s16(vaddq_s16(vshlq_n_s16(du, 1), du),
+				vaddq_s16(vshlq_n_s16(dv, 2), vshlq_n_s16(dv, 1))), 3);
+	v1 = vshrq_n_s16(vaddq_s16(vshlq_n_s16(dv, 1), dv), 1);
+	ye = vreinterpretq_s16_u16(vmovl_u8(y0));
+	yo = vreinterpretq_s16_u16(vmovl_u8(y1));
+
+	/* saturate to 8 bit and put the even and odd pixels back in order */
+	r = vzip_u8(vqmovun_s16(vaddq_s16(ye, v1)), vqmovun_s16(vaddq_s16(yo, v1)));
+	g = vzip_u8(vqmovun_s16(vsubq_s16(ye, rg)), vqmovun_s16(vsubq_s16(yo, rg)));
+	b = vzip_u8(vqmovun_s16(vaddq_s16(ye, u1)), vqmovun_s16(vaddq_s16(yo, u1)));
+
+	out.val[1] = vcombine_u8(g.val[0], g.val[1]);
+	if (bgr) {
+		out.val[0] = vcombine_u8(b.val[0], b.val[1]);
+		out.val[2] = vcombine_u8(r.val[0], r.val[1]);
+	} else {
+		out.val[0] = vcombine_u8(r.val[0], r.val[1]);
+		out.val[2] = vcombine_u8(b.val[0], b.val[1]);
+	}
+	vst3q_u8(dest, out);
+}
+
+static ALWAYS_INLINE
+int yuv422_to_rgb24_line_neon(const unsigned char *src, unsigned char *dest,
+		int width, int order, int bgr)
+{
+	int j;
+
+	for (j = 0; j + 16 <= width; j += 16) {
+		yuv422_to_rgb24_16_neon(src, dest, order, bgr);
+		src += 32;
+		dest += 48;
+	}
+	return j;
+}
+
+int v4lconvert_yuv422_to_rgb24_line_neon(const unsigned char *src,
+		unsigned char *dest, int width, int order, int bgr)
+{
+	switch (order * 2 + !!bgr) {
+	case V4LCONVERT_ORDER_YUYV * 2:
+		return yuv422_to_rgb24_line_neon(src, dest, width, V4LCONVERT_ORDER_YUYV, 0);
+	case V4LCONVERT_ORDER_YUYV * 2 + 1:
+		return yuv422_to_rgb24_line_neon(src, dest, width, V4LCONVERT_ORDER_YUYV, 1);
+	case V4LCONVERT_ORDER_YVYU * 2:
+		return yuv422_to_rgb24_line_neon(src, dest, width, V4LCONVERT_ORDER_YVYU, 0);
+	case V4LCONVERT_ORDER_YVYU * 2 + 1:
+		return yuv422_to_rgb24_line_neon(src, dest, width, V4LCONVERT_ORDER_YVYU, 1);
+	case V4LCONVERT_ORDER_UYVY * 2:
+		return yuv422_to_rgb24_line_neon(src, dest, width, V4LCONVERT_ORDER_UYVY, 0);
+	case V4LCONVERT_ORDER_UYVY * 2 + 1:
+		return yuv422_to_rgb24_line_neon(src, dest, width, V4LCONVERT_ORDER_UYVY, 1);
+	}
+	return 0;
+}
+#endif /* V4LCONVERT_HAVE_NEON */
@@ -202,10 +202,16 @@ void v4lconvert_yuv420_to_rgb24(const unsigned char *src, unsigned char *dest,
 void v4lconvert_yuyv_to_bgr24(const unsigned char *src, unsigned char *dest,
 		int width, int height, int stride)
 {
+	v4lconvert_yuv422_line_func line_func =
+		v4lconvert_kernels.yuv422_to_rgb24_line;
 	int j;
 
 	while (--height >= 0) {
-		for (j = 0; j + 1 < width; j += 2) {
+		j = line_func ? line_func(src, dest, width,
+				V4LCONVERT_ORDER_YUYV, 1) : 0;
+		src += j * 2;
+		dest += j * 3;
+		for (; j + 1 < width; j += 2) {
 			int u = src[1];
 			int v = src[3];
 			int u1 = (((u - 128) << 7) +  (u - 128)) >> 6;
@@ -229,10 +235,16 @@ void v4lconvert_yuyv_to_bgr24(const unsigned char *src, unsigned char *dest,
 void v4lconvert_yuyv_to_rgb24(const unsigned char *src, unsigned char *dest,
 		int width, int height, int stride)
 {
+	v4lconvert_yuv422_line_func line_func =
+		v4lconvert_kernels.yuv422_to_rgb24_line;
 	int j;
 
 	while (--height >= 0) {
-		for (j = 0; j + 1 < width; j += 2) {
+		j = line_func ? line_func(src, dest, width,
+				V4LCONVERT_ORDER_YUYV, 0) : 0;
+		src += j * 2;
+		dest += j * 3;
+		for (; j + 1 < width; j += 2) {
 			int u = src[1];
 			int v = src[3];
 			int u1 = (((u - 128) << 7) +  (u - 128)) >> 6;
@@ -297,10 +309,16 @@ void v4lconvert_yuyv_to_yuv420(const unsigned char *src, unsigned char *dest,
 void v4lconvert_yvyu_to_bgr24(const unsigned char *src, unsigned char *dest,
 		int width, int height, int stride)
 {
+	v4lconvert_yuv422_line_func line_func =
+		v4lconvert_kernels.yuv422_to_rgb24_line;
 	int j;
 
 	while (--height >= 0) {
-		for (j = 0; j + 1 < width; j += 2) {
+		j = line_func ? line_func(src, dest, width,
+				V4LCONVERT_ORDER_YVYU, 1) : 0;
+		src += j * 2;
+		dest += j * 3;
+		for (; j + 1 < width; j += 2) {
 			int u = src[3];
 			int v = src[1];
 			int u1 = (((u - 128) << 7) +  (u - 128)) >> 6;
@@ -324,10 +342,16 @@ void v4lconvert_yvyu_to_bgr24(const unsigned char *src, unsigned char *dest,
 void v4lconvert_yvyu_to_rgb24(const unsigned char *src, unsigned char *dest,
 		int width, int height, int stride)
 {
+	v4lconvert_yuv422_line_func line_func =
+		v4lconvert_kernels.yuv422_to_rgb24_line;
 	int j;
 
 	while (--height >= 0) {
-		for (j = 0; j + 1 < width; j += 2) {
+		j = line_func ? line_func(src, dest, width,
+				V4LCONVERT_ORDER_YVYU, 0) : 0;
+		src += j * 2;
+		dest += j * 3;
+		for (; j + 1 < width; j += 2) {
 			int u = src[3];
 			int v = src[1];
 			int u1 = (((u - 128) << 7) +  (u - 128)) >> 6;
@@ -351,10 +375,16 @@ void v4lconvert_yvyu_to_rgb24(const unsigned char *src, unsigned char *dest,
 void v4lconvert_uyvy_to_bgr24(const unsigned char *src, unsigned char *dest,
 		int width, int height, int stride)
 {
+	v4lconvert_yuv422_line_func line_func =
+		v4lconvert_kernels.yuv422_to_rgb24_line;
 	int j;
 
 	while (--height >= 0) {
-		for (j = 0; j + 1 < width; j += 2) {
+		j = line_func ? line_func(src, dest, width,
+				V4LCONVERT_ORDER_UYVY, 1) : 0;
+		src += j * 2;
+		dest += j * 3;
+		for (; j + 1 < width; j += 2) {
 			int u = src[0];
 			int v = src[2];
 			int u1 = (((u - 128) << 7) +  (u - 128)) >> 6;
@@ -378,10 +408,16 @@ void v4lconvert_uyvy_to_bgr24(const unsigned char *src, unsigned char *dest,
 void v4lconvert_uyvy_to_rgb24(const unsigned char *src, unsigned char *dest,
 		int width, int height, int stride)
 {
+	v4lconvert_yuv422_line_func line_func =
+		v4lconvert_kernels.yuv422_to_rgb24_line;
 	int j;
 
 	while (--height >= 0) {
-		for (j = 0; j + 1 < width; j += 2) {
+		j = line_func ? line_func(src, dest, width,
+				V4LCONVERT_ORDER_UYVY, 0) : 0;
+		src += j * 2;
+		dest += j * 3;
+		for (; j + 1 < width; j += 2) {
 			int u = src[0];
 			int v = src[2];
 			int u1 = (((u - 128) << 7) +  (u - 128)) >> 6;
@@ -442,6 +478,280 @@ void v4lconvert_uyvy_to_yuv420(const unsigned char *src, unsigned char *dest,
 	}
 }
 
+void v4lconvert_yuyv_to_nv12(const unsigned char *src, unsigned char *dest,
+		int width, int height, int stride, int nv21)
+{
+	int i, j;
+	const unsigned char *src1;
+	unsigned char *uvdest;
+
+	/* copy the Y values */
+	src1 = src;
+	for (i = 0; i < height; i++) {
+		for (j = 0; j + 1 < width; j += 2) {
+			*dest++ = src1[0];
+			*dest++ = src1[2];
+			src1 += 4;
+		}
+		src1 += stride - width * 2;
+	}
+
+	/* copy the U and V values, interleaved */
+	uvdest = dest;
+	if (nv21)
+		src += 3;		/* point to V */
+	else
+		src++;			/* point to U */
+	src1 = src + stride;		/* next line */
+	for (i = 0; i < height; i += 2) {
+		for (j = 0; j + 1 < width; j += 2) {
+			*uvdest++ = ((int) src[0] + src1[0]) / 2;
+			*uvdest++ = ((int) src[nv21 ? -2 : 2] +
+					src1[nv21 ? -2 : 2]) / 2;
+			src += 4;
+			src1 += 4;
+		}
+		src1 += stride - width * 2;
+		src = src1;
+		src1 += stride;
+	}
+}
+
+void v4lconvert_uyvy_to_nv12(const unsigned char *src, unsigned char *dest,
+		int width, int height, int stride, int nv21)
+{
+	int i, j;
+	const unsigned char *src1;
+	unsigned char *uvdest;
+
+	/* copy the Y values */
+	src1 = src;
+	for (i = 0; i < height; i++) {
+		for (j = 0; j + 1 < width; j += 2) {
+			*dest++ = src1[1];
+			*dest++ = src1[3];
+			src1 += 4;
+		}
+		src1 += stride - width * 2;
+	}
+
+	/* copy the U and V values, interleaved */
+	uvdest = dest;
+	if (nv21)
+		src += 2;		/* point to V */
+	src1 = src + stride;		/* next line */
+	for (i = 0; i < height; i += 2) {
+		for (j = 0; j + 1 < width; j += 2) {
+			*uvdest++ = ((int) src[0] + src1[0]) / 2;
+			*uvdest++ = ((int) src[nv21 ? -2 : 2] +
+					src1[nv21 ? -2 : 2]) / 2;
+			src += 4;
+			src1 += 4;
+		}
+		src1 += stride - width * 2;
+		src = src1;
+		src1 += stride;
+	}
+}
+
+/* Converts any of the packed yuv 4:2:2 formats to yuyv, order is one of
+   V4LCONVERT_ORDER_* and gives the order of the source */
+void v4lconvert_yuv422_to_yuyv(const unsigned char *src, unsigned char *dest,
+		int width, int height, int stride, int order)
+{
+	int i, j;
+
+	for (i = 0; i < height; i++) {
+		const unsigned char *s = src;
+
+		switch (order) {
+		case V4LCONVERT_ORDER_YUYV:
+			memcpy(dest, s, width * 2);
+			dest += width * 2;
+			break;
+		case V4LCONVERT_ORDER_YVYU:
+			for (j = 0; j + 1 < width; j += 2) {
+				*dest++ = s[0];
+				*dest++ = s[3];
+				*dest++ = s[2];
+				*dest++ = s[1];
+				s += 4;
+			}
+			break;
+		case V4LCONVERT_ORDER_UYVY:
+			for (j = 0; j + 1 < width; j += 2) {
+				*dest++ = s[1];
+				*dest++ = s[0];
+				*dest++ = s[3];
+				*dest++ = s[2];
+				s += 4;
+			}
+			break;
+		}
+		src += stride;
+	}
+}
+
+void v4lconvert_yuv420_to_nv12(const unsigned char *src, unsigned char *dest,
+		int width, int height, int yvu)
+{
+	int i;
+	const unsigned char *usrc, *vsrc;
+
+	if (yvu) {
+		vsrc = src + width * height;
+		usrc = vsrc + width * height / 4;
+	} else {
+		usrc = src + width * height;
+		vsrc = usrc + width * height / 4;
+	}
+
+	memcpy(dest, src, width * height);
+	dest += width * height;
+
+	for (i = 0; i < width * height / 4; i++) {
+		*dest++ = *usrc++;
+		*dest++ = *vsrc++;
+	}
+}
+
+void v4lconvert_yuv420_to_yuyv(const unsigned char *src, unsigned char *dest,
+		int width, int height, int yvu)
+{
+	int i, j;
+	const unsigned char *ysrc = src;
+	const unsigned char *usrc, *vsrc;
+
+	if (yvu) {
+		vsrc = src + width * height;
+		usrc = vsrc + width * height / 4;
+	} else {
+		usrc = src + width * height;
+		vsrc = usrc + width * height / 4;
+	}
+
+	for (i = 0; i < height; i++) {
+		for (j = 0; j + 1 < width; j += 2) {
+			*dest++ = *ysrc++;
+			*dest++ = *usrc++;
+			*dest++ = *ysrc++;
+			*dest++ = *vsrc++;
+		}
+		/* Rewind u and v for next line */
+		if (!(i & 1)) {
+			usrc -= width / 2;
+			vsrc -= width / 2;
+		}
+	}
+}
+
+void v4lconvert_nv12_to_rgb24(const unsigned char *src, unsigned char *dest,
+		int width, int height, int bgr, int nv21)
+{
+	int i, j;
+	const unsigned char *ysrc = src;
+	const unsigned char *uvsrc = src + width * height;
+	/* offsets of u and v in the interleaved chroma plane */
+	int uo = nv21 ? 1 : 0, vo = nv21 ? 0 : 1;
+
+	for (i = 0; i < height; i++) {
+		for (j = 0; j < width; j += 2) {
+			int u = uvsrc[uo], v = uvsrc[vo];
+			int u1 = (((u - 128) << 7) +  (u - 128)) >> 6;
+			int rg = (((u - 128) << 1) +  (u - 128) +
+					((v - 128) << 2) + ((v - 128) << 1)) >> 3;
+			int v1 = (((v - 128) << 1) +  (v - 128)) >> 1;
+
+			if (bgr) {
+				*dest++ = CLIP(*ysrc + u1);
+				*dest++ = CLIP(*ysrc - rg);
+				*dest++ = CLIP(*ysrc + v1);
+				ysrc++;
+
+				*dest++ = CLIP(*ysrc + u1);
+				*dest++ = CLIP(*ysrc - rg);
+				*dest++ = CLIP(*ysrc + v1);
+			} else {
+				*dest++ = CLIP(*ysrc + v1);
+				*dest++ = CLIP(*ysrc - rg);
+				*dest++ = CLIP(*ysrc + u1);
+				ysrc++;
+
+				*dest++ = CLIP(*ysrc + v1);
+				*dest++ = CLIP(*ysrc - rg);
+				*dest++ = CLIP(*ysrc + u1);
+			}
+			ysrc++;
+			uvsrc += 2;
+		}
+		/* Rewind uv for next line */
+		if (!(i & 1))
+			uvsrc -= width;
+	}
+}
+
+void v4lconvert_nv12_to_yuv420(const unsigned char *src, unsigned char *dest,
+		int width, int height, int yvu)
+{
+	int i;
+	const unsigned char *uvsrc = src + width * height;
+	unsigned char *udest, *vdest;
+
+	memcpy(dest, src, width * height);
+
+	if (yvu) {
+		vdest = dest + width * height;
+		udest = vdest + width * height / 4;
+	} else {
+		udest = dest + width * height;
+		vdest = udest + width * height / 4;
+	}
+
+	for (i = 0; i < width * height / 4; i++) {
+		*udest++ = *uvsrc++;
+		*vdest++ = *uvsrc++;
+	}
+}
+
+/* Also converts nv21 to nv12 */
+void v4lconvert_nv12_to_nv21(const unsigned char *src, unsigned char *dest,
+		int width, int height)
+{
+	int i;
+
+	memcpy(dest, src, width * height);
+	src += width * height;
+	dest += width * height;
+
+	for (i = 0; i < width * height / 4; i++) {
+		*dest++ = src[1];
+		*dest++ = src[0];
+		src += 2;
+	}
+}
+
+void v4lconvert_nv12_to_yuyv(const unsigned char *src, unsigned char *dest,
+		int width, int height, int nv21)
+{
+	int i, j;
+	const unsigned char *ysrc = src;
+	const unsigned char *uvsrc = src + width * height;
+	int uo = nv21 ? 1 : 0, vo = nv21 ? 0 : 1;
+
+	for (i = 0; i < height; i++) {
+		for (j = 0; j + 1 < width; j += 2) {
+			*dest++ = *ysrc++;
+			*dest++ = uvsrc[uo];
+			*dest++ = *ysrc++;
+			*dest++ = uvsrc[vo];
+			uvsrc += 2;
+		}
+		/* Rewind uv for next line */
+		if (!(i & 1))
+			uvsrc -= width;
+	}
+}
+
 void v4lconvert_swap_rgb(const unsigned char *src, unsigned char *dst,
 		int width, int height)
 {
@@ -566,12 +876,12 @@ void v4lconvert_rgb565_to_yuv420(const unsigned char *src, unsigned char *dest,
 			g[1] = 0xfc & (tmp >> 3);
 			b[1] = 0xf8 & (tmp >> 8);
 
-			tmp = *(((unsigned short *)src) + src_fmt->fmt.pix.bytesperline);
+			tmp = *(unsigned short *)(src + src_fmt->fmt.pix.bytesperline);
 			r[2] = 0xf8 & (tmp << 3);
 			g[2] = 0xfc & (tmp >> 3);
 			b[2] = 0xf8 & (tmp >> 8);
 
-			tmp = *(((unsigned short *)src) + src_fmt->fmt.pix.bytesperline + 1);
+			tmp = *(((unsigned short *)(src + src_fmt->fmt.pix.bytesperline)) + 1);
 			r[3] = 0xf8 & (tmp << 3);
 			g[3] = 0xfc & (tmp >> 3);
 			b[3] = 0xf8 & (tmp >> 8);
@@ -0,0 +1,128 @@
+/*
+# SIMD versions of the vertical pass of the scaler
+
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU Lesser General Public License as published by
+# the Free Software Foundation; either version 2.1 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU Lesser General Public License for more details.
+#
+# You should have received a copy of the GNU Lesser General Public License
+# along with this program; if not, write to the Free Software
+# Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA  02110-1335  USA
+ */
+
+/*
+ * These give exactly the same results as v4lconvert_scale_line_v_c(). The
+ * samples of 2 source lines get interleaved as 16 bit values, so that
+ * pmaddwd multiplies them with their weights and adds them up in one go.
+ * The sums fit in 16 bits unsigned after the final shift, there is no
+ * unsigned 32 to 16 bit pack in SSE2, so these get packed signed with an
+ * offset of 32768, which is removed again afterwards.
+ */
+
+#include "simd-funcs.h"
+
+#ifdef V4LCONVERT_HAVE_X86_SIMD
+
+#define ROUND (1 << (V4LCONVERT_SCALE_BITS - 8 - 1))
+#define SHIFT (V4LCONVERT_SCALE_BITS - 8)
+
+__attribute__((target("sse2")))
+void v4lconvert_scale_line_v_sse2(unsigned short *dest,
+		const unsigned char *src, int stride, const short *weights,
+		int taps, int count)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i round = _mm_set1_epi32(ROUND - (32768 << SHIFT));
+	const __m128i offset = _mm_set1_epi16(-32768);
+	__m128i acc0, acc1, acc2, acc3, a, b, w, lo, hi;
+	const unsigned char *s;
+	int i, t;
+
+	for (i = 0; i + 16 <= count; i += 16) {
+		acc0 = acc1 = acc2 = acc3 = round;
+		for (t = 0; t < taps; t += 2) {
+			s = src + t * stride + i;
+			a = _mm_loadu_si128((const __m128i *)s);
+			if (t + 1 < taps) {
+				b = _mm_loadu_si128((const __m128i *)(s + stride));
+				w = _mm_set1_epi32((weights[t + 1] << 16) |
+						(unsigned short)weights[t]);
+			} else {
+				b = zero;
+				w = _mm_set1_epi32((unsigned short)weights[t]);
+			}
+			lo = _mm_unpacklo_epi8(a, zero);
+			hi = _mm_unpacklo_epi8(b, zero);
+			acc0 = _mm_add_epi32(acc0, _mm_madd_epi16(
+					_mm_unpacklo_epi16(lo, hi), w));
+			acc1 = _mm_add_epi32(acc1, _mm_madd_epi16(
+					_mm_unpackhi_epi16(lo, hi), w));
+			lo = _mm_unpackhi_epi8(a, zero);
+			hi = _mm_unpackhi_epi8(b, zero);
+			acc2 = _mm_add_epi32(acc2, _mm_madd_epi16(
+					_mm_unpacklo_epi16(lo, hi), w));
+			acc3 = _mm_add_epi32(acc3, _mm_madd_epi16(
+					_mm_unpackhi_epi16(lo, hi), w));
+		}
+		lo = _mm_packs_epi32(_mm_srai_epi32(acc0, SHIFT),
+				_mm_srai_epi32(acc1, SHIFT));
+		hi = _mm_packs_epi32(_mm_srai_epi32(acc2, SHIFT),
+				_mm_srai_epi32(acc3, SHIFT));
+		_mm_storeu_si128((__m128i *)(dest + i), _mm_xor_si128(lo, offset));
+		_mm_storeu_si128((__m128i *)(dest + i + 8),
+				_mm_xor_si128(hi, offset));
+	}
+	v4lconvert_scale_line_v_c(dest + i, src + i, stride, weights, taps,
+			count - i);
+}
+
+__attribute__((target("avx2")))
+void v4lconvert_scale_line_v_avx2(unsigned short *dest,
+		const unsigned char *src, int stride, const short *weights,
+		int taps, int count)
+{
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i round = _mm256_set1_epi32(ROUND - (32768 << SHIFT));
+	const __m256i offset = _mm256_set1_epi16(-32768);
+	__m256i acc0, acc1, a, b, w;
+	const unsigned char *s;
+	int i, t;
+
+	for (i = 0; i + 16 <= count; i += 16) {
+		acc0 = acc1 = round;
+		for (t = 0; t < taps; t += 2) {
+			s = src + t * stride + i;
+			a = _mm256_cvtepu8_epi16(
+				_mm_loadu_si128((const __m128i *)s));
+			if (t + 1 < taps) {
+				b = _mm256_cvtepu8_epi16(
+					_mm_loadu_si128((const __m128i *)(s + stride)));
+				w = _mm256_set1_epi32((weights[t + 1] << 16) |
+						(unsigned short)weights[t]);
+			} else {
+				b = zero;
+				w = _mm256_set1_epi32((unsigned short)weights[t]);
+			}
+			/* Samples 0-3, 8-11 resp. 4-7, 12-15, which the in lane
+			   pack below puts back in order */
+			acc0 = _mm256_add_epi32(acc0, _mm256_madd_epi16(
+					_mm256_unpacklo_epi16(a, b), w));
+			acc1 = _mm256_add_epi32(acc1, _mm256_madd_epi16(
+					_mm256_unpackhi_epi16(a, b), w));
+		}
+		a = _mm256_packs_epi32(_mm256_srai_epi32(acc0, SHIFT),
+				_mm256_srai_epi32(acc1, SHIFT));
+		_mm256_storeu_si256((__m256i *)(dest + i),
+				_mm256_xor_si256(a, offset));
+	}
+	v4lconvert_scale_line_v_c(dest + i, src + i, stride, weights, taps,
+			count - i);
+}
+
+#endif /* V4LCONVERT_HAVE_X86_SIMD */
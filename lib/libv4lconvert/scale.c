@@ -0,0 +1,374 @@
+/*
+
+# RGB and YUV scaling routines
+
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU Lesser General Public License as published by
+# the Free Software Foundation; either version 2.1 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU Lesser General Public License for more details.
+#
+# You should have received a copy of the GNU Lesser General Public License
+# along with this program; if not, write to the Free Software
+# Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA  02110-1335  USA
+
+ */
+
+/*
+ * Each destination line is made in 2 passes: first the source lines it
+ * needs get combined into a line of 16 bit samples with 8 fraction bits,
+ * then the pixels of that line get combined into the destination pixels.
+ * Doing the vertical pass first means that when downscaling each source
+ * pixel is read only once. Both passes use filters precalculated for the
+ * frame sizes, with 14 bit fixed point weights.
+ *
+ * The bilinear filter interpolates between the 2 source pixels nearest to
+ * the center of the destination pixel. The area filter averages all source
+ * pixels covered by the destination pixel, weighted by how much of them is
+ * covered; as for upscaling that is almost nearest neighbour, it is
+ * bilinear then. To keep the aspect ratio the source is cropped to that of
+ * the destination first.
+ */
+
+#include <errno.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "libv4lconvert-priv.h"
+
+#define MIN(a, b) (((a) < (b)) ? (a) : (b))
+#define MAX(a, b) (((a) > (b)) ? (a) : (b))
+#define CLAMP(x, lo, hi) MIN(MAX(x, lo), hi)
+
+/* Returns 1 if the frame should be scaled rather than cropped. The source
+   only having a few extra (border) pixels is still cropped, as is done for
+   devices which cannot crop these off themselves, see
+   v4lconvert_try_format(). */
+int v4lconvert_scale_needed(struct v4lconvert_data *data,
+		const struct v4l2_format *src_fmt, const struct v4l2_format *dest_fmt)
+{
+	int dx = src_fmt->fmt.pix.width - dest_fmt->fmt.pix.width;
+	int dy = src_fmt->fmt.pix.height - dest_fmt->fmt.pix.height;
+
+	if (data->scale_filter == V4LCONVERT_SCALE_NONE)
+		return 0;
+
+	return !(dx >= 0 && dx < 16 && dy >= 0 && dy < 8);
+}
+
+static void v4lconvert_scale_axis_free(struct v4lconvert_scale_axis *axis)
+{
+	free(axis->start);
+	free(axis->weights);
+	axis->start = NULL;
+	axis->weights = NULL;
+}
+
+/* Calculates the filter for scaling the part of src_size pixels starting
+   at offset and len pixels long to dest_size pixels */
+static int v4lconvert_scale_axis_init(struct v4lconvert_scale_axis *axis,
+		int filter, double offset, double len, int src_size,
+		int dest_size)
+{
+	double scale = len / dest_size, lo, hi, c, f, *w;
+	int area = filter == V4LCONVERT_SCALE_AREA && scale > 1.0;
+	int i, j, t, first, start, taps, sum, max;
+	short *q;
+
+	taps = area ? (int)ceil(scale) + 1 : 2;
+	if (taps > src_size)
+		taps = src_size;
+
+	axis->taps = taps;
+	axis->start = malloc(dest_size * sizeof(int));
+	axis->weights = malloc(dest_size * taps * sizeof(short));
+	w = malloc(taps * sizeof(double));
+	if (!axis->start || !axis->weights || !w) {
+		v4lconvert_scale_axis_free(axis);
+		free(w);
+		return -1;
+	}
+
+	for (i = 0; i < dest_size; i++) {
+		memset(w, 0, taps * sizeof(double));
+		if (area) {
+			lo = offset + i * scale;
+			hi = lo + scale;
+			first = (int)floor(lo);
+			start = CLAMP(first, 0, src_size - taps);
+			for (j = first; j < hi; j++)
+				w[CLAMP(j, 0, src_size - 1) - start] +=
+					(MIN(hi, j + 1) - MAX(lo, j)) / scale;
+		} else {
+			c = offset + (i + 0.5) * scale - 0.5;
+			first = (int)floor(c);
+			f = c - first;
+			start = CLAMP(first, 0, src_size - taps);
+			w[CLAMP(first, 0, src_size - 1) - start] += 1.0 - f;
+			w[CLAMP(first + 1, 0, src_size - 1) - start] += f;
+		}
+
+		/* Make the rounded weights add up exactly, so that a flat
+		   area stays flat */
+		q = axis->weights + i * taps;
+		for (t = 0, sum = 0, max = 0; t < taps; t++) {
+			q[t] = lrint(w[t] * V4LCONVERT_SCALE_ONE);
+			sum += q[t];
+			if (q[t] > q[max])
+				max = t;
+		}
+		q[max] += V4LCONVERT_SCALE_ONE - sum;
+		axis->start[i] = start;
+	}
+
+	free(w);
+	return 0;
+}
+
+void v4lconvert_scaler_free(struct v4lconvert_scaler *scaler)
+{
+	v4lconvert_scale_axis_free(&scaler->x);
+	v4lconvert_scale_axis_free(&scaler->y);
+	v4lconvert_scale_axis_free(&scaler->cx);
+	v4lconvert_scale_axis_free(&scaler->cy);
+	free(scaler->rows);
+	scaler->rows = NULL;
+	scaler->rows_size = 0;
+	scaler->filter = V4LCONVERT_SCALE_NONE;
+}
+
+/* (Re)calculates the filters when the sizes or the filter changed */
+static int v4lconvert_scaler_init(struct v4lconvert_scaler *sc, int filter,
+		int yuv420, int sw, int sh, int dw, int dh)
+{
+	double ox = 0, oy = 0, lw = sw, lh = sh;
+
+	if (sc->filter == filter && sc->yuv420 == yuv420 &&
+			sc->src_width == sw && sc->src_height == sh &&
+			sc->dest_width == dw && sc->dest_height == dh)
+		return 0;
+
+	v4lconvert_scale_axis_free(&sc->x);
+	v4lconvert_scale_axis_free(&sc->y);
+	v4lconvert_scale_axis_free(&sc->cx);
+	v4lconvert_scale_axis_free(&sc->cy);
+	sc->filter = V4LCONVERT_SCALE_NONE;
+
+	/* Crop the source to the aspect ratio of the destination */
+	if ((long long)sw * dh > (long long)dw * sh) {
+		lw = (double)sh * dw / dh;
+		ox = (sw - lw) / 2;
+	} else {
+		lh = (double)sw * dh / dw;
+		oy = (sh - lh) / 2;
+	}
+
+	if (v4lconvert_scale_axis_init(&sc->x, filter, ox, lw, sw, dw) ||
+			v4lconvert_scale_axis_init(&sc->y, filter, oy, lh, sh, dh))
+		return -1;
+	if (yuv420 &&
+			(v4lconvert_scale_axis_init(&sc->cx, filter, ox / 2, lw / 2,
+				sw / 2, dw / 2) ||
+			 v4lconvert_scale_axis_init(&sc->cy, filter, oy / 2, lh / 2,
+				sh / 2, dh / 2)))
+		return -1;
+
+	sc->filter = filter;
+	sc->yuv420 = yuv420;
+	sc->src_width = sw;
+	sc->src_height = sh;
+	sc->dest_width = dw;
+	sc->dest_height = dh;
+	return 0;
+}
+
+void v4lconvert_scale_line_v_c(unsigned short *dest,
+		const unsigned char *src, int stride, const short *weights,
+		int taps, int count)
+{
+	int i, t;
+	unsigned int sum;
+
+	for (i = 0; i < count; i++) {
+		sum = 1 << (V4LCONVERT_SCALE_BITS - 8 - 1);
+		for (t = 0; t < taps; t++)
+			sum += weights[t] * src[t * stride + i];
+		dest[i] = sum >> (V4LCONVERT_SCALE_BITS - 8);
+	}
+}
+
+/* The horizontal pass, src starts at the pixel of the first tap of the
+   first destination pixel */
+static inline void v4lconvert_scale_line_h(unsigned char *dest,
+		const unsigned short *src, const struct v4lconvert_scale_axis *x,
+		int count, const int bpp, const int taps)
+{
+	const unsigned short *s;
+	const short *w = x->weights;
+	int i, c, t;
+	unsigned int sum;
+
+	for (i = 0; i < count; i++, w += taps) {
+		s = src + (x->start[i] - x->start[0]) * bpp;
+		for (c = 0; c < bpp; c++) {
+			sum = 1 << (V4LCONVERT_SCALE_BITS + 8 - 1);
+			for (t = 0; t < taps; t++)
+				sum += w[t] * s[t * bpp + c];
+			*dest++ = sum >> (V4LCONVERT_SCALE_BITS + 8);
+		}
+	}
+}
+
+/* Let the compiler generate specialized loops for bilinear and for area
+   downscaling by up to 3 */
+static void v4lconvert_scale_line_h_taps(unsigned char *dest,
+		const unsigned short *src, const struct v4lconvert_scale_axis *x,
+		int count, const int bpp)
+{
+	switch (x->taps) {
+	case 2:
+		v4lconvert_scale_line_h(dest, src, x, count, bpp, 2);
+		break;
+	case 3:
+		v4lconvert_scale_line_h(dest, src, x, count, bpp, 3);
+		break;
+	case 4:
+		v4lconvert_scale_line_h(dest, src, x, count, bpp, 4);
+		break;
+	default:
+		v4lconvert_scale_line_h(dest, src, x, count, bpp, x->taps);
+		break;
+	}
+}
+
+/* Scaling a plane gets split in bands of destination lines, each band has
+   its own vertically filtered line */
+struct v4lconvert_scale_job {
+	const struct v4lconvert_scale_axis *x;
+	const struct v4lconvert_scale_axis *y;
+	const unsigned char *src;
+	int src_stride;
+	unsigned char *dest;
+	int dest_stride;
+	int dest_width;
+	int dest_height;
+	int bpp;
+	int no_bands;
+	unsigned char *rows;
+	int row_size;
+};
+
+static void v4lconvert_scale_band(void *arg, int band)
+{
+	struct v4lconvert_scale_job *job = arg;
+	const struct v4lconvert_scale_axis *x = job->x, *y = job->y;
+	unsigned short *row = (unsigned short *)
+		(job->rows + band * job->row_size);
+	int first = band * job->dest_height / job->no_bands;
+	int last = (band + 1) * job->dest_height / job->no_bands;
+	/* Only the source pixels used by the horizontal pass */
+	int x0 = x->start[0];
+	int count = (x->start[job->dest_width - 1] + x->taps - x0) * job->bpp;
+	unsigned char *dest = job->dest + first * job->dest_stride;
+	int i;
+
+	for (i = first; i < last; i++, dest += job->dest_stride) {
+		v4lconvert_kernels.scale_line_v(row,
+				job->src + y->start[i] * job->src_stride +
+				x0 * job->bpp, job->src_stride,
+				y->weights + i * y->taps, y->taps, count);
+		if (job->bpp == 3)
+			v4lconvert_scale_line_h_taps(dest, row, x,
+					job->dest_width, 3);
+		else
+			v4lconvert_scale_line_h_taps(dest, row, x,
+					job->dest_width, 1);
+	}
+}
+
+static void v4lconvert_scale_plane(struct v4lconvert_data *data,
+		struct v4lconvert_scale_job *job, int no_bands)
+{
+	job->no_bands = MIN(no_bands, job->dest_height);
+	v4lconvert_workers_run(data->workers, v4lconvert_scale_band, job,
+			job->no_bands);
+}
+
+/* Scales src to dest, rgb24 / bgr24 or planar yuv 4:2:0 frames with the
+   same layout as for v4lconvert_crop() */
+int v4lconvert_scale(struct v4lconvert_data *data, unsigned char *src,
+		unsigned char *dest, const struct v4l2_format *src_fmt,
+		const struct v4l2_format *dest_fmt)
+{
+	struct v4lconvert_scaler *sc = &data->scaler;
+	int sw = src_fmt->fmt.pix.width, sh = src_fmt->fmt.pix.height;
+	int dw = dest_fmt->fmt.pix.width, dh = dest_fmt->fmt.pix.height;
+	int src_bpl = src_fmt->fmt.pix.bytesperline;
+	int dest_bpl = dest_fmt->fmt.pix.bytesperline;
+	int yuv420, no_bands = 1;
+	struct v4lconvert_scale_job job;
+
+	switch (dest_fmt->fmt.pix.pixelformat) {
+	case V4L2_PIX_FMT_RGB24:
+	case V4L2_PIX_FMT_BGR24:
+		yuv420 = 0;
+		break;
+	case V4L2_PIX_FMT_YUV420:
+	case V4L2_PIX_FMT_YVU420:
+		yuv420 = 1;
+		break;
+	default:
+		V4LCONVERT_ERR("Unknown dest format in scaling\n");
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (v4lconvert_scaler_init(sc, data->scale_filter, yuv420,
+				sw, sh, dw, dh))
+		return v4lconvert_oom_error(data);
+
+	/* Use some more bands than threads to even out the load */
+	if (data->workers)
+		no_bands = v4lconvert_workers_threads(data->workers) * 2;
+
+	job.row_size = sw * (yuv420 ? 1 : 3) * sizeof(unsigned short);
+	job.rows = v4lconvert_alloc_buffer(no_bands * job.row_size,
+			&sc->rows, &sc->rows_size);
+	if (!job.rows)
+		return v4lconvert_oom_error(data);
+
+	job.x = &sc->x;
+	job.y = &sc->y;
+	job.src = src;
+	job.src_stride = src_bpl;
+	job.dest = dest;
+	job.dest_stride = dest_bpl;
+	job.dest_width = dw;
+	job.dest_height = dh;
+	job.bpp = yuv420 ? 1 : 3;
+	v4lconvert_scale_plane(data, &job, no_bands);
+	if (!yuv420)
+		return 0;
+
+	/* U */
+	job.x = &sc->cx;
+	job.y = &sc->cy;
+	job.src = src + sh * src_bpl;
+	job.src_stride = src_bpl / 2;
+	job.dest = dest + dh * dest_bpl;
+	job.dest_stride = dest_bpl / 2;
+	job.dest_width = dw / 2;
+	job.dest_height = dh / 2;
+	v4lconvert_scale_plane(data, &job, no_bands);
+
+	/* V */
+	job.src = src + sh * src_bpl * 5 / 4;
+	job.dest = dest + dh * dest_bpl * 5 / 4;
+	v4lconvert_scale_plane(data, &job, no_bands);
+
+	return 0;
+}
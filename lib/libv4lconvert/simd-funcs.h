@@ -0,0 +1,77 @@
+/*
+# Helper functions shared by the SIMD conversion routines
+
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU Lesser General Public License as published by
+# the Free Software Foundation; either version 2.1 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU Lesser General Public License for more details.
+#
+# You should have received a copy of the GNU Lesser General Public License
+# along with this program; if not, write to the Free Software
+# Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA  02110-1335  USA
+ */
+
+#ifndef __LIBV4LCONVERT_SIMD_FUNCS_H
+#define __LIBV4LCONVERT_SIMD_FUNCS_H
+
+#include "libv4lconvert-priv.h"
+
+#define ALWAYS_INLINE inline __attribute__((always_inline))
+
+#ifdef V4LCONVERT_HAVE_X86_SIMD
+#include <immintrin.h>
+
+/* Packs 4 pixels stored as 32 bit xxBBGGRR values into 12 bytes, leaving
+   the 4 upper bytes zero */
+static ALWAYS_INLINE __attribute__((target("sse2")))
+__m128i pack_rgb32_to_rgb24_sse2(__m128i x)
+{
+	const __m128i lo24 = _mm_set_epi32(0, 0x00ffffff, 0, 0x00ffffff);
+	const __m128i hi24 = _mm_set_epi32(0x0000ffff, 0xff000000,
+					   0x0000ffff, 0xff000000);
+
+	x = _mm_or_si128(_mm_and_si128(x, lo24),
+			 _mm_and_si128(_mm_srli_epi64(x, 8), hi24));
+	return _mm_or_si128(_mm_move_epi64(x),
+			    _mm_slli_si128(_mm_srli_si128(x, 8), 6));
+}
+
+/* Interleaves 16 first, second and third component bytes into 48 bytes */
+static ALWAYS_INLINE __attribute__((target("sse2")))
+void store_rgb24_sse2(unsigned char *dest, __m128i c0, __m128i c1, __m128i c2)
+{
+	const __m128i zero = _mm_setzero_si128();
+	__m128i c01_lo = _mm_unpacklo_epi8(c0, c1);
+	__m128i c01_hi = _mm_unpackhi_epi8(c0, c1);
+	__m128i c2_lo = _mm_unpacklo_epi8(c2, zero);
+	__m128i c2_hi = _mm_unpackhi_epi8(c2, zero);
+	__m128i p0 = pack_rgb32_to_rgb24_sse2(_mm_unpacklo_epi16(c01_lo, c2_lo));
+	__m128i p1 = pack_rgb32_to_rgb24_sse2(_mm_unpackhi_epi16(c01_lo, c2_lo));
+	__m128i p2 = pack_rgb32_to_rgb24_sse2(_mm_unpacklo_epi16(c01_hi, c2_hi));
+	__m128i p3 = pack_rgb32_to_rgb24_sse2(_mm_unpackhi_epi16(c01_hi, c2_hi));
+
+	_mm_storeu_si128((__m128i *)dest,
+			_mm_or_si128(p0, _mm_slli_si128(p1, 12)));
+	_mm_storeu_si128((__m128i *)(dest + 16),
+			_mm_or_si128(_mm_srli_si128(p1, 4), _mm_slli_si128(p2, 8)));
+	_mm_storeu_si128((__m128i *)(dest + 32),
+			_mm_or_si128(_mm_srli_si128(p2, 8), _mm_slli_si128(p3, 4)));
+}
+
+/* Interleaves 32 first, second and third component bytes into 96 bytes */
+static ALWAYS_INLINE __attribute__((target("avx2")))
+void store_rgb24_avx2(unsigned char *dest, __m256i c0, __m256i c1, __m256i c2)
+{
+	store_rgb24_sse2(dest, _mm256_castsi256_si128(c0),
+			_mm256_castsi256_si128(c1), _mm256_castsi256_si128(c2));
+	store_rgb24_sse2(dest + 48, _mm256_extracti128_si256(c0, 1),
+			_mm256_extracti128_si256(c1, 1), _mm256_extracti128_si256(c2, 1));
+}
+#endif /* V4LCONVERT_HAVE_X86_SIMD */
+
+#endif
@@ -41,7 +41,7 @@
 
 struct jdec_private;
 
-#define HUFFMAN_HASH_NBITS 9
+#define HUFFMAN_HASH_NBITS 10
 #define HUFFMAN_HASH_SIZE  (1UL<<HUFFMAN_HASH_NBITS)
 #define HUFFMAN_HASH_MASK  (HUFFMAN_HASH_SIZE-1)
 
@@ -60,12 +60,17 @@ struct huffman_table {
 	 * IMPROVEME: Calculate if 256 value is enough to store all values
 	 */
 	uint16_t slowtable[16 - HUFFMAN_HASH_NBITS][256];
+	/* Fast AC look up table: when a code and its value bits together fit in
+	 * HUFFMAN_HASH_NBITS bits, this holds value << 16 | run << 8 | nbits,
+	 * with nbits the code size plus value size. 0 when not usable. */
+	int32_t fast_ac[HUFFMAN_HASH_SIZE];
 };
 
 struct component {
 	unsigned int Hfactor;
 	unsigned int Vfactor;
 	float *Q_table;		/* Pointer to the quantisation table to use */
+	int16_t *Q_table_int;	/* Same table unscaled, for the integer IDCT */
 	struct huffman_table *AC_table;
 	struct huffman_table *DC_table;
 	short int previous_DC;	/* Previous DC coefficient */
@@ -90,10 +95,12 @@ struct jdec_private {
 	const unsigned char *stream;	/* Pointer to the current stream */
 	unsigned char *stream_filtered;
 	int stream_filtered_bufsize;
-	unsigned int reservoir, nbits_in_reservoir;
+	uint64_t reservoir;
+	unsigned int nbits_in_reservoir;
 
 	struct component component_infos[COMPONENTS];
 	float Q_tables[COMPONENTS][64];		/* quantization tables */
+	int16_t Q_tables_int[COMPONENTS][64];	/* same, for the integer IDCT */
 	struct huffman_table HTDC[HUFFMAN_TABLES];	/* DC huffman tables   */
 	struct huffman_table HTAC[HUFFMAN_TABLES];	/* AC huffman tables   */
 	int default_huffman_table_initialized;
@@ -118,10 +125,25 @@ struct jdec_private {
 	/* Temp buffers for multipass planar JPG -> RGB decoding */
 	int tmp_buf_y_size;
 	uint8_t *tmp_buf[COMPONENTS];
+
+	/* For splitting the IDCT and colorspace conversion over threads */
+	struct v4lconvert_workers *workers;
+	short int *coefs;		/* DCT coef of all MCUs */
+	int coefs_size;
+	struct jdec_private *band_privs;	/* private copy for each band */
+	int band_privs_size;
+	const unsigned char **rst_starts;	/* start of each restart interval */
+	int rst_starts_size;
 };
 
-#define IDCT tinyjpeg_idct_float
+#define IDCT v4lconvert_kernels.idct
 void tinyjpeg_idct_float (struct component *compptr, uint8_t *output_buf, int stride);
+#ifdef V4LCONVERT_HAVE_X86_SIMD
+void tinyjpeg_idct_islow_sse2(struct component *compptr, uint8_t *output_buf, int stride);
+#endif
+#ifdef V4LCONVERT_HAVE_NEON
+void tinyjpeg_idct_islow_neon(struct component *compptr, uint8_t *output_buf, int stride);
+#endif
 
 #endif
 
@@ -40,6 +40,7 @@
 #include "tinyjpeg.h"
 #include "tinyjpeg-internal.h"
 #include "libv4lconvert-priv.h"
+#include "simd-funcs.h"
 
 enum std_markers {
 	DQT  = 0xDB, /* Define Quantization Table */
@@ -255,22 +256,87 @@ const unsigned char standard_quantization[][64] = { {
  *            To get two bits from this example
  *                 result = (reservoir >> 15) & 3
  *
+ * The reservoir is 64 bits wide and gets topped up to at least 56 bits each
+ * time it runs low, so that most of the time a whole huffman code plus its
+ * value bits can be taken from it without refilling in between.
  */
+#define RESERVOIR_BITS 64
+
+/* Bytes without any 0xff can go into the reservoir in one go, as there is no
+   byte stuffing to undo. */
+static inline int no_0xff_bytes(uint64_t bytes, unsigned int n)
+{
+	uint64_t x = ~bytes & (~0ULL << (RESERVOIR_BITS - 8 * n));
+
+	/* A 0xff byte is a zero byte in x, spurious hits can only happen above
+	   a real one, so this never misses one. */
+	return ((x - 0x0101010101010101ULL) & ~x & 0x8080808080808080ULL &
+		(~0ULL << (RESERVOIR_BITS - 8 * n))) == 0;
+}
+
+static void fill_reservoir(struct jdec_private *priv, unsigned int nbits_wanted)
+{
+	const unsigned char *stream = priv->stream;
+	uint64_t reservoir = priv->reservoir;
+	unsigned int nbits = priv->nbits_in_reservoir;
+
+	if (priv->stream_end - stream >= 8) {
+		/* Fast path: as many whole bytes as fit, if none needs unstuffing */
+		unsigned int n = (RESERVOIR_BITS - 1 - nbits) / 8;
+		uint64_t bytes;
+
+		memcpy(&bytes, stream, 8);
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+		bytes = __builtin_bswap64(bytes);
+#endif
+		if (no_0xff_bytes(bytes, n)) {
+			priv->reservoir = (reservoir << (8 * n)) |
+				(bytes >> (RESERVOIR_BITS - 8 * n));
+			priv->nbits_in_reservoir = nbits + 8 * n;
+			priv->stream = stream + n;
+			return;
+		}
+	}
+
+	while (nbits <= RESERVOIR_BITS - 16 && stream < priv->stream_end) {
+		unsigned char c = *stream;
+
+		if (c == 0xff && (stream + 1 >= priv->stream_end || stream[1] != 0x00)) {
+			/* Don't read ahead past a marker, the callers rewind the
+			   stream by the amount of bytes left in the reservoir to find
+			   it again. Only take the marker bytes as data when they are
+			   really needed, just like the bytes following them. */
+			if (nbits >= nbits_wanted)
+				break;
+			while (nbits < nbits_wanted && stream < priv->stream_end) {
+				c = *stream++;
+				if (c == 0xff && stream < priv->stream_end && *stream == 0x00)
+					stream++;
+				reservoir = (reservoir << 8) | c;
+				nbits += 8;
+			}
+			break;
+		}
+		stream++;
+		if (c == 0xff)
+			stream++;
+		reservoir = (reservoir << 8) | c;
+		nbits += 8;
+	}
+	priv->reservoir = reservoir;
+	priv->nbits_in_reservoir = nbits;
+	priv->stream = stream;
+}
+
 #define fill_nbits(reservoir, nbits_in_reservoir, stream, nbits_wanted) do { \
-	while (nbits_in_reservoir < nbits_wanted) { \
-		unsigned char c; \
-		if (stream >= priv->stream_end) { \
+	if (nbits_in_reservoir < (nbits_wanted)) { \
+		fill_reservoir(priv, (nbits_wanted)); \
+		if (nbits_in_reservoir < (nbits_wanted)) { \
 			snprintf(priv->error_string, sizeof(priv->error_string), \
 					"fill_nbits error: need %u more bits\n", \
-					nbits_wanted - nbits_in_reservoir); \
+					(nbits_wanted) - nbits_in_reservoir); \
 			longjmp(priv->jump_state, -EIO); \
 		} \
-		c = *stream++; \
-		reservoir <<= 8; \
-		if (c == 0xff && *stream == 0x00) \
-			stream++; \
-		reservoir |= c; \
-		nbits_in_reservoir += 8; \
 	} \
 }  while (0);
 
@@ -279,7 +345,7 @@ const unsigned char standard_quantization[][64] = { {
 	fill_nbits(reservoir, nbits_in_reservoir, stream, (nbits_wanted)); \
 	result = ((reservoir) >> (nbits_in_reservoir - (nbits_wanted))); \
 	nbits_in_reservoir -= (nbits_wanted);  \
-	reservoir &= ((1U << nbits_in_reservoir) - 1); \
+	reservoir &= ((1ULL << nbits_in_reservoir) - 1); \
 	if ((unsigned int)result < (1UL << ((nbits_wanted) - 1))) \
 		result += (0xFFFFFFFFUL << (nbits_wanted)) + 1; \
 }  while (0);
@@ -294,12 +360,12 @@ const unsigned char standard_quantization[][64] = { {
  * #define skip_nbits(reservoir, nbits_in_reservoir, stream, nbits_wanted) do { \
  *   fill_nbits(reservoir, nbits_in_reservoir, stream, (nbits_wanted)); \
  *   nbits_in_reservoir -= (nbits_wanted); \
- *   reservoir &= ((1U << nbits_in_reservoir) - 1); \
+ *   reservoir &= ((1ULL << nbits_in_reservoir) - 1); \
  * }  while(0);
  */
 #define skip_nbits(reservoir, nbits_in_reservoir, stream, nbits_wanted) do { \
 	nbits_in_reservoir -= (nbits_wanted); \
-	reservoir &= ((1U << nbits_in_reservoir) - 1); \
+	reservoir &= ((1ULL << nbits_in_reservoir) - 1); \
 }  while (0);
 
 #define be16_to_cpu(x) (((x)[0] << 8) | (x)[1])
@@ -385,6 +451,19 @@ static void process_Huffman_data_unit(struct jdec_private *priv, int component)
 	/* AC coefficient decoding */
 	j = 1;
 	while (j < 64) {
+		unsigned int hcode;
+		int32_t fast;
+
+		/* Most codes and their value bits are resolved by a single lookup */
+		look_nbits(priv->reservoir, priv->nbits_in_reservoir, priv->stream, HUFFMAN_HASH_NBITS, hcode);
+		fast = c->AC_table->fast_ac[hcode];
+		if (fast && j + ((fast >> 8) & 0xff) < 64) {
+			j += (fast >> 8) & 0xff;	/* skip run zeroes */
+			skip_nbits(priv->reservoir, priv->nbits_in_reservoir, priv->stream, fast & 0xff);
+			DCT[j++] = fast >> 16;
+			continue;
+		}
+
 		huff_code = get_next_huffman_code(priv, c->AC_table);
 
 		size_val = huff_code & 0xF;
@@ -499,6 +578,31 @@ static int build_huffman_table(struct jdec_private *priv, const unsigned char *b
 	for (i = 0; i < (16 - HUFFMAN_HASH_NBITS); i++)
 		table->slowtable[i][slowtable_used[i]] = 0;
 
+	/*
+	 * Build the fast AC table, for codes which leave enough room in the
+	 * lookup bits to also hold the value bits, decode the value up front.
+	 */
+	for (i = 0; i < HUFFMAN_HASH_SIZE; i++) {
+		int value;
+
+		table->fast_ac[i] = 0;
+		if (table->lookup[i] < 0)
+			continue;
+
+		val = table->lookup[i];
+		code_size = table->code_size[val];
+		nbits = val & 0xf;
+		if (nbits == 0 || code_size + nbits > HUFFMAN_HASH_NBITS)
+			continue;
+
+		value = (i >> (HUFFMAN_HASH_NBITS - code_size - nbits)) &
+			((1 << nbits) - 1);
+		if (value < (1 << (nbits - 1)))
+			value -= (1 << nbits) - 1;
+		table->fast_ac[i] = value * 65536 + ((val >> 4) << 8) +
+			code_size + nbits;
+	}
+
 	return 0;
 }
 
@@ -549,775 +653,198 @@ static unsigned char clamp(int i)
 }
 
 
-/**
- *  YCrCb -> YUV420P (1x1)
- *  .---.
- *  | 1 |
- *  `---'
- */
-static void YCrCB_to_YUV420P_1x1(struct jdec_private *priv)
-{
-	const unsigned char *s, *y;
-	unsigned char *p;
-	int i, j;
-
-	p = priv->plane[0];
-	y = priv->Y;
-	for (i = 0; i < 8; i++) {
-		memcpy(p, y, 8);
-		p += priv->width;
-		y += 8;
-	}
-
-	p = priv->plane[1];
-	s = priv->Cb;
-	for (i = 0; i < 8; i += 2) {
-		for (j = 0; j < 8; j += 2, s += 2)
-			*p++ = *s;
-		s += 8; /* Skip one line */
-		p += priv->width / 2 - 4;
-	}
-
-	p = priv->plane[2];
-	s = priv->Cr;
-	for (i = 0; i < 8; i += 2) {
-		for (j = 0; j < 8; j += 2, s += 2)
-			*p++ = *s;
-		s += 8; /* Skip one line */
-		p += priv->width / 2 - 4;
-	}
-}
-
-/**
- *  YCrCb -> YUV420P (2x1)
- *  .-------.
- *  | 1 | 2 |
- *  `-------'
- */
-static void YCrCB_to_YUV420P_2x1(struct jdec_private *priv)
-{
-	unsigned char *p;
-	const unsigned char *s, *y1;
-	unsigned int i;
-
-	p = priv->plane[0];
-	y1 = priv->Y;
-	for (i = 0; i < 8; i++) {
-		memcpy(p, y1, 16);
-		p += priv->width;
-		y1 += 16;
-	}
-
-	p = priv->plane[1];
-	s = priv->Cb;
-	for (i = 0; i < 8; i += 2) {
-		memcpy(p, s, 8);
-		s += 16; /* Skip one line */
-		p += priv->width / 2;
-	}
-
-	p = priv->plane[2];
-	s = priv->Cr;
-	for (i = 0; i < 8; i += 2) {
-		memcpy(p, s, 8);
-		s += 16; /* Skip one line */
-		p += priv->width/2;
-	}
-}
-
-
-/**
- *  YCrCb -> YUV420P (1x2)
- *  .---.
- *  | 1 |
- *  |---|
- *  | 2 |
- *  `---'
- */
-static void YCrCB_to_YUV420P_1x2(struct jdec_private *priv)
-{
-	const unsigned char *s, *y;
-	unsigned char *p;
-	int i, j;
-
-	p = priv->plane[0];
-	y = priv->Y;
-	for (i = 0; i < 16; i++) {
-		memcpy(p, y, 8);
-		p += priv->width;
-		y += 8;
-	}
-
-	p = priv->plane[1];
-	s = priv->Cb;
-	for (i = 0; i < 8; i++) {
-		for (j = 0; j < 8; j += 2, s += 2)
-			*p++ = *s;
-		p += priv->width / 2 - 4;
-	}
-
-	p = priv->plane[2];
-	s = priv->Cr;
-	for (i = 0; i < 8; i++) {
-		for (j = 0; j < 8; j += 2, s += 2)
-			*p++ = *s;
-		p += priv->width / 2 - 4;
-	}
-}
-
-/**
- *  YCrCb -> YUV420P (2x2)
- *  .-------.
- *  | 1 | 2 |
- *  |---+---|
- *  | 3 | 4 |
- *  `-------'
- */
-static void YCrCB_to_YUV420P_2x2(struct jdec_private *priv)
-{
-	unsigned char *p;
-	const unsigned char *s, *y1;
-	unsigned int i;
-
-	p = priv->plane[0];
-	y1 = priv->Y;
-	for (i = 0; i < 16; i++) {
-		memcpy(p, y1, 16);
-		p += priv->width;
-		y1 += 16;
-	}
-
-	p = priv->plane[1];
-	s = priv->Cb;
-	for (i = 0; i < 8; i++) {
-		memcpy(p, s, 8);
-		s += 8;
-		p += priv->width / 2;
-	}
-
-	p = priv->plane[2];
-	s = priv->Cr;
-	for (i = 0; i < 8; i++) {
-		memcpy(p, s, 8);
-		s += 8;
-		p += priv->width / 2;
-	}
-}
-
-/**
- *  YCrCb -> RGB24 (1x1)
- *  .---.
- *  | 1 |
- *  `---'
- */
-static void YCrCB_to_RGB24_1x1(struct jdec_private *priv)
-{
-	const unsigned char *Y, *Cb, *Cr;
-	unsigned char *p;
-	int i, j;
-	int offset_to_next_row;
-
 #define SCALEBITS       10
 #define ONE_HALF        (1UL << (SCALEBITS - 1))
 #define FIX(x)          ((int)((x) * (1UL << SCALEBITS) + 0.5))
 
-	p = priv->plane[0];
-	Y = priv->Y;
-	Cb = priv->Cb;
-	Cr = priv->Cr;
-	offset_to_next_row = priv->width * 3 - 8 * 3;
-
-	for (i = 0; i < 8; i++) {
-		for (j = 0; j < 8; j++) {
-			int y, cb, cr;
-			int add_r, add_g, add_b;
-			int r, g , b;
-
-			y  = (*Y++) << SCALEBITS;
-			cb = *Cb++ - 128;
-			cr = *Cr++ - 128;
-			add_r = FIX(1.40200) * cr + ONE_HALF;
-			add_g = -FIX(0.34414) * cb - FIX(0.71414) * cr + ONE_HALF;
-			add_b = FIX(1.77200) * cb + ONE_HALF;
-
-			r = (y + add_r) >> SCALEBITS;
-			*p++ = clamp(r);
-			g = (y + add_g) >> SCALEBITS;
-			*p++ = clamp(g);
-			b = (y + add_b) >> SCALEBITS;
-			*p++ = clamp(b);
-
-		}
-
-		p += offset_to_next_row;
-	}
-
-#undef SCALEBITS
-#undef ONE_HALF
-#undef FIX
-}
-
-/**
- *  YCrCb -> BGR24 (1x1)
- *  .---.
- *  | 1 |
- *  `---'
- */
-static void YCrCB_to_BGR24_1x1(struct jdec_private *priv)
-{
-	const unsigned char *Y, *Cb, *Cr;
-	unsigned char *p;
-	int i, j;
-	int offset_to_next_row;
-
-#define SCALEBITS       10
-#define ONE_HALF        (1UL << (SCALEBITS - 1))
-#define FIX(x)          ((int)((x) * (1UL << SCALEBITS) + 0.5))
-
-	p = priv->plane[0];
-	Y = priv->Y;
-	Cb = priv->Cb;
-	Cr = priv->Cr;
-	offset_to_next_row = priv->width * 3 - 8 * 3;
-
-	for (i = 0; i < 8; i++) {
-		for (j = 0; j < 8; j++) {
-			int y, cb, cr;
-			int add_r, add_g, add_b;
-			int r, g , b;
-
-			y  = (*Y++) << SCALEBITS;
-			cb = *Cb++ - 128;
-			cr = *Cr++ - 128;
-			add_r = FIX(1.40200) * cr + ONE_HALF;
-			add_g = -FIX(0.34414) * cb - FIX(0.71414) * cr + ONE_HALF;
-			add_b = FIX(1.77200) * cb + ONE_HALF;
-
-			b = (y + add_b) >> SCALEBITS;
-			*p++ = clamp(b);
-			g = (y + add_g) >> SCALEBITS;
-			*p++ = clamp(g);
-			r = (y + add_r) >> SCALEBITS;
-			*p++ = clamp(r);
-
-		}
-		p += offset_to_next_row;
-	}
-
-#undef SCALEBITS
-#undef ONE_HALF
-#undef FIX
-}
-
-
-/**
- *  YCrCb -> RGB24 (2x1)
- *  .-------.
- *  | 1 | 2 |
- *  `-------'
- */
-static void YCrCB_to_RGB24_2x1(struct jdec_private *priv)
-{
-	const unsigned char *Y, *Cb, *Cr;
-	unsigned char *p;
-	int i, j;
-	int offset_to_next_row;
-
-#define SCALEBITS       10
-#define ONE_HALF        (1UL << (SCALEBITS - 1))
-#define FIX(x)          ((int)((x) * (1UL << SCALEBITS) + 0.5))
-
-	p = priv->plane[0];
-	Y = priv->Y;
-	Cb = priv->Cb;
-	Cr = priv->Cr;
-	offset_to_next_row = priv->width * 3 - 16 * 3;
-
-	for (i = 0; i < 8; i++) {
-		for (j = 0; j < 8; j++) {
-			int y, cb, cr;
-			int add_r, add_g, add_b;
-			int r, g , b;
-
-			y  = (*Y++) << SCALEBITS;
-			cb = *Cb++ - 128;
-			cr = *Cr++ - 128;
-			add_r = FIX(1.40200) * cr + ONE_HALF;
-			add_g = -FIX(0.34414) * cb - FIX(0.71414) * cr + ONE_HALF;
-			add_b = FIX(1.77200) * cb + ONE_HALF;
-
-			r = (y + add_r) >> SCALEBITS;
-			*p++ = clamp(r);
-			g = (y + add_g) >> SCALEBITS;
-			*p++ = clamp(g);
-			b = (y + add_b) >> SCALEBITS;
-			*p++ = clamp(b);
-
-			y  = (*Y++) << SCALEBITS;
-			r = (y + add_r) >> SCALEBITS;
-			*p++ = clamp(r);
-			g = (y + add_g) >> SCALEBITS;
-			*p++ = clamp(g);
-			b = (y + add_b) >> SCALEBITS;
-			*p++ = clamp(b);
-		}
-
-		p += offset_to_next_row;
-	}
-
-#undef SCALEBITS
-#undef ONE_HALF
-#undef FIX
-}
-
 /*
- *  YCrCb -> BGR24 (2x1)
- *  .-------.
- *  | 1 | 2 |
- *  `-------'
+ * Convert a line of Y samples to rgb24 / bgr24 (bpp 3) or rgb32 / bgr32
+ * (bpp 4), each Cb / Cr sample is used for 1 << hshift pixels. The
+ * optimized kernel does the bulk of the line when there is one.
  */
-static void YCrCB_to_BGR24_2x1(struct jdec_private *priv)
+static ALWAYS_INLINE void YCrCB_to_rgb_line(const unsigned char *Y,
+		const unsigned char *Cb, const unsigned char *Cr,
+		unsigned char *p, int width, int hshift, int bpp, int bgr)
 {
-	const unsigned char *Y, *Cb, *Cr;
-	unsigned char *p;
-	int i, j;
-	int offset_to_next_row;
-
-#define SCALEBITS       10
-#define ONE_HALF        (1UL << (SCALEBITS - 1))
-#define FIX(x)          ((int)((x) * (1UL << SCALEBITS) + 0.5))
-
-	p = priv->plane[0];
-	Y = priv->Y;
-	Cb = priv->Cb;
-	Cr = priv->Cr;
-	offset_to_next_row = priv->width * 3 - 16 * 3;
-
-	for (i = 0; i < 8; i++) {
-		for (j = 0; j < 8; j++) {
-			int y, cb, cr;
-			int add_r, add_g, add_b;
-			int r, g , b;
-
-			cb = *Cb++ - 128;
-			cr = *Cr++ - 128;
-			add_r = FIX(1.40200) * cr + ONE_HALF;
-			add_g = -FIX(0.34414) * cb - FIX(0.71414) * cr + ONE_HALF;
-			add_b = FIX(1.77200) * cb + ONE_HALF;
-
-			y  = (*Y++) << SCALEBITS;
-			b = (y + add_b) >> SCALEBITS;
-			*p++ = clamp(b);
-			g = (y + add_g) >> SCALEBITS;
-			*p++ = clamp(g);
-			r = (y + add_r) >> SCALEBITS;
-			*p++ = clamp(r);
-
-			y  = (*Y++) << SCALEBITS;
-			b = (y + add_b) >> SCALEBITS;
-			*p++ = clamp(b);
-			g = (y + add_g) >> SCALEBITS;
-			*p++ = clamp(g);
-			r = (y + add_r) >> SCALEBITS;
-			*p++ = clamp(r);
-		}
-
-		p += offset_to_next_row;
+	int j = 0;
+
+	if (v4lconvert_kernels.ycbcr_to_rgb_line)
+		j = v4lconvert_kernels.ycbcr_to_rgb_line(Y, Cb, Cr, p, width,
+							 hshift, bpp, bgr);
+
+	for (p += j * bpp; j < width; j++) {
+		int y, cb, cr;
+		int add_r, add_g, add_b;
+		unsigned char r, g, b;
+
+		y  = Y[j] << SCALEBITS;
+		cb = Cb[j >> hshift] - 128;
+		cr = Cr[j >> hshift] - 128;
+		add_r = FIX(1.40200) * cr + ONE_HALF;
+		add_g = -FIX(0.34414) * cb - FIX(0.71414) * cr + ONE_HALF;
+		add_b = FIX(1.77200) * cb + ONE_HALF;
+
+		r = clamp((y + add_r) >> SCALEBITS);
+		g = clamp((y + add_g) >> SCALEBITS);
+		b = clamp((y + add_b) >> SCALEBITS);
+
+		if (bpp == 4 && !bgr)
+			*p++ = 0xff;
+		*p++ = bgr ? b : r;
+		*p++ = g;
+		*p++ = bgr ? r : b;
+		if (bpp == 4 && bgr)
+			*p++ = 0xff;
 	}
-
-#undef SCALEBITS
-#undef ONE_HALF
-#undef FIX
 }
 
-/**
- *  YCrCb -> RGB24 (1x2)
- *  .---.
- *  | 1 |
- *  |---|
- *  | 2 |
- *  `---'
- */
-static void YCrCB_to_RGB24_1x2(struct jdec_private *priv)
-{
-	const unsigned char *Y, *Cb, *Cr;
-	unsigned char *p, *p2;
-	int i, j;
-	int offset_to_next_row;
-
-#define SCALEBITS       10
-#define ONE_HALF        (1UL << (SCALEBITS - 1))
-#define FIX(x)          ((int)((x) * (1UL << SCALEBITS) + 0.5))
-
-	p = priv->plane[0];
-	p2 = priv->plane[0] + priv->width * 3;
-	Y = priv->Y;
-	Cb = priv->Cb;
-	Cr = priv->Cr;
-	offset_to_next_row = 2 * priv->width * 3 - 8 * 3;
-
-	for (i = 0; i < 8; i++) {
-		for (j = 0; j < 8; j++) {
-			int y, cb, cr;
-			int add_r, add_g, add_b;
-			int r, g , b;
-
-			cb = *Cb++ - 128;
-			cr = *Cr++ - 128;
-			add_r = FIX(1.40200) * cr + ONE_HALF;
-			add_g = -FIX(0.34414) * cb - FIX(0.71414) * cr + ONE_HALF;
-			add_b = FIX(1.77200) * cb + ONE_HALF;
-
-			y  = (*Y++) << SCALEBITS;
-			r = (y + add_r) >> SCALEBITS;
-			*p++ = clamp(r);
-			g = (y + add_g) >> SCALEBITS;
-			*p++ = clamp(g);
-			b = (y + add_b) >> SCALEBITS;
-			*p++ = clamp(b);
-
-			y  = (Y[8-1]) << SCALEBITS;
-			r = (y + add_r) >> SCALEBITS;
-			*p2++ = clamp(r);
-			g = (y + add_g) >> SCALEBITS;
-			*p2++ = clamp(g);
-			b = (y + add_b) >> SCALEBITS;
-			*p2++ = clamp(b);
-
-		}
-		Y += 8;
-		p += offset_to_next_row;
-		p2 += offset_to_next_row;
-	}
-
 #undef SCALEBITS
 #undef ONE_HALF
 #undef FIX
-}
 
 /*
- *  YCrCb -> BGR24 (1x2)
- *  .---.
- *  | 1 |
- *  |---|
- *  | 2 |
- *  `---'
+ * The MCU converters below are written once for any sampling factor, the
+ * DECLARE_COLORSPACE macro instantiates them for the 4 supported ones.
+ * A MCU consists of hf x vf Y blocks, stored with a stride of 8 * hf, and
+ * a single 8x8 Cb and Cr block which gets upsampled (nearest neighbour)
+ * to the size of the MCU.
+ *
+ *  1x1       1x2        2x1           2x2
+ *  .---.     .---.      .-------.     .-------.
+ *  | 1 |     | 1 |      | 1 | 2 |     | 1 | 2 |
+ *  `---'     |---|      `-------'     |---+---|
+ *            | 2 |                    | 3 | 4 |
+ *            `---'                    `-------'
  */
-static void YCrCB_to_BGR24_1x2(struct jdec_private *priv)
-{
-	const unsigned char *Y, *Cb, *Cr;
-	unsigned char *p, *p2;
-	int i, j;
-	int offset_to_next_row;
-
-#define SCALEBITS       10
-#define ONE_HALF        (1UL << (SCALEBITS - 1))
-#define FIX(x)          ((int)((x) * (1UL << SCALEBITS) + 0.5))
-
-	p = priv->plane[0];
-	p2 = priv->plane[0] + priv->width * 3;
-	Y = priv->Y;
-	Cb = priv->Cb;
-	Cr = priv->Cr;
-	offset_to_next_row = 2 * priv->width * 3 - 8 * 3;
-
-	for (i = 0; i < 8; i++) {
-		for (j = 0; j < 8; j++) {
-			int y, cb, cr;
-			int add_r, add_g, add_b;
-			int r, g , b;
-
-			cb = *Cb++ - 128;
-			cr = *Cr++ - 128;
-			add_r = FIX(1.40200) * cr + ONE_HALF;
-			add_g = -FIX(0.34414) * cb - FIX(0.71414) * cr + ONE_HALF;
-			add_b = FIX(1.77200) * cb + ONE_HALF;
-
-			y  = (*Y++) << SCALEBITS;
-			b = (y + add_b) >> SCALEBITS;
-			*p++ = clamp(b);
-			g = (y + add_g) >> SCALEBITS;
-			*p++ = clamp(g);
-			r = (y + add_r) >> SCALEBITS;
-			*p++ = clamp(r);
-
-			y  = (Y[8-1]) << SCALEBITS;
-			b = (y + add_b) >> SCALEBITS;
-			*p2++ = clamp(b);
-			g = (y + add_g) >> SCALEBITS;
-			*p2++ = clamp(g);
-			r = (y + add_r) >> SCALEBITS;
-			*p2++ = clamp(r);
-
-		}
-		Y += 8;
-		p += offset_to_next_row;
-		p2 += offset_to_next_row;
-	}
 
-#undef SCALEBITS
-#undef ONE_HALF
-#undef FIX
-}
-
-
-/**
- *  YCrCb -> RGB24 (2x2)
- *  .-------.
- *  | 1 | 2 |
- *  |---+---|
- *  | 3 | 4 |
- *  `-------'
- */
-static void YCrCB_to_RGB24_2x2(struct jdec_private *priv)
+static ALWAYS_INLINE void YCrCB_copy_Y(struct jdec_private *priv,
+		int hf, int vf)
 {
-	const unsigned char *Y, *Cb, *Cr;
-	unsigned char *p, *p2;
-	int i, j;
-	int offset_to_next_row;
-
-#define SCALEBITS       10
-#define ONE_HALF        (1UL << (SCALEBITS - 1))
-#define FIX(x)          ((int)((x) * (1UL << SCALEBITS) + 0.5))
+	const unsigned char *y;
+	unsigned char *p;
+	int i;
 
 	p = priv->plane[0];
-	p2 = priv->plane[0] + priv->width * 3;
-	Y = priv->Y;
-	Cb = priv->Cb;
-	Cr = priv->Cr;
-	offset_to_next_row = (priv->width * 3 * 2) - 16 * 3;
-
-	for (i = 0; i < 8; i++) {
-		for (j = 0; j < 8; j++) {
-			int y, cb, cr;
-			int add_r, add_g, add_b;
-			int r, g , b;
-
-			cb = *Cb++ - 128;
-			cr = *Cr++ - 128;
-			add_r = FIX(1.40200) * cr + ONE_HALF;
-			add_g = -FIX(0.34414) * cb - FIX(0.71414) * cr + ONE_HALF;
-			add_b = FIX(1.77200) * cb + ONE_HALF;
-
-			y  = (*Y++) << SCALEBITS;
-			r = (y + add_r) >> SCALEBITS;
-			*p++ = clamp(r);
-			g = (y + add_g) >> SCALEBITS;
-			*p++ = clamp(g);
-			b = (y + add_b) >> SCALEBITS;
-			*p++ = clamp(b);
-
-			y  = (*Y++) << SCALEBITS;
-			r = (y + add_r) >> SCALEBITS;
-			*p++ = clamp(r);
-			g = (y + add_g) >> SCALEBITS;
-			*p++ = clamp(g);
-			b = (y + add_b) >> SCALEBITS;
-			*p++ = clamp(b);
-
-			y  = (Y[16-2]) << SCALEBITS;
-			r = (y + add_r) >> SCALEBITS;
-			*p2++ = clamp(r);
-			g = (y + add_g) >> SCALEBITS;
-			*p2++ = clamp(g);
-			b = (y + add_b) >> SCALEBITS;
-			*p2++ = clamp(b);
-
-			y  = (Y[16-1]) << SCALEBITS;
-			r = (y + add_r) >> SCALEBITS;
-			*p2++ = clamp(r);
-			g = (y + add_g) >> SCALEBITS;
-			*p2++ = clamp(g);
-			b = (y + add_b) >> SCALEBITS;
-			*p2++ = clamp(b);
-		}
-		Y  += 16;
-		p  += offset_to_next_row;
-		p2 += offset_to_next_row;
+	y = priv->Y;
+	for (i = 0; i < 8 * vf; i++) {
+		memcpy(p, y, 8 * hf);
+		p += priv->width;
+		y += 8 * hf;
 	}
-
-#undef SCALEBITS
-#undef ONE_HALF
-#undef FIX
 }
 
-
 /*
- *  YCrCb -> BGR24 (2x2)
- *  .-------.
- *  | 1 | 2 |
- *  |---+---|
- *  | 3 | 4 |
- *  `-------'
+ * YUV420P and NV12 output, for NV12 plane[1] and plane[2] point to the first
+ * U resp. V byte of the interleaved chroma plane, so with them swapped we
+ * get NV21.
  */
-static void YCrCB_to_BGR24_2x2(struct jdec_private *priv)
+static ALWAYS_INLINE void YCrCB_to_yuv420(struct jdec_private *priv,
+		int hf, int vf, int nv12)
 {
-	const unsigned char *Y, *Cb, *Cr;
-	unsigned char *p, *p2;
-	int i, j;
-	int offset_to_next_row;
-
-#define SCALEBITS       10
-#define ONE_HALF        (1UL << (SCALEBITS - 1))
-#define FIX(x)          ((int)((x) * (1UL << SCALEBITS) + 0.5))
-
-	p = priv->plane[0];
-	p2 = priv->plane[0] + priv->width * 3;
-	Y = priv->Y;
-	Cb = priv->Cb;
-	Cr = priv->Cr;
-	offset_to_next_row = (priv->width * 3 * 2) - 16 * 3;
-
-	for (i = 0; i < 8; i++) {
-		for (j = 0; j < 8; j++) {
-			int y, cb, cr;
-			int add_r, add_g, add_b;
-			int r, g , b;
-
-			cb = *Cb++ - 128;
-			cr = *Cr++ - 128;
-			add_r = FIX(1.40200) * cr + ONE_HALF;
-			add_g = -FIX(0.34414) * cb - FIX(0.71414) * cr + ONE_HALF;
-			add_b = FIX(1.77200) * cb + ONE_HALF;
-
-			y  = (*Y++) << SCALEBITS;
-			b = (y + add_b) >> SCALEBITS;
-			*p++ = clamp(b);
-			g = (y + add_g) >> SCALEBITS;
-			*p++ = clamp(g);
-			r = (y + add_r) >> SCALEBITS;
-			*p++ = clamp(r);
-
-			y  = (*Y++) << SCALEBITS;
-			b = (y + add_b) >> SCALEBITS;
-			*p++ = clamp(b);
-			g = (y + add_g) >> SCALEBITS;
-			*p++ = clamp(g);
-			r = (y + add_r) >> SCALEBITS;
-			*p++ = clamp(r);
-
-			y  = (Y[16-2]) << SCALEBITS;
-			b = (y + add_b) >> SCALEBITS;
-			*p2++ = clamp(b);
-			g = (y + add_g) >> SCALEBITS;
-			*p2++ = clamp(g);
-			r = (y + add_r) >> SCALEBITS;
-			*p2++ = clamp(r);
-
-			y  = (Y[16-1]) << SCALEBITS;
-			b = (y + add_b) >> SCALEBITS;
-			*p2++ = clamp(b);
-			g = (y + add_g) >> SCALEBITS;
-			*p2++ = clamp(g);
-			r = (y + add_r) >> SCALEBITS;
-			*p2++ = clamp(r);
+	const unsigned char *cb, *cr;
+	unsigned char *u, *v;
+	int i, j, stride;
+
+	YCrCB_copy_Y(priv, hf, vf);
+
+	u = priv->plane[1];
+	v = priv->plane[2];
+	stride = nv12 ? priv->width : priv->width / 2;
+	for (i = 0; i < 4 * vf; i++) {
+		cb = priv->Cb + (2 * i / vf) * 8;
+		cr = priv->Cr + (2 * i / vf) * 8;
+		for (j = 0; j < 4 * hf; j++) {
+			u[j << nv12] = cb[2 * j / hf];
+			v[j << nv12] = cr[2 * j / hf];
 		}
-		Y  += 16;
-		p  += offset_to_next_row;
-		p2 += offset_to_next_row;
-	}
-
-#undef SCALEBITS
-#undef ONE_HALF
-#undef FIX
-}
-
-
-
-/**
- *  YCrCb -> Grey (1x1)
- *  .---.
- *  | 1 |
- *  `---'
- */
-static void YCrCB_to_Grey_1x1(struct jdec_private *priv)
-{
-	const unsigned char *y;
-	unsigned char *p;
-	unsigned int i;
-	int offset_to_next_row;
-
-	p = priv->plane[0];
-	y = priv->Y;
-	offset_to_next_row = priv->width;
-
-	for (i = 0; i < 8; i++) {
-		memcpy(p, y, 8);
-		y += 8;
-		p += offset_to_next_row;
+		u += stride;
+		v += stride;
 	}
 }
 
-/**
- *  YCrCb -> Grey (2x1)
- *  .-------.
- *  | 1 | 2 |
- *  `-------'
- */
-static void YCrCB_to_Grey_2x1(struct jdec_private *priv)
+static ALWAYS_INLINE void YCrCB_to_yuyv(struct jdec_private *priv,
+		int hf, int vf)
 {
-	const unsigned char *y;
+	const unsigned char *y, *cb, *cr;
 	unsigned char *p;
-	unsigned int i;
+	int i, j;
 
 	p = priv->plane[0];
 	y = priv->Y;
-
-	for (i = 0; i < 8; i++) {
-		memcpy(p, y, 16);
-		y += 16;
-		p += priv->width;
+	for (i = 0; i < 8 * vf; i++) {
+		cb = priv->Cb + (i / vf) * 8;
+		cr = priv->Cr + (i / vf) * 8;
+		for (j = 0; j < 4 * hf; j++) {
+			p[4 * j]     = y[2 * j];
+			p[4 * j + 1] = cb[2 * j / hf];
+			p[4 * j + 2] = y[2 * j + 1];
+			p[4 * j + 3] = cr[2 * j / hf];
+		}
+		p += priv->width * 2;
+		y += 8 * hf;
 	}
 }
 
-
-/**
- *  YCrCb -> Grey (1x2)
- *  .---.
- *  | 1 |
- *  |---|
- *  | 2 |
- *  `---'
- */
-static void YCrCB_to_Grey_1x2(struct jdec_private *priv)
+static ALWAYS_INLINE void YCrCB_to_rgb(struct jdec_private *priv,
+		int hf, int vf, int bpp, int bgr)
 {
 	const unsigned char *y;
 	unsigned char *p;
-	unsigned int i;
+	int i;
 
 	p = priv->plane[0];
 	y = priv->Y;
-
-	for (i = 0; i < 16; i++) {
-		memcpy(p, y, 8);
-		y += 8;
-		p += priv->width;
+	for (i = 0; i < 8 * vf; i++) {
+		YCrCB_to_rgb_line(y, priv->Cb + (i / vf) * 8,
+				  priv->Cr + (i / vf) * 8, p, 8 * hf, hf - 1,
+				  bpp, bgr);
+		p += priv->width * bpp;
+		y += 8 * hf;
 	}
 }
 
-/**
- *  YCrCb -> Grey (2x2)
- *  .-------.
- *  | 1 | 2 |
- *  |---+---|
- *  | 3 | 4 |
- *  `-------'
- */
-static void YCrCB_to_Grey_2x2(struct jdec_private *priv)
-{
-	const unsigned char *y;
-	unsigned char *p;
-	unsigned int i;
-
-	p = priv->plane[0];
-	y = priv->Y;
+#define YCrCB_to_yuv420p(priv, hf, vf)	YCrCB_to_yuv420(priv, hf, vf, 0)
+#define YCrCB_to_nv12(priv, hf, vf)	YCrCB_to_yuv420(priv, hf, vf, 1)
+#define YCrCB_to_rgb24(priv, hf, vf)	YCrCB_to_rgb(priv, hf, vf, 3, 0)
+#define YCrCB_to_bgr24(priv, hf, vf)	YCrCB_to_rgb(priv, hf, vf, 3, 1)
+#define YCrCB_to_rgb32(priv, hf, vf)	YCrCB_to_rgb(priv, hf, vf, 4, 0)
+#define YCrCB_to_bgr32(priv, hf, vf)	YCrCB_to_rgb(priv, hf, vf, 4, 1)
+#define YCrCB_to_grey(priv, hf, vf)	YCrCB_copy_Y(priv, hf, vf)
+
+/* Defines YCrCB_to_<fmt>_<hf>x<vf>() and the convert_colorspace_<fmt> table,
+   indexed like decode_mcu_3comp_table */
+#define DECLARE_COLORSPACE(fmt) \
+static void YCrCB_to_##fmt##_1x1(struct jdec_private *priv) \
+{ \
+	YCrCB_to_##fmt(priv, 1, 1); \
+} \
+static void YCrCB_to_##fmt##_1x2(struct jdec_private *priv) \
+{ \
+	YCrCB_to_##fmt(priv, 1, 2); \
+} \
+static void YCrCB_to_##fmt##_2x1(struct jdec_private *priv) \
+{ \
+	YCrCB_to_##fmt(priv, 2, 1); \
+} \
+static void YCrCB_to_##fmt##_2x2(struct jdec_private *priv) \
+{ \
+	YCrCB_to_##fmt(priv, 2, 2); \
+} \
+static const convert_colorspace_fct convert_colorspace_##fmt[4] = { \
+	YCrCB_to_##fmt##_1x1, \
+	YCrCB_to_##fmt##_1x2, \
+	YCrCB_to_##fmt##_2x1, \
+	YCrCB_to_##fmt##_2x2, \
+};
 
-	for (i = 0; i < 16; i++) {
-		memcpy(p, y, 16);
-		y += 16;
-		p += priv->width;
-	}
-}
+DECLARE_COLORSPACE(yuv420p)
+DECLARE_COLORSPACE(nv12)
+DECLARE_COLORSPACE(yuyv)
+DECLARE_COLORSPACE(rgb24)
+DECLARE_COLORSPACE(bgr24)
+DECLARE_COLORSPACE(rgb32)
+DECLARE_COLORSPACE(bgr32)
+DECLARE_COLORSPACE(grey)
 
 
 /*
@@ -1380,7 +907,8 @@ static void decode_MCU_2x1_3planes(struct jdec_private *priv)
 	IDCT(&priv->component_infos[cCr], priv->Cr, 8);
 }
 
-static void build_quantization_table(float *qtable, const unsigned char *ref_table);
+static void build_quantization_table(float *qtable, int16_t *qtable_int,
+		const unsigned char *ref_table);
 
 static void pixart_decode_MCU_2x1_3planes(struct jdec_private *priv)
 {
@@ -1465,7 +993,8 @@ static void pixart_decode_MCU_2x1_3planes(struct jdec_private *priv)
 			j = (pixart_q[lumi][i] * comp + 50) / 100;
 			qt[i] = (j < 255) ? j : 255;
 		}
-		build_quantization_table(priv->Q_tables[0], qt);
+		build_quantization_table(priv->Q_tables[0], priv->Q_tables_int[0],
+				qt);
 
 		/* If bit 7 of the marker is set chrominance uses the
 		   luminance quantization table */
@@ -1476,7 +1005,8 @@ static void pixart_decode_MCU_2x1_3planes(struct jdec_private *priv)
 				qt[i] = (j < 255) ? j : 255;
 			}
 		}
-		build_quantization_table(priv->Q_tables[1], qt);
+		build_quantization_table(priv->Q_tables[1], priv->Q_tables_int[1],
+				qt);
 
 		priv->marker = marker;
 	}
@@ -1657,7 +1187,8 @@ static void print_SOF(const unsigned char *stream)
  *
  ******************************************************************************/
 
-static void build_quantization_table(float *qtable, const unsigned char *ref_table)
+static void build_quantization_table(float *qtable, int16_t *qtable_int,
+		const unsigned char *ref_table)
 {
 	/* Taken from libjpeg. Copyright Independent JPEG Group's LLM idct.
 	 * For float AA&N IDCT method, divisors are equal to quantization
@@ -1667,6 +1198,7 @@ static void build_quantization_table(float *qtable, const unsigned char *ref_tab
 	 * We apply a further scale factor of 8.
 	 * What's actually stored is 1/divisor so that the inner loop can
 	 * use a multiplication rather than a division.
+	 * The integer IDCT gets the plain coefficients in qtable_int.
 	 */
 	int i, j;
 	static const double aanscalefactor[8] = {
@@ -1676,8 +1208,10 @@ static void build_quantization_table(float *qtable, const unsigned char *ref_tab
 	const unsigned char *zz = zigzag;
 
 	for (i = 0; i < 8; i++)
-		for (j = 0; j < 8; j++)
+		for (j = 0; j < 8; j++) {
+			*qtable_int++ = ref_table[*zz];
 			*qtable++ = ref_table[*zz++] * aanscalefactor[i] * aanscalefactor[j];
+		}
 
 }
 
@@ -1701,7 +1235,7 @@ static int parse_DQT(struct jdec_private *priv, const unsigned char *stream)
 					COMPONENTS, qi + 1);
 #endif
 		table = priv->Q_tables[qi];
-		build_quantization_table(table, stream);
+		build_quantization_table(table, priv->Q_tables_int[qi], stream);
 		stream += 64;
 	}
 	trace("< DQT marker\n");
@@ -1744,6 +1278,7 @@ static int parse_SOF(struct jdec_private *priv, const unsigned char *stream)
 		c->Vfactor = sampling_factor & 0xf;
 		c->Hfactor = sampling_factor >> 4;
 		c->Q_table = priv->Q_tables[Q_table];
+		c->Q_table_int = priv->Q_tables_int[Q_table];
 		trace("Component:%d  factor:%dx%d  Quantization table:%d\n",
 				cid, c->Hfactor, c->Hfactor, Q_table);
 
@@ -2101,6 +1636,9 @@ void tinyjpeg_free(struct jdec_private *priv)
 	}
 	priv->tmp_buf_y_size = 0;
 	free(priv->stream_filtered);
+	free(priv->coefs);
+	free(priv->band_privs);
+	free(priv->rst_starts);
 	free(priv);
 }
 
@@ -2142,34 +1680,6 @@ static const decode_MCU_fct decode_mcu_1comp_table[4] = {
 	decode_MCU_2x2_1plane,
 };
 
-static const convert_colorspace_fct convert_colorspace_yuv420p[4] = {
-	YCrCB_to_YUV420P_1x1,
-	YCrCB_to_YUV420P_1x2,
-	YCrCB_to_YUV420P_2x1,
-	YCrCB_to_YUV420P_2x2,
-};
-
-static const convert_colorspace_fct convert_colorspace_rgb24[4] = {
-	YCrCB_to_RGB24_1x1,
-	YCrCB_to_RGB24_1x2,
-	YCrCB_to_RGB24_2x1,
-	YCrCB_to_RGB24_2x2,
-};
-
-static const convert_colorspace_fct convert_colorspace_bgr24[4] = {
-	YCrCB_to_BGR24_1x1,
-	YCrCB_to_BGR24_1x2,
-	YCrCB_to_BGR24_2x1,
-	YCrCB_to_BGR24_2x2,
-};
-
-static const convert_colorspace_fct convert_colorspace_grey[4] = {
-	YCrCB_to_Grey_1x1,
-	YCrCB_to_Grey_1x2,
-	YCrCB_to_Grey_2x1,
-	YCrCB_to_Grey_2x2,
-};
-
 int tinyjpeg_decode_planar(struct jdec_private *priv, int pixfmt);
 
 /* This function parses and removes the special Pixart JPEG chunk headers */
@@ -2236,6 +1746,271 @@ kernel: 0xff 0xff 0x00 0xff 0x96, and we skip one unknown byte */
  *
  * Note: components will be automaticaly allocated if no memory is attached.
  */
+/*
+ * Decoding split over worker threads: the huffman decoding must be done in
+ * order, so first the DCT coef of all MCUs get decoded, then the IDCT and
+ * colorspace conversion of bands of MCU rows get done in parallel, each band
+ * using its own copy of the private data for the per MCU temp space.
+ *
+ * Except when the jpeg has restart markers, as the huffman decoding starts
+ * afresh after each of these. Then the stream is first scanned for all of the
+ * restart markers, after which the restart intervals get huffman decoded in
+ * parallel too, each into the DCT coef of its own MCUs.
+ */
+struct jdec_band_job {
+	struct jdec_private *priv;
+	convert_colorspace_fct convert_to_pixfmt;
+	unsigned int Hfactor, Vfactor;	/* Y blocks per MCU */
+	int chroma;			/* IDCT the chroma blocks too */
+	unsigned int blocks_per_mcu;
+	unsigned int mcus_per_row, mcu_rows;
+	unsigned int bytes_per_blocklines[3], bytes_per_mcu[3];
+	int no_bands;
+	unsigned int no_intervals;	/* restart intervals */
+	int no_interval_chunks;
+};
+
+/* Don't bother with threads for less MCU rows per band */
+#define JPEG_MIN_BAND_MCU_ROWS 2
+
+static void huffman_decode_MCU(struct jdec_private *priv,
+		const struct jdec_band_job *job, short int *coef)
+{
+	unsigned int i;
+
+	for (i = 0; i < job->Hfactor * job->Vfactor; i++) {
+		process_Huffman_data_unit(priv, cY);
+		memcpy(coef, priv->component_infos[cY].DCT, 64 * sizeof(short int));
+		coef += 64;
+	}
+
+	for (i = cCb; i <= cCr; i++) {
+		process_Huffman_data_unit(priv, i);
+		if (job->chroma) {
+			memcpy(coef, priv->component_infos[i].DCT,
+					64 * sizeof(short int));
+			coef += 64;
+		}
+	}
+}
+
+static void idct_MCU(struct jdec_private *priv,
+		const struct jdec_band_job *job, const short int *coef)
+{
+	struct component *c = &priv->component_infos[cY];
+	unsigned int i, stride = job->Hfactor * 8;
+
+	for (i = 0; i < job->Hfactor * job->Vfactor; i++) {
+		memcpy(c->DCT, coef, sizeof(c->DCT));
+		IDCT(c, priv->Y + (i % job->Hfactor) * 8 +
+				(i / job->Hfactor) * 8 * stride, stride);
+		coef += 64;
+	}
+
+	if (!job->chroma)
+		return;
+
+	c = &priv->component_infos[cCb];
+	memcpy(c->DCT, coef, sizeof(c->DCT));
+	IDCT(c, priv->Cb, 8);
+	coef += 64;
+
+	c = &priv->component_infos[cCr];
+	memcpy(c->DCT, coef, sizeof(c->DCT));
+	IDCT(c, priv->Cr, 8);
+}
+
+static void decode_band(void *arg, int band)
+{
+	struct jdec_band_job *job = arg;
+	struct jdec_private *priv = &job->priv->band_privs[band];
+	unsigned int x, y;
+	unsigned int first = band * job->mcu_rows / job->no_bands;
+	unsigned int last = (band + 1) * job->mcu_rows / job->no_bands;
+	const short int *coef = job->priv->coefs +
+		first * job->mcus_per_row * job->blocks_per_mcu * 64;
+
+	for (y = first; y < last; y++) {
+		priv->plane[0] = priv->components[0] + (y * job->bytes_per_blocklines[0]);
+		priv->plane[1] = priv->components[1] + (y * job->bytes_per_blocklines[1]);
+		priv->plane[2] = priv->components[2] + (y * job->bytes_per_blocklines[2]);
+		for (x = 0; x < job->mcus_per_row; x++) {
+			idct_MCU(priv, job, coef);
+			job->convert_to_pixfmt(priv);
+			priv->plane[0] += job->bytes_per_mcu[0];
+			priv->plane[1] += job->bytes_per_mcu[1];
+			priv->plane[2] += job->bytes_per_mcu[2];
+			coef += job->blocks_per_mcu * 64;
+		}
+	}
+}
+
+/*
+ * Find the start of each of the first @no_intervals@ restart intervals,
+ * returns -1 if the restart markers are not all there in the expected order.
+ */
+static int find_restart_intervals(struct jdec_private *priv,
+		unsigned int no_intervals)
+{
+	const unsigned char *stream = priv->stream;
+	unsigned int i, rst = priv->last_rst_marker_seen;
+
+	priv->rst_starts[0] = stream;
+	for (i = 1; i < no_intervals; i++) {
+		while (1) {
+			stream = memchr(stream, 0xff, priv->stream_end - stream);
+			if (stream == NULL)
+				return -1;
+			/* Skip any padding ff byte (this is normal) */
+			while (stream + 1 < priv->stream_end && stream[1] == 0xff)
+				stream++;
+			if (stream + 1 >= priv->stream_end)
+				return -1;
+			if (stream[1] != 0x00)
+				break;
+			stream += 2;	/* byte stuffing */
+		}
+		if (stream[1] != RST + rst)
+			return -1;
+		stream += 2;
+		rst = (rst + 1) & 7;
+		priv->rst_starts[i] = stream;
+	}
+
+	return 0;
+}
+
+static void huffman_decode_intervals(void *arg, int chunk)
+{
+	struct jdec_band_job *job = arg;
+	struct jdec_private *priv = &job->priv->band_privs[chunk];
+	unsigned int i, mcu, last_mcu;
+	unsigned int first = chunk * job->no_intervals / job->no_interval_chunks;
+	unsigned int last = (chunk + 1) * job->no_intervals /
+		job->no_interval_chunks;
+	unsigned int no_mcus = job->mcu_rows * job->mcus_per_row;
+	short int *coef;
+
+	/* Errors get reported through our error_string */
+	if (setjmp(priv->jump_state))
+		return;
+
+	for (i = first; i < last; i++) {
+		/* Give each interval the following RST marker as its stream end,
+		   the marker bytes may be needed to look ahead at the last code */
+		priv->stream = job->priv->rst_starts[i];
+		if (i + 1 < job->no_intervals)
+			priv->stream_end = job->priv->rst_starts[i + 1];
+		else
+			priv->stream_end = job->priv->stream_end;
+		resync(priv);
+
+		mcu = i * job->priv->restart_interval;
+		last_mcu = mcu + job->priv->restart_interval;
+		if (last_mcu > no_mcus)
+			last_mcu = no_mcus;
+		coef = job->priv->coefs + mcu * job->blocks_per_mcu * 64;
+		for (; mcu < last_mcu; mcu++) {
+			huffman_decode_MCU(priv, job, coef);
+			coef += job->blocks_per_mcu * 64;
+		}
+	}
+}
+
+static int decode_with_workers(struct jdec_private *priv,
+		struct jdec_band_job *job)
+{
+	unsigned int i, x, y;
+	int no_privs;
+	short int *coef;
+
+	job->blocks_per_mcu = job->Hfactor * job->Vfactor + (job->chroma ? 2 : 0);
+	coef = (short int *)v4lconvert_alloc_buffer(job->mcu_rows *
+			job->mcus_per_row * job->blocks_per_mcu * 64 * sizeof(short int),
+			(unsigned char **)&priv->coefs, &priv->coefs_size);
+	if (!coef)
+		error("Out of memory!\n");
+
+	no_privs = job->no_bands;
+	if (priv->restart_interval > 0) {
+		job->no_intervals = (job->mcu_rows * job->mcus_per_row +
+				priv->restart_interval - 1) / priv->restart_interval;
+		priv->rst_starts = (const unsigned char **)v4lconvert_alloc_buffer(
+				job->no_intervals * sizeof(*priv->rst_starts),
+				(unsigned char **)&priv->rst_starts,
+				&priv->rst_starts_size);
+		if (!priv->rst_starts)
+			error("Out of memory!\n");
+
+		/* On a missing or unexpected marker fall back to decoding in
+		   order, which knows how to deal with that */
+		if (job->no_intervals < 2 ||
+				find_restart_intervals(priv, job->no_intervals) < 0)
+			job->no_intervals = 0;
+
+		/* Intervals may differ a lot in size, so use smaller chunks */
+		job->no_interval_chunks =
+			v4lconvert_workers_threads(priv->workers) * 4;
+		if (job->no_interval_chunks > (int)job->no_intervals)
+			job->no_interval_chunks = job->no_intervals;
+		if (no_privs < job->no_interval_chunks)
+			no_privs = job->no_interval_chunks;
+	}
+
+	priv->band_privs = (struct jdec_private *)v4lconvert_alloc_buffer(
+			no_privs * sizeof(struct jdec_private),
+			(unsigned char **)&priv->band_privs, &priv->band_privs_size);
+	if (!priv->band_privs)
+		error("Out of memory!\n");
+
+	for (i = 0; i < no_privs; i++) {
+		struct jdec_private *band_priv = &priv->band_privs[i];
+
+		band_priv->width = priv->width;
+		band_priv->restart_interval = priv->restart_interval;
+		band_priv->error_string[0] = 0;
+		memcpy(band_priv->components, priv->components,
+				sizeof(priv->components));
+		memcpy(band_priv->component_infos, priv->component_infos,
+				sizeof(priv->component_infos));
+	}
+
+	if (job->no_intervals) {
+		v4lconvert_workers_run(priv->workers, huffman_decode_intervals,
+				job, job->no_interval_chunks);
+		for (i = 0; i < job->no_interval_chunks; i++) {
+			if (priv->band_privs[i].error_string[0]) {
+				strcpy(priv->error_string,
+						priv->band_privs[i].error_string);
+				return -1;
+			}
+		}
+		v4lconvert_workers_run(priv->workers, decode_band, job,
+				job->no_bands);
+		return 0;
+	}
+
+	for (y = 0; y < job->mcu_rows; y++) {
+		for (x = 0; x < job->mcus_per_row; x++) {
+			huffman_decode_MCU(priv, job, coef);
+			coef += job->blocks_per_mcu * 64;
+			if (priv->restarts_to_go > 0) {
+				priv->restarts_to_go--;
+				if (priv->restarts_to_go == 0) {
+					priv->stream -= (priv->nbits_in_reservoir / 8);
+					resync(priv);
+					if (find_next_rst_marker(priv) < 0)
+						return -1;
+				}
+			}
+		}
+	}
+
+	v4lconvert_workers_run(priv->workers, decode_band, job, job->no_bands);
+
+	return 0;
+}
+
 int tinyjpeg_decode(struct jdec_private *priv, int pixfmt)
 {
 	unsigned int x, y, xstride_by_mcu, ystride_by_mcu;
@@ -2296,6 +2071,27 @@ int tinyjpeg_decode(struct jdec_private *priv, int pixfmt)
 		bytes_per_mcu[2] = 4;
 		break;
 
+	case TINYJPEG_FMT_NV12:
+		colorspace_array_conv = convert_colorspace_nv12;
+		if (priv->components[0] == NULL || priv->components[1] == NULL ||
+				priv->components[2] == NULL)
+			error("NV12 output needs all components to be set\n");
+		bytes_per_blocklines[0] = priv->width;
+		bytes_per_blocklines[1] = priv->width / 2;
+		bytes_per_blocklines[2] = priv->width / 2;
+		bytes_per_mcu[0] = 8;
+		bytes_per_mcu[1] = 8;
+		bytes_per_mcu[2] = 8;
+		break;
+
+	case TINYJPEG_FMT_YUYV:
+		colorspace_array_conv = convert_colorspace_yuyv;
+		if (priv->components[0] == NULL)
+			priv->components[0] = (uint8_t *)malloc(priv->width * priv->height * 2);
+		bytes_per_blocklines[0] = priv->width * 2;
+		bytes_per_mcu[0] = 2*8;
+		break;
+
 	case TINYJPEG_FMT_RGB24:
 		colorspace_array_conv = convert_colorspace_rgb24;
 		if (priv->components[0] == NULL)
@@ -2312,6 +2108,22 @@ int tinyjpeg_decode(struct jdec_private *priv, int pixfmt)
 		bytes_per_mcu[0] = 3*8;
 		break;
 
+	case TINYJPEG_FMT_RGB32:
+		colorspace_array_conv = convert_colorspace_rgb32;
+		if (priv->components[0] == NULL)
+			priv->components[0] = (uint8_t *)malloc(priv->width * priv->height * 4);
+		bytes_per_blocklines[0] = priv->width * 4;
+		bytes_per_mcu[0] = 4*8;
+		break;
+
+	case TINYJPEG_FMT_BGR32:
+		colorspace_array_conv = convert_colorspace_bgr32;
+		if (priv->components[0] == NULL)
+			priv->components[0] = (uint8_t *)malloc(priv->width * priv->height * 4);
+		bytes_per_blocklines[0] = priv->width * 4;
+		bytes_per_mcu[0] = 4*8;
+		break;
+
 	case TINYJPEG_FMT_GREY:
 		decode_mcu_table = decode_mcu_1comp_table;
 		if (priv->flags & TINYJPEG_FLAGS_PIXART_JPEG)
@@ -2364,6 +2176,29 @@ int tinyjpeg_decode(struct jdec_private *priv, int pixfmt)
 	bytes_per_mcu[1] *= xstride_by_mcu / 8;
 	bytes_per_mcu[2] *= xstride_by_mcu / 8;
 
+	if (priv->workers && !(priv->flags & TINYJPEG_FLAGS_PIXART_JPEG) &&
+			priv->height / ystride_by_mcu >= 2 * JPEG_MIN_BAND_MCU_ROWS) {
+		struct jdec_band_job job = {
+			.priv = priv,
+			.convert_to_pixfmt = convert_to_pixfmt,
+			.Hfactor = xstride_by_mcu / 8,
+			.Vfactor = ystride_by_mcu / 8,
+			.chroma = pixfmt != TINYJPEG_FMT_GREY,
+			.mcus_per_row = (priv->width + xstride_by_mcu - 1) / xstride_by_mcu,
+			.mcu_rows = priv->height / ystride_by_mcu,
+		};
+
+		memcpy(job.bytes_per_blocklines, bytes_per_blocklines,
+				sizeof(job.bytes_per_blocklines));
+		memcpy(job.bytes_per_mcu, bytes_per_mcu, sizeof(job.bytes_per_mcu));
+		/* Use some more bands than threads to even out the load */
+		job.no_bands = v4lconvert_workers_threads(priv->workers) * 2;
+		if (job.no_bands > job.mcu_rows / JPEG_MIN_BAND_MCU_ROWS)
+			job.no_bands = job.mcu_rows / JPEG_MIN_BAND_MCU_ROWS;
+
+		return decode_with_workers(priv, &job);
+	}
+
 	/* Just the decode the image by macroblock (size is 8x8, 8x16, or 16x16) */
 	for (y = 0; y < priv->height / ystride_by_mcu; y++) {
 		//trace("Decoding row %d\n", y);
@@ -2400,7 +2235,8 @@ int tinyjpeg_decode(struct jdec_private *priv, int pixfmt)
 int tinyjpeg_decode_planar(struct jdec_private *priv, int pixfmt)
 {
 	unsigned int i, x, y;
-	uint8_t *y_buf, *u_buf, *v_buf, *p, *p2;
+	uint8_t *y_buf, *u_buf, *v_buf, *p;
+	int bpp, bgr;
 
 	switch (pixfmt) {
 	case TINYJPEG_FMT_GREY:
@@ -2409,6 +2245,10 @@ int tinyjpeg_decode_planar(struct jdec_private *priv, int pixfmt)
 
 	case TINYJPEG_FMT_RGB24:
 	case TINYJPEG_FMT_BGR24:
+	case TINYJPEG_FMT_RGB32:
+	case TINYJPEG_FMT_BGR32:
+	case TINYJPEG_FMT_NV12:
+	case TINYJPEG_FMT_YUYV:
 		if (priv->tmp_buf_y_size < (priv->width * priv->height)) {
 			for (i = 0; i < COMPONENTS; i++) {
 				free(priv->tmp_buf[i]);
@@ -2494,138 +2334,55 @@ int tinyjpeg_decode_planar(struct jdec_private *priv, int pixfmt)
 		v_buf += 7 * (priv->width / 2);
 	}
 
-#define SCALEBITS       10
-#define ONE_HALF        (1UL << (SCALEBITS - 1))
-#define FIX(x)          ((int)((x) * (1UL << SCALEBITS) + 0.5))
-
 	switch (pixfmt) {
 	case TINYJPEG_FMT_RGB24:
+	case TINYJPEG_FMT_BGR24:
+	case TINYJPEG_FMT_RGB32:
+	case TINYJPEG_FMT_BGR32:
+		bpp = (pixfmt == TINYJPEG_FMT_RGB32 ||
+		       pixfmt == TINYJPEG_FMT_BGR32) ? 4 : 3;
+		bgr = pixfmt == TINYJPEG_FMT_BGR24 || pixfmt == TINYJPEG_FMT_BGR32;
 		y_buf = priv->tmp_buf[cY];
-		u_buf = priv->tmp_buf[cCb];
-		v_buf = priv->tmp_buf[cCr];
 		p = priv->components[0];
-		p2 = priv->components[0] + priv->width * 3;
 
-		for (y = 0; y < priv->height / 2; y++) {
-			for (x = 0; x < priv->width / 2; x++) {
-				int l, cb, cr;
-				int add_r, add_g, add_b;
-				int r, g , b;
-
-				cb = *u_buf++ - 128;
-				cr = *v_buf++ - 128;
-				add_r = FIX(1.40200) * cr + ONE_HALF;
-				add_g = -FIX(0.34414) * cb - FIX(0.71414) * cr + ONE_HALF;
-				add_b = FIX(1.77200) * cb + ONE_HALF;
-
-				l  = (*y_buf) << SCALEBITS;
-				r = (l + add_r) >> SCALEBITS;
-				*p++ = clamp(r);
-				g = (l + add_g) >> SCALEBITS;
-				*p++ = clamp(g);
-				b = (l + add_b) >> SCALEBITS;
-				*p++ = clamp(b);
-
-				l  = (y_buf[priv->width]) << SCALEBITS;
-				r = (l + add_r) >> SCALEBITS;
-				*p2++ = clamp(r);
-				g = (l + add_g) >> SCALEBITS;
-				*p2++ = clamp(g);
-				b = (l + add_b) >> SCALEBITS;
-				*p2++ = clamp(b);
-
-				y_buf++;
-
-				l  = (*y_buf) << SCALEBITS;
-				r = (l + add_r) >> SCALEBITS;
-				*p++ = clamp(r);
-				g = (l + add_g) >> SCALEBITS;
-				*p++ = clamp(g);
-				b = (l + add_b) >> SCALEBITS;
-				*p++ = clamp(b);
-
-				l  = (y_buf[priv->width]) << SCALEBITS;
-				r = (l + add_r) >> SCALEBITS;
-				*p2++ = clamp(r);
-				g = (l + add_g) >> SCALEBITS;
-				*p2++ = clamp(g);
-				b = (l + add_b) >> SCALEBITS;
-				*p2++ = clamp(b);
-
-				y_buf++;
-			}
+		for (y = 0; y < priv->height; y++) {
+			u_buf = priv->tmp_buf[cCb] + (y / 2) * (priv->width / 2);
+			v_buf = priv->tmp_buf[cCr] + (y / 2) * (priv->width / 2);
+			YCrCB_to_rgb_line(y_buf, u_buf, v_buf, p, priv->width, 1,
+					  bpp, bgr);
 			y_buf += priv->width;
-			p  += priv->width * 3;
-			p2 += priv->width * 3;
+			p += priv->width * bpp;
 		}
 		break;
 
-	case TINYJPEG_FMT_BGR24:
-		y_buf = priv->tmp_buf[cY];
+	case TINYJPEG_FMT_NV12:
+		memcpy(priv->components[0], priv->tmp_buf[cY],
+				priv->width * priv->height);
 		u_buf = priv->tmp_buf[cCb];
 		v_buf = priv->tmp_buf[cCr];
+		for (i = 0; i < priv->width * priv->height / 4; i++) {
+			priv->components[1][i * 2] = *u_buf++;
+			priv->components[2][i * 2] = *v_buf++;
+		}
+		break;
+
+	case TINYJPEG_FMT_YUYV:
+		y_buf = priv->tmp_buf[cY];
 		p = priv->components[0];
-		p2 = priv->components[0] + priv->width * 3;
 
-		for (y = 0; y < priv->height / 2; y++) {
+		for (y = 0; y < priv->height; y++) {
+			u_buf = priv->tmp_buf[cCb] + (y / 2) * (priv->width / 2);
+			v_buf = priv->tmp_buf[cCr] + (y / 2) * (priv->width / 2);
 			for (x = 0; x < priv->width / 2; x++) {
-				int l, cb, cr;
-				int add_r, add_g, add_b;
-				int r, g , b;
-
-				cb = *u_buf++ - 128;
-				cr = *v_buf++ - 128;
-				add_r = FIX(1.40200) * cr + ONE_HALF;
-				add_g = -FIX(0.34414) * cb - FIX(0.71414) * cr + ONE_HALF;
-				add_b = FIX(1.77200) * cb + ONE_HALF;
-
-				l  = (*y_buf) << SCALEBITS;
-				b = (l + add_b) >> SCALEBITS;
-				*p++ = clamp(b);
-				g = (l + add_g) >> SCALEBITS;
-				*p++ = clamp(g);
-				r = (l + add_r) >> SCALEBITS;
-				*p++ = clamp(r);
-
-				l  = (y_buf[priv->width]) << SCALEBITS;
-				b = (l + add_b) >> SCALEBITS;
-				*p2++ = clamp(b);
-				g = (l + add_g) >> SCALEBITS;
-				*p2++ = clamp(g);
-				r = (l + add_r) >> SCALEBITS;
-				*p2++ = clamp(r);
-
-				y_buf++;
-
-				l  = (*y_buf) << SCALEBITS;
-				b = (l + add_b) >> SCALEBITS;
-				*p++ = clamp(b);
-				g = (l + add_g) >> SCALEBITS;
-				*p++ = clamp(g);
-				r = (l + add_r) >> SCALEBITS;
-				*p++ = clamp(r);
-
-				l  = (y_buf[priv->width]) << SCALEBITS;
-				b = (l + add_b) >> SCALEBITS;
-				*p2++ = clamp(b);
-				g = (l + add_g) >> SCALEBITS;
-				*p2++ = clamp(g);
-				r = (l + add_r) >> SCALEBITS;
-				*p2++ = clamp(r);
-
-				y_buf++;
+				*p++ = *y_buf++;
+				*p++ = *u_buf++;
+				*p++ = *y_buf++;
+				*p++ = *v_buf++;
 			}
-			y_buf += priv->width;
-			p  += priv->width * 3;
-			p2 += priv->width * 3;
 		}
 		break;
 	}
 
-#undef SCALEBITS
-#undef ONE_HALF
-#undef FIX
-
 	return 0;
 }
 
@@ -2668,3 +2425,8 @@ int tinyjpeg_set_flags(struct jdec_private *priv, int flags)
 	return oldflags;
 }
 
+void tinyjpeg_set_workers(struct jdec_private *priv, struct v4lconvert_workers *workers)
+{
+	priv->workers = workers;
+}
+
@@ -40,6 +40,7 @@ extern "C" {
 #endif
 
 struct jdec_private;
+struct v4lconvert_workers;
 
 /* Flags that can be set by any applications */
 #define TINYJPEG_FLAGS_MJPEG_TABLE	(1<<1)
@@ -52,6 +53,11 @@ enum tinyjpeg_fmt {
 	TINYJPEG_FMT_BGR24,
 	TINYJPEG_FMT_RGB24,
 	TINYJPEG_FMT_YUV420P,
+	TINYJPEG_FMT_NV12,	/* components 1 and 2 point to the first U and V
+				   bytes of the interleaved chroma plane */
+	TINYJPEG_FMT_YUYV,
+	TINYJPEG_FMT_RGB32,	/* V4L2 byte order: x r g b, x is 0xff */
+	TINYJPEG_FMT_BGR32,	/* V4L2 byte order: b g r x, x is 0xff */
 };
 
 struct jdec_private *tinyjpeg_init(void);
@@ -65,6 +71,7 @@ int tinyjpeg_get_components(struct jdec_private *priv, unsigned char **component
 int tinyjpeg_set_components(struct jdec_private *priv, unsigned char **components,
 				unsigned int ncomponents);
 int tinyjpeg_set_flags(struct jdec_private *priv, int flags);
+void tinyjpeg_set_workers(struct jdec_private *priv, struct v4lconvert_workers *workers);
 
 #ifdef __cplusplus
 }
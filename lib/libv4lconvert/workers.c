@@ -0,0 +1,180 @@
+/*
+# Worker threads for splitting a conversion in independent jobs
+
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU Lesser General Public License as published by
+# the Free Software Foundation; either version 2.1 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU Lesser General Public License for more details.
+#
+# You should have received a copy of the GNU Lesser General Public License
+# along with this program; if not, write to the Free Software
+# Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA  02110-1335  USA
+ */
+
+#include <pthread.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "libv4lconvert-priv.h"
+
+struct v4lconvert_workers {
+	pthread_mutex_t lock;
+	pthread_cond_t start_cond;	/* signalled when jobs get queued */
+	pthread_cond_t done_cond;	/* signalled when all jobs are done */
+	pthread_t threads[V4LCONVERT_MAX_THREADS - 1];
+	int no_threads;
+	int quit;
+	/* The currently queued jobs, protected by lock */
+	unsigned int generation;
+	v4lconvert_job_func func;
+	void *arg;
+	int no_jobs;
+	int next_job;
+	int jobs_done;
+};
+
+/* Must be called with the lock held, returns with the lock held */
+static void v4lconvert_workers_do_jobs(struct v4lconvert_workers *workers)
+{
+	while (workers->next_job < workers->no_jobs) {
+		int job = workers->next_job++;
+
+		pthread_mutex_unlock(&workers->lock);
+		workers->func(workers->arg, job);
+		pthread_mutex_lock(&workers->lock);
+
+		if (++workers->jobs_done == workers->no_jobs)
+			pthread_cond_broadcast(&workers->done_cond);
+	}
+}
+
+static void *v4lconvert_worker_thread(void *arg)
+{
+	struct v4lconvert_workers *workers = arg;
+	unsigned int generation = 0;
+
+	pthread_mutex_lock(&workers->lock);
+	for (;;) {
+		while (!workers->quit && workers->generation == generation)
+			pthread_cond_wait(&workers->start_cond, &workers->lock);
+		if (workers->quit)
+			break;
+
+		generation = workers->generation;
+		v4lconvert_workers_do_jobs(workers);
+	}
+	pthread_mutex_unlock(&workers->lock);
+
+	return NULL;
+}
+
+/* Returns the number of threads to use when asked for one thread per cpu,
+   this is the number of online cpus, including the calling thread */
+int v4lconvert_workers_default_threads(void)
+{
+	long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+	if (cpus < 1)
+		return 1;
+	if (cpus > V4LCONVERT_MAX_THREADS)
+		return V4LCONVERT_MAX_THREADS;
+	return cpus;
+}
+
+/* Creates a pool with threads - 1 worker threads, as the thread calling
+   v4lconvert_workers_run takes part in the work too */
+struct v4lconvert_workers *v4lconvert_workers_create(int threads)
+{
+	struct v4lconvert_workers *workers;
+	sigset_t all, old;
+
+	if (threads < 2)
+		return NULL;
+	if (threads > V4LCONVERT_MAX_THREADS)
+		threads = V4LCONVERT_MAX_THREADS;
+
+	workers = calloc(1, sizeof(*workers));
+	if (!workers)
+		return NULL;
+
+	pthread_mutex_init(&workers->lock, NULL);
+	pthread_cond_init(&workers->start_cond, NULL);
+	pthread_cond_init(&workers->done_cond, NULL);
+
+	/* Signals are for the application's threads, not for ours */
+	sigfillset(&all);
+	pthread_sigmask(SIG_SETMASK, &all, &old);
+	for (; workers->no_threads < threads - 1; workers->no_threads++)
+		if (pthread_create(&workers->threads[workers->no_threads], NULL,
+					v4lconvert_worker_thread, workers))
+			break;
+	pthread_sigmask(SIG_SETMASK, &old, NULL);
+
+	if (workers->no_threads == 0) {
+		v4lconvert_workers_destroy(workers);
+		return NULL;
+	}
+
+	return workers;
+}
+
+void v4lconvert_workers_destroy(struct v4lconvert_workers *workers)
+{
+	int i;
+
+	if (!workers)
+		return;
+
+	pthread_mutex_lock(&workers->lock);
+	workers->quit = 1;
+	pthread_cond_broadcast(&workers->start_cond);
+	pthread_mutex_unlock(&workers->lock);
+
+	for (i = 0; i < workers->no_threads; i++)
+		pthread_join(workers->threads[i], NULL);
+
+	pthread_cond_destroy(&workers->done_cond);
+	pthread_cond_destroy(&workers->start_cond);
+	pthread_mutex_destroy(&workers->lock);
+	free(workers);
+}
+
+/* Returns the number of threads taking part in v4lconvert_workers_run */
+int v4lconvert_workers_threads(struct v4lconvert_workers *workers)
+{
+	return workers ? workers->no_threads + 1 : 1;
+}
+
+/* Calls func(arg, job) for job 0 - no_jobs - 1, spread over the worker
+   threads and the calling thread, and waits for all jobs to be done.
+   When workers is NULL all jobs get done by the calling thread. */
+void v4lconvert_workers_run(struct v4lconvert_workers *workers,
+		v4lconvert_job_func func, void *arg, int no_jobs)
+{
+	int i;
+
+	if (!workers || no_jobs < 2) {
+		for (i = 0; i < no_jobs; i++)
+			func(arg, i);
+		return;
+	}
+
+	pthread_mutex_lock(&workers->lock);
+	workers->func = func;
+	workers->arg = arg;
+	workers->no_jobs = no_jobs;
+	workers->next_job = 0;
+	workers->jobs_done = 0;
+	workers->generation++;
+	pthread_cond_broadcast(&workers->start_cond);
+
+	v4lconvert_workers_do_jobs(workers);
+	while (workers->jobs_done < workers->no_jobs)
+		pthread_cond_wait(&workers->done_cond, &workers->lock);
+	pthread_mutex_unlock(&workers->lock);
+}
@@ -32,7 +32,10 @@
 #include <fcntl.h>
 #include <errno.h>
 #include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <sys/time.h>
+#include <time.h>
 #include <dirent.h>
 #include <config.h>
 #include <signal.h>
@@ -70,11 +73,16 @@ enum Option {
 	OptSetTuner = 't',
 	OptUseWrapper = 'w',
 	OptAll = 128,
+	OptDaemon,
 	OptFreqSeek,
 	OptListDevices,
 	OptListFreqBands,
 	OptOpenFile,
 	OptPrintBlock,
+	OptPublish,
+	OptRecord,
+	OptReplay,
+	OptReplaySpeed,
 	OptSilent,
 	OptTunerIndex,
 	OptVerbose,
@@ -91,6 +99,26 @@ struct ctl_parameters {
 	uint32_t wait_limit;
 	uint8_t tuner_index;
 	struct v4l2_hw_freq_seek freq_seek;
+	char record_name[80];
+	int record_fd;
+	double replay_speed;
+	uint64_t start_ns;
+	char publish_name[80];
+	struct v4l2_rds_shm *shm;
+};
+
+/* every file created by --record starts with this identifier, followed
+ * by a sequence of struct rds_record entries */
+static const char rds_record_magic[8] = {
+	'R', 'D', 'S', 'R', 'E', 'C', '0', '1'
+};
+
+/* struct to encapsulate one recorded RDS block */
+struct rds_record {
+	uint64_t timestamp_ns;		/* time at which the block was read,
+					 * relative to the start of decoding */
+	struct v4l2_rds_data data;	/* raw RDS block */
+	uint8_t reserved[5];		/* pad the record to 16 bytes */
 };
 
 static struct ctl_parameters params;
@@ -98,6 +126,7 @@ static int app_result;
 
 static struct option long_options[] = {
 	{"all", no_argument, 0, OptAll},
+	{"daemon", no_argument, 0, OptDaemon},
 	{"device", required_argument, 0, OptSetDevice},
 	{"file", required_argument, 0, OptOpenFile},
 	{"freq-seek", required_argument, 0, OptFreqSeek},
@@ -108,7 +137,11 @@ static struct option long_options[] = {
 	{"list-devices", no_argument, 0, OptListDevices},
 	{"list-freq-bands", no_argument, 0, OptListFreqBands},
 	{"print-block", no_argument, 0, OptPrintBlock},
+	{"publish", required_argument, 0, OptPublish},
 	{"read-rds", no_argument, 0, OptReadRds},
+	{"record", required_argument, 0, OptRecord},
+	{"replay", required_argument, 0, OptReplay},
+	{"replay-speed", required_argument, 0, OptReplaySpeed},
 	{"set-freq", required_argument, 0, OptSetFreq},
 	{"tuner-index", required_argument, 0, OptTunerIndex},
 	{"verbose", no_argument, 0, OptVerbose},
@@ -163,6 +196,17 @@ static void usage_rds(void)
 	       "  --file=<path>\n"
 	       "                     open a RDS stream file dump instead of a device\n"
 	       "                     all General and Tuner Options are disabled in this mode\n"
+	       "  --record=<path>\n"
+	       "                     write every received RDS block together with its\n"
+	       "                     time of arrival to <path>\n"
+	       "  --replay=<path>\n"
+	       "                     decode a stream created with --record, reproducing\n"
+	       "                     the original timing of the blocks\n"
+	       "                     all General and Tuner Options are disabled in this mode\n"
+	       "  --replay-speed=<factor>\n"
+	       "                     replay the recording <factor> times faster than it\n"
+	       "                     was received, 0 replays it as fast as possible\n"
+	       "                     <default>: 1\n"
 	       "  --wait-limit=<ms>\n"
 	       "                     defines the maximum wait duration for avaibility of new\n"
 	       "                     RDS data\n"
@@ -173,6 +217,12 @@ static void usage_rds(void)
 	       "  --verbose\n"
 	       "                     turn on verbose mode - every received RDS group\n"
 	       "                     will be printed\n"
+	       "  --publish=<name>\n"
+	       "                     publish the decoded RDS state in the POSIX shared\n"
+	       "                     memory object <name> (see struct v4l2_rds_shm)\n"
+	       "  --daemon\n"
+	       "                     run in the background and keep decoding until\n"
+	       "                     terminated, requires --publish\n"
 	       );
 }
 
@@ -585,6 +635,99 @@ static void print_rds_data(const struct v4l2_rds *handle, uint32_t updated_field
 		printf("\n");
 }
 
+static uint64_t get_time_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int open_record_file(const char *name)
+{
+	int fd = open(name, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+
+	if (fd < 0)
+		return -1;
+	if (write(fd, rds_record_magic, sizeof(rds_record_magic)) !=
+			sizeof(rds_record_magic)) {
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+static void record_block(const struct v4l2_rds_data *rds_data)
+{
+	struct rds_record record;
+
+	memset(&record, 0, sizeof(record));
+	record.timestamp_ns = get_time_ns() - params.start_ns;
+	record.data = *rds_data;
+	if (write(params.record_fd, &record, sizeof(record)) != sizeof(record)) {
+		fprintf(stderr, "\nError writing to %s: %s, recording stopped\n",
+			params.record_name, strerror(errno));
+		close(params.record_fd);
+		params.record_fd = -1;
+	}
+}
+
+static struct v4l2_rds_shm *create_shm(const char *name)
+{
+	struct v4l2_rds_shm *shm;
+	int fd = shm_open(name, O_RDWR | O_CREAT | O_TRUNC, 0644);
+
+	if (fd < 0)
+		return NULL;
+	if (ftruncate(fd, sizeof(*shm)) < 0) {
+		close(fd);
+		shm_unlink(name);
+		return NULL;
+	}
+	shm = (struct v4l2_rds_shm *)mmap(NULL, sizeof(*shm),
+			PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (shm == MAP_FAILED) {
+		shm_unlink(name);
+		return NULL;
+	}
+	v4l2_rds_shm_init(shm);
+	return shm;
+}
+
+static void destroy_shm(struct v4l2_rds_shm *shm, const char *name)
+{
+	munmap(shm, sizeof(*shm));
+	shm_unlink(name);
+}
+
+/* reads the next block of a recording and waits until it is due. The
+ * deadline is absolute, so the time spent on decoding and printing does
+ * not accumulate into a drift of the replay */
+static int replay_block(const int fd, struct v4l2_rds_data *rds_data)
+{
+	struct rds_record record;
+	int byte_cnt = read(fd, &record, sizeof(record));
+
+	/* a truncated record can only occur at the end of the recording */
+	if (byte_cnt != sizeof(record))
+		return byte_cnt < 0 ? -1 : 0;
+
+	if (params.replay_speed > 0) {
+		uint64_t due = params.start_ns +
+			(uint64_t)(record.timestamp_ns / params.replay_speed);
+		struct timespec ts;
+
+		ts.tv_sec = due / 1000000000ULL;
+		ts.tv_nsec = due % 1000000000ULL;
+		while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR &&
+				!params.terminate_decoding)
+			;
+	}
+	*rds_data = record.data;
+	return 3;
+}
+
 static void read_rds(struct v4l2_rds *handle, const int fd, const int wait_limit)
 {
 	int byte_cnt = 0;
@@ -592,13 +735,23 @@ static void read_rds(struct v4l2_rds *handle, const int fd, const int wait_limit
 	uint32_t updated_fields = 0x00;
 	struct v4l2_rds_data rds_data; /* read buffer for rds blocks */
 
+	params.start_ns = get_time_ns();
 	while (!params.terminate_decoding) {
 		memset(&rds_data, 0, sizeof(rds_data));
-		if ((byte_cnt=read(fd, &rds_data, 3)) != 3) {
+		if (params.options[OptReplay])
+			byte_cnt = replay_block(fd, &rds_data);
+		else
+			byte_cnt = read(fd, &rds_data, 3);
+		if (byte_cnt != 3) {
 			if (byte_cnt == 0) {
 				printf("\nEnd of input file reached \n");
 				break;
-			} else if(++error_cnt > 2) {
+			} else if (params.options[OptDaemon] ?
+					byte_cnt < 0 && errno != EAGAIN &&
+					errno != EINTR && errno != EIO :
+					++error_cnt > 2) {
+				/* a daemon keeps waiting for data, unless the
+				 * device is gone */
 				fprintf(stderr, "\nError reading from "
 					"device (no RDS data available)\n");
 				break;
@@ -609,8 +762,13 @@ static void read_rds(struct v4l2_rds *handle, const int fd, const int wait_limit
 		}
 		else if (byte_cnt == 3) {
 			error_cnt = 0;
+			if (params.record_fd >= 0)
+				record_block(&rds_data);
 			/* true if a new group was decoded */
-			if ((updated_fields = v4l2_rds_add(handle, &rds_data))) {
+			updated_fields = v4l2_rds_add(handle, &rds_data);
+			if (params.shm)
+				v4l2_rds_shm_publish(params.shm, handle);
+			if (updated_fields) {
 				print_rds_data(handle, updated_fields);
 				if (params.options[OptVerbose])
 					 print_rds_group(v4l2_rds_get_group(handle));
@@ -704,6 +862,33 @@ static int parse_cl(int argc, char **argv)
 			params.options[OptReadRds] = 1;
 			break;
 		}
+		case OptPublish:
+			strncpy(params.publish_name, optarg, sizeof(params.publish_name) - 1);
+			params.options[OptReadRds] = 1;
+			break;
+		case OptRecord:
+			strncpy(params.record_name, optarg, sizeof(params.record_name) - 1);
+			params.options[OptReadRds] = 1;
+			break;
+		case OptReplay:
+		{
+			if (access(optarg, F_OK) != -1) {
+				params.filemode_active = true;
+				strncpy(params.fd_name, optarg, 80);
+			} else {
+				fprintf(stderr, "Unable to open file: %s\n", optarg);
+				return -1;
+			}
+			params.options[OptReadRds] = 1;
+			break;
+		}
+		case OptReplaySpeed:
+			params.replay_speed = strtod(optarg, NULL);
+			if (params.replay_speed < 0) {
+				fprintf(stderr, "Invalid replay speed: %s\n", optarg);
+				return -1;
+			}
+			break;
 		case OptWaitLimit:
 			params.wait_limit = strtoul(optarg, NULL, 0);
 			break;
@@ -733,6 +918,11 @@ static int parse_cl(int argc, char **argv)
 		params.options[OptGetTuner] = 1;
 		params.options[OptSilent] = 1;
 	}
+	if (params.options[OptDaemon] && !params.options[OptPublish]) {
+		fprintf(stderr, "Option --daemon requires --publish\n");
+		usage_hint();
+		exit(1);
+	}
 
 	return 0;
 }
@@ -877,6 +1067,8 @@ int main(int argc, char **argv)
 	memset(&vcap, 0, sizeof(vcap));
 	memset(&vf, 0, sizeof(vf));
 	strcpy(params.fd_name, "/dev/radio0");
+	params.record_fd = -1;
+	params.replay_speed = 1;
 
 	/* define locale for unicode support */
 	if (!setlocale(LC_CTYPE, "")) {
@@ -885,6 +1077,7 @@ int main(int argc, char **argv)
 	}
 	/* register signal handler for interrupt signal, to exit gracefully */
 	signal(SIGINT, signal_handler_interrupt);
+	signal(SIGTERM, signal_handler_interrupt);
 
 	/* try to parse the command line */
 	parse_cl(argc, argv);
@@ -893,14 +1086,44 @@ int main(int argc, char **argv)
 		exit(0);
 	}
 
+	if (params.options[OptRecord]) {
+		if ((params.record_fd = open_record_file(params.record_name)) < 0) {
+			fprintf(stderr, "Failed to create %s: %s\n",
+				params.record_name, strerror(errno));
+			exit(1);
+		}
+	}
+
+	if (params.options[OptPublish]) {
+		if (!(params.shm = create_shm(params.publish_name))) {
+			fprintf(stderr, "Failed to create shared memory object %s: %s\n",
+				params.publish_name, strerror(errno));
+			exit(1);
+		}
+	}
+
 	/* File Mode: disables all other features, except for RDS decoding */
 	if (params.filemode_active) {
 		if ((fd = open(params.fd_name, O_RDONLY|O_NONBLOCK)) < 0){
 			perror("error opening file");
 			exit(1);
 		}
+		if (params.options[OptReplay]) {
+			char magic[sizeof(rds_record_magic)];
+
+			if (read(fd, magic, sizeof(magic)) != sizeof(magic) ||
+			    memcmp(magic, rds_record_magic, sizeof(magic))) {
+				fprintf(stderr, "%s is not an RDS recording\n",
+					params.fd_name);
+				exit(1);
+			}
+		}
 		read_rds_from_fd(fd);
 		test_close(fd);
+		if (params.record_fd >= 0)
+			close(params.record_fd);
+		if (params.shm)
+			destroy_shm(params.shm, params.publish_name);
 		exit(0);
 	}
 
@@ -929,10 +1152,19 @@ int main(int argc, char **argv)
 	set_options(fd, vcap.capabilities, &vf, &tuner);
 	/* Get options */
 	get_options(fd, vcap.capabilities, &vf, &tuner);
+	/* Daemon Mode: keep the device open and decode in the background */
+	if (params.options[OptDaemon] && daemon(0, 0) < 0) {
+		perror("failed to start daemon");
+		exit(1);
+	}
 	/* RDS decoding */
 	if (params.options[OptReadRds])
 		read_rds_from_fd(fd);
 
 	test_close(fd);
+	if (params.record_fd >= 0)
+		close(params.record_fd);
+	if (params.shm)
+		destroy_shm(params.shm, params.publish_name);
 	exit(app_result);
 }